@@ -0,0 +1,344 @@
+/**
+ * batch.cpp
+ * * Running requests from stdin or a Unix socket, with the index kept
+ * in memory between them.
+ */
+
+#include "batch.h"
+#include "index.h"
+#include "minigit.h"
+#include "object_store.h"
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace MiniGit {
+
+    namespace {
+        // The largest length-delimited request accepted (its arguments)
+        const uint64_t MAX_REQUEST_SIZE = 64 << 20;
+
+        /**
+         * @brief Splits a request line into arguments, shell style.
+         * @return false (with 'error' set) for an unterminated quote.
+         */
+        bool splitWords(const std::string& line, std::vector<std::string>& args, std::string& error) {
+            std::string word;
+            bool inWord = false;
+            char quote = 0;
+            for (std::size_t i = 0; i < line.size(); ++i) {
+                char c = line[i];
+                if (quote == '\'') {
+                    if (c == '\'') {
+                        quote = 0;
+                    } else {
+                        word += c;
+                    }
+                } else if (c == '\\' && i + 1 < line.size() && (quote == 0 || line[i + 1] == '"' || line[i + 1] == '\\')) {
+                    word += line[++i];
+                    inWord = true;
+                } else if (quote == '"') {
+                    if (c == '"') {
+                        quote = 0;
+                    } else {
+                        word += c;
+                    }
+                } else if (c == '\'' || c == '"') {
+                    quote = c;
+                    inWord = true;
+                } else if (c == ' ' || c == '\t') {
+                    if (inWord) {
+                        args.push_back(std::move(word));
+                        word.clear();
+                        inWord = false;
+                    }
+                } else {
+                    word += c;
+                    inWord = true;
+                }
+            }
+            if (quote != 0) {
+                error = "Unterminated quote in request: " + line;
+                return false;
+            }
+            if (inWord) {
+                args.push_back(std::move(word));
+            }
+            return true;
+        }
+
+        /**
+         * @brief Reads the next request (blank lines are skipped).
+         * @param broken Set if the input cannot be read past this request
+         * (answered with 'error' then).
+         * @return false at the end of the input.
+         */
+        bool readRequest(std::istream& in, std::vector<std::string>& args, std::string& error, bool& broken) {
+            args.clear();
+            error.clear();
+            broken = false;
+            std::string line;
+            while (args.empty()) {
+                if (!std::getline(in, line)) {
+                    return false;
+                }
+                if (!line.empty() && line.back() == '\r') {
+                    line.pop_back();
+                }
+                bool isLength = !line.empty() && line.size() <= 18;
+                for (char c : line) {
+                    isLength = isLength && std::isdigit(static_cast<unsigned char>(c));
+                }
+                if (!isLength) {
+                    if (!splitWords(line, args, error)) {
+                        return true;
+                    }
+                    continue;
+                }
+
+                // A length-delimited request: NUL-separated arguments. The
+                // length comes from the client, so it is checked before
+                // anything is allocated; past a bad one the rest of the
+                // input cannot be framed, and it ends with this answer.
+                uint64_t size = 0;
+                auto parsed = std::from_chars(line.data(), line.data() + line.size(), size);
+                if (parsed.ec != std::errc() || parsed.ptr != line.data() + line.size() || size > MAX_REQUEST_SIZE) {
+                    error = "Request too large: " + line + " bytes (at most " + std::to_string(MAX_REQUEST_SIZE) + ")";
+                    broken = true;
+                    return true;
+                }
+                std::string payload(static_cast<std::size_t>(size), '\0');
+                in.read(&payload[0], static_cast<std::streamsize>(payload.size()));
+                if (static_cast<std::size_t>(in.gcount()) != payload.size()) {
+                    error = "Truncated request: expected " + line + " bytes";
+                    return true;
+                }
+                std::size_t begin = 0;
+                while (begin < payload.size()) {
+                    std::size_t end = payload.find('\0', begin);
+                    if (end == std::string::npos) {
+                        end = payload.size();
+                    }
+                    args.push_back(payload.substr(begin, end - begin));
+                    begin = end + 1;
+                }
+                if (args.empty()) {
+                    error = "Empty request";
+                    return true;
+                }
+            }
+            return true;
+        }
+
+        // Sends whatever a command prints (both streams) into one buffer
+        class CaptureOutput {
+        public:
+            explicit CaptureOutput(std::streambuf* target)
+                : out_(std::cout.rdbuf(target)), err_(std::cerr.rdbuf(target)) {}
+            ~CaptureOutput() {
+                std::cout.rdbuf(out_);
+                std::cerr.rdbuf(err_);
+            }
+            CaptureOutput(const CaptureOutput&) = delete;
+            CaptureOutput& operator=(const CaptureOutput&) = delete;
+
+        private:
+            std::streambuf* out_;
+            std::streambuf* err_;
+        };
+
+        /**
+         * @brief Runs one request.
+         * @return Whether it succeeded; 'output' gets what it printed.
+         */
+        bool answer(const std::vector<std::string>& args, const CommandRunner& run, std::string& output) {
+            std::stringbuf captured;
+            int status = 1;
+            {
+                CaptureOutput capture(&captured);
+                try {
+                    if (args[0] == "flush") {
+                        flushIndexBatch();
+                        flushObjects();
+                        status = 0;
+                    } else {
+                        // Another process may have written to the repository
+                        // since the last request (a commit, a gc): reload
+                        // what it changed
+                        refreshCaches();
+                        status = run(args);
+                    }
+                } catch (const std::exception& e) {
+                    std::cerr << "Error: " << e.what() << std::endl;
+                }
+                std::cout.flush();
+            }
+            output = captured.str();
+            return status == 0;
+        }
+
+#ifdef __linux__
+        // A connected socket as a stream: buffered both ways
+        class SocketBuffer : public std::streambuf {
+        public:
+            explicit SocketBuffer(int fd) : fd_(fd) {
+                setg(input_, input_, input_);
+                setp(output_, output_ + sizeof(output_));
+            }
+            ~SocketBuffer() override { sync(); }
+
+        protected:
+            int_type underflow() override {
+                ssize_t n;
+                do {
+                    n = recv(fd_, input_, sizeof(input_), 0);
+                } while (n < 0 && errno == EINTR);
+                if (n <= 0) {
+                    return traits_type::eof();
+                }
+                setg(input_, input_, input_ + n);
+                return traits_type::to_int_type(input_[0]);
+            }
+
+            int_type overflow(int_type c) override {
+                if (sync() != 0) {
+                    return traits_type::eof();
+                }
+                if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                    *pptr() = traits_type::to_char_type(c);
+                    pbump(1);
+                }
+                return traits_type::not_eof(c);
+            }
+
+            int sync() override {
+                const char* data = pbase();
+                std::size_t size = static_cast<std::size_t>(pptr() - pbase());
+                while (size != 0) {
+                    ssize_t n = send(fd_, data, size, MSG_NOSIGNAL);
+                    if (n < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (n <= 0) {
+                        return -1; // the client went away
+                    }
+                    data += n;
+                    size -= static_cast<std::size_t>(n);
+                }
+                setp(output_, output_ + sizeof(output_));
+                return 0;
+            }
+
+        private:
+            int fd_;
+            char input_[64 * 1024];
+            char output_[64 * 1024];
+        };
+#endif
+    }
+
+    int runBatch(std::istream& in, std::ostream& out, const CommandRunner& run) {
+        beginIndexBatch();
+        std::vector<std::string> args;
+        std::string error;
+        std::string output;
+        bool broken = false;
+        while (!broken && readRequest(in, args, error, broken)) {
+            bool ok = false;
+            if (!error.empty()) {
+                output = "Error: " + error + "\n";
+            } else {
+                ok = answer(args, run, output);
+            }
+            out << (ok ? "ok " : "error ") << output.size() << "\n" << output << std::flush;
+        }
+
+        // The batch is over: the index is written once
+        try {
+            endIndexBatch();
+            flushObjects();
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+#ifdef __linux__
+    void serveBatches(const fs::path& socketPath, const CommandRunner& run) {
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        std::string path = socketPath.string();
+        if (path.size() >= sizeof(address.sun_path)) {
+            throw std::runtime_error("Socket path too long: " + path);
+        }
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+        // 1. A socket file nobody answers on is left over from a server
+        // that died: replace it. One that answers belongs to a live server.
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (probe >= 0) {
+            bool live = connect(probe, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+            close(probe);
+            if (live) {
+                throw std::runtime_error("Fatal: A server is already listening on " + path);
+            }
+        }
+        std::error_code ec;
+        fs::remove(socketPath, ec);
+
+        int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listener < 0) {
+            throw std::runtime_error(std::string("socket failed: ") + std::strerror(errno));
+        }
+        if (bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+            listen(listener, 16) != 0) {
+            std::string reason = std::strerror(errno);
+            close(listener);
+            throw std::runtime_error("Cannot listen on " + path + ": " + reason);
+        }
+        std::cerr << "Serving on " << path << std::endl;
+
+        // 2. One connection at a time, each a batch: the commands share
+        // this process's caches, and its index is written when it closes
+        while (true) {
+            int client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                std::string reason = std::strerror(errno);
+                close(listener);
+                throw std::runtime_error("accept failed: " + reason);
+            }
+            try {
+                SocketBuffer buffer(client);
+                std::iostream stream(&buffer);
+                runBatch(stream, stream, run);
+            } catch (const std::exception& e) {
+                // One connection going wrong must not stop the others
+                std::cerr << "Error: " << e.what() << std::endl;
+            }
+            close(client);
+        }
+    }
+#else
+    void serveBatches(const fs::path&, const CommandRunner&) {
+        throw std::runtime_error("Fatal: 'serve' is only available on Linux; use 'minigit --batch' instead");
+    }
+#endif
+
+} // namespace MiniGit
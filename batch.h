@@ -0,0 +1,65 @@
+/**
+ * batch.h
+ * * 'minigit --batch' and 'minigit serve': many commands, one process.
+ *
+ * A single command pays for starting up every time: the config, the refs,
+ * the commit-graph and the packs are loaded again, objects are parsed
+ * again and the index is verified and rewritten. A batch runs all its
+ * commands in one process, so those stay loaded (before each request a
+ * stat per file checks whether another process changed them; see
+ * refreshCaches in minigit.h), and the index the commands change is kept
+ * in memory and written once, when the batch ends (see beginIndexBatch
+ * in index.h).
+ *
+ * Requests, one after another:
+ *   a line      the command and its arguments as on a command line,
+ *               separated by blanks; '...' and "..." quote, a backslash
+ *               escapes the next character ("add -j4 a.txt 'b c.txt'")
+ *   <n>\n<n bytes>
+ *               a line holding only a length, then that many bytes: the
+ *               arguments separated by NUL bytes (no quoting needed);
+ *               at most 64 MiB, a larger length is answered with an
+ *               error and ends the input (it cannot be skipped)
+ *
+ * Each request is answered with "ok <n>\n" (or "error <n>\n" if the
+ * command failed), followed by the n bytes the command printed.
+ * "flush" writes the index kept in memory right away.
+ *
+ * 'minigit --batch' reads requests from stdin until it is closed;
+ * 'minigit serve <socket>' accepts connections on a Unix socket and
+ * answers each one's requests as a batch of its own (one connection at
+ * a time; Linux only).
+ */
+
+#ifndef MINIGIT_BATCH_H
+#define MINIGIT_BATCH_H
+
+#include <filesystem>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace MiniGit {
+
+    /**
+     * @brief Runs one command (the arguments after the program name) and
+     * returns its exit status. It prints to std::cout and std::cerr.
+     */
+    using CommandRunner = std::function<int(const std::vector<std::string>& args)>;
+
+    /**
+     * @brief Answers requests from 'in' on 'out' until 'in' ends.
+     * @return The exit status: 0, or 1 if the index could not be written.
+     */
+    int runBatch(std::istream& in, std::ostream& out, const CommandRunner& run);
+
+    /**
+     * @brief Answers connections on a Unix socket, until killed.
+     * @throws std::runtime_error if the socket cannot be opened.
+     */
+    void serveBatches(const std::filesystem::path& socketPath, const CommandRunner& run);
+
+} // namespace MiniGit
+
+#endif // MINIGIT_BATCH_H
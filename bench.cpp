@@ -0,0 +1,216 @@
+/**
+ * bench.cpp
+ * * minigit_bench: throughput benchmarks on a generated repository.
+ *
+ * Usage: minigit_bench [--files=N] [--depth=D] [--history=H] [--churn=R]
+ *                      [--file-size=BYTES] [--seed=S] [benchmark flags]
+ *
+ * The repository (see synthetic_repo.h) is generated once, in a temporary
+ * directory, before the benchmarks run, and removed afterwards. The usual
+ * Google Benchmark flags apply; for results to track over time use
+ *   minigit_bench --benchmark_out=results.json --benchmark_out_format=json
+ * (or --benchmark_format=json for stdout). The spec is recorded in the
+ * JSON "context".
+ */
+
+#include "commit_graph.h"
+#include "index.h"
+#include "minigit.h"
+#include "object_cache.h"
+#include "refs.h"
+#include "repository.h"
+#include "synthetic_repo.h"
+#include <benchmark/benchmark.h>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+using namespace MiniGit;
+
+namespace {
+    SyntheticRepoSpec spec;
+    std::unique_ptr<Repository> repo;
+    std::vector<std::string> paths;
+    std::vector<ObjectId> commits; // oldest first, as generated
+
+    // --- Reading ---
+
+    void BM_HashString(benchmark::State& state) {
+        std::string content(static_cast<std::size_t>(state.range(0)), 'x');
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(hashString(content));
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+    }
+    BENCHMARK(BM_HashString)->Arg(64)->Arg(4 << 10)->Arg(1 << 20);
+
+    void BM_GetStagingArea(benchmark::State& state) {
+        // Every file staged: the largest staging area the index can hold
+        setStagingArea(getCommitFiles(repo->head()));
+        for (auto _ : state) {
+            FileMap staged = getStagingArea();
+            benchmark::DoNotOptimize(staged.size());
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * paths.size()));
+        setStagingArea({});
+    }
+    BENCHMARK(BM_GetStagingArea)->Unit(benchmark::kMicrosecond);
+
+    // 'log' without the printing: every commit of the history and its message
+    void BM_Log(benchmark::State& state) {
+        std::size_t count = 0;
+        for (auto _ : state) {
+            count = 0;
+            CommitWalker walker(repo->head());
+            ObjectId hash;
+            while (walker.next(hash)) {
+                benchmark::DoNotOptimize(getCommit(hash)->message.size());
+                ++count;
+            }
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+        state.counters["commits"] = static_cast<double>(count);
+    }
+    BENCHMARK(BM_Log)->Unit(benchmark::kMicrosecond);
+
+    // --- Changing ---
+
+    // Back and forth between the newest commit and one halfway down the
+    // history: the churn of H/2 commits changes each time
+    void BM_Checkout(benchmark::State& state) {
+        std::string older = commits[commits.size() / 2].toHex();
+        Repository::CheckoutResult result;
+        bool atOlder = false;
+        std::size_t written = 0;
+        for (auto _ : state) {
+            repo->checkout(atOlder ? DEFAULT_BRANCH : older, result);
+            atOlder = !atOlder;
+            written += result.restored.size() + result.deleted.size();
+        }
+        if (atOlder) {
+            repo->checkout(DEFAULT_BRANCH, result);
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(written));
+    }
+
+    // Arg 0: an empty index, so every file is read and hashed.
+    // Arg 1: a clean index, so the stat cache skips every file.
+    void BM_Add(benchmark::State& state) {
+        bool warm = state.range(0) != 0;
+        Repository::AddResult added;
+        std::vector<std::string> all{"."};
+        for (auto _ : state) {
+            state.PauseTiming();
+            Repository::CheckoutResult reset;
+            repo->checkout(DEFAULT_BRANCH, reset); // nothing staged, fresh stat data
+            if (!warm) {
+                writeIndexFile(INDEX_FILE, {});
+            }
+            state.ResumeTiming();
+            repo->add(warm ? paths : all, added);
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * paths.size()));
+        Repository::CheckoutResult reset;
+        repo->checkout(DEFAULT_BRANCH, reset);
+    }
+
+    // One commit of 'churn' changed files (changed and staged untimed)
+    void BM_Commit(benchmark::State& state) {
+        std::mt19937_64 random(spec.seed + 1);
+        Repository::AddResult added;
+        for (auto _ : state) {
+            state.PauseTiming();
+            repo->add(churnFiles(repo->root(), paths, spec.churn, random), added);
+            state.ResumeTiming();
+            benchmark::DoNotOptimize(repo->commit("Benchmark"));
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+    }
+
+    bool parseOption(const char* arg, const char* name, std::string& value) {
+        std::size_t length = std::strlen(name);
+        if (std::strncmp(arg, name, length) != 0 || arg[length] != '=') {
+            return false;
+        }
+        value = arg + length + 1;
+        return true;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    // 1. Our options; the rest is left for Google Benchmark
+    std::vector<char*> rest{argv[0]};
+    for (int i = 1; i < argc; ++i) {
+        std::string value;
+        if (parseOption(argv[i], "--files", value)) {
+            spec.files = std::stoul(value);
+        } else if (parseOption(argv[i], "--depth", value)) {
+            spec.depth = static_cast<unsigned>(std::stoul(value));
+        } else if (parseOption(argv[i], "--history", value)) {
+            spec.history = std::stoul(value);
+        } else if (parseOption(argv[i], "--churn", value)) {
+            spec.churn = std::stod(value);
+        } else if (parseOption(argv[i], "--file-size", value)) {
+            spec.fileSize = std::stoul(value);
+        } else if (parseOption(argv[i], "--seed", value)) {
+            spec.seed = std::stoull(value);
+        } else {
+            rest.push_back(argv[i]);
+        }
+    }
+    int restCount = static_cast<int>(rest.size());
+    benchmark::Initialize(&restCount, rest.data());
+    if (benchmark::ReportUnrecognizedArguments(restCount, rest.data())) {
+        return 1;
+    }
+    if (spec.files == 0 || spec.history == 0) {
+        std::cerr << "Fatal: --files and --history must be at least 1" << std::endl;
+        return 1;
+    }
+
+    // 2. The repository, and the working directory the core functions
+    // (hashString, getStagingArea, ...) expect
+    fs::path root = fs::temp_directory_path() / ("minigit_bench_" + std::to_string(std::random_device()()));
+    try {
+        std::cerr << "Generating " << spec.files << " files, " << spec.history << " commits in " << root << "..."
+                  << std::endl;
+        repo = std::make_unique<Repository>(generateSyntheticRepo(root, spec, commits));
+        paths = syntheticPaths(spec);
+        fs::current_path(root);
+        writeCommitGraph(); // as after a 'gc'
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        fs::remove_all(root);
+        return 1;
+    }
+    benchmark::AddCustomContext("files", std::to_string(spec.files));
+    benchmark::AddCustomContext("depth", std::to_string(spec.depth));
+    benchmark::AddCustomContext("history", std::to_string(spec.history));
+    benchmark::AddCustomContext("churn", std::to_string(spec.churn));
+    benchmark::AddCustomContext("file_size", std::to_string(spec.fileSize));
+    benchmark::AddCustomContext("seed", std::to_string(spec.seed));
+
+    // The changing benchmarks run last, in this order: each one leaves the
+    // repository on its branch with nothing staged
+    benchmark::RegisterBenchmark("BM_Checkout", BM_Checkout)->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark("BM_Add", BM_Add)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark("BM_Commit", BM_Commit)->Unit(benchmark::kMillisecond);
+
+    // 3. Run, then clean up
+    int status = 0;
+    try {
+        benchmark::RunSpecifiedBenchmarks();
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        status = 1;
+    }
+    benchmark::Shutdown();
+    repo.reset();
+    fs::current_path(fs::temp_directory_path());
+    fs::remove_all(root);
+    return status;
+}
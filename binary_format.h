@@ -0,0 +1,70 @@
+/**
+ * binary_format.h
+ * * Helpers shared by MiniGit's binary file formats (the index, ...).
+ * All integers are stored little-endian, independent of the host.
+ */
+
+#ifndef MINIGIT_BINARY_FORMAT_H
+#define MINIGIT_BINARY_FORMAT_H
+
+#include "object_id.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace MiniGit {
+
+    // --- Little-endian encoding ---
+
+    inline void putU8(std::string& out, uint8_t value) {
+        out.push_back(static_cast<char>(value));
+    }
+
+    inline void putU16(std::string& out, uint16_t value) {
+        for (int i = 0; i < 2; ++i) {
+            out.push_back(static_cast<char>(value >> (8 * i)));
+        }
+    }
+
+    inline void putU32(std::string& out, uint32_t value) {
+        for (int i = 0; i < 4; ++i) {
+            out.push_back(static_cast<char>(value >> (8 * i)));
+        }
+    }
+
+    inline void putU64(std::string& out, uint64_t value) {
+        for (int i = 0; i < 8; ++i) {
+            out.push_back(static_cast<char>(value >> (8 * i)));
+        }
+    }
+
+    inline uint16_t getU16(const unsigned char* p) {
+        return static_cast<uint16_t>(p[0] | (p[1] << 8));
+    }
+
+    inline uint32_t getU32(const unsigned char* p) {
+        return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+               (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    inline uint64_t getU64(const unsigned char* p) {
+        return static_cast<uint64_t>(getU32(p)) | (static_cast<uint64_t>(getU32(p + 4)) << 32);
+    }
+
+    inline void putObjectId(std::string& out, const ObjectId& hash) {
+        out.append(reinterpret_cast<const char*>(hash.bytes), ObjectId::MAX_BYTES);
+    }
+
+    inline ObjectId getObjectId(const unsigned char* p, uint8_t hexLength) {
+        ObjectId hash;
+        std::memcpy(hash.bytes, p, ObjectId::MAX_BYTES);
+        hash.hexLength = hexLength;
+        return hash;
+    }
+
+} // namespace MiniGit
+
+#endif // MINIGIT_BINARY_FORMAT_H
@@ -0,0 +1,90 @@
+/**
+ * chunker.cpp
+ * * The FastCDC chunker and the chunk manifest format.
+ */
+
+#include "chunker.h"
+#include <cstdlib>
+#include <stdexcept>
+
+namespace MiniGit {
+
+    namespace {
+        // A fixed table of pseudo-random numbers, one per byte value. It
+        // must never change: boundaries (and so chunk ids) depend on it.
+        struct GearTable {
+            uint64_t values[256];
+            GearTable() {
+                uint64_t state = 0x9E3779B97F4A7C15ull; // splitmix64
+                for (uint64_t& value : values) {
+                    state += 0x9E3779B97F4A7C15ull;
+                    uint64_t z = state;
+                    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+                    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+                    value = z ^ (z >> 31);
+                }
+            }
+        };
+        const GearTable GEAR;
+
+        // Normalized chunking: a stricter mask (more bits) before the
+        // average size and a looser one after it pulls chunk sizes towards
+        // the average. 64 KiB average = 16 bits, +-2 bits of normalization,
+        // spread over the high bits (the ones that saw the most bytes).
+        const uint64_t MASK_SMALL = 0x9292524a49490000ull; // 18 bits set
+        const uint64_t MASK_LARGE = 0x8912224448910000ull; // 14 bits set
+    }
+
+    ContentChunker::ContentChunker() = default;
+
+    std::size_t ContentChunker::scan(const unsigned char* data, std::size_t size, bool& boundary) {
+        boundary = false;
+        for (std::size_t i = 0; i < size; ++i) {
+            // DSA: ROLLING HASH. Shifting left drops the influence of old
+            // bytes, so the fingerprint only depends on the last 64 bytes.
+            fingerprint_ = (fingerprint_ << 1) + GEAR.values[data[i]];
+            ++length_;
+            if (length_ < MIN_SIZE) {
+                continue; // cut-point skipping: no boundaries in tiny chunks
+            }
+            uint64_t mask = length_ < AVERAGE_SIZE ? MASK_SMALL : MASK_LARGE;
+            if ((fingerprint_ & mask) == 0 || length_ >= MAX_SIZE) {
+                boundary = true;
+                fingerprint_ = 0;
+                length_ = 0;
+                return i + 1;
+            }
+        }
+        return size;
+    }
+
+    std::string encodeManifest(const std::vector<std::pair<ObjectId, uint64_t>>& chunks) {
+        std::string manifest;
+        for (const auto& chunk : chunks) {
+            manifest += "chunk ";
+            manifest += chunk.first.toHex();
+            manifest += ' ';
+            manifest += std::to_string(chunk.second);
+            manifest += '\n';
+        }
+        return manifest;
+    }
+
+    std::vector<std::pair<ObjectId, uint64_t>> parseManifest(std::string_view manifest) {
+        std::vector<std::pair<ObjectId, uint64_t>> chunks;
+        while (!manifest.empty()) {
+            std::size_t end = manifest.find('\n');
+            std::string_view line = manifest.substr(0, end);
+            manifest.remove_prefix(end == std::string_view::npos ? manifest.size() : end + 1);
+
+            std::size_t space = line.rfind(' ');
+            if (line.compare(0, 6, "chunk ") != 0 || space == std::string_view::npos || space <= 6) {
+                throw std::runtime_error("Corrupt chunk manifest line: " + std::string(line));
+            }
+            std::string size(line.substr(space + 1));
+            chunks.emplace_back(ObjectId::fromHex(line.substr(6, space - 6)), std::strtoull(size.c_str(), nullptr, 10));
+        }
+        return chunks;
+    }
+
+} // namespace MiniGit
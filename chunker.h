@@ -0,0 +1,68 @@
+/**
+ * chunker.h
+ * * Content-defined chunking (FastCDC) for large blobs.
+ *
+ * Cutting a file every N bytes would shift every chunk after an insert.
+ * Instead, a rolling "gear" hash over the last bytes decides where a
+ * chunk ends, so boundaries follow the content: an edit only changes the
+ * chunks around it, and the rest are shared with the previous version.
+ *
+ * A chunked blob is stored under the hash of its whole content (so its
+ * id is the same as if it were stored in one piece), as a manifest:
+ *   chunk <hash> <size>
+ * one line per chunk, in order. Each chunk is its own object.
+ */
+
+#ifndef MINIGIT_CHUNKER_H
+#define MINIGIT_CHUNKER_H
+
+#include "object_id.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace MiniGit {
+
+    /**
+     * @brief Finds chunk boundaries in a byte stream fed in pieces.
+     */
+    class ContentChunker {
+    public:
+        static const std::size_t MIN_SIZE = 16 * 1024;
+        static const std::size_t AVERAGE_SIZE = 64 * 1024;
+        static const std::size_t MAX_SIZE = 256 * 1024;
+
+        ContentChunker();
+
+        /**
+         * @brief Scans the next bytes of the current chunk.
+         * @param data The bytes following those already scanned.
+         * @param size Number of bytes available.
+         * @param boundary Set to true if the chunk ends within 'data'.
+         * @return The number of bytes that belong to the current chunk
+         * (all of 'size' unless a boundary was found).
+         */
+        std::size_t scan(const unsigned char* data, std::size_t size, bool& boundary);
+
+    private:
+        uint64_t fingerprint_ = 0;
+        std::size_t length_ = 0; // bytes of the current chunk scanned so far
+    };
+
+    /**
+     * @brief Serializes a manifest (chunk hash, chunk size) per line.
+     */
+    std::string encodeManifest(const std::vector<std::pair<ObjectId, uint64_t>>& chunks);
+
+    /**
+     * @brief Parses a manifest.
+     * @throws std::runtime_error if a line is malformed.
+     */
+    std::vector<std::pair<ObjectId, uint64_t>> parseManifest(std::string_view manifest);
+
+} // namespace MiniGit
+
+#endif // MINIGIT_CHUNKER_H
@@ -0,0 +1,635 @@
+/**
+ * commit_graph.cpp
+ * * Reading, writing and walking the commit-graph.
+ */
+
+#include "commit_graph.h"
+#include "concurrency.h"
+#include "hash.h"
+#include "minigit.h"
+#include "object_cache.h"
+#include "refs.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+namespace MiniGit {
+
+    namespace {
+        const char GRAPH_MAGIC[4] = {'M', 'G', 'C', 'G'};
+        const uint32_t GRAPH_VERSION = 2;
+        const uint32_t GRAPH_VERSION_NO_FILTERS = 1;
+        const std::size_t HEADER_SIZE = 16;
+        const std::size_t FANOUT_SIZE = 256 * 4;
+        const std::size_t ENTRY_SIZE = 88;
+        const std::size_t CHECKSUM_SIZE = 32;
+
+        // Changed-path filters: 10 bits and 7 hashes per path give about
+        // 1% false positives
+        const uint32_t BLOOM_BITS_PER_PATH = 10;
+        const uint32_t BLOOM_HASHES = 7;
+        const std::size_t BLOOM_MAX_PATHS = 512;
+
+        bool bloomBitSet(const unsigned char* filter, std::size_t size, const ChangedPathKey& key) {
+            uint64_t bits = static_cast<uint64_t>(size) * 8;
+            for (uint32_t i = 0; i < BLOOM_HASHES; ++i) {
+                uint64_t bit = (key.h1 + static_cast<uint64_t>(i) * key.h2) % bits;
+                if ((filter[bit / 8] & (1u << (bit % 8))) == 0) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // The filter of the paths a commit changed, and of their directories
+        std::string changedPathFilter(const ObjectId& parent, const ObjectId& commit) {
+            std::unordered_set<std::string> paths;
+            for (const TreeChange& change : diffCommits(parent, commit)) {
+                std::string path = change.path;
+                while (paths.insert(path).second) {
+                    std::size_t slash = path.rfind('/');
+                    if (slash == std::string::npos) {
+                        break;
+                    }
+                    path.resize(slash);
+                }
+                if (paths.size() > BLOOM_MAX_PATHS) {
+                    return std::string(1, '\xFF'); // every path "may have changed"
+                }
+            }
+            if (paths.empty()) {
+                return std::string(1, '\0');
+            }
+            std::size_t bytes = (paths.size() * BLOOM_BITS_PER_PATH + 7) / 8;
+            std::string filter(bytes, '\0');
+            uint64_t bits = static_cast<uint64_t>(bytes) * 8;
+            for (const std::string& path : paths) {
+                ChangedPathKey key = changedPathKey(path);
+                for (uint32_t i = 0; i < BLOOM_HASHES; ++i) {
+                    uint64_t bit = (key.h1 + static_cast<uint64_t>(i) * key.h2) % bits;
+                    filter[bit / 8] = static_cast<char>(filter[bit / 8] | (1u << (bit % 8)));
+                }
+            }
+            return filter;
+        }
+
+        void graphChecksum(const unsigned char* data, std::size_t size, unsigned char out[CHECKSUM_SIZE]) {
+            Blake3Hasher hasher;
+            hasher.update(data, size);
+            hasher.finalize(out);
+        }
+
+        std::mutex graphMutex;
+        bool graphLoaded = false;
+        std::unique_ptr<CommitGraph> loadedGraph;
+
+        void dropCommitGraph() {
+            std::lock_guard<std::mutex> lock(graphMutex);
+            loadedGraph.reset();
+            graphLoaded = false;
+        }
+    }
+
+    ChangedPathKey changedPathKey(std::string_view path) {
+        // A strong hash keeps the two values independent, which double
+        // hashing needs; paths are short, so it is cheap enough
+        Blake3Hasher hasher;
+        hasher.update(path.data(), path.size());
+        unsigned char digest[32];
+        hasher.finalize(digest);
+        ChangedPathKey key;
+        key.h1 = getU32(digest);
+        key.h2 = getU32(digest + 4) | 1; // odd, so the probes never repeat one bit
+        return key;
+    }
+
+    // --- CommitGraph ---
+
+    bool CommitGraph::load(const fs::path& file) {
+        close();
+        if (!map_.open(file)) {
+            return false;
+        }
+        auto corrupt = [&]() { return std::runtime_error("Corrupt commit-graph file " + file.string()); };
+
+        const unsigned char* data = map_.data();
+        std::size_t size = map_.size();
+        if (size < HEADER_SIZE + FANOUT_SIZE + CHECKSUM_SIZE || std::memcmp(data, GRAPH_MAGIC, sizeof(GRAPH_MAGIC)) != 0) {
+            throw corrupt();
+        }
+        uint32_t version = getU32(data + 4);
+        if (version != GRAPH_VERSION && version != GRAPH_VERSION_NO_FILTERS) {
+            throw std::runtime_error("Unsupported commit-graph version in " + file.string());
+        }
+        uint64_t count = getU32(data + 8);
+        uint64_t tableEnd = HEADER_SIZE + FANOUT_SIZE + count * ENTRY_SIZE;
+        uint64_t filterSize = 0;
+        if (version == GRAPH_VERSION) {
+            if (tableEnd + count * 4 + CHECKSUM_SIZE > size) {
+                throw corrupt();
+            }
+            filterSize = count == 0 ? 0 : getU32(data + tableEnd + (count - 1) * 4);
+            tableEnd += count * 4;
+        }
+        if (tableEnd + filterSize + CHECKSUM_SIZE != size) {
+            throw corrupt();
+        }
+        unsigned char checksum[CHECKSUM_SIZE];
+        graphChecksum(data, size - CHECKSUM_SIZE, checksum);
+        if (std::memcmp(checksum, data + size - CHECKSUM_SIZE, CHECKSUM_SIZE) != 0) {
+            throw corrupt();
+        }
+
+        fanout_ = data + HEADER_SIZE;
+        entries_ = fanout_ + FANOUT_SIZE;
+        count_ = static_cast<std::size_t>(count);
+        if (version == GRAPH_VERSION) {
+            filterEnds_ = entries_ + count_ * ENTRY_SIZE;
+            filterData_ = filterEnds_ + count_ * 4;
+        }
+        uint32_t previousEnd = 0;
+        for (std::size_t i = 0; i < count_; ++i) {
+            uint32_t p1 = parent(static_cast<uint32_t>(i));
+            uint32_t p2 = secondParent(static_cast<uint32_t>(i));
+            if ((p1 != NO_PARENT && p1 >= count_) || (p2 != NO_PARENT && p2 >= count_)) {
+                throw corrupt();
+            }
+            if (filterEnds_ != nullptr) {
+                uint32_t end = getU32(filterEnds_ + i * 4);
+                if (end < previousEnd) {
+                    throw corrupt();
+                }
+                previousEnd = end;
+            }
+        }
+        return true;
+    }
+
+    void CommitGraph::close() {
+        map_.close();
+        fanout_ = nullptr;
+        entries_ = nullptr;
+        filterEnds_ = nullptr;
+        filterData_ = nullptr;
+        count_ = 0;
+    }
+
+    const unsigned char* CommitGraph::entry(uint32_t position) const {
+        return entries_ + static_cast<std::size_t>(position) * ENTRY_SIZE;
+    }
+
+    bool CommitGraph::find(const ObjectId& target, uint32_t& position) const {
+        if (count_ == 0 || target.empty()) {
+            return false;
+        }
+
+        // DSA: BINARY SEARCH, narrowed first by the fanout table
+        std::size_t low = target.bytes[0] == 0 ? 0 : getU32(fanout_ + 4 * (target.bytes[0] - 1));
+        std::size_t high = getU32(fanout_ + 4 * target.bytes[0]);
+        while (low < high) {
+            std::size_t mid = low + (high - low) / 2;
+            int c = hash(static_cast<uint32_t>(mid)).compare(target);
+            if (c == 0) {
+                position = static_cast<uint32_t>(mid);
+                return true;
+            }
+            if (c < 0) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        return false;
+    }
+
+    ObjectId CommitGraph::hash(uint32_t position) const {
+        const unsigned char* e = entry(position);
+        return getObjectId(e, e[32]);
+    }
+
+    ObjectId CommitGraph::tree(uint32_t position) const {
+        const unsigned char* e = entry(position);
+        return getObjectId(e + 56, e[33]);
+    }
+
+    uint32_t CommitGraph::parent(uint32_t position) const {
+        return getU32(entry(position) + 36);
+    }
+
+    uint32_t CommitGraph::secondParent(uint32_t position) const {
+        return getU32(entry(position) + 40);
+    }
+
+    uint32_t CommitGraph::generation(uint32_t position) const {
+        return getU32(entry(position) + 44);
+    }
+
+    uint64_t CommitGraph::timestamp(uint32_t position) const {
+        return getU64(entry(position) + 48);
+    }
+
+    std::string_view CommitGraph::changedPathFilter(uint32_t position) const {
+        if (filterEnds_ == nullptr) {
+            return std::string_view();
+        }
+        uint32_t begin = position == 0 ? 0 : getU32(filterEnds_ + (position - 1) * 4);
+        uint32_t end = getU32(filterEnds_ + position * 4);
+        return std::string_view(reinterpret_cast<const char*>(filterData_) + begin, end - begin);
+    }
+
+    bool CommitGraph::mayHaveChanged(uint32_t position, const ChangedPathKey& key) const {
+        std::string_view filter = changedPathFilter(position);
+        if (filter.empty()) {
+            return true; // no filter: nothing is ruled out
+        }
+        return bloomBitSet(reinterpret_cast<const unsigned char*>(filter.data()), filter.size(), key);
+    }
+
+    const CommitGraph* commitGraph() {
+        std::lock_guard<std::mutex> lock(graphMutex);
+        if (!graphLoaded) {
+            // The graph only speeds things up: if it is damaged, say so
+            // and fall back to reading the commits themselves
+            std::unique_ptr<CommitGraph> graph(new CommitGraph());
+            try {
+                if (graph->load(rootPath(COMMIT_GRAPH_FILE))) {
+                    loadedGraph = std::move(graph);
+                }
+            } catch (const std::runtime_error& e) {
+                std::cerr << "Warning: " << e.what() << " (ignored; run 'minigit gc' to rebuild it)" << std::endl;
+            }
+            graphLoaded = true;
+        }
+        return loadedGraph.get();
+    }
+
+    void reloadCommitGraph() {
+        dropCommitGraph();
+    }
+
+    // --- Writing ---
+
+    std::size_t writeCommitGraph() {
+        MINIGIT_TRACE_SCOPE("writeCommitGraph");
+        struct Node {
+            ObjectId hash;
+            ObjectId tree;
+            ObjectId parent;
+            ObjectId secondParent;
+            uint64_t timestamp;
+            uint32_t generation = 0; // 0: not computed yet
+        };
+
+        // 1. Collect every commit reachable from HEAD and the branches,
+        // through both parents of merges, so the table is closed under
+        // ancestry
+        std::vector<Node> nodes;
+        std::unordered_map<ObjectId, std::size_t> nodeOf;
+        std::vector<ObjectId> pending = listRefTips();
+        while (!pending.empty()) {
+            ObjectId hash = pending.back();
+            pending.pop_back();
+            if (hash.empty() || !nodeOf.emplace(hash, nodes.size()).second) {
+                continue;
+            }
+            std::shared_ptr<const CommitInfo> commit = getCommit(hash);
+            Node node;
+            node.hash = hash;
+            node.tree = commit->tree;
+            node.parent = commit->parent;
+            node.secondParent = commit->secondParent;
+            node.timestamp = commit->timestamp;
+            nodes.push_back(std::move(node));
+            pending.push_back(commit->parent);
+            pending.push_back(commit->secondParent);
+        }
+
+        // 2. Generation numbers: one more than the larger of the parents'.
+        // DSA: DEPTH-FIRST SEARCH in post-order (parents before children),
+        // with an explicit stack so long histories cannot overflow it
+        for (std::size_t root = 0; root < nodes.size(); ++root) {
+            std::vector<std::size_t> stack{root};
+            while (!stack.empty()) {
+                Node& node = nodes[stack.back()];
+                if (node.generation != 0) {
+                    stack.pop_back(); // reached twice, through two children
+                    continue;
+                }
+                uint32_t generation = 1;
+                bool ready = true;
+                for (const ObjectId* parent : {&node.parent, &node.secondParent}) {
+                    if (parent->empty()) {
+                        continue;
+                    }
+                    std::size_t p = nodeOf.at(*parent);
+                    if (nodes[p].generation == 0) {
+                        stack.push_back(p);
+                        ready = false;
+                    } else {
+                        generation = std::max(generation, nodes[p].generation + 1);
+                    }
+                }
+                if (ready) {
+                    node.generation = generation;
+                    stack.pop_back();
+                }
+            }
+        }
+
+        // 3. Sort by hash; parents become positions in the sorted table
+        std::sort(nodes.begin(), nodes.end(), [](const Node& a, const Node& b) { return a.hash < b.hash; });
+        auto positionOf = [&](const ObjectId& target) {
+            if (target.empty()) {
+                return CommitGraph::NO_PARENT;
+            }
+            auto it = std::lower_bound(nodes.begin(), nodes.end(), target,
+                                       [](const Node& n, const ObjectId& h) { return n.hash < h; });
+            return it != nodes.end() && it->hash == target ? static_cast<uint32_t>(it - nodes.begin())
+                                                           : CommitGraph::NO_PARENT;
+        };
+
+        // 4. The changed-path filters, in table order. Commits the old
+        // graph has keep their filter; the others are diffed against
+        // their first parent, in parallel.
+        std::vector<std::string> filters(nodes.size());
+        {
+            const CommitGraph* old = commitGraph();
+            ThreadPool workers(ThreadPool::resolveThreadCount(0));
+            for (std::size_t i = 0; i < nodes.size(); ++i) {
+                uint32_t oldPosition;
+                if (old != nullptr && old->find(nodes[i].hash, oldPosition) &&
+                    !old->changedPathFilter(oldPosition).empty()) {
+                    filters[i] = std::string(old->changedPathFilter(oldPosition));
+                    continue;
+                }
+                workers.submit([&nodes, &filters, i] { filters[i] = changedPathFilter(nodes[i].parent, nodes[i].hash); });
+            }
+            workers.wait();
+        }
+
+        std::string out;
+        out.reserve(HEADER_SIZE + FANOUT_SIZE + nodes.size() * ENTRY_SIZE + CHECKSUM_SIZE);
+        out.append(GRAPH_MAGIC, sizeof(GRAPH_MAGIC));
+        putU32(out, GRAPH_VERSION);
+        putU32(out, static_cast<uint32_t>(nodes.size()));
+        putU32(out, 0); // reserved
+
+        uint32_t fanout[256] = {};
+        for (const Node& node : nodes) {
+            ++fanout[node.hash.bytes[0]];
+        }
+        uint32_t running = 0;
+        for (uint32_t bucket : fanout) {
+            running += bucket;
+            putU32(out, running);
+        }
+
+        for (const Node& node : nodes) {
+            putObjectId(out, node.hash);
+            putU8(out, node.hash.hexLength);
+            putU8(out, node.tree.hexLength);
+            putU16(out, 0); // reserved
+            putU32(out, positionOf(node.parent));
+            putU32(out, positionOf(node.secondParent));
+            putU32(out, node.generation);
+            putU64(out, node.timestamp);
+            putObjectId(out, node.tree);
+        }
+        uint32_t filterEnd = 0;
+        for (const std::string& filter : filters) {
+            filterEnd += static_cast<uint32_t>(filter.size());
+            putU32(out, filterEnd);
+        }
+        for (const std::string& filter : filters) {
+            out += filter;
+        }
+
+        unsigned char checksum[CHECKSUM_SIZE];
+        graphChecksum(reinterpret_cast<const unsigned char*>(out.data()), out.size(), checksum);
+        out.append(reinterpret_cast<const char*>(checksum), CHECKSUM_SIZE);
+
+        // 5. Replace the old graph in one rename (unmapped first, for Windows)
+        dropCommitGraph();
+        writeFileAtomic(rootPath(COMMIT_GRAPH_FILE), out);
+        return nodes.size();
+    }
+
+    // --- Walking ---
+
+    CommitWalker::CommitWalker(const ObjectId& start) : next_(start), graph_(commitGraph()) {}
+
+    bool CommitWalker::next(ObjectId& hash) {
+        // Inside the graph: follow parent positions, no object reads
+        if (inGraph_) {
+            if (position_ == CommitGraph::NO_PARENT) {
+                return false;
+            }
+            current_ = position_;
+            hash = graph_->hash(position_);
+            position_ = graph_->parent(position_);
+            return true;
+        }
+
+        // Commits newer than the graph: read them until we reach it
+        if (next_.empty()) {
+            return false;
+        }
+        hash = next_;
+        uint32_t position;
+        if (graph_ != nullptr && graph_->find(hash, position)) {
+            inGraph_ = true;
+            current_ = position;
+            position_ = graph_->parent(position);
+        } else {
+            current_ = CommitGraph::NO_PARENT;
+            next_ = getCommit(hash)->parent;
+        }
+        return true;
+    }
+
+    bool isAncestor(const ObjectId& ancestor, const ObjectId& descendant) {
+        const CommitGraph* graph = commitGraph();
+        uint32_t ancestorPosition = CommitGraph::NO_PARENT;
+        bool ancestorInGraph = graph != nullptr && graph->find(ancestor, ancestorPosition);
+        uint32_t ancestorGeneration = ancestorInGraph ? graph->generation(ancestorPosition) : 0;
+
+        // DSA: BREADTH-FIRST SEARCH towards the roots. Inside the graph,
+        // a commit whose generation is not above the ancestor's cannot
+        // lead to it, so that whole branch of the search is cut off.
+        std::deque<ObjectId> queue{descendant};
+        std::unordered_set<ObjectId> visited;
+        while (!queue.empty()) {
+            ObjectId hash = queue.front();
+            queue.pop_front();
+            if (hash.empty() || !visited.insert(hash).second) {
+                continue;
+            }
+            if (hash == ancestor) {
+                return true;
+            }
+
+            uint32_t position;
+            if (graph != nullptr && graph->find(hash, position)) {
+                if (ancestorInGraph && graph->generation(position) <= ancestorGeneration) {
+                    continue;
+                }
+                for (uint32_t parent : {graph->parent(position), graph->secondParent(position)}) {
+                    if (parent != CommitGraph::NO_PARENT) {
+                        queue.push_back(graph->hash(parent));
+                    }
+                }
+            } else {
+                std::shared_ptr<const CommitInfo> commit = getCommit(hash);
+                queue.push_back(commit->parent);
+                queue.push_back(commit->secondParent);
+            }
+        }
+        return false;
+    }
+
+    ObjectId mergeBase(const ObjectId& a, const ObjectId& b) {
+        if (a.empty() || b.empty()) {
+            return ObjectId();
+        }
+        if (a == b) {
+            return a;
+        }
+        const CommitGraph* graph = commitGraph();
+
+        // Parents and generation of a commit: from the graph, or from its
+        // object (generations of commits outside the graph are computed
+        // once from their parents, iteratively)
+        std::unordered_map<ObjectId, uint32_t> computedGeneration;
+        auto parentsOf = [&](const ObjectId& hash, ObjectId parents[2]) {
+            uint32_t position;
+            if (graph != nullptr && graph->find(hash, position)) {
+                uint32_t p1 = graph->parent(position), p2 = graph->secondParent(position);
+                parents[0] = p1 == CommitGraph::NO_PARENT ? ObjectId() : graph->hash(p1);
+                parents[1] = p2 == CommitGraph::NO_PARENT ? ObjectId() : graph->hash(p2);
+            } else {
+                std::shared_ptr<const CommitInfo> commit = getCommit(hash);
+                parents[0] = commit->parent;
+                parents[1] = commit->secondParent;
+            }
+        };
+        auto generationOf = [&](const ObjectId& start) {
+            std::vector<ObjectId> stack{start};
+            while (!stack.empty()) {
+                ObjectId hash = stack.back();
+                uint32_t position;
+                if (graph != nullptr && graph->find(hash, position)) {
+                    computedGeneration[hash] = graph->generation(position);
+                    stack.pop_back();
+                    continue;
+                }
+                if (computedGeneration.count(hash) != 0) {
+                    stack.pop_back();
+                    continue;
+                }
+                ObjectId parents[2];
+                parentsOf(hash, parents);
+                uint32_t generation = 1;
+                bool ready = true;
+                for (const ObjectId& parent : parents) {
+                    if (parent.empty()) {
+                        continue;
+                    }
+                    auto known = computedGeneration.find(parent);
+                    uint32_t parentPosition;
+                    if (known != computedGeneration.end()) {
+                        generation = std::max(generation, known->second + 1);
+                    } else if (graph != nullptr && graph->find(parent, parentPosition)) {
+                        generation = std::max(generation, graph->generation(parentPosition) + 1);
+                    } else {
+                        stack.push_back(parent);
+                        ready = false;
+                    }
+                }
+                if (ready) {
+                    computedGeneration[hash] = generation;
+                    stack.pop_back();
+                }
+            }
+            return computedGeneration[start];
+        };
+
+        // 1. Paint down from both commits, highest generation first, so a
+        // commit is only expanded once everything above it has passed on
+        // its paint. A commit is queued again when it gets new paint.
+        const uint8_t FROM_A = 1, FROM_B = 2, STALE = 4, RESULT = 8;
+        std::unordered_map<ObjectId, uint8_t> flags;
+        using Item = std::pair<uint32_t, ObjectId>;
+        auto lower = [](const Item& x, const Item& y) {
+            return x.first != y.first ? x.first < y.first : x.second < y.second;
+        };
+        std::vector<Item> queue; // a max-heap by generation
+        auto push = [&](const ObjectId& hash) {
+            queue.emplace_back(generationOf(hash), hash);
+            std::push_heap(queue.begin(), queue.end(), lower);
+        };
+        auto hasActive = [&]() {
+            // The queue stays as wide as the number of parallel lines of
+            // history, so a scan is cheap
+            return std::any_of(queue.begin(), queue.end(),
+                               [&](const Item& item) { return (flags[item.second] & STALE) == 0; });
+        };
+        flags[a] |= FROM_A;
+        push(a);
+        flags[b] |= FROM_B;
+        push(b);
+
+        std::vector<ObjectId> candidates;
+        while (hasActive()) {
+            std::pop_heap(queue.begin(), queue.end(), lower);
+            ObjectId hash = queue.back().second;
+            queue.pop_back();
+
+            uint8_t passOn = flags[hash] & (FROM_A | FROM_B | STALE);
+            if (passOn == (FROM_A | FROM_B)) {
+                // 2. Reached from both: a common ancestor. Its ancestors
+                // are common ancestors too, but worse ones: stale.
+                if ((flags[hash] & RESULT) == 0) {
+                    flags[hash] |= RESULT;
+                    candidates.push_back(hash);
+                }
+                passOn |= STALE;
+            }
+            ObjectId parents[2];
+            parentsOf(hash, parents);
+            for (const ObjectId& parent : parents) {
+                if (!parent.empty() && (flags[parent] & passOn) != passOn) {
+                    flags[parent] |= passOn;
+                    push(parent);
+                }
+            }
+        }
+
+        // 3. A candidate that is an ancestor of another is not a best base
+        for (const ObjectId& candidate : candidates) {
+            if ((flags[candidate] & STALE) != 0) {
+                continue; // below another common ancestor
+            }
+            bool redundant = false;
+            for (const ObjectId& other : candidates) {
+                if (other != candidate && isAncestor(candidate, other)) {
+                    redundant = true;
+                    break;
+                }
+            }
+            if (!redundant) {
+                return candidate; // candidates come out highest generation first
+            }
+        }
+        return ObjectId();
+    }
+
+} // namespace MiniGit
@@ -0,0 +1,199 @@
+/**
+ * commit_graph.h
+ * * The commit-graph: a sidecar table of the commit history.
+ *
+ * .minigit/commit-graph
+ *   header   "MGCG", u32 version, u32 commit count, u32 reserved
+ *   fanout   256 x u32: number of commits whose first hash byte is <= i
+ *   entries  sorted by hash, 88 bytes each:
+ *              32-byte commit hash, u8 hash hex length,
+ *              u8 tree hex length, u16 reserved,
+ *              u32 first parent, u32 second parent (entry positions,
+ *              NO_PARENT if none), u32 generation,
+ *              u64 commit time (seconds), 32-byte root tree hash
+ *   filters  (version 2) count x u32: where each entry's changed-path
+ *              filter ends in the filter data, then the filter data
+ *   checksum BLAKE3 of everything above
+ *
+ * Parents are stored as positions in the same table, so walking history
+ * is pointer chasing through one memory-mapped file instead of opening
+ * and parsing a commit object per step. The generation number of a
+ * commit is one more than the largest generation of its parents (1 for
+ * a root). A commit can only be an ancestor of commits with a strictly
+ * larger generation, which lets ancestry and merge-base searches stop
+ * early. Merge commits record the merged-in parent as the second parent.
+ *
+ * DSA: BLOOM FILTER. Each commit also gets a changed-path filter: the
+ * paths that differ from its first parent, and their directories, set
+ * BLOOM_HASHES bits each in a bit array of BLOOM_BITS_PER_PATH bits per
+ * path. A path whose bits are not all set was certainly not changed, so
+ * a path-limited log skips the commit without reading a tree. A set bit
+ * can be a false positive: those commits are checked against their trees
+ * (about 1 in 100 with these sizes). A commit that changed more than
+ * BLOOM_MAX_PATHS paths gets a one-byte filter with every bit set.
+ * Version 1 graphs, without filters, are still read.
+ *
+ * The graph is rebuilt by 'gc' (or 'commit-graph write'). Commits made
+ * since then are not in it; readers fall back to the objects for those.
+ */
+
+#ifndef MINIGIT_COMMIT_GRAPH_H
+#define MINIGIT_COMMIT_GRAPH_H
+
+#include "binary_format.h"
+#include "platform.h"
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+namespace MiniGit {
+
+    /**
+     * @brief A path hashed once, to be tested against many changed-path
+     * filters (the filters' bit positions are derived from these two
+     * values by double hashing).
+     */
+    struct ChangedPathKey {
+        uint32_t h1 = 0;
+        uint32_t h2 = 0;
+    };
+
+    /**
+     * @brief The key of a path ("dir/file.txt", no trailing slash).
+     */
+    ChangedPathKey changedPathKey(std::string_view path);
+
+    /**
+     * @brief A memory-mapped, read-only view of the commit-graph file.
+     */
+    class CommitGraph {
+    public:
+        static const uint32_t NO_PARENT = 0xFFFFFFFFu;
+
+        CommitGraph() = default;
+        CommitGraph(const CommitGraph&) = delete;
+        CommitGraph& operator=(const CommitGraph&) = delete;
+
+        /**
+         * @brief Maps the graph file.
+         * @return false if there is no graph.
+         * @throws std::runtime_error if the file is corrupt.
+         */
+        bool load(const std::filesystem::path& file);
+        void close();
+
+        std::size_t size() const { return count_; }
+
+        /**
+         * @brief Finds a commit's position in the table (binary search).
+         */
+        bool find(const ObjectId& hash, uint32_t& position) const;
+
+        ObjectId hash(uint32_t position) const;
+        ObjectId tree(uint32_t position) const;
+        uint32_t parent(uint32_t position) const;       // first parent, or NO_PARENT
+        uint32_t secondParent(uint32_t position) const; // the merged-in parent, or NO_PARENT
+        uint32_t generation(uint32_t position) const;
+        uint64_t timestamp(uint32_t position) const;
+
+        /**
+         * @brief Checks a commit's changed-path filter.
+         * @return false if the commit certainly left the path (a file or a
+         * directory) as its first parent had it; true if it may have
+         * changed it, or if the commit has no filter.
+         */
+        bool mayHaveChanged(uint32_t position, const ChangedPathKey& key) const;
+
+        /**
+         * @brief A commit's filter as stored (empty if it has none).
+         */
+        std::string_view changedPathFilter(uint32_t position) const;
+
+    private:
+        const unsigned char* entry(uint32_t position) const;
+
+        MappedFile map_;
+        const unsigned char* fanout_ = nullptr;
+        const unsigned char* entries_ = nullptr;
+        const unsigned char* filterEnds_ = nullptr; // nullptr in a version 1 graph
+        const unsigned char* filterData_ = nullptr;
+        std::size_t count_ = 0;
+    };
+
+    /**
+     * @brief The repository's commit-graph, mapped on first use.
+     * The pointer stays valid until the graph is rewritten.
+     * @return nullptr if the repository has no commit-graph.
+     */
+    const CommitGraph* commitGraph();
+
+    /**
+     * @brief Forgets the mapped graph, so the next commitGraph() maps the
+     * file again (after another process rewrote it). Invalidates the
+     * pointers commitGraph() returned.
+     */
+    void reloadCommitGraph();
+
+    /**
+     * @brief Rebuilds the commit-graph from the history reachable from HEAD
+     * and every branch. Filters of commits already in the old graph are
+     * copied; the others are computed by diffing the commit against its
+     * first parent.
+     * @return The number of commits written.
+     */
+    std::size_t writeCommitGraph();
+
+    /**
+     * @brief Walks first-parent history, newest first.
+     * Steps covered by the commit-graph never open a commit object.
+     */
+    class CommitWalker {
+    public:
+        explicit CommitWalker(const ObjectId& start);
+
+        /**
+         * @brief Moves to the next commit.
+         * @return false when the history is exhausted.
+         */
+        bool next(ObjectId& hash);
+
+        /**
+         * @brief The commit-graph position of the commit next() returned
+         * last, or NO_PARENT if it is not in the graph.
+         */
+        uint32_t graphPosition() const { return current_; }
+
+        const CommitGraph* graph() const { return graph_; }
+
+    private:
+        ObjectId next_;
+        const CommitGraph* graph_;
+        bool inGraph_ = false;
+        uint32_t position_ = CommitGraph::NO_PARENT;
+        uint32_t current_ = CommitGraph::NO_PARENT;
+    };
+
+    /**
+     * @brief Checks whether 'ancestor' is reachable from 'descendant'
+     * (a commit counts as its own ancestor).
+     */
+    bool isAncestor(const ObjectId& ancestor, const ObjectId& descendant);
+
+    /**
+     * @brief Finds the best common ancestor of two commits, the base of a
+     * three-way merge. Of several (criss-cross history), the one with the
+     * highest generation is returned.
+     * DSA: PRIORITY QUEUE ordered by generation number. Both commits
+     * paint their ancestors; a commit reached from both is a common
+     * ancestor, and the ancestors of one are stale. The search ends as
+     * soon as only stale commits are queued, so history below the merge
+     * base is not walked. Commits newer than the commit-graph get their
+     * generation computed from their parents on the way.
+     * @return The merge base, or an empty id if the histories are unrelated.
+     */
+    ObjectId mergeBase(const ObjectId& a, const ObjectId& b);
+
+} // namespace MiniGit
+
+#endif // MINIGIT_COMMIT_GRAPH_H
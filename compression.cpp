@@ -0,0 +1,198 @@
+/**
+ * compression.cpp
+ * * deflate (zlib) helpers.
+ */
+
+#include "compression.h"
+#include "minigit.h"
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <zlib.h>
+
+namespace MiniGit {
+
+    namespace {
+        // zlib counts in 'uInt', which is 32 bits even on 64-bit Windows,
+        // so large buffers are fed to it in slices.
+        const std::size_t ZLIB_SLICE = UINT_MAX;
+    }
+
+    int compressionLevel() {
+        std::map<std::string, std::string> config = readConfig();
+        auto it = config.find("compression");
+        return it == config.end() ? Z_DEFAULT_COMPRESSION : std::stoi(it->second);
+    }
+
+    void deflateAppend(const char* data, std::size_t size, int level, std::string& out) {
+        z_stream stream;
+        std::memset(&stream, 0, sizeof(stream));
+        if (deflateInit(&stream, level) != Z_OK) {
+            throw std::runtime_error("Could not initialize compression");
+        }
+
+        std::size_t start = out.size();
+        out.resize(start + deflateBound(&stream, static_cast<uLong>(std::min<std::size_t>(size, ULONG_MAX))));
+        const unsigned char* in = reinterpret_cast<const unsigned char*>(data);
+        std::size_t inLeft = size;
+        std::size_t written = start;
+
+        int result = Z_OK;
+        do {
+            if (stream.avail_in == 0 && inLeft > 0) {
+                std::size_t slice = std::min(inLeft, ZLIB_SLICE);
+                stream.next_in = const_cast<unsigned char*>(in);
+                stream.avail_in = static_cast<uInt>(slice);
+                in += slice;
+                inLeft -= slice;
+            }
+            if (written == out.size()) {
+                out.resize(out.size() + out.size() / 2 + 64);
+            }
+            std::size_t space = std::min(out.size() - written, ZLIB_SLICE);
+            stream.next_out = reinterpret_cast<unsigned char*>(&out[written]);
+            stream.avail_out = static_cast<uInt>(space);
+            result = deflate(&stream, inLeft == 0 ? Z_FINISH : Z_NO_FLUSH);
+            written += space - stream.avail_out;
+        } while (result != Z_STREAM_END && result != Z_STREAM_ERROR);
+
+        deflateEnd(&stream);
+        if (result != Z_STREAM_END) {
+            throw std::runtime_error("Compression failed");
+        }
+        out.resize(written);
+    }
+
+    bool inflateExact(const unsigned char* in, std::size_t inSize, char* out, std::size_t size) {
+        z_stream stream;
+        std::memset(&stream, 0, sizeof(stream));
+        if (inflateInit(&stream) != Z_OK) {
+            throw std::runtime_error("Could not initialize decompression");
+        }
+
+        std::size_t inLeft = inSize;
+        std::size_t outLeft = size;
+        int result = Z_OK;
+        do {
+            if (stream.avail_in == 0 && inLeft > 0) {
+                std::size_t slice = std::min(inLeft, ZLIB_SLICE);
+                stream.next_in = const_cast<unsigned char*>(in);
+                stream.avail_in = static_cast<uInt>(slice);
+                in += slice;
+                inLeft -= slice;
+            }
+            std::size_t slice = std::min(outLeft, ZLIB_SLICE);
+            stream.next_out = reinterpret_cast<unsigned char*>(out);
+            stream.avail_out = static_cast<uInt>(slice);
+            result = inflate(&stream, Z_NO_FLUSH);
+            std::size_t produced = slice - stream.avail_out;
+            out += produced;
+            outLeft -= produced;
+        } while (result == Z_OK && (stream.avail_in > 0 || inLeft > 0 || outLeft > 0));
+
+        inflateEnd(&stream);
+        return result == Z_STREAM_END && outLeft == 0;
+    }
+
+    std::size_t maxInflatedSize(std::size_t inSize) {
+        const std::size_t maxRatio = 1032;
+        return inSize > SIZE_MAX / maxRatio ? SIZE_MAX : inSize * maxRatio;
+    }
+
+    // --- DeflateStream ---
+
+    DeflateStream::DeflateStream(int level) : stream_(new z_stream()) {
+        std::memset(stream_.get(), 0, sizeof(z_stream));
+        if (deflateInit(stream_.get(), level) != Z_OK) {
+            throw std::runtime_error("Could not initialize compression");
+        }
+    }
+
+    DeflateStream::~DeflateStream() {
+        deflateEnd(stream_.get());
+    }
+
+    void DeflateStream::update(const char* data, std::size_t size, std::string& out) {
+        while (size > 0) {
+            std::size_t slice = std::min(size, ZLIB_SLICE);
+            stream_->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+            stream_->avail_in = static_cast<uInt>(slice);
+            run(Z_NO_FLUSH, out);
+            data += slice;
+            size -= slice;
+        }
+    }
+
+    void DeflateStream::finish(std::string& out) {
+        stream_->next_in = nullptr;
+        stream_->avail_in = 0;
+        run(Z_FINISH, out);
+    }
+
+    void DeflateStream::run(int flush, std::string& out) {
+        // Drain until zlib has consumed the input (or ended the stream)
+        unsigned char buffer[64 * 1024];
+        int result;
+        do {
+            stream_->next_out = buffer;
+            stream_->avail_out = sizeof(buffer);
+            result = deflate(stream_.get(), flush);
+            if (result == Z_STREAM_ERROR) {
+                throw std::runtime_error("Compression failed");
+            }
+            out.append(reinterpret_cast<const char*>(buffer), sizeof(buffer) - stream_->avail_out);
+        } while (stream_->avail_out == 0 || (flush == Z_FINISH && result != Z_STREAM_END));
+    }
+
+    // --- InflateStream ---
+
+    InflateStream::InflateStream() : stream_(new z_stream()) {
+        std::memset(stream_.get(), 0, sizeof(z_stream));
+        if (inflateInit(stream_.get()) != Z_OK) {
+            throw std::runtime_error("Could not initialize decompression");
+        }
+    }
+
+    InflateStream::~InflateStream() {
+        inflateEnd(stream_.get());
+    }
+
+    void InflateStream::input(const unsigned char* in, std::size_t size) {
+        in_ = in;
+        inLeft_ = size;
+    }
+
+    std::size_t InflateStream::availableInput() const {
+        return stream_->avail_in;
+    }
+
+    std::size_t InflateStream::read(char* out, std::size_t capacity) {
+        std::size_t produced = 0;
+        while (!ended_ && produced < capacity) {
+            if (stream_->avail_in == 0) {
+                if (inLeft_ == 0) {
+                    break; // the caller has to supply more input
+                }
+                std::size_t slice = std::min(inLeft_, ZLIB_SLICE);
+                stream_->next_in = const_cast<unsigned char*>(in_);
+                stream_->avail_in = static_cast<uInt>(slice);
+                in_ += slice;
+                inLeft_ -= slice;
+            }
+            std::size_t space = std::min(capacity - produced, ZLIB_SLICE);
+            stream_->next_out = reinterpret_cast<unsigned char*>(out + produced);
+            stream_->avail_out = static_cast<uInt>(space);
+            int result = inflate(stream_.get(), Z_NO_FLUSH);
+            produced += space - stream_->avail_out;
+            if (result == Z_STREAM_END) {
+                ended_ = true;
+            } else if (result != Z_OK && result != Z_BUF_ERROR) {
+                throw std::runtime_error("Corrupt compressed stream");
+            }
+        }
+        return produced;
+    }
+
+} // namespace MiniGit
@@ -0,0 +1,111 @@
+/**
+ * compression.h
+ * * deflate (zlib) helpers shared by loose objects and packfiles.
+ */
+
+#ifndef MINIGIT_COMPRESSION_H
+#define MINIGIT_COMPRESSION_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+struct z_stream_s; // zlib's stream state, kept out of this header
+
+namespace MiniGit {
+
+    /**
+     * @brief The deflate level to use (config key "compression", 0-9).
+     */
+    int compressionLevel();
+
+    /**
+     * @brief Deflates 'size' bytes at 'data' and appends the result to 'out'.
+     * @throws std::runtime_error if zlib fails.
+     */
+    void deflateAppend(const char* data, std::size_t size, int level, std::string& out);
+
+    /**
+     * @brief Inflates a deflate stream into a preallocated buffer.
+     * @param in The compressed bytes.
+     * @param inSize Number of compressed bytes.
+     * @param out The output buffer.
+     * @param size Exact number of bytes the stream must inflate to.
+     * @return false if the stream is corrupt or has the wrong size.
+     */
+    bool inflateExact(const unsigned char* in, std::size_t inSize, char* out, std::size_t size);
+
+    /**
+     * @brief The most 'inSize' bytes of deflate data can inflate to
+     * (deflate's best ratio is 1032:1), for checking a size read from a
+     * pack or a remote before allocating it.
+     */
+    std::size_t maxInflatedSize(std::size_t inSize);
+
+    /**
+     * @brief Incremental deflate, for data fed in chunks.
+     */
+    class DeflateStream {
+    public:
+        explicit DeflateStream(int level);
+        ~DeflateStream();
+
+        DeflateStream(const DeflateStream&) = delete;
+        DeflateStream& operator=(const DeflateStream&) = delete;
+
+        /**
+         * @brief Compresses the next chunk, appending output to 'out'.
+         */
+        void update(const char* data, std::size_t size, std::string& out);
+
+        /**
+         * @brief Ends the stream, appending the remaining output to 'out'.
+         */
+        void finish(std::string& out);
+
+    private:
+        void run(int flush, std::string& out);
+        std::unique_ptr<z_stream_s> stream_;
+    };
+
+    /**
+     * @brief Incremental inflate: compressed input is fed in chunks and
+     * output is produced a buffer at a time.
+     */
+    class InflateStream {
+    public:
+        InflateStream();
+        ~InflateStream();
+
+        InflateStream(const InflateStream&) = delete;
+        InflateStream& operator=(const InflateStream&) = delete;
+
+        /**
+         * @brief Supplies the next chunk of compressed input. It must stay
+         * valid until needsInput() is true again.
+         */
+        void input(const unsigned char* in, std::size_t size);
+
+        /**
+         * @brief Inflates up to 'capacity' bytes into 'out'.
+         * @return The number of bytes produced; 0 when more input is needed
+         * or the stream has ended.
+         * @throws std::runtime_error if the stream is corrupt.
+         */
+        std::size_t read(char* out, std::size_t capacity);
+
+        bool needsInput() const { return inLeft_ == 0 && availableInput() == 0; }
+        bool ended() const { return ended_; }
+
+    private:
+        std::size_t availableInput() const;
+
+        std::unique_ptr<z_stream_s> stream_;
+        const unsigned char* in_ = nullptr;
+        std::size_t inLeft_ = 0;
+        bool ended_ = false;
+    };
+
+} // namespace MiniGit
+
+#endif // MINIGIT_COMPRESSION_H
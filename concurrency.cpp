@@ -0,0 +1,88 @@
+/**
+ * concurrency.cpp
+ * * Implementation of the MiniGit thread pool.
+ */
+
+#include "concurrency.h"
+
+namespace MiniGit {
+
+    ThreadPool::ThreadPool(unsigned threads) {
+        threads = resolveThreadCount(threads);
+        workers_.reserve(threads);
+        for (unsigned i = 0; i < threads; ++i) {
+            workers_.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        jobAvailable_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    void ThreadPool::submit(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back(std::move(job));
+        }
+        jobAvailable_.notify_one();
+    }
+
+    void ThreadPool::wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_.wait(lock, [this] { return jobs_.empty() && running_ == 0; });
+        if (error_) {
+            std::exception_ptr error = error_;
+            error_ = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+    unsigned ThreadPool::resolveThreadCount(unsigned requested) {
+        if (requested != 0) {
+            return requested;
+        }
+        unsigned hardware = std::thread::hardware_concurrency();
+        return hardware == 0 ? 1 : hardware;
+    }
+
+    void ThreadPool::workerLoop() {
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                jobAvailable_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+                if (jobs_.empty()) {
+                    return; // stopping and nothing left to do
+                }
+                job = std::move(jobs_.front());
+                jobs_.pop_front();
+                ++running_;
+            }
+
+            try {
+                job();
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!error_) {
+                    error_ = std::current_exception();
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                --running_;
+                if (jobs_.empty() && running_ == 0) {
+                    idle_.notify_all();
+                }
+            }
+        }
+    }
+
+} // namespace MiniGit
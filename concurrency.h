@@ -0,0 +1,111 @@
+/**
+ * concurrency.h
+ * * Small threading building blocks shared by the MiniGit commands.
+ * A bounded queue connects the stages of a pipeline, and a fixed-size
+ * thread pool runs independent jobs (hashing, checkout writes, ...).
+ */
+
+#ifndef MINIGIT_CONCURRENCY_H
+#define MINIGIT_CONCURRENCY_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace MiniGit {
+
+    /**
+     * @brief A blocking FIFO queue with a fixed capacity.
+     * push() waits while the queue is full, pop() waits while it is empty.
+     * Once close() is called, pop() drains the remaining items and then
+     * returns false so consumers know the producer has finished.
+     */
+    template <typename T>
+    class BoundedQueue {
+    public:
+        explicit BoundedQueue(std::size_t capacity) : capacity_(capacity == 0 ? 1 : capacity) {}
+
+        void push(T item) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            notFull_.wait(lock, [this] { return items_.size() < capacity_ || closed_; });
+            if (closed_) {
+                return;
+            }
+            items_.push_back(std::move(item));
+            notEmpty_.notify_one();
+        }
+
+        bool pop(T& item) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            notEmpty_.wait(lock, [this] { return !items_.empty() || closed_; });
+            if (items_.empty()) {
+                return false;
+            }
+            item = std::move(items_.front());
+            items_.pop_front();
+            notFull_.notify_one();
+            return true;
+        }
+
+        void close() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+            notEmpty_.notify_all();
+            notFull_.notify_all();
+        }
+
+    private:
+        std::size_t capacity_;
+        std::deque<T> items_;
+        bool closed_ = false;
+        std::mutex mutex_;
+        std::condition_variable notEmpty_;
+        std::condition_variable notFull_;
+    };
+
+    /**
+     * @brief A fixed set of worker threads executing submitted jobs.
+     * wait() blocks until every job submitted so far has finished.
+     * The first exception thrown by a job is re-thrown from wait().
+     */
+    class ThreadPool {
+    public:
+        explicit ThreadPool(unsigned threads);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        void submit(std::function<void()> job);
+        void wait();
+
+        unsigned size() const { return static_cast<unsigned>(workers_.size()); }
+
+        /**
+         * @brief The number of threads to use when the user did not ask for one.
+         * @param requested A user supplied thread count, or 0 for "pick for me".
+         * @return requested if non-zero, otherwise the hardware concurrency (at least 1).
+         */
+        static unsigned resolveThreadCount(unsigned requested);
+
+    private:
+        void workerLoop();
+
+        std::vector<std::thread> workers_;
+        std::deque<std::function<void()>> jobs_;
+        std::size_t running_ = 0;
+        bool stopping_ = false;
+        std::exception_ptr error_;
+        std::mutex mutex_;
+        std::condition_variable jobAvailable_;
+        std::condition_variable idle_;
+    };
+
+} // namespace MiniGit
+
+#endif // MINIGIT_CONCURRENCY_H
@@ -0,0 +1,205 @@
+/**
+ * delta.cpp
+ * * Delta compression for packfiles.
+ * The base is indexed in fixed-size blocks by a hash table; a rolling
+ * hash then slides over the target looking for blocks it can copy.
+ */
+
+#include "delta.h"
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace MiniGit {
+
+    namespace {
+        const std::size_t BLOCK = 16;
+        const uint32_t PRIME = 0x01000193u;
+
+        const uint8_t OP_INSERT = 0x00;
+        const uint8_t OP_COPY = 0x01;
+
+        void putVarint(std::string& out, uint64_t value) {
+            while (value >= 0x80) {
+                out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+                value >>= 7;
+            }
+            out.push_back(static_cast<char>(value));
+        }
+
+        uint64_t getVarint(std::string_view data, std::size_t& pos) {
+            uint64_t value = 0;
+            int shift = 0;
+            while (true) {
+                if (pos >= data.size() || shift > 63) {
+                    throw std::runtime_error("Corrupt delta");
+                }
+                uint8_t byte = static_cast<uint8_t>(data[pos++]);
+                value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+                if ((byte & 0x80) == 0) {
+                    return value;
+                }
+                shift += 7;
+            }
+        }
+
+        uint32_t hashBlock(const unsigned char* p) {
+            uint32_t h = 0;
+            for (std::size_t i = 0; i < BLOCK; ++i) {
+                h = h * PRIME + p[i];
+            }
+            return h;
+        }
+
+        void emitInsert(std::string& out, std::string_view target, std::size_t from, std::size_t to) {
+            if (to > from) {
+                out.push_back(static_cast<char>(OP_INSERT));
+                putVarint(out, to - from);
+                out.append(target.data() + from, to - from);
+            }
+        }
+    }
+
+    bool computeDelta(std::string_view base, std::string_view target, std::string& out, std::size_t maxSize) {
+        out.clear();
+        putVarint(out, base.size());
+        putVarint(out, target.size());
+        if (base.size() < BLOCK || target.size() < BLOCK) {
+            return false;
+        }
+
+        const unsigned char* b = reinterpret_cast<const unsigned char*>(base.data());
+        const unsigned char* t = reinterpret_cast<const unsigned char*>(target.data());
+
+        // 1. DSA: HASH TABLE (open addressing) of the base's blocks.
+        // Slots hold block offset + 1, so 0 means empty.
+        std::size_t blocks = base.size() / BLOCK;
+        std::size_t capacity = 1;
+        while (capacity < blocks * 2) {
+            capacity <<= 1;
+        }
+        std::size_t mask = capacity - 1;
+        std::vector<uint32_t> table(capacity, 0);
+        for (std::size_t i = 0; i + BLOCK <= base.size(); i += BLOCK) {
+            std::size_t slot = hashBlock(b + i) & mask;
+            for (int probe = 0; probe < 8 && table[slot] != 0; ++probe) {
+                slot = (slot + 1) & mask;
+            }
+            if (table[slot] == 0) {
+                table[slot] = static_cast<uint32_t>(i + 1);
+            }
+        }
+
+        // PRIME^(BLOCK-1), to remove the byte leaving the rolling window
+        uint32_t outFactor = 1;
+        for (std::size_t i = 1; i < BLOCK; ++i) {
+            outFactor *= PRIME;
+        }
+
+        // 2. Slide a rolling hash over the target and copy what matches
+        std::size_t pos = 0;
+        std::size_t insertStart = 0;
+        uint32_t h = hashBlock(t);
+        while (pos + BLOCK <= target.size()) {
+            std::size_t matchOffset = 0;
+            std::size_t matchLength = 0;
+            std::size_t slot = h & mask;
+            for (int probe = 0; probe < 8 && table[slot] != 0; ++probe) {
+                std::size_t candidate = table[slot] - 1;
+                if (std::memcmp(b + candidate, t + pos, BLOCK) == 0) {
+                    std::size_t length = BLOCK;
+                    while (candidate + length < base.size() && pos + length < target.size() &&
+                           b[candidate + length] == t[pos + length]) {
+                        ++length;
+                    }
+                    if (length > matchLength) {
+                        matchOffset = candidate;
+                        matchLength = length;
+                    }
+                }
+                slot = (slot + 1) & mask;
+            }
+
+            if (matchLength == 0) {
+                if (pos + BLOCK >= target.size()) {
+                    break;
+                }
+                h = (h - t[pos] * outFactor) * PRIME + t[pos + BLOCK];
+                ++pos;
+                continue;
+            }
+
+            // Grow the match backwards into the pending literal bytes
+            while (pos > insertStart && matchOffset > 0 && b[matchOffset - 1] == t[pos - 1]) {
+                --pos;
+                --matchOffset;
+                ++matchLength;
+            }
+
+            emitInsert(out, target, insertStart, pos);
+            out.push_back(static_cast<char>(OP_COPY));
+            putVarint(out, matchOffset);
+            putVarint(out, matchLength);
+            if (out.size() > maxSize) {
+                return false;
+            }
+
+            pos += matchLength;
+            insertStart = pos;
+            if (pos + BLOCK <= target.size()) {
+                h = hashBlock(t + pos);
+            }
+        }
+
+        emitInsert(out, target, insertStart, target.size());
+        return out.size() <= maxSize;
+    }
+
+    std::string applyDelta(std::string_view base, std::string_view delta) {
+        std::size_t pos = 0;
+        uint64_t baseSize = getVarint(delta, pos);
+        uint64_t resultSize = getVarint(delta, pos);
+        if (baseSize != base.size()) {
+            throw std::runtime_error("Corrupt delta: base size mismatch");
+        }
+        // The result size comes from pack or remote data: it cannot be
+        // more than the instructions left can make (an insert at most its
+        // own bytes, a copy of three bytes or more at most the whole base),
+        // so a corrupt one is refused before anything is reserved
+        uint64_t left = delta.size() - pos;
+        uint64_t copies = left / 3;
+        bool bounded = copies == 0 || base.size() <= (UINT64_MAX - left) / copies; // else no size exceeds it
+        if (bounded && resultSize > left + copies * base.size()) {
+            throw std::runtime_error("Corrupt delta: result size out of range");
+        }
+
+        std::string result;
+        result.reserve(static_cast<std::size_t>(resultSize));
+        while (pos < delta.size()) {
+            uint8_t op = static_cast<uint8_t>(delta[pos++]);
+            if (op == OP_INSERT) {
+                uint64_t length = getVarint(delta, pos);
+                if (length > delta.size() - pos) {
+                    throw std::runtime_error("Corrupt delta: insert past end");
+                }
+                result.append(delta.data() + pos, static_cast<std::size_t>(length));
+                pos += static_cast<std::size_t>(length);
+            } else if (op == OP_COPY) {
+                uint64_t offset = getVarint(delta, pos);
+                uint64_t length = getVarint(delta, pos);
+                if (offset > base.size() || length > base.size() - offset) {
+                    throw std::runtime_error("Corrupt delta: copy out of range");
+                }
+                result.append(base.data() + offset, static_cast<std::size_t>(length));
+            } else {
+                throw std::runtime_error("Corrupt delta: unknown instruction");
+            }
+        }
+        if (result.size() != resultSize) {
+            throw std::runtime_error("Corrupt delta: result size mismatch");
+        }
+        return result;
+    }
+
+} // namespace MiniGit
@@ -0,0 +1,37 @@
+/**
+ * delta.h
+ * * Binary deltas between two versions of an object, used by packfiles.
+ *
+ * A delta is: varint base size, varint result size, then a list of
+ * instructions. 0x00 <varint n> <n bytes> inserts literal bytes;
+ * 0x01 <varint offset> <varint n> copies n bytes from the base.
+ */
+
+#ifndef MINIGIT_DELTA_H
+#define MINIGIT_DELTA_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace MiniGit {
+
+    /**
+     * @brief Encodes 'target' as a delta against 'base'.
+     * @param base The object the delta will be applied to.
+     * @param target The object to reconstruct.
+     * @param out Receives the delta.
+     * @param maxSize Give up once the delta would be larger than this.
+     * @return false if no delta smaller than maxSize exists.
+     */
+    bool computeDelta(std::string_view base, std::string_view target, std::string& out, std::size_t maxSize);
+
+    /**
+     * @brief Rebuilds the target object from its base and a delta.
+     * @throws std::runtime_error if the delta does not fit the base.
+     */
+    std::string applyDelta(std::string_view base, std::string_view delta);
+
+} // namespace MiniGit
+
+#endif // MINIGIT_DELTA_H
@@ -0,0 +1,478 @@
+/**
+ * diff.cpp
+ * * Line splitting, line interning, Myers' diff and unified output.
+ */
+
+#include "diff.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MINIGIT_DIFF_SSE2 1
+#include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace MiniGit {
+
+    namespace {
+
+        const std::size_t BINARY_PROBE = 8000; // like git: a NUL this early means binary
+        const std::ptrdiff_t MIN_COST_LIMIT = 256;
+
+        inline unsigned countTrailingZeros(unsigned value) {
+#ifdef _MSC_VER
+            unsigned long index;
+            _BitScanForward(&index, value);
+            return static_cast<unsigned>(index);
+#else
+            return static_cast<unsigned>(__builtin_ctz(value));
+#endif
+        }
+
+        /**
+         * @brief A fast, non-cryptographic line hash that consumes eight
+         * bytes per step (lines are only interned with it, never named).
+         */
+        struct LineHasher {
+            std::size_t operator()(std::string_view line) const noexcept {
+                const uint64_t K = 0x9E3779B97F4A7C15ull;
+                uint64_t h = static_cast<uint64_t>(line.size()) * K;
+                const char* p = line.data();
+                std::size_t n = line.size();
+                for (; n >= 8; p += 8, n -= 8) {
+                    uint64_t word;
+                    std::memcpy(&word, p, 8);
+                    h = (h ^ word) * K;
+                    h ^= h >> 29;
+                }
+                if (n > 0) {
+                    uint64_t word = 0;
+                    std::memcpy(&word, p, n);
+                    h = (h ^ word) * K;
+                    h ^= h >> 29;
+                }
+                return static_cast<std::size_t>(h ^ (h >> 32));
+            }
+        };
+
+        bool isBinary(std::string_view text) {
+            return std::memchr(text.data(), '\0', std::min(text.size(), BINARY_PROBE)) != nullptr;
+        }
+
+        /**
+         * @brief Myers' diff over two sequences of line ids.
+         */
+        class MyersDiff {
+        public:
+            MyersDiff(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b,
+                      std::vector<std::pair<uint32_t, uint32_t>>& matches)
+                : a_(a), b_(b), matches_(matches) {}
+
+            void run() {
+                // Like xdiff: searches costlier than ~sqrt(N + M) steps give up
+                // on the optimum and split at the furthest path found so far
+                maxCost_ = std::max<std::ptrdiff_t>(MIN_COST_LIMIT, static_cast<std::ptrdiff_t>(
+                                                                        std::sqrt(double(a_.size() + b_.size()))));
+                diff(0, a_.size(), 0, b_.size());
+            }
+
+        private:
+            void match(std::size_t x, std::size_t y) {
+                matches_.emplace_back(static_cast<uint32_t>(x), static_cast<uint32_t>(y));
+            }
+
+            void diff(std::size_t aLo, std::size_t aHi, std::size_t bLo, std::size_t bHi) {
+                // 1. Common prefix and suffix are matches without any search
+                while (aLo < aHi && bLo < bHi && a_[aLo] == b_[bLo]) {
+                    match(aLo++, bLo++);
+                }
+                std::size_t aEnd = aHi;
+                while (aHi > aLo && bHi > bLo && a_[aHi - 1] == b_[bHi - 1]) {
+                    --aHi;
+                    --bHi;
+                }
+
+                // 2. Split the rest at the middle snake and solve both halves
+                std::size_t x, y;
+                if (aLo < aHi && bLo < bHi && bisect(aLo, aHi, bLo, bHi, x, y)) {
+                    diff(aLo, x, bLo, y);
+                    diff(x, aHi, y, bHi);
+                }
+
+                for (; aHi < aEnd; ++aHi, ++bHi) {
+                    match(aHi, bHi);
+                }
+            }
+
+            /**
+             * @brief Runs the forward and the backward search for the
+             * shortest edit script at the same time until they overlap;
+             * the overlap is on an optimal path and splits the problem.
+             * Past maxCost_ steps the furthest forward path is taken as
+             * the split instead: the result is still a correct diff, just
+             * possibly not the shortest.
+             * @return false if no split was found (nothing in common).
+             */
+            bool bisect(std::size_t aLo, std::size_t aHi, std::size_t bLo, std::size_t bHi, std::size_t& xMid,
+                        std::size_t& yMid) {
+                const std::ptrdiff_t n = static_cast<std::ptrdiff_t>(aHi - aLo);
+                const std::ptrdiff_t m = static_cast<std::ptrdiff_t>(bHi - bLo);
+                const std::ptrdiff_t maxD = (n + m + 1) / 2;
+                const std::ptrdiff_t offset = maxD;
+                const std::ptrdiff_t length = 2 * maxD + 2;
+                forward_.assign(static_cast<std::size_t>(length), -1);
+                backward_.assign(static_cast<std::size_t>(length), -1);
+                forward_[offset + 1] = 0;
+                backward_[offset + 1] = 0;
+                const std::ptrdiff_t delta = n - m;
+                const bool front = delta % 2 != 0; // which search detects the overlap
+                const uint32_t* a = a_.data() + aLo;
+                const uint32_t* b = b_.data() + bLo;
+
+                // Diagonals that left the grid are not extended again
+                std::ptrdiff_t k1start = 0, k1end = 0, k2start = 0, k2end = 0;
+                for (std::ptrdiff_t d = 0; d < maxD; ++d) {
+                    std::ptrdiff_t bestX = -1, bestY = -1; // furthest forward point of this round
+                    // Forward: furthest reaching path on each diagonal k = x - y
+                    for (std::ptrdiff_t k1 = -d + k1start; k1 <= d - k1end; k1 += 2) {
+                        std::ptrdiff_t k1offset = offset + k1;
+                        std::ptrdiff_t x1 = (k1 == -d || (k1 != d && forward_[k1offset - 1] < forward_[k1offset + 1]))
+                                                ? forward_[k1offset + 1]
+                                                : forward_[k1offset - 1] + 1;
+                        std::ptrdiff_t y1 = x1 - k1;
+                        while (x1 < n && y1 < m && a[x1] == b[y1]) {
+                            ++x1;
+                            ++y1;
+                        }
+                        forward_[k1offset] = x1;
+                        if (x1 <= n && y1 <= m && x1 + y1 > bestX + bestY) {
+                            bestX = x1;
+                            bestY = y1;
+                        }
+                        if (x1 > n) {
+                            k1end += 2;
+                        } else if (y1 > m) {
+                            k1start += 2;
+                        } else if (front) {
+                            std::ptrdiff_t k2offset = offset + delta - k1;
+                            if (k2offset >= 0 && k2offset < length && backward_[k2offset] != -1 &&
+                                x1 >= n - backward_[k2offset]) {
+                                xMid = aLo + static_cast<std::size_t>(x1);
+                                yMid = bLo + static_cast<std::size_t>(y1);
+                                return true;
+                            }
+                        }
+                    }
+                    if (d >= maxCost_ && bestX + bestY > 0 && (bestX < n || bestY < m)) {
+                        xMid = aLo + static_cast<std::size_t>(bestX);
+                        yMid = bLo + static_cast<std::size_t>(bestY);
+                        return true;
+                    }
+
+                    // Backward: the same from the bottom right corner
+                    for (std::ptrdiff_t k2 = -d + k2start; k2 <= d - k2end; k2 += 2) {
+                        std::ptrdiff_t k2offset = offset + k2;
+                        std::ptrdiff_t x2 = (k2 == -d || (k2 != d && backward_[k2offset - 1] < backward_[k2offset + 1]))
+                                                ? backward_[k2offset + 1]
+                                                : backward_[k2offset - 1] + 1;
+                        std::ptrdiff_t y2 = x2 - k2;
+                        while (x2 < n && y2 < m && a[n - x2 - 1] == b[m - y2 - 1]) {
+                            ++x2;
+                            ++y2;
+                        }
+                        backward_[k2offset] = x2;
+                        if (x2 > n) {
+                            k2end += 2;
+                        } else if (y2 > m) {
+                            k2start += 2;
+                        } else if (!front) {
+                            std::ptrdiff_t k1offset = offset + delta - k2;
+                            if (k1offset >= 0 && k1offset < length && forward_[k1offset] != -1) {
+                                std::ptrdiff_t x1 = forward_[k1offset];
+                                std::ptrdiff_t y1 = x1 - (k1offset - offset);
+                                if (x1 >= n - x2) {
+                                    xMid = aLo + static_cast<std::size_t>(x1);
+                                    yMid = bLo + static_cast<std::size_t>(y1);
+                                    return true;
+                                }
+                            }
+                        }
+                    }
+                }
+                return false;
+            }
+
+            const std::vector<uint32_t>& a_;
+            const std::vector<uint32_t>& b_;
+            std::vector<std::pair<uint32_t, uint32_t>>& matches_;
+            std::vector<std::ptrdiff_t> forward_;  // reused by every bisect
+            std::vector<std::ptrdiff_t> backward_;
+            std::ptrdiff_t maxCost_ = 0;
+        };
+
+        void appendLine(std::string& out, char marker, std::string_view line) {
+            out += marker;
+            out.append(line.data(), line.size());
+            if (line.empty() || line.back() != '\n') {
+                out += "\n\\ No newline at end of file\n";
+            }
+        }
+
+        // The "start,length" of a hunk side (an empty side names the line before it)
+        std::string hunkRange(std::size_t start, std::size_t length) {
+            return std::to_string(length == 0 ? start : start + 1) + "," + std::to_string(length);
+        }
+
+    } // namespace
+
+    std::vector<std::string_view> splitLines(std::string_view text) {
+        std::vector<std::string_view> lines;
+        const char* data = text.data();
+        const std::size_t size = text.size();
+        std::size_t start = 0;
+        std::size_t i = 0;
+
+#ifdef MINIGIT_DIFF_SSE2
+        // DSA: SIMD SCAN. Compare 16 bytes with '\n' at once; each set
+        // bit of the mask is a line end.
+        const __m128i newline = _mm_set1_epi8('\n');
+        for (; i + 16 <= size; i += 16) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)));
+            while (mask != 0) {
+                std::size_t end = i + countTrailingZeros(mask) + 1;
+                lines.emplace_back(data + start, end - start);
+                start = end;
+                mask &= mask - 1; // clear the lowest set bit
+            }
+        }
+#endif
+        // The tail (or everything, without SSE2); memchr is vectorized too
+        while (i < size) {
+            const void* found = std::memchr(data + i, '\n', size - i);
+            if (found == nullptr) {
+                break;
+            }
+            std::size_t end = static_cast<std::size_t>(static_cast<const char*>(found) - data) + 1;
+            lines.emplace_back(data + start, end - start);
+            start = i = end;
+        }
+        if (start < size) {
+            lines.emplace_back(data + start, size - start);
+        }
+        return lines;
+    }
+
+    std::vector<std::pair<uint32_t, uint32_t>> diffLines(const std::vector<std::string_view>& oldLines,
+                                                         const std::vector<std::string_view>& newLines) {
+        // 1. DSA: HASHING. Intern every distinct line as a small integer
+        std::unordered_map<std::string_view, uint32_t, LineHasher> ids;
+        ids.reserve(oldLines.size() + newLines.size());
+        std::vector<uint32_t> oldIds(oldLines.size());
+        std::vector<uint32_t> newIds(newLines.size());
+        std::vector<uint8_t> sides; // per id: bit 0 = in the old text, bit 1 = in the new one
+        auto intern = [&](std::string_view line, uint8_t side) {
+            auto inserted = ids.emplace(line, static_cast<uint32_t>(sides.size()));
+            if (inserted.second) {
+                sides.push_back(0);
+            }
+            sides[inserted.first->second] |= side;
+            return inserted.first->second;
+        };
+        for (std::size_t i = 0; i < oldLines.size(); ++i) {
+            oldIds[i] = intern(oldLines[i], 1);
+        }
+        for (std::size_t i = 0; i < newLines.size(); ++i) {
+            newIds[i] = intern(newLines[i], 2);
+        }
+
+        // 2. A line found on one side only is an insertion or a deletion
+        // whatever the diff decides, so only the others are searched
+        std::vector<uint32_t> a, b;
+        std::vector<uint32_t> aLine, bLine; // positions in the full lists
+        for (std::size_t i = 0; i < oldIds.size(); ++i) {
+            if (sides[oldIds[i]] == 3) {
+                a.push_back(oldIds[i]);
+                aLine.push_back(static_cast<uint32_t>(i));
+            }
+        }
+        for (std::size_t i = 0; i < newIds.size(); ++i) {
+            if (sides[newIds[i]] == 3) {
+                b.push_back(newIds[i]);
+                bLine.push_back(static_cast<uint32_t>(i));
+            }
+        }
+
+        // 3. Diff what is left and map the matches back
+        std::vector<std::pair<uint32_t, uint32_t>> matches;
+        MyersDiff(a, b, matches).run();
+        for (auto& matchPair : matches) {
+            matchPair.first = aLine[matchPair.first];
+            matchPair.second = bLine[matchPair.second];
+        }
+        return matches;
+    }
+
+    void appendUnifiedDiff(std::string& out, std::string_view oldText, std::string_view newText, unsigned context) {
+        std::vector<std::string_view> oldLines = splitLines(oldText);
+        std::vector<std::string_view> newLines = splitLines(newText);
+        std::vector<std::pair<uint32_t, uint32_t>> matches = diffLines(oldLines, newLines);
+
+        // 1. The changed blocks: the gaps between consecutive matches
+        struct Block {
+            std::size_t oldStart, oldEnd, newStart, newEnd;
+        };
+        std::vector<Block> blocks;
+        std::size_t oldNext = 0;
+        std::size_t newNext = 0;
+        matches.emplace_back(static_cast<uint32_t>(oldLines.size()), static_cast<uint32_t>(newLines.size()));
+        for (const auto& matchPair : matches) {
+            if (matchPair.first > oldNext || matchPair.second > newNext) {
+                blocks.push_back(Block{oldNext, matchPair.first, newNext, matchPair.second});
+            }
+            oldNext = matchPair.first + 1;
+            newNext = matchPair.second + 1;
+        }
+
+        // 2. Blocks closer than twice the context share one hunk
+        for (std::size_t first = 0; first < blocks.size();) {
+            std::size_t last = first;
+            while (last + 1 < blocks.size() && blocks[last + 1].oldStart - blocks[last].oldEnd <= 2 * context) {
+                ++last;
+            }
+            std::size_t oldStart = blocks[first].oldStart - std::min<std::size_t>(context, blocks[first].oldStart);
+            std::size_t newStart = blocks[first].newStart - (blocks[first].oldStart - oldStart);
+            std::size_t trailing = std::min<std::size_t>(context, oldLines.size() - blocks[last].oldEnd);
+            std::size_t oldEnd = blocks[last].oldEnd + trailing;
+            std::size_t newEnd = blocks[last].newEnd + trailing;
+
+            out += "@@ -" + hunkRange(oldStart, oldEnd - oldStart) + " +" + hunkRange(newStart, newEnd - newStart) +
+                   " @@\n";
+            std::size_t line = oldStart;
+            for (std::size_t k = first; k <= last; ++k) {
+                for (; line < blocks[k].oldStart; ++line) {
+                    appendLine(out, ' ', oldLines[line]);
+                }
+                for (std::size_t i = blocks[k].oldStart; i < blocks[k].oldEnd; ++i) {
+                    appendLine(out, '-', oldLines[i]);
+                }
+                for (std::size_t i = blocks[k].newStart; i < blocks[k].newEnd; ++i) {
+                    appendLine(out, '+', newLines[i]);
+                }
+                line = blocks[k].oldEnd;
+            }
+            for (; line < oldEnd; ++line) {
+                appendLine(out, ' ', oldLines[line]);
+            }
+            first = last + 1;
+        }
+    }
+
+    void appendFileDiff(std::string& out, const std::string& path, std::string_view oldText, bool oldExists,
+                        std::string_view newText, bool newExists) {
+        std::string oldName = oldExists ? "a/" + path : "/dev/null";
+        std::string newName = newExists ? "b/" + path : "/dev/null";
+        out += "diff --minigit a/" + path + " b/" + path + "\n";
+        if (!oldExists) {
+            out += "new file\n";
+        } else if (!newExists) {
+            out += "deleted file\n";
+        }
+        if (isBinary(oldText) || isBinary(newText)) {
+            out += "Binary files " + oldName + " and " + newName + " differ\n";
+            return;
+        }
+        out += "--- " + oldName + "\n";
+        out += "+++ " + newName + "\n";
+        appendUnifiedDiff(out, oldText, newText);
+    }
+
+    bool mergeText(std::string& out, std::string_view base, std::string_view ours, std::string_view theirs,
+                   const std::string& oursLabel, const std::string& theirsLabel) {
+        out.clear();
+        if (isBinary(base) || isBinary(ours) || isBinary(theirs)) {
+            return false;
+        }
+        std::vector<std::string_view> baseLines = splitLines(base);
+        std::vector<std::string_view> ourLines = splitLines(ours);
+        std::vector<std::string_view> theirLines = splitLines(theirs);
+
+        // 1. Where each base line went on either side (NONE: changed)
+        const uint32_t NONE = 0xFFFFFFFFu;
+        std::vector<uint32_t> toOurs(baseLines.size(), NONE);
+        std::vector<uint32_t> toTheirs(baseLines.size(), NONE);
+        for (const auto& matchPair : diffLines(baseLines, ourLines)) {
+            toOurs[matchPair.first] = matchPair.second;
+        }
+        for (const auto& matchPair : diffLines(baseLines, theirLines)) {
+            toTheirs[matchPair.first] = matchPair.second;
+        }
+
+        auto sameLines = [](const std::vector<std::string_view>& x, std::size_t xFrom, std::size_t xTo,
+                            const std::vector<std::string_view>& y, std::size_t yFrom, std::size_t yTo) {
+            return xTo - xFrom == yTo - yFrom && std::equal(x.begin() + xFrom, x.begin() + xTo, y.begin() + yFrom);
+        };
+        auto append = [&](const std::vector<std::string_view>& lines, std::size_t from, std::size_t to) {
+            for (std::size_t k = from; k < to; ++k) {
+                out.append(lines[k].data(), lines[k].size());
+            }
+        };
+        auto endLine = [&]() {
+            if (!out.empty() && out.back() != '\n') {
+                out.push_back('\n'); // a marker must start on its own line
+            }
+        };
+
+        // 2. Walk the three texts in step. Base lines kept by both sides
+        // are stable; between two stable lines, a chunk changed on one
+        // side only takes that side, and one changed on both is a conflict.
+        bool clean = true;
+        std::size_t i = 0, a = 0, b = 0;
+        while (true) {
+            std::size_t k = i;
+            while (k < baseLines.size() && (toOurs[k] == NONE || toTheirs[k] == NONE)) {
+                ++k;
+            }
+            std::size_t aEnd = k < baseLines.size() ? toOurs[k] : ourLines.size();
+            std::size_t bEnd = k < baseLines.size() ? toTheirs[k] : theirLines.size();
+
+            if (k == i && aEnd == a && bEnd == b) {
+                if (k == baseLines.size()) {
+                    break;
+                }
+                out.append(baseLines[k].data(), baseLines[k].size());
+                i = k + 1;
+                a = aEnd + 1;
+                b = bEnd + 1;
+                continue;
+            }
+
+            if (sameLines(baseLines, i, k, ourLines, a, aEnd)) {
+                append(theirLines, b, bEnd);
+            } else if (sameLines(baseLines, i, k, theirLines, b, bEnd) ||
+                       sameLines(ourLines, a, aEnd, theirLines, b, bEnd)) {
+                append(ourLines, a, aEnd);
+            } else {
+                endLine();
+                out += "<<<<<<< " + oursLabel + "\n";
+                append(ourLines, a, aEnd);
+                endLine();
+                out += "=======\n";
+                append(theirLines, b, bEnd);
+                endLine();
+                out += ">>>>>>> " + theirsLabel + "\n";
+                clean = false;
+            }
+            i = k;
+            a = aEnd;
+            b = bEnd;
+        }
+        return clean;
+    }
+
+} // namespace MiniGit
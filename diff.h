@@ -0,0 +1,71 @@
+/**
+ * diff.h
+ * * Line diffs between two versions of a file, in unified format.
+ *
+ * Both texts are split into lines (16 bytes at a time with SSE2) and
+ * every distinct line is given a small integer id, so the diff itself
+ * compares integers, never strings. Lines that only occur on one side
+ * cannot be part of a match and are set aside before the diff runs,
+ * which keeps Myers' algorithm close to linear on typical edits. The
+ * same line matching drives the three-way merge of 'minigit merge'.
+ */
+
+#ifndef MINIGIT_DIFF_H
+#define MINIGIT_DIFF_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace MiniGit {
+
+    /**
+     * @brief Splits a text into lines, each including its '\n' (the last
+     * one may have none).
+     */
+    std::vector<std::string_view> splitLines(std::string_view text);
+
+    /**
+     * @brief Finds a longest common subsequence of two line lists.
+     * DSA: MYERS' O(ND) DIFF, in its linear-space form: the "middle
+     * snake" of the edit graph splits the problem in two halves.
+     * @return The matching (old line, new line) pairs, in order.
+     */
+    std::vector<std::pair<uint32_t, uint32_t>> diffLines(const std::vector<std::string_view>& oldLines,
+                                                         const std::vector<std::string_view>& newLines);
+
+    /**
+     * @brief Appends the hunks ("@@ -a,b +c,d @@" and their lines) of a
+     * unified diff between two texts.
+     * @param context Unchanged lines shown around each change.
+     */
+    void appendUnifiedDiff(std::string& out, std::string_view oldText, std::string_view newText,
+                           unsigned context = 3);
+
+    /**
+     * @brief Appends the complete diff of one file: the header lines and
+     * the hunks, or a one-line note for binary content.
+     * @param oldExists False for a file that was added.
+     * @param newExists False for a file that was deleted.
+     */
+    void appendFileDiff(std::string& out, const std::string& path, std::string_view oldText, bool oldExists,
+                        std::string_view newText, bool newExists);
+
+    /**
+     * @brief Three-way merge of two versions of a text with their common
+     * ancestor (diff3). Changes made on one side only are taken; where
+     * both sides changed the same lines differently, both versions are
+     * kept between conflict markers.
+     * @param out Receives the merged text (empty for binary content).
+     * @param oursLabel, theirsLabel Names shown on the conflict markers.
+     * @return false if there were conflicts, or the content is binary.
+     */
+    bool mergeText(std::string& out, std::string_view base, std::string_view ours, std::string_view theirs,
+                   const std::string& oursLabel, const std::string& theirsLabel);
+
+} // namespace MiniGit
+
+#endif // MINIGIT_DIFF_H
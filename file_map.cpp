@@ -0,0 +1,64 @@
+/**
+ * file_map.cpp
+ * * The flat, arena-backed file list.
+ */
+
+#include "file_map.h"
+#include <algorithm>
+#include <limits>
+
+namespace MiniGit {
+
+    void FileMap::reserve(std::size_t files, std::size_t pathBytes) {
+        slots_.reserve(files);
+        arena_.reserve(pathBytes);
+    }
+
+    void FileMap::add(std::string_view path, const ObjectId& hash) {
+        if (arena_.size() + path.size() > std::numeric_limits<uint32_t>::max()) {
+            throw std::runtime_error("Too many files in one file list");
+        }
+        if (sorted_ && !slots_.empty() && path <= this->path(slots_.back())) {
+            sorted_ = false;
+        }
+        slots_.push_back(Slot{static_cast<uint32_t>(arena_.size()), static_cast<uint32_t>(path.size()), hash});
+        arena_.append(path.data(), path.size());
+    }
+
+    void FileMap::normalize() {
+        if (sorted_) {
+            return;
+        }
+
+        // Stable, so that among equal paths the last one added stays last
+        std::stable_sort(slots_.begin(), slots_.end(),
+                         [this](const Slot& a, const Slot& b) { return path(a) < path(b); });
+        std::size_t kept = 0;
+        for (std::size_t i = 0; i < slots_.size(); ++i) {
+            if (i + 1 < slots_.size() && path(slots_[i]) == path(slots_[i + 1])) {
+                continue; // replaced by a later entry
+            }
+            slots_[kept++] = slots_[i];
+        }
+        slots_.resize(kept);
+        sorted_ = true;
+    }
+
+    bool FileMap::find(std::string_view target, ObjectId& hash) const {
+        // DSA: BINARY SEARCH over the sorted records
+        auto it = std::lower_bound(slots_.begin(), slots_.end(), target,
+                                   [this](const Slot& slot, std::string_view t) { return path(slot) < t; });
+        if (it == slots_.end() || path(*it) != target) {
+            return false;
+        }
+        hash = it->hash;
+        return true;
+    }
+
+    void FileMap::clear() {
+        arena_.clear();
+        slots_.clear();
+        sorted_ = true;
+    }
+
+} // namespace MiniGit
@@ -0,0 +1,116 @@
+/**
+ * file_map.h
+ * * A flat file list (path -> blob id), as held by a commit or the
+ * staging area.
+ *
+ * All paths live back to back in one arena string, and each entry is a
+ * fixed-size record (path offset and length, binary id), kept in one
+ * vector sorted by path. Filling a map costs a few reallocations instead
+ * of two heap allocations and a tree node per file, lookups are binary
+ * searches over contiguous memory, and the map is moved, not copied,
+ * out of the functions that build it.
+ */
+
+#ifndef MINIGIT_FILE_MAP_H
+#define MINIGIT_FILE_MAP_H
+
+#include "binary_format.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace MiniGit {
+
+    class FileMap {
+    public:
+        struct Entry {
+            std::string_view path; // points into the map; valid until it changes
+            ObjectId hash;
+        };
+
+        class const_iterator {
+        public:
+            struct Pointer {
+                Entry entry;
+                const Entry* operator->() const { return &entry; }
+            };
+
+            const_iterator(const FileMap* map, std::size_t position) : map_(map), position_(position) {}
+
+            Entry operator*() const { return (*map_)[position_]; }
+            Pointer operator->() const { return Pointer{(*map_)[position_]}; }
+            const_iterator& operator++() {
+                ++position_;
+                return *this;
+            }
+            bool operator==(const const_iterator& other) const { return position_ == other.position_; }
+            bool operator!=(const const_iterator& other) const { return position_ != other.position_; }
+
+        private:
+            const FileMap* map_;
+            std::size_t position_;
+        };
+
+        FileMap() = default;
+        FileMap(FileMap&&) noexcept = default;
+        FileMap& operator=(FileMap&&) noexcept = default;
+        FileMap(const FileMap&) = default;
+        FileMap& operator=(const FileMap&) = default;
+
+        /**
+         * @brief Reserves room for 'files' entries and 'pathBytes' of paths.
+         */
+        void reserve(std::size_t files, std::size_t pathBytes);
+
+        /**
+         * @brief Adds a file. Adding in path order keeps the map sorted;
+         * otherwise call normalize() before looking anything up.
+         * If a path is added twice, the later id wins.
+         */
+        void add(std::string_view path, const ObjectId& hash);
+
+        /**
+         * @brief Sorts the entries by path (byte order) and drops all but
+         * the last id added for each path. A no-op if already sorted.
+         */
+        void normalize();
+
+        /**
+         * @brief Looks a path up (the map must be normalized).
+         * @return false if the path is not in the map.
+         */
+        bool find(std::string_view path, ObjectId& hash) const;
+
+        std::size_t size() const { return slots_.size(); }
+        bool empty() const { return slots_.empty(); }
+        void clear();
+
+        Entry operator[](std::size_t i) const {
+            const Slot& slot = slots_[i];
+            return Entry{std::string_view(arena_.data() + slot.offset, slot.length), slot.hash};
+        }
+
+        const_iterator begin() const { return const_iterator(this, 0); }
+        const_iterator end() const { return const_iterator(this, slots_.size()); }
+
+    private:
+        struct Slot {
+            uint32_t offset;
+            uint32_t length;
+            ObjectId hash;
+        };
+
+        std::string_view path(const Slot& slot) const {
+            return std::string_view(arena_.data() + slot.offset, slot.length);
+        }
+
+        std::string arena_; // all paths, concatenated
+        std::vector<Slot> slots_;
+        bool sorted_ = true; // sorted by path, no duplicates
+    };
+
+} // namespace MiniGit
+
+#endif // MINIGIT_FILE_MAP_H
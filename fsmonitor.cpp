@@ -0,0 +1,544 @@
+/**
+ * fsmonitor.cpp
+ * * The inotify-based filesystem monitor daemon and its client.
+ */
+
+#include "fsmonitor.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace MiniGit {
+
+#ifdef __linux__
+    namespace {
+        const uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE |
+                                    IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF |
+                                    IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+        const std::size_t MAX_JOURNAL = 1 << 20; // paths kept before old tokens are given up
+        const int COOKIE_TIMEOUT_MS = 5000;
+        const char COOKIE_PREFIX[] = "fsmonitor-cookie-";
+
+        sockaddr_un socketAddress() {
+            sockaddr_un address = {};
+            address.sun_family = AF_UNIX;
+            std::string path = rootPath(FSMONITOR_SOCKET).string();
+            if (path.size() >= sizeof(address.sun_path)) {
+                throw std::runtime_error("fsmonitor socket path too long: " + path);
+            }
+            std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+            return address;
+        }
+
+        // A connection to the daemon, or -1 if none is listening
+        int connectToDaemon() {
+            if (rootPath(FSMONITOR_SOCKET).string().size() >= sizeof(sockaddr_un::sun_path)) {
+                return -1; // a root too deep for a socket address: no daemon can listen there
+            }
+            int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd < 0) {
+                return -1;
+            }
+            sockaddr_un address = socketAddress();
+            if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+                close(fd);
+                return -1;
+            }
+            timeval timeout = {10, 0}; // a stuck daemon must not hang the command
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            return fd;
+        }
+
+        bool sendAll(int fd, std::string_view data) {
+            while (!data.empty()) {
+                ssize_t n = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    return false;
+                }
+                data.remove_prefix(static_cast<std::size_t>(n));
+            }
+            return true;
+        }
+
+        // Reads until the peer closes the connection
+        bool receiveAll(int fd, std::string& out) {
+            char buffer[64 * 1024];
+            while (true) {
+                ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n < 0) {
+                    return false;
+                }
+                if (n == 0) {
+                    return true;
+                }
+                out.append(buffer, static_cast<std::size_t>(n));
+            }
+        }
+
+        uint64_t newEpoch() {
+            uint64_t now = static_cast<uint64_t>(std::chrono::system_clock::now().time_since_epoch().count());
+            return (now ^ (static_cast<uint64_t>(getpid()) << 40)) | 1; // never 0 ("no token")
+        }
+
+        class Monitor {
+        public:
+            Monitor() = default;
+            Monitor(const Monitor&) = delete;
+            Monitor& operator=(const Monitor&) = delete;
+
+            ~Monitor() {
+                if (listener_ >= 0) {
+                    close(listener_);
+                    unlink(FSMONITOR_SOCKET.c_str());
+                }
+                if (inotify_ >= 0) {
+                    close(inotify_);
+                }
+            }
+
+            /**
+             * @brief Watches the whole working tree and opens the socket.
+             * @throws std::runtime_error if any of it fails.
+             */
+            void setup() {
+                epoch_ = newEpoch();
+                inotify_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+                if (inotify_ < 0) {
+                    throw std::runtime_error(std::string("inotify_init1 failed: ") + std::strerror(errno));
+                }
+                // .minigit itself is only watched for cookies (and its removal)
+                gitDirWatch_ = inotify_add_watch(inotify_, GIT_DIR.c_str(),
+                                                 IN_CREATE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+                if (gitDirWatch_ < 0) {
+                    throw std::runtime_error(std::string("Cannot watch .minigit: ") + std::strerror(errno));
+                }
+                watchTree("", false);
+
+                listener_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+                if (listener_ < 0) {
+                    throw std::runtime_error(std::string("socket failed: ") + std::strerror(errno));
+                }
+                unlink(FSMONITOR_SOCKET.c_str()); // left behind by a daemon that was killed
+                sockaddr_un address = socketAddress();
+                if (bind(listener_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+                    listen(listener_, 16) != 0) {
+                    throw std::runtime_error("Cannot listen on " + FSMONITOR_SOCKET.string() + ": " +
+                                             std::strerror(errno));
+                }
+            }
+
+            /**
+             * @brief Serves events and requests until asked to quit or
+             * the repository disappears.
+             */
+            void run() {
+                while (!stopping_) {
+                    pollfd fds[2] = {{inotify_, POLLIN, 0}, {listener_, POLLIN, 0}};
+                    if (poll(fds, 2, -1) < 0) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+                        throw std::runtime_error(std::string("poll failed: ") + std::strerror(errno));
+                    }
+                    if (fds[0].revents & POLLIN) {
+                        readEvents(0, nullptr);
+                    }
+                    if (fds[1].revents & POLLIN) {
+                        int client = accept4(listener_, nullptr, nullptr, SOCK_CLOEXEC);
+                        if (client >= 0) {
+                            answer(client);
+                            close(client);
+                        }
+                    }
+                }
+            }
+
+        private:
+            /**
+             * @brief Adds watches for a directory and everything below it.
+             * @param journalContents Also record every path found, for a
+             * directory that appeared while the daemon was running (its
+             * files may have been written before the watch existed).
+             */
+            void watchTree(const std::string& root, bool journalContents) {
+                // DSA: DEPTH-FIRST WALK with an explicit stack
+                std::vector<std::string> pending{root};
+                while (!pending.empty()) {
+                    std::string directory = std::move(pending.back());
+                    pending.pop_back();
+
+                    int wd = inotify_add_watch(inotify_, directory.empty() ? "." : directory.c_str(), WATCH_MASK);
+                    if (wd < 0) {
+                        if (errno == ENOSPC || errno == ENOMEM) {
+                            throw std::runtime_error("Too many directories to watch (raise "
+                                                     "/proc/sys/fs/inotify/max_user_watches)");
+                        }
+                        continue; // removed meanwhile, or not a directory after all
+                    }
+                    directories_[wd] = directory;
+                    watches_[directory] = wd;
+
+                    std::error_code error;
+                    fs::directory_iterator it(directory.empty() ? fs::path(".") : fs::path(directory), error);
+                    for (; !error && it != fs::directory_iterator(); it.increment(error)) {
+                        std::string name = it->path().filename().string();
+                        if (directory.empty() && name == GIT_DIR.string()) {
+                            continue;
+                        }
+                        std::string path = directory.empty() ? name : directory + "/" + name;
+                        if (journalContents) {
+                            record(path);
+                        }
+                        std::error_code typeError;
+                        if (!it->is_symlink(typeError) && it->is_directory(typeError)) {
+                            pending.push_back(std::move(path));
+                        }
+                    }
+                }
+            }
+
+            // Drops the watches of a directory that was moved away or removed
+            void unwatchTree(const std::string& directory) {
+                std::string prefix = directory + "/";
+                for (auto it = watches_.begin(); it != watches_.end();) {
+                    if (it->first == directory || it->first.compare(0, prefix.size(), prefix) == 0) {
+                        inotify_rm_watch(inotify_, it->second);
+                        directories_.erase(it->second);
+                        it = watches_.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+            }
+
+            void record(const std::string& path) {
+                if (!journal_.empty() && journal_.back() == path) {
+                    return; // the common case of many writes to one file
+                }
+                if (journal_.size() >= MAX_JOURNAL) {
+                    base_ += journal_.size(); // tokens before this now get "everything"
+                    journal_.clear();
+                }
+                journal_.push_back(path);
+            }
+
+            // Events were lost: no old token can be answered any more
+            void resetJournal() {
+                epoch_ = newEpoch();
+                base_ = 0;
+                journal_.clear();
+            }
+
+            /**
+             * @brief Reads and records the queued events.
+             * @param timeoutMs How long to wait for the first event.
+             * @param cookie If not null, the cookie file name to look for.
+             * @return true if the cookie's event was seen.
+             */
+            bool readEvents(int timeoutMs, const std::string* cookie) {
+                pollfd fd = {inotify_, POLLIN, 0};
+                if (poll(&fd, 1, timeoutMs) <= 0) {
+                    return false;
+                }
+
+                bool cookieSeen = false;
+                alignas(inotify_event) char buffer[64 * 1024];
+                while (true) {
+                    ssize_t n = read(inotify_, buffer, sizeof(buffer));
+                    if (n <= 0) {
+                        break; // EAGAIN: drained
+                    }
+                    for (char* p = buffer; p < buffer + n;) {
+                        const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+                        p += sizeof(inotify_event) + event->len;
+                        std::string name = event->len > 0 ? std::string(event->name) : std::string();
+
+                        if (event->mask & IN_Q_OVERFLOW) {
+                            resetJournal();
+                            continue;
+                        }
+                        if (event->wd == gitDirWatch_) {
+                            if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                                stopping_ = true; // the repository is gone
+                            }
+                            if (cookie != nullptr && name == *cookie) {
+                                cookieSeen = true;
+                            }
+                            continue;
+                        }
+
+                        auto it = directories_.find(event->wd);
+                        if (it == directories_.end()) {
+                            continue; // a watch that was just dropped
+                        }
+                        std::string directory = it->second;
+                        if (event->mask & IN_IGNORED) {
+                            watches_.erase(directory);
+                            directories_.erase(it);
+                            continue;
+                        }
+                        if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                            if (directory.empty()) {
+                                stopping_ = true; // the working tree itself is gone
+                            } else {
+                                record(directory);
+                            }
+                            continue;
+                        }
+                        if (directory.empty() && name == GIT_DIR.string()) {
+                            continue;
+                        }
+
+                        std::string path = directory.empty() ? name : directory + "/" + name;
+                        record(path);
+                        if (event->mask & IN_ISDIR) {
+                            if (event->mask & (IN_MOVED_FROM | IN_DELETE)) {
+                                unwatchTree(path);
+                            } else if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                                watchTree(path, true);
+                            }
+                        }
+                    }
+                }
+                return cookieSeen;
+            }
+
+            void answer(int client) {
+                timeval timeout = {2, 0};
+                setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                std::string request;
+                char c;
+                while (request.size() < 128 && recv(client, &c, 1, 0) == 1 && c != '\n') {
+                    request += c;
+                }
+                if (request == "quit") {
+                    stopping_ = true;
+                    return;
+                }
+                unsigned long long epoch = 0;
+                unsigned long long sequence = 0;
+                if (std::sscanf(request.c_str(), "query %llu %llu", &epoch, &sequence) != 2) {
+                    return;
+                }
+
+                // 1. Cookie: once its event is read, every change made before
+                // the request has been read too (inotify keeps order)
+                std::string cookie = COOKIE_PREFIX + std::to_string(++cookies_);
+                fs::path cookiePath = GIT_DIR / cookie;
+                bool everything = true;
+                int fd = open(cookiePath.c_str(), O_CREAT | O_WRONLY | O_CLOEXEC, 0600);
+                if (fd >= 0) {
+                    close(fd);
+                    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(COOKIE_TIMEOUT_MS);
+                    while (std::chrono::steady_clock::now() < deadline) {
+                        int left = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                                        deadline - std::chrono::steady_clock::now()).count());
+                        if (readEvents(std::max(left, 1), &cookie)) {
+                            everything = false;
+                            break;
+                        }
+                    }
+                    unlink(cookiePath.c_str());
+                }
+
+                // 2. The paths recorded since the caller's token
+                uint64_t now = base_ + journal_.size();
+                everything = everything || epoch != epoch_ || sequence < base_ || sequence > now;
+                std::string response = std::to_string(epoch_) + " " + std::to_string(now) + " " +
+                                       (everything ? "1" : "0") + "\n";
+                if (!everything) {
+                    std::vector<std::string_view> paths(journal_.begin() + static_cast<std::ptrdiff_t>(sequence - base_),
+                                                        journal_.end());
+                    std::sort(paths.begin(), paths.end());
+                    paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+                    for (const auto& path : paths) {
+                        response.append(path.data(), path.size());
+                        response += '\0';
+                    }
+                }
+                sendAll(client, response);
+            }
+
+            int inotify_ = -1;
+            int listener_ = -1;
+            int gitDirWatch_ = -1;
+            std::unordered_map<int, std::string> directories_; // watch -> directory ("" = root)
+            std::unordered_map<std::string, int> watches_;     // directory -> watch
+            std::vector<std::string> journal_;                 // touched paths, in order
+            uint64_t epoch_ = 0;
+            uint64_t base_ = 0; // sequence number of journal_[0]
+            uint64_t cookies_ = 0;
+            bool stopping_ = false;
+        };
+    } // namespace
+
+    void startFsmonitor() {
+        if (fsmonitorRunning()) {
+            throw std::runtime_error("The filesystem monitor is already running");
+        }
+
+        // The child reports "ok" (or what went wrong) through a pipe once
+        // it is watching, so this command only returns when it is ready
+        int ready[2];
+        if (pipe(ready) != 0) {
+            throw std::runtime_error(std::string("pipe failed: ") + std::strerror(errno));
+        }
+        std::cout.flush();
+        std::cerr.flush();
+        pid_t pid = fork();
+        if (pid < 0) {
+            throw std::runtime_error(std::string("fork failed: ") + std::strerror(errno));
+        }
+        if (pid == 0) {
+            close(ready[0]);
+            setsid();
+            try {
+                Monitor monitor;
+                monitor.setup();
+                ssize_t written = write(ready[1], "ok", 2);
+                (void)written;
+                close(ready[1]);
+                int null = open("/dev/null", O_RDWR);
+                if (null >= 0) {
+                    dup2(null, 0);
+                    dup2(null, 1);
+                    dup2(null, 2);
+                    close(null);
+                }
+                monitor.run();
+            } catch (const std::exception& e) {
+                std::string message = e.what();
+                ssize_t ignored = write(ready[1], message.data(), message.size());
+                (void)ignored;
+            }
+            _exit(0);
+        }
+
+        close(ready[1]);
+        std::string status;
+        char buffer[512];
+        ssize_t n;
+        while ((n = read(ready[0], buffer, sizeof(buffer))) > 0) {
+            status.append(buffer, static_cast<std::size_t>(n));
+        }
+        close(ready[0]);
+        if (status.compare(0, 2, "ok") != 0) {
+            throw std::runtime_error(status.empty() ? "The filesystem monitor failed to start" : status);
+        }
+        std::cout << "Started the filesystem monitor (pid " << pid << ")" << std::endl;
+    }
+
+    void runFsmonitor() {
+        if (fsmonitorRunning()) {
+            throw std::runtime_error("The filesystem monitor is already running");
+        }
+        Monitor monitor;
+        monitor.setup();
+        monitor.run();
+    }
+
+    bool stopFsmonitor() {
+        int fd = connectToDaemon();
+        if (fd < 0) {
+            return false;
+        }
+        sendAll(fd, "quit\n");
+        std::string ignored;
+        receiveAll(fd, ignored); // returns once the daemon has handled it
+        close(fd);
+        return true;
+    }
+
+    bool fsmonitorRunning() {
+        int fd = connectToDaemon();
+        if (fd < 0) {
+            return false;
+        }
+        close(fd);
+        return true;
+    }
+
+    bool queryFsmonitor(const FsmonitorToken& since, FsmonitorToken& now, std::vector<std::string>& changed,
+                        bool& everything) {
+        int fd = connectToDaemon();
+        if (fd < 0) {
+            return false;
+        }
+        std::string response;
+        bool ok = sendAll(fd, "query " + std::to_string(since.epoch) + " " + std::to_string(since.sequence) + "\n") &&
+                  receiveAll(fd, response);
+        close(fd);
+
+        // 1. "<epoch> <sequence> <all>\n"
+        std::size_t newline = response.find('\n');
+        unsigned long long epoch = 0;
+        unsigned long long sequence = 0;
+        int all = 1;
+        if (!ok || newline == std::string::npos ||
+            std::sscanf(response.substr(0, newline).c_str(), "%llu %llu %d", &epoch, &sequence, &all) != 3) {
+            return false; // treat a broken daemon like a missing one
+        }
+        now.epoch = epoch;
+        now.sequence = sequence;
+        everything = all != 0;
+
+        // 2. The paths, '\0'-terminated and already sorted
+        changed.clear();
+        std::size_t start = newline + 1;
+        while (start < response.size()) {
+            std::size_t end = response.find('\0', start);
+            if (end == std::string::npos) {
+                break;
+            }
+            changed.emplace_back(response, start, end - start);
+            start = end + 1;
+        }
+        return true;
+    }
+
+#else
+    void startFsmonitor() {
+        throw std::runtime_error("The filesystem monitor is only supported on Linux");
+    }
+
+    void runFsmonitor() {
+        startFsmonitor();
+    }
+
+    bool stopFsmonitor() {
+        return false;
+    }
+
+    bool fsmonitorRunning() {
+        return false;
+    }
+
+    bool queryFsmonitor(const FsmonitorToken&, FsmonitorToken&, std::vector<std::string>&, bool&) {
+        return false;
+    }
+#endif
+
+} // namespace MiniGit
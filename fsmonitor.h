@@ -0,0 +1,77 @@
+/**
+ * fsmonitor.h
+ * * An optional filesystem monitor daemon ("minigit fsmonitor start").
+ *
+ * The daemon watches every directory of the working tree and appends
+ * each path the kernel reports as touched to an in-memory journal. A
+ * command asks it for the paths touched since the token stored in the
+ * index; files that were unchanged at that token and are not in the
+ * answer are not stat'ed at all. On a huge tree, status then costs a
+ * few system calls per changed file instead of one stat per file.
+ *
+ * Protocol (Unix socket .minigit/fsmonitor.sock, one request per connection):
+ *   request   "query <epoch> <sequence>\n"  or  "quit\n"
+ *   response  "<epoch> <sequence> <all>\n", then the touched paths,
+ *             each terminated by '\0'. <all> is 1 when the daemon cannot
+ *             tell (unknown token, lost events): the caller must check
+ *             everything.
+ * Before answering, the daemon creates a cookie file in .minigit and
+ * waits until its own event comes back, so every change made before
+ * the request is already in the answer.
+ *
+ * Only Linux (inotify) is supported; elsewhere 'start' fails and
+ * queries report that no monitor is running.
+ */
+
+#ifndef MINIGIT_FSMONITOR_H
+#define MINIGIT_FSMONITOR_H
+
+#include "index.h"
+#include "minigit.h"
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace MiniGit {
+
+    const std::filesystem::path FSMONITOR_SOCKET = GIT_DIR / "fsmonitor.sock";
+
+    /**
+     * @brief Starts the daemon in the background for the repository in
+     * the current directory. Returns once it is watching every directory.
+     * @throws std::runtime_error if it is already running, the platform
+     * has no monitor, or the watches could not be set up.
+     */
+    void startFsmonitor();
+
+    /**
+     * @brief Runs the daemon in the foreground until it is stopped.
+     */
+    void runFsmonitor();
+
+    /**
+     * @brief Asks a running daemon to exit.
+     * @return false if none was running.
+     */
+    bool stopFsmonitor();
+
+    /**
+     * @brief Whether a daemon is answering for this repository.
+     */
+    bool fsmonitorRunning();
+
+    /**
+     * @brief Asks the daemon what was touched since a token.
+     * @param since The token from the index.
+     * @param now Receives the daemon's current token.
+     * @param changed Receives the touched paths (files or directories,
+     * relative to the root, sorted, unique).
+     * @param everything Set when the daemon cannot answer for 'since'.
+     * @return false if no daemon is running.
+     */
+    bool queryFsmonitor(const FsmonitorToken& since, FsmonitorToken& now, std::vector<std::string>& changed,
+                        bool& everything);
+
+} // namespace MiniGit
+
+#endif // MINIGIT_FSMONITOR_H
@@ -0,0 +1,354 @@
+/**
+ * hash.cpp
+ * * Implementation of the MiniGit hash engines.
+ * BLAKE3 follows the reference specification: the input is split into
+ * 1024-byte chunks, each chunk is compressed block by block, and the chunk
+ * chaining values are merged into a binary tree whose root is the digest.
+ */
+
+#include "hash.h"
+#include <cstring>
+#include <functional> // For std::hash (legacy engine)
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MINIGIT_BLAKE3_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace MiniGit {
+
+    namespace {
+
+        const uint32_t BLAKE3_IV[8] = {
+            0x6A09E667u, 0xBB67AE85u, 0x3C6EF372u, 0xA54FF53Au,
+            0x510E527Fu, 0x9B05688Cu, 0x1F83D9ABu, 0x5BE0CD19u
+        };
+
+        const uint8_t MSG_SCHEDULE[7][16] = {
+            {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+            {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8},
+            {3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1},
+            {10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6},
+            {12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4},
+            {9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7},
+            {11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13},
+        };
+
+        const uint32_t CHUNK_START = 1u << 0;
+        const uint32_t CHUNK_END = 1u << 1;
+        const uint32_t PARENT = 1u << 2;
+        const uint32_t ROOT = 1u << 3;
+
+        const std::size_t BLOCK_LEN = 64;
+        const std::size_t CHUNK_LEN = 1024;
+
+        inline uint32_t load32(const unsigned char* p) {
+            return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+                   (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+        }
+
+        inline void store32(unsigned char* p, uint32_t w) {
+            p[0] = static_cast<unsigned char>(w);
+            p[1] = static_cast<unsigned char>(w >> 8);
+            p[2] = static_cast<unsigned char>(w >> 16);
+            p[3] = static_cast<unsigned char>(w >> 24);
+        }
+
+        inline void loadBlock(const unsigned char block[64], uint32_t m[16]) {
+            for (int i = 0; i < 16; ++i) {
+                m[i] = load32(block + 4 * i);
+            }
+        }
+
+#ifdef MINIGIT_BLAKE3_SSE2
+        // The 4x4 state is held as four rows, so all four column (and then
+        // all four diagonal) G functions of a round run in parallel lanes.
+        inline __m128i rotr(__m128i x, int n) {
+            return _mm_or_si128(_mm_srli_epi32(x, n), _mm_slli_epi32(x, 32 - n));
+        }
+
+        inline void g4(__m128i& a, __m128i& b, __m128i& c, __m128i& d, __m128i mx, __m128i my) {
+            a = _mm_add_epi32(_mm_add_epi32(a, b), mx);
+            d = rotr(_mm_xor_si128(d, a), 16);
+            c = _mm_add_epi32(c, d);
+            b = rotr(_mm_xor_si128(b, c), 12);
+            a = _mm_add_epi32(_mm_add_epi32(a, b), my);
+            d = rotr(_mm_xor_si128(d, a), 8);
+            c = _mm_add_epi32(c, d);
+            b = rotr(_mm_xor_si128(b, c), 7);
+        }
+
+        void compress(const uint32_t cv[8], const uint32_t m[16], uint64_t counter,
+                      uint32_t blockLength, uint32_t flags, uint32_t out[16]) {
+            __m128i row0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cv));
+            __m128i row1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cv + 4));
+            __m128i row2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(BLAKE3_IV));
+            __m128i row3 = _mm_setr_epi32(static_cast<int>(static_cast<uint32_t>(counter)),
+                                          static_cast<int>(static_cast<uint32_t>(counter >> 32)),
+                                          static_cast<int>(blockLength), static_cast<int>(flags));
+            const __m128i cvLow = row0;
+            const __m128i cvHigh = row1;
+
+            for (int r = 0; r < 7; ++r) {
+                const uint8_t* s = MSG_SCHEDULE[r];
+                auto word = [&](int i) { return static_cast<int>(m[s[i]]); };
+
+                // Columns
+                g4(row0, row1, row2, row3,
+                   _mm_setr_epi32(word(0), word(2), word(4), word(6)),
+                   _mm_setr_epi32(word(1), word(3), word(5), word(7)));
+
+                // Rotate rows so the diagonals line up in the lanes
+                row1 = _mm_shuffle_epi32(row1, _MM_SHUFFLE(0, 3, 2, 1));
+                row2 = _mm_shuffle_epi32(row2, _MM_SHUFFLE(1, 0, 3, 2));
+                row3 = _mm_shuffle_epi32(row3, _MM_SHUFFLE(2, 1, 0, 3));
+
+                // Diagonals
+                g4(row0, row1, row2, row3,
+                   _mm_setr_epi32(word(8), word(10), word(12), word(14)),
+                   _mm_setr_epi32(word(9), word(11), word(13), word(15)));
+
+                row1 = _mm_shuffle_epi32(row1, _MM_SHUFFLE(2, 1, 0, 3));
+                row2 = _mm_shuffle_epi32(row2, _MM_SHUFFLE(1, 0, 3, 2));
+                row3 = _mm_shuffle_epi32(row3, _MM_SHUFFLE(0, 3, 2, 1));
+            }
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_xor_si128(row0, row2));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4), _mm_xor_si128(row1, row3));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8), _mm_xor_si128(row2, cvLow));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 12), _mm_xor_si128(row3, cvHigh));
+        }
+#else
+        inline uint32_t rotr(uint32_t x, int n) {
+            return (x >> n) | (x << (32 - n));
+        }
+
+        inline void g(uint32_t* v, int a, int b, int c, int d, uint32_t mx, uint32_t my) {
+            v[a] = v[a] + v[b] + mx;
+            v[d] = rotr(v[d] ^ v[a], 16);
+            v[c] = v[c] + v[d];
+            v[b] = rotr(v[b] ^ v[c], 12);
+            v[a] = v[a] + v[b] + my;
+            v[d] = rotr(v[d] ^ v[a], 8);
+            v[c] = v[c] + v[d];
+            v[b] = rotr(v[b] ^ v[c], 7);
+        }
+
+        void compress(const uint32_t cv[8], const uint32_t m[16], uint64_t counter,
+                      uint32_t blockLength, uint32_t flags, uint32_t out[16]) {
+            uint32_t v[16] = {
+                cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+                BLAKE3_IV[0], BLAKE3_IV[1], BLAKE3_IV[2], BLAKE3_IV[3],
+                static_cast<uint32_t>(counter), static_cast<uint32_t>(counter >> 32),
+                blockLength, flags
+            };
+            for (int r = 0; r < 7; ++r) {
+                const uint8_t* s = MSG_SCHEDULE[r];
+                g(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+                g(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+                g(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+                g(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+                g(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+                g(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+                g(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+                g(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+            }
+            for (int i = 0; i < 8; ++i) {
+                out[i] = v[i] ^ v[i + 8];
+                out[i + 8] = v[i + 8] ^ cv[i];
+            }
+        }
+#endif
+
+        void parentChainingValue(const uint32_t left[8], const uint32_t right[8], uint32_t flags,
+                                 uint32_t out[8]) {
+            uint32_t m[16];
+            std::memcpy(m, left, 32);
+            std::memcpy(m + 8, right, 32);
+            uint32_t full[16];
+            compress(BLAKE3_IV, m, 0, BLOCK_LEN, flags | PARENT, full);
+            std::memcpy(out, full, 32);
+        }
+
+    } // namespace
+
+    // --- Hasher ---
+
+    std::string Hasher::finalizeHex() {
+        unsigned char digest[64];
+        finalize(digest);
+        return toHex(digest, digestSize());
+    }
+
+    ObjectId Hasher::finalizeId() {
+        ObjectId id;
+        finalize(id.bytes); // every engine but the legacy one fits in 32 bytes
+        id.hexLength = static_cast<uint8_t>(2 * digestSize());
+        return id;
+    }
+
+    // --- BLAKE3 ---
+
+    Blake3Hasher::Blake3Hasher() {
+        resetChunk(0);
+    }
+
+    void Blake3Hasher::resetChunk(uint64_t counter) {
+        std::memcpy(chunk_.cv, BLAKE3_IV, sizeof(chunk_.cv));
+        chunk_.counter = counter;
+        std::memset(chunk_.block, 0, sizeof(chunk_.block));
+        chunk_.blockLength = 0;
+        chunk_.blocksCompressed = 0;
+    }
+
+    std::size_t Blake3Hasher::chunkLength() const {
+        return BLOCK_LEN * chunk_.blocksCompressed + chunk_.blockLength;
+    }
+
+    void Blake3Hasher::addChunkChainingValue(const uint32_t cv[8], uint64_t totalChunks) {
+        // DSA: BINARY TREE
+        // Every trailing zero bit in the chunk count is a completed subtree
+        // on the stack that can now be merged with the new chaining value.
+        uint32_t merged[8];
+        std::memcpy(merged, cv, sizeof(merged));
+        while ((totalChunks & 1) == 0) {
+            --cvStackLength_;
+            parentChainingValue(cvStack_[cvStackLength_], merged, 0, merged);
+            totalChunks >>= 1;
+        }
+        std::memcpy(cvStack_[cvStackLength_], merged, sizeof(merged));
+        ++cvStackLength_;
+    }
+
+    void Blake3Hasher::update(const void* data, std::size_t length) {
+        const unsigned char* input = static_cast<const unsigned char*>(data);
+
+        while (length > 0) {
+            // A full chunk is only finished once more input arrives, because
+            // the last chunk must be compressed with the ROOT flag instead.
+            if (chunkLength() == CHUNK_LEN) {
+                uint32_t m[16];
+                loadBlock(chunk_.block, m);
+                uint32_t out[16];
+                compress(chunk_.cv, m, chunk_.counter, chunk_.blockLength,
+                         CHUNK_END | (chunk_.blocksCompressed == 0 ? CHUNK_START : 0), out);
+                uint64_t totalChunks = chunk_.counter + 1;
+                addChunkChainingValue(out, totalChunks);
+                resetChunk(totalChunks);
+            }
+
+            // Same rule for blocks inside a chunk: compress a full block
+            // only when we know it is not the chunk's final block.
+            if (chunk_.blockLength == BLOCK_LEN) {
+                uint32_t m[16];
+                loadBlock(chunk_.block, m);
+                uint32_t out[16];
+                compress(chunk_.cv, m, chunk_.counter, BLOCK_LEN,
+                         chunk_.blocksCompressed == 0 ? CHUNK_START : 0, out);
+                std::memcpy(chunk_.cv, out, sizeof(chunk_.cv));
+                ++chunk_.blocksCompressed;
+                std::memset(chunk_.block, 0, sizeof(chunk_.block));
+                chunk_.blockLength = 0;
+            }
+
+            std::size_t take = BLOCK_LEN - chunk_.blockLength;
+            if (take > length) {
+                take = length;
+            }
+            std::memcpy(chunk_.block + chunk_.blockLength, input, take);
+            chunk_.blockLength = static_cast<uint8_t>(chunk_.blockLength + take);
+            input += take;
+            length -= take;
+        }
+    }
+
+    void Blake3Hasher::finalize(unsigned char* out) {
+        // Start with the output of the current (last) chunk ...
+        uint32_t inputCv[8];
+        uint32_t m[16];
+        std::memcpy(inputCv, chunk_.cv, sizeof(inputCv));
+        loadBlock(chunk_.block, m);
+        uint64_t counter = chunk_.counter;
+        uint32_t blockLength = chunk_.blockLength;
+        uint32_t flags = CHUNK_END | (chunk_.blocksCompressed == 0 ? CHUNK_START : 0);
+
+        // ... and fold in the pending subtrees from right to left.
+        for (std::size_t remaining = cvStackLength_; remaining > 0; --remaining) {
+            uint32_t full[16];
+            compress(inputCv, m, counter, blockLength, flags, full);
+            std::memcpy(m, cvStack_[remaining - 1], 32);
+            std::memcpy(m + 8, full, 32);
+            std::memcpy(inputCv, BLAKE3_IV, sizeof(inputCv));
+            counter = 0;
+            blockLength = BLOCK_LEN;
+            flags = PARENT;
+        }
+
+        uint32_t root[16];
+        compress(inputCv, m, counter, blockLength, flags | ROOT, root);
+        for (int i = 0; i < 8; ++i) {
+            store32(out + 4 * i, root[i]);
+        }
+    }
+
+    // --- Legacy std::hash ---
+
+    void LegacyHasher::update(const void* data, std::size_t length) {
+        buffer_.append(static_cast<const char*>(data), length);
+    }
+
+    void LegacyHasher::finalize(unsigned char* out) {
+        std::size_t hashVal = std::hash<std::string>{}(buffer_);
+        std::memcpy(out, &hashVal, sizeof(hashVal));
+    }
+
+    std::string LegacyHasher::finalizeHex() {
+        // Same formatting as the original hashString (no zero padding)
+        std::stringstream ss;
+        ss << std::hex << std::hash<std::string>{}(buffer_);
+        return ss.str();
+    }
+
+    ObjectId LegacyHasher::finalizeId() {
+        return ObjectId::fromHex(finalizeHex()); // ids without zero padding
+    }
+
+    // --- Factory ---
+
+    std::unique_ptr<Hasher> makeHasher(HashAlgorithm algorithm) {
+        switch (algorithm) {
+            case HashAlgorithm::Legacy:
+                return std::unique_ptr<Hasher>(new LegacyHasher());
+            case HashAlgorithm::Blake3:
+                break;
+        }
+        return std::unique_ptr<Hasher>(new Blake3Hasher());
+    }
+
+    const char* hashAlgorithmName(HashAlgorithm algorithm) {
+        return algorithm == HashAlgorithm::Legacy ? "std-hash" : "blake3";
+    }
+
+    HashAlgorithm parseHashAlgorithm(const std::string& name) {
+        if (name == "blake3") {
+            return HashAlgorithm::Blake3;
+        }
+        if (name == "std-hash") {
+            return HashAlgorithm::Legacy;
+        }
+        throw std::runtime_error("Unknown hash algorithm: " + name);
+    }
+
+    std::string toHex(const unsigned char* data, std::size_t length) {
+        static const char digits[] = "0123456789abcdef";
+        std::string hex(length * 2, '0');
+        for (std::size_t i = 0; i < length; ++i) {
+            hex[2 * i] = digits[data[i] >> 4];
+            hex[2 * i + 1] = digits[data[i] & 0x0f];
+        }
+        return hex;
+    }
+
+} // namespace MiniGit
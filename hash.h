@@ -0,0 +1,137 @@
+/**
+ * hash.h
+ * * The content hash engine used for MiniGit's content-addressing.
+ * Every object id (blobs, commits, ...) comes from one of these hashers.
+ * The interface is streaming, so large inputs can be hashed piece by piece.
+ */
+
+#ifndef MINIGIT_HASH_H
+#define MINIGIT_HASH_H
+
+#include "object_id.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace MiniGit {
+
+    /**
+     * @brief The hash functions a repository can be configured with.
+     * Legacy is the original 64-bit std::hash scheme. It is only kept so
+     * old repositories can be understood; it differs between standard
+     * libraries and must not be used for new objects.
+     */
+    enum class HashAlgorithm {
+        Legacy,
+        Blake3
+    };
+
+    /**
+     * @brief A streaming hash function: update() any number of times,
+     * then finalize() once to obtain the digest.
+     */
+    class Hasher {
+    public:
+        virtual ~Hasher() = default;
+
+        virtual void update(const void* data, std::size_t length) = 0;
+
+        /**
+         * @brief Writes the digest to 'out', which must hold digestSize() bytes.
+         */
+        virtual void finalize(unsigned char* out) = 0;
+
+        /**
+         * @brief The digest rendered as lowercase hex (the object id).
+         */
+        virtual std::string finalizeHex();
+
+        /**
+         * @brief The digest as an object id.
+         */
+        virtual ObjectId finalizeId();
+
+        virtual std::size_t digestSize() const = 0;
+
+        void update(const std::string& data) { update(data.data(), data.size()); }
+    };
+
+    /**
+     * @brief BLAKE3 with 256-bit output. This is the default engine.
+     * The compression function uses SSE2 when the compiler targets it and
+     * a portable implementation otherwise; both produce the same digests.
+     */
+    class Blake3Hasher : public Hasher {
+    public:
+        Blake3Hasher();
+
+        using Hasher::update;
+        void update(const void* data, std::size_t length) override;
+        void finalize(unsigned char* out) override;
+        std::size_t digestSize() const override { return 32; }
+
+    private:
+        // State of the 1024-byte chunk currently being hashed
+        struct ChunkState {
+            uint32_t cv[8];
+            uint64_t counter;
+            unsigned char block[64];
+            uint8_t blockLength;
+            uint8_t blocksCompressed;
+        };
+
+        void resetChunk(uint64_t counter);
+        std::size_t chunkLength() const;
+        void addChunkChainingValue(const uint32_t cv[8], uint64_t totalChunks);
+
+        ChunkState chunk_;
+        // DSA: STACK
+        // Chaining values of completed subtrees, merged pairwise as the
+        // binary hash tree grows (at most one per level, 2^54 chunks max).
+        uint32_t cvStack_[54][8];
+        std::size_t cvStackLength_ = 0;
+    };
+
+    /**
+     * @brief The original std::hash<std::string> scheme, for reading
+     * repositories that predate the format marker.
+     * std::hash cannot be streamed, so the input is buffered until finalize().
+     */
+    class LegacyHasher : public Hasher {
+    public:
+        using Hasher::update;
+        void update(const void* data, std::size_t length) override;
+        void finalize(unsigned char* out) override;
+        std::string finalizeHex() override;
+        ObjectId finalizeId() override;
+        std::size_t digestSize() const override { return sizeof(std::size_t); }
+
+    private:
+        std::string buffer_;
+    };
+
+    /**
+     * @brief Creates a fresh hasher for the given algorithm.
+     */
+    std::unique_ptr<Hasher> makeHasher(HashAlgorithm algorithm);
+
+    /**
+     * @brief Name used for the algorithm in the repository config.
+     */
+    const char* hashAlgorithmName(HashAlgorithm algorithm);
+
+    /**
+     * @brief Parses a config name back into an algorithm.
+     * @throws std::runtime_error for unknown names.
+     */
+    HashAlgorithm parseHashAlgorithm(const std::string& name);
+
+    /**
+     * @brief Lowercase hex rendering of a byte string.
+     */
+    std::string toHex(const unsigned char* data, std::size_t length);
+
+} // namespace MiniGit
+
+#endif // MINIGIT_HASH_H
@@ -0,0 +1,354 @@
+/**
+ * index.cpp
+ * * Reading and writing the binary staging area.
+ */
+
+#include "index.h"
+#include "hash.h"
+#include "minigit.h"
+#include "trace.h"
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace MiniGit {
+
+    namespace {
+        const char INDEX_MAGIC[4] = {'M', 'G', 'I', 'X'};
+        const std::size_t HEADER_SIZE_V2 = 16;
+        const std::size_t HEADER_SIZE = 32;   // version 3: plus the fsmonitor token
+        const std::size_t ENTRY_SIZE_V1 = 48;  // no stat data, hash at 16
+        const std::size_t ENTRY_SIZE = 80;     // hash at 48
+        const std::size_t CHECKSUM_SIZE = 32;
+
+        void indexChecksum(const unsigned char* data, std::size_t size, unsigned char out[CHECKSUM_SIZE]) {
+            Blake3Hasher hasher;
+            hasher.update(data, size);
+            hasher.finalize(out);
+        }
+
+        // The last index file whose checksum was verified, and its stat
+        // data. Every rewrite renames a new file into place, so the same
+        // stat data means the same bytes: a process that loads the index
+        // over and over (a Repository handle) verifies it once.
+        std::mutex verifiedMutex;
+        std::string verifiedPath;
+        FileStat verifiedStat;
+
+        // The index of a batch, written out once at its end. Its stamp file
+        // is touched on every write, so the racily-clean check (which
+        // compares entries with the time the index was written) and the
+        // file finally written both use the time of the last write.
+        std::mutex batchMutex;
+        bool batching = false;
+        fs::path batchFile;
+        std::shared_ptr<const std::string> batchContent; // null until a command writes the index
+        uint64_t batchMtimeNs = 0;
+
+        fs::path batchStampFile(const fs::path& file) {
+            fs::path stamp = file;
+            stamp += ".batch";
+            return stamp;
+        }
+
+        // The caller holds batchMutex
+        void writeBatchIndex() {
+            if (!batchContent) {
+                return;
+            }
+            fs::path stamp = batchStampFile(batchFile);
+            writeFileAtomic(batchFile, *batchContent);
+            std::error_code error;
+            fs::last_write_time(batchFile, fs::last_write_time(stamp, error), error);
+            fs::remove(stamp, error);
+            batchContent.reset();
+        }
+    }
+
+    // --- IndexView ---
+
+    bool IndexView::load(const fs::path& file) {
+        MINIGIT_TRACE_SCOPE("loadIndex");
+        close();
+        {
+            std::lock_guard<std::mutex> lock(batchMutex);
+            if (batchContent && file == batchFile) {
+                deferred_ = batchContent; // encoded by this process: no checksum to verify
+                indexMtimeNs_ = batchMtimeNs;
+                parse(reinterpret_cast<const unsigned char*>(deferred_->data()), deferred_->size(), file, false);
+                return true;
+            }
+        }
+        if (!map_.open(file)) {
+            return false;
+        }
+        // Stat after mapping: if the file was replaced meanwhile, its stat
+        // data is the new file's and cannot match the verified one
+        FileStat indexStat;
+        bool statted = statFile(file, indexStat);
+        if (statted) {
+            indexMtimeNs_ = indexStat.mtimeNs;
+        }
+
+        if (map_.size() >= sizeof(INDEX_MAGIC) && std::memcmp(map_.data(), INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0) {
+            std::string path = statted ? fs::absolute(file).string() : std::string();
+            bool verified = false;
+            if (statted) {
+                std::lock_guard<std::mutex> lock(verifiedMutex);
+                verified = path == verifiedPath && indexStat == verifiedStat && indexStat.size == map_.size();
+            }
+            parse(map_.data(), map_.size(), file, !verified);
+            if (statted && !verified) {
+                std::lock_guard<std::mutex> lock(verifiedMutex);
+                verifiedPath = path;
+                verifiedStat = indexStat;
+            }
+            return true;
+        }
+
+        // Old text index: "<path> <hash>" per line. Convert it to the
+        // binary layout once, then read it like any other index.
+        std::map<std::string, std::string> staged;
+        std::stringstream ss(std::string(reinterpret_cast<const char*>(map_.data()), map_.size()));
+        std::string line;
+        while (std::getline(ss, line)) {
+            std::stringstream line_ss(line);
+            std::string filename, hash;
+            if (line_ss >> filename >> hash) {
+                staged[filename] = hash;
+            }
+        }
+        map_.close();
+
+        std::vector<IndexRecord> records;
+        records.reserve(staged.size());
+        for (const auto& pair : staged) {
+            IndexRecord record;
+            record.path = pair.first;
+            record.hash = ObjectId::fromHex(pair.second);
+            record.flags = INDEX_STAGED; // the text index only held staged files
+            records.push_back(record);
+        }
+        converted_ = encodeIndex(records);
+        parse(reinterpret_cast<const unsigned char*>(converted_.data()), converted_.size(), file);
+        return true;
+    }
+
+    void IndexView::close() {
+        map_.close();
+        converted_.clear();
+        deferred_.reset();
+        entries_ = nullptr;
+        strings_ = nullptr;
+        count_ = 0;
+        indexMtimeNs_ = 0;
+        fsmonitorToken_ = FsmonitorToken();
+    }
+
+    void IndexView::parse(const unsigned char* data, std::size_t size, const fs::path& file, bool verifyChecksum) {
+        auto corrupt = [&](const std::string& why) {
+            return std::runtime_error("Corrupt index file " + file.string() + ": " + why);
+        };
+
+        if (size < HEADER_SIZE_V2 + CHECKSUM_SIZE) {
+            throw corrupt("truncated header");
+        }
+        uint32_t version = getU32(data + 4);
+        if (version == 0 || version > INDEX_VERSION) {
+            throw std::runtime_error("Unsupported index version " + std::to_string(version) +
+                                     " in " + file.string());
+        }
+        version_ = version;
+        entrySize_ = version == 1 ? ENTRY_SIZE_V1 : ENTRY_SIZE;
+        std::size_t headerSize = version < 3 ? HEADER_SIZE_V2 : HEADER_SIZE;
+        if (size < headerSize + CHECKSUM_SIZE) {
+            throw corrupt("truncated header");
+        }
+        uint64_t count = getU32(data + 8);
+        uint64_t stringSize = getU32(data + 12);
+        if (headerSize + count * entrySize_ + stringSize + CHECKSUM_SIZE != size) {
+            throw corrupt("size mismatch");
+        }
+
+        if (verifyChecksum) {
+            unsigned char checksum[CHECKSUM_SIZE];
+            indexChecksum(data, size - CHECKSUM_SIZE, checksum);
+            if (std::memcmp(checksum, data + size - CHECKSUM_SIZE, CHECKSUM_SIZE) != 0) {
+                throw corrupt("checksum mismatch");
+            }
+        }
+
+        fsmonitorToken_ = FsmonitorToken();
+        if (version >= 3) {
+            fsmonitorToken_.epoch = getU64(data + 16);
+            fsmonitorToken_.sequence = getU64(data + 24);
+        }
+        entries_ = data + headerSize;
+        strings_ = reinterpret_cast<const char*>(entries_ + count * entrySize_);
+        count_ = static_cast<std::size_t>(count);
+
+        for (std::size_t i = 0; i < count_; ++i) {
+            const unsigned char* e = entry(i);
+            if (static_cast<uint64_t>(getU32(e)) + getU32(e + 4) > stringSize || e[8] > 2 * ObjectId::MAX_BYTES) {
+                throw corrupt("bad entry");
+            }
+        }
+    }
+
+    const unsigned char* IndexView::entry(std::size_t i) const {
+        return entries_ + i * entrySize_;
+    }
+
+    std::string_view IndexView::path(std::size_t i) const {
+        const unsigned char* e = entry(i);
+        return std::string_view(strings_ + getU32(e), getU32(e + 4));
+    }
+
+    ObjectId IndexView::hash(std::size_t i) const {
+        const unsigned char* e = entry(i);
+        return getObjectId(e + (version_ == 1 ? 16 : 48), e[8]);
+    }
+
+    FileStat IndexView::stat(std::size_t i) const {
+        FileStat st;
+        if (version_ == 1) {
+            return st;
+        }
+        const unsigned char* e = entry(i);
+        st.mode = getU32(e + 12);
+        st.mtimeNs = getU64(e + 16);
+        st.ctimeNs = getU64(e + 24);
+        st.size = getU64(e + 32);
+        st.inode = getU64(e + 40);
+        return st;
+    }
+
+    uint8_t IndexView::flags(std::size_t i) const {
+        // Version 1 indexes only ever held staged files
+        return version_ == 1 ? INDEX_STAGED : entry(i)[9];
+    }
+
+    IndexRecord IndexView::record(std::size_t i) const {
+        IndexRecord r;
+        r.path = path(i);
+        r.hash = hash(i);
+        r.stat = stat(i);
+        r.flags = flags(i);
+        return r;
+    }
+
+    bool IndexView::statMatches(std::size_t i, const FileStat& current) const {
+        FileStat cached = stat(i);
+        if (cached.mtimeNs == 0 || cached != current) {
+            return false;
+        }
+        // DSA: the "racy clean" rule. If the file was last modified no
+        // earlier than the index was written, a later change within the
+        // same timestamp tick would be invisible, so we cannot trust it.
+        return cached.mtimeNs < indexMtimeNs_;
+    }
+
+    bool IndexView::find(std::string_view target, std::size_t& position) const {
+        std::size_t low = 0;
+        std::size_t high = count_;
+        while (low < high) {
+            std::size_t mid = low + (high - low) / 2;
+            int c = path(mid).compare(target);
+            if (c == 0) {
+                position = mid;
+                return true;
+            }
+            if (c < 0) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        position = low;
+        return false;
+    }
+
+    // --- Writing ---
+
+    std::string encodeIndex(const std::vector<IndexRecord>& records, const FsmonitorToken& token) {
+        std::size_t stringSize = 0;
+        for (const auto& record : records) {
+            stringSize += record.path.size();
+        }
+
+        std::string out;
+        out.reserve(HEADER_SIZE + records.size() * ENTRY_SIZE + stringSize + CHECKSUM_SIZE);
+        out.append(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+        putU32(out, INDEX_VERSION);
+        putU32(out, static_cast<uint32_t>(records.size()));
+        putU32(out, static_cast<uint32_t>(stringSize));
+        putU64(out, token.epoch);
+        putU64(out, token.sequence);
+
+        uint32_t offset = 0;
+        for (const auto& record : records) {
+            putU32(out, offset);
+            putU32(out, static_cast<uint32_t>(record.path.size()));
+            putU8(out, record.hash.hexLength);
+            putU8(out, record.flags);
+            putU16(out, 0); // reserved
+            putU32(out, record.stat.mode);
+            putU64(out, record.stat.mtimeNs);
+            putU64(out, record.stat.ctimeNs);
+            putU64(out, record.stat.size);
+            putU64(out, record.stat.inode);
+            putObjectId(out, record.hash);
+            offset += static_cast<uint32_t>(record.path.size());
+        }
+        for (const auto& record : records) {
+            out.append(record.path.data(), record.path.size());
+        }
+
+        unsigned char checksum[CHECKSUM_SIZE];
+        indexChecksum(reinterpret_cast<const unsigned char*>(out.data()), out.size(), checksum);
+        out.append(reinterpret_cast<const char*>(checksum), CHECKSUM_SIZE);
+        return out;
+    }
+
+    void writeIndexFile(const fs::path& file, const std::vector<IndexRecord>& records) {
+        writeIndexContent(file, encodeIndex(records));
+    }
+
+    void writeIndexContent(const fs::path& file, std::string content) {
+        MINIGIT_TRACE_SCOPE("writeIndex");
+        std::lock_guard<std::mutex> lock(batchMutex);
+        if (!batching) {
+            writeFileAtomic(file, content);
+            return;
+        }
+        if (batchContent && file != batchFile) {
+            writeBatchIndex(); // another index (never happens within one repository)
+        }
+        fs::path stamp = batchStampFile(file);
+        writeFileContent(stamp, "");
+        FileStat stampStat;
+        batchMtimeNs = statFile(stamp, stampStat) ? stampStat.mtimeNs : 0;
+        batchFile = file;
+        batchContent = std::make_shared<const std::string>(std::move(content));
+    }
+
+    void beginIndexBatch() {
+        std::lock_guard<std::mutex> lock(batchMutex);
+        batching = true;
+    }
+
+    void flushIndexBatch() {
+        std::lock_guard<std::mutex> lock(batchMutex);
+        writeBatchIndex();
+    }
+
+    void endIndexBatch() {
+        std::lock_guard<std::mutex> lock(batchMutex);
+        batching = false;
+        writeBatchIndex();
+    }
+
+} // namespace MiniGit
@@ -0,0 +1,190 @@
+/**
+ * index.h
+ * * The binary staging area (.minigit/index).
+ *
+ * File layout (all integers little-endian):
+ *   header   "MGIX", u32 version, u32 entry count, u32 string table size,
+ *            (version 3) u64 fsmonitor epoch, u64 fsmonitor sequence
+ *   entries  fixed-width records, sorted by path (byte order):
+ *            u32 path offset, u32 path length, u8 hash hex length,
+ *            u8 flags, u16 reserved, u32 mode, u64 mtime (ns),
+ *            u64 ctime (ns), u64 size, u64 inode, 32-byte hash
+ *   strings  all paths, concatenated
+ *   checksum BLAKE3 of everything above (32 bytes)
+ *
+ * Besides the staged files, the index remembers every file that was
+ * committed or checked out, together with its stat data. A file whose
+ * stat data still matches its entry is known to be unchanged without
+ * reading it. Version 1 indexes (no stat data) are still readable.
+ *
+ * With the filesystem monitor running (see fsmonitor.h), the header also
+ * records how far its journal had got, and entries flagged
+ * INDEX_FSMONITOR_VALID are known to be unchanged as of that point:
+ * status only stats them again if the journal names them since.
+ *
+ * The file is memory-mapped and searched in place, so looking up or
+ * iterating entries does not allocate.
+ */
+
+#ifndef MINIGIT_INDEX_H
+#define MINIGIT_INDEX_H
+
+#include "binary_format.h"
+#include "platform.h"
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace MiniGit {
+
+    const uint32_t INDEX_VERSION = 3;
+
+    // Entry flags
+    const uint8_t INDEX_STAGED = 1 << 0;          // part of the staging area for the next commit
+    const uint8_t INDEX_FSMONITOR_VALID = 1 << 1; // unchanged as of the index's fsmonitor token
+
+    /**
+     * @brief A position in the filesystem monitor's journal. A daemon
+     * restart (or a lost event) changes the epoch, which invalidates
+     * every older token. {0, 0} means "no token".
+     */
+    struct FsmonitorToken {
+        uint64_t epoch = 0;
+        uint64_t sequence = 0;
+
+        bool valid() const { return epoch != 0; }
+        bool operator==(const FsmonitorToken& other) const {
+            return epoch == other.epoch && sequence == other.sequence;
+        }
+        bool operator!=(const FsmonitorToken& other) const { return !(*this == other); }
+    };
+
+    /**
+     * @brief One entry of the index.
+     */
+    struct IndexRecord {
+        std::string_view path;
+        ObjectId hash;
+        FileStat stat;      // all zero when unknown (forces a re-check)
+        uint8_t flags = 0;
+    };
+
+    /**
+     * @brief A read-only, memory-mapped view of the index file.
+     * Old text indexes ("<path> <hash>" lines) are converted to the binary
+     * layout in memory when loaded, so callers see a single format.
+     */
+    class IndexView {
+    public:
+        IndexView() = default;
+        IndexView(const IndexView&) = delete;
+        IndexView& operator=(const IndexView&) = delete;
+
+        /**
+         * @brief Maps and validates the index file.
+         * @return false if there is no index file (an empty staging area).
+         * @throws std::runtime_error if the file is corrupt or too new.
+         */
+        bool load(const std::filesystem::path& file);
+
+        /**
+         * @brief Releases the mapping. Must be called before the index
+         * file is rewritten (Windows cannot replace a mapped file).
+         */
+        void close();
+
+        std::size_t size() const { return count_; }
+        bool empty() const { return count_ == 0; }
+
+        std::string_view path(std::size_t i) const;
+        ObjectId hash(std::size_t i) const;
+        FileStat stat(std::size_t i) const;
+        uint8_t flags(std::size_t i) const;
+        bool isStaged(std::size_t i) const { return (flags(i) & INDEX_STAGED) != 0; }
+        IndexRecord record(std::size_t i) const;
+
+        /**
+         * @brief The fsmonitor token the index was written with ({0, 0}
+         * for older indexes or when no monitor was running).
+         */
+        FsmonitorToken fsmonitorToken() const { return fsmonitorToken_; }
+
+        /**
+         * @brief Whether a file's current stat data proves it is unchanged.
+         * Entries that are "racily clean" (the file was modified in the same
+         * timestamp tick the index was written) never match, so the caller
+         * re-hashes them instead of trusting the timestamps.
+         * @param i The entry position.
+         * @param current The file's current stat data.
+         */
+        bool statMatches(std::size_t i, const FileStat& current) const;
+
+        /**
+         * @brief DSA: BINARY SEARCH over the sorted entries.
+         * @param path The path to look up.
+         * @param position Set to the entry's position if found.
+         * @return true if the path is in the index.
+         */
+        bool find(std::string_view path, std::size_t& position) const;
+
+    private:
+        void parse(const unsigned char* data, std::size_t size, const std::filesystem::path& file,
+                   bool verifyChecksum = true);
+        const unsigned char* entry(std::size_t i) const;
+
+        MappedFile map_;
+        std::string converted_; // backing store for a converted text index
+        std::shared_ptr<const std::string> deferred_; // backing store for an index kept in memory (batch)
+        const unsigned char* entries_ = nullptr;
+        const char* strings_ = nullptr;
+        std::size_t count_ = 0;
+        uint32_t version_ = INDEX_VERSION;
+        std::size_t entrySize_ = 0;
+        uint64_t indexMtimeNs_ = 0; // when the index file was last written
+        FsmonitorToken fsmonitorToken_;
+    };
+
+    /**
+     * @brief Serializes entries (which must be sorted by path and unique).
+     * @param token The fsmonitor token the entries' INDEX_FSMONITOR_VALID
+     * flags refer to (callers that keep the flags pass the loaded one on).
+     * @return The complete index file content.
+     */
+    std::string encodeIndex(const std::vector<IndexRecord>& records, const FsmonitorToken& token = {});
+
+    /**
+     * @brief Writes entries (sorted by path, unique) to an index file.
+     */
+    void writeIndexFile(const std::filesystem::path& file, const std::vector<IndexRecord>& records);
+
+    /**
+     * @brief Replaces an index file with encoded content (atomically, see
+     * writeFileAtomic), or during a batch keeps it in memory.
+     */
+    void writeIndexContent(const std::filesystem::path& file, std::string content);
+
+    /**
+     * @brief Starts a batch: index writes are kept in memory, and
+     * IndexView::load sees the latest one, until endIndexBatch() writes
+     * it out once. Other processes see the index as it was before the
+     * batch until then.
+     */
+    void beginIndexBatch();
+
+    /**
+     * @brief Writes the index kept in memory (if any command changed it).
+     * The batch goes on.
+     */
+    void flushIndexBatch();
+
+    /**
+     * @brief Writes the index kept in memory and ends the batch.
+     */
+    void endIndexBatch();
+
+} // namespace MiniGit
+
+#endif // MINIGIT_INDEX_H
@@ -6,7 +6,12 @@
  * corresponding functions from the MiniGit library.
  */
 
+#include "batch.h"
+#include "fsmonitor.h"
 #include "minigit.h"
+#include "object_store.h"
+#include "remote.h"
+#include "trace.h"
 #include <iostream>
 #include <vector>
 #include <string>
@@ -17,14 +22,59 @@ void printUsage() {
               << "\n"
               << "Available commands:\n"
               << "  init                  Create an empty MiniGit repository\n"
-              << "  add <file1> [file2]...  Add file(s) to the staging area\n"
-              << "  commit -m \"<message>\"   Record changes to the repository\n"
-              << "  log                   Show the commit history\n"
+              << "  add [-j <threads>] <path1> [path2]...\n"
+              << "                        Add file(s) to the staging area (a directory:\n"
+              << "                        its new and modified files)\n"
+              << "  commit [-a] -m \"<message>\"\n"
+              << "                        Record changes to the repository (-a: stage\n"
+              << "                        modified tracked files first)\n"
+              << "  log [-p] [--] [<path>...]\n"
+              << "                        Show the commit history (-p: with each commit's\n"
+              << "                        changes; paths: only commits that changed them)\n"
+              << "  status [-j <threads>] Show staged, modified and untracked files\n"
+              << "  checkout [-j <threads>] <branch> | <commit>\n"
+              << "                        Switch to a branch, or restore the files of a\n"
+              << "                        commit (detaching HEAD)\n"
+              << "  merge [-j <threads>] <branch>\n"
+              << "                        Merge a branch (or commit) into the current one\n"
+              << "  merge-base <commit> <commit>\n"
+              << "                        Show the best common ancestor of two commits\n"
+              << "  branch [-d] [<name> [<commit>]]\n"
+              << "                        List, create or delete (-d) branches\n"
+              << "  diff [<commit> <commit>]\n"
+              << "                        Show changes between commits, or unstaged changes\n"
+              << "  rev-list [--count] [<commit>]\n"
+              << "                        List the hashes of a commit's history\n"
+              << "  gc | repack           Pack all objects and write the commit-graph\n"
+              << "  commit-graph write    Rebuild only the commit-graph\n"
+              << "  clone [--depth <n>] [--filter=blob:none] <url> [<directory>]\n"
+              << "                        Copy a repository (ssh://host/path, host:path or\n"
+              << "                        a path); --depth: only the newest n commits;\n"
+              << "                        --filter=blob:none: get blobs when first needed\n"
+              << "  fetch [<remote>]      Get a remote's branches into refs/remotes/<remote>/\n"
+              << "  push [<remote> [<branch>]]\n"
+              << "                        Send a branch to a remote (fast-forwards only)\n"
+              << "  remote [add <name> <url>]\n"
+              << "                        List or add remotes\n"
+              << "  upload-pack | receive-pack <directory>\n"
+              << "                        Serve a fetch or a push on stdin and stdout\n"
+              << "  fsmonitor start|stop|status|run\n"
+              << "                        Run a filesystem monitor so status skips\n"
+              << "                        untouched files\n"
+              << "  --batch               Run commands read from stdin, one per line, in\n"
+              << "                        one process (the index is written once)\n"
+              << "  serve <socket>        Run the commands of each connection to a Unix\n"
+              << "                        socket as a batch\n"
+              << "\n"
+              << "  --trace[=<file>] <command>\n"
+              << "                        Time the command's phases and count its I/O: a\n"
+              << "                        table on stderr, or Chrome trace events in <file>\n"
+              << "                        (also MINIGIT_TRACE=1 or MINIGIT_TRACE=<file>)\n"
               << std::endl;
 }
 
-// Entry point of the program
-int main(int argc, char* argv[]) {
+// Runs one command; argv[1] is the command
+int runCommand(int argc, char* argv[]) {
     // Need at least one command
     if (argc < 2) {
         printUsage();
@@ -34,6 +84,18 @@ int main(int argc, char* argv[]) {
     std::string command = argv[1];
 
     try {
+        // A command that writes upgrades an older repository first (the
+        // library does so too, without saying anything)
+        bool writes = command == "add" || command == "commit" || command == "checkout" || command == "merge" ||
+                      command == "commit-graph" || command == "fetch" || command == "push" || command == "gc" ||
+                      command == "repack" || ((command == "branch" || command == "remote") && argc > 2);
+        if (writes && MiniGit::repoExists()) {
+            std::size_t moved = MiniGit::upgradeRepoFormat();
+            if (moved != 0) {
+                std::cout << "Moved " << moved << " object(s) into the sharded object layout." << std::endl;
+            }
+        }
+
         if (command == "init") {
             MiniGit::init();
         } else if (command == "add") {
@@ -42,35 +104,94 @@ int main(int argc, char* argv[]) {
                 std::cerr << "Fatal: Not a MiniGit repository. (Run 'minigit init' first)" << std::endl;
                 return 1;
             }
-            if (argc < 3) {
-                std::cerr << "Usage: minigit add <file1> [file2]..." << std::endl;
-                return 1;
-            }
-            // Add all files listed
+            // Add all files listed, with an optional "-j <threads>"
             std::vector<std::string> filesToAdd;
+            unsigned jobs = 0;
             for (int i = 2; i < argc; ++i) {
-                filesToAdd.push_back(argv[i]);
+                std::string arg = argv[i];
+                if (arg == "-j" && i + 1 < argc) {
+                    jobs = static_cast<unsigned>(std::stoul(argv[++i]));
+                } else if (arg.rfind("-j", 0) == 0 && arg.size() > 2) {
+                    jobs = static_cast<unsigned>(std::stoul(arg.substr(2)));
+                } else {
+                    filesToAdd.push_back(arg);
+                }
             }
-            MiniGit::add(filesToAdd);
+            if (filesToAdd.empty()) {
+                std::cerr << "Usage: minigit add [-j <threads>] <path1> [path2]..." << std::endl;
+                return 1;
+            }
+            MiniGit::add(filesToAdd, jobs);
         } else if (command == "commit") {
             // Check if we are in a repo
             if (!MiniGit::repoExists()) {
                 std::cerr << "Fatal: Not a MiniGit repository." << std::endl;
                 return 1;
             }
-            if (argc != 4 || std::string(argv[2]) != "-m") {
-                std::cerr << "Usage: minigit commit -m \"<message>\"" << std::endl;
+            // "-m <message>", optionally with "-a" (or "-am <message>")
+            bool all = false;
+            bool haveMessage = false;
+            std::string message;
+            for (int i = 2; i < argc; ++i) {
+                std::string arg = argv[i];
+                if (arg == "-a") {
+                    all = true;
+                } else if ((arg == "-m" || arg == "-am") && i + 1 < argc && !haveMessage) {
+                    all = all || arg == "-am";
+                    message = argv[++i];
+                    haveMessage = true;
+                } else {
+                    haveMessage = false;
+                    break;
+                }
+            }
+            if (!haveMessage) {
+                std::cerr << "Usage: minigit commit [-a] -m \"<message>\"" << std::endl;
                 return 1;
             }
-            std::string message = argv[3];
-            MiniGit::commit(message);
+            MiniGit::commit(message, all);
         } else if (command == "log") {
             // Check if we are in a repo
             if (!MiniGit::repoExists()) {
                 std::cerr << "Fatal: Not a MiniGit repository." << std::endl;
                 return 1;
             }
-            MiniGit::log();
+            bool patch = false;
+            std::vector<std::string> paths;
+            bool pathsOnly = false; // after "--"
+            for (int i = 2; i < argc; ++i) {
+                std::string arg = argv[i];
+                if (!pathsOnly && (arg == "-p" || arg == "--patch")) {
+                    patch = true;
+                } else if (!pathsOnly && arg == "--") {
+                    pathsOnly = true;
+                } else if (!pathsOnly && !arg.empty() && arg[0] == '-') {
+                    std::cerr << "Usage: minigit log [-p] [--] [<path>...]" << std::endl;
+                    return 1;
+                } else {
+                    paths.push_back(arg);
+                }
+            }
+            MiniGit::log(patch, paths);
+        } else if (command == "status") {
+            // Check if we are in a repo
+            if (!MiniGit::repoExists()) {
+                std::cerr << "Fatal: Not a MiniGit repository." << std::endl;
+                return 1;
+            }
+            unsigned jobs = 0;
+            for (int i = 2; i < argc; ++i) {
+                std::string arg = argv[i];
+                if (arg == "-j" && i + 1 < argc) {
+                    jobs = static_cast<unsigned>(std::stoul(argv[++i]));
+                } else if (arg.rfind("-j", 0) == 0 && arg.size() > 2) {
+                    jobs = static_cast<unsigned>(std::stoul(arg.substr(2)));
+                } else {
+                    std::cerr << "Usage: minigit status [-j <threads>]" << std::endl;
+                    return 1;
+                }
+            }
+            MiniGit::status(jobs);
         } // --- PASTE THIS BLOCK ---
         else if (command == "checkout") {
             // Check if we are in a repo
@@ -78,14 +199,204 @@ int main(int argc, char* argv[]) {
                 std::cerr << "Fatal: Not a MiniGit repository." << std::endl;
                 return 1;
             }
-            if (argc != 3) {
-                std::cerr << "Usage: minigit checkout <commit-hash>" << std::endl;
+            // The commit, with an optional "-j <threads>"
+            std::string commitHash;
+            unsigned jobs = 0;
+            for (int i = 2; i < argc; ++i) {
+                std::string arg = argv[i];
+                if (arg == "-j" && i + 1 < argc) {
+                    jobs = static_cast<unsigned>(std::stoul(argv[++i]));
+                } else if (arg.rfind("-j", 0) == 0 && arg.size() > 2) {
+                    jobs = static_cast<unsigned>(std::stoul(arg.substr(2)));
+                } else if (commitHash.empty()) {
+                    commitHash = arg;
+                } else {
+                    commitHash.clear();
+                    break;
+                }
+            }
+            if (commitHash.empty()) {
+                std::cerr << "Usage: minigit checkout [-j <threads>] <branch> | <commit-hash>" << std::endl;
                 return 1;
             }
-            std::string commitHash = argv[2];
-            MiniGit::checkout(commitHash);
+            MiniGit::checkout(commitHash, jobs);
         }
         // ------------------------ 
+        else if (command == "merge") {
+            if (!MiniGit::repoExists()) {
+                std::cerr << "Fatal: Not a MiniGit repository." << std::endl;
+                return 1;
+            }
+            std::string name;
+            unsigned jobs = 0;
+            for (int i = 2; i < argc; ++i) {
+                std::string arg = argv[i];
+                if (arg == "-j" && i + 1 < argc) {
+                    jobs = static_cast<unsigned>(std::stoul(argv[++i]));
+                } else if (arg.rfind("-j", 0) == 0 && arg.size() > 2) {
+                    jobs = static_cast<unsigned>(std::stoul(arg.substr(2)));
+                } else if (name.empty()) {
+                    name = arg;
+                } else {
+                    name.clear();
+                    break;
+                }
+            }
+            if (name.empty()) {
+                std::cerr << "Usage: minigit merge [-j <threads>] <branch>" << std::endl;
+                return 1;
+            }
+            if (!MiniGit::merge(name, jobs)) {
+                return 1; // stopped on conflicts
+            }
+        }
+        else if (command == "merge-base") {
+            if (!MiniGit::repoExists()) {
+                std::cerr << "Fatal: Not a MiniGit repository." << std::endl;
+                return 1;
+            }
+            if (argc != 4) {
+                std::cerr << "Usage: minigit merge-base <commit> <commit>" << std::endl;
+                return 1;
+            }
+            MiniGit::printMergeBase(argv[2], argv[3]);
+        }
+        else if (command == "branch") {
+            if (!MiniGit::repoExists()) {
+                std::cerr << "Fatal: Not a MiniGit repository." << std::endl;
+                return 1;
+            }
+            std::vector<std::string> args(argv + 2, argv + argc);
+            if (args.empty()) {
+                MiniGit::listBranches();
+            } else if (args[0] == "-d" && args.size() == 2) {
+                MiniGit::deleteBranch(args[1]);
+            } else if (args[0] != "-d" && args.size() <= 2) {
+                MiniGit::createBranch(args[0], args.size() == 2 ? args[1] : "");
+            } else {
+                std::cerr << "Usage: minigit branch [-d] [<name> [<commit>]]" << std::endl;
+                return 1;
+            }
+        }
+        else if (command == "rev-list") {
+            if (!MiniGit::repoExists()) {
+                std::cerr << "Fatal: Not a MiniGit repository." << std::endl;
+                return 1;
+            }
+            bool countOnly = false;
+            std::string start;
+            for (int i = 2; i < argc; ++i) {
+                std::string arg = argv[i];
+                if (arg == "--count") {
+                    countOnly = true;
+                } else {
+                    start = arg;
+                }
+            }
+            MiniGit::revList(start, countOnly);
+        }
+        else if (command == "diff") {
+            if (!MiniGit::repoExists()) {
+                std::cerr << "Fatal: Not a MiniGit repository." << std::endl;
+                return 1;
+            }
+            if (argc != 2 && argc != 4) {
+                std::cerr << "Usage: minigit diff [<commit> <commit>]" << std::endl;
+                return 1;
+            }
+            MiniGit::diff(std::vector<std::string>(argv + 2, argv + argc));
+        }
+        else if (command == "commit-graph") {
+            if (!MiniGit::repoExists()) {
+                std::cerr << "Fatal: Not a MiniGit repository." << std::endl;
+                return 1;
+            }
+            if (argc != 3 || std::string(argv[2]) != "write") {
+                std::cerr << "Usage: minigit commit-graph write" << std::endl;
+                return 1;
+            }
+            MiniGit::commitGraphWrite();
+        }
+        else if (command == "fsmonitor") {
+            if (!MiniGit::repoExists()) {
+                std::cerr << "Fatal: Not a MiniGit repository." << std::endl;
+                return 1;
+            }
+            std::string action = argc == 3 ? argv[2] : "";
+            if (action == "start") {
+                MiniGit::startFsmonitor();
+            } else if (action == "run") {
+                MiniGit::runFsmonitor();
+            } else if (action == "stop") {
+                std::cout << (MiniGit::stopFsmonitor() ? "Stopped the filesystem monitor."
+                                                       : "The filesystem monitor is not running.") << std::endl;
+            } else if (action == "status") {
+                std::cout << (MiniGit::fsmonitorRunning() ? "The filesystem monitor is running."
+                                                          : "The filesystem monitor is not running.") << std::endl;
+            } else {
+                std::cerr << "Usage: minigit fsmonitor start|stop|status|run" << std::endl;
+                return 1;
+            }
+        }
+        else if (command == "clone") {
+            MiniGit::FetchOptions options;
+            std::vector<std::string> args;
+            for (int i = 2; i < argc; ++i) {
+                std::string arg = argv[i];
+                if (arg == "--depth" && i + 1 < argc) {
+                    options.depth = static_cast<unsigned>(std::stoul(argv[++i]));
+                } else if (arg.rfind("--depth=", 0) == 0) {
+                    options.depth = static_cast<unsigned>(std::stoul(arg.substr(8)));
+                } else if (arg == "--filter=blob:none") {
+                    options.blobless = true;
+                } else {
+                    args.push_back(arg);
+                }
+            }
+            if (args.empty() || args.size() > 2 || args[0][0] == '-') {
+                std::cerr << "Usage: minigit clone [--depth <n>] [--filter=blob:none] <url> [<directory>]" << std::endl;
+                return 1;
+            }
+            MiniGit::clone(args[0], args.size() == 2 ? args[1] : "", options);
+        }
+        else if (command == "fetch" || command == "push" || command == "remote") {
+            if (!MiniGit::repoExists()) {
+                std::cerr << "Fatal: Not a MiniGit repository." << std::endl;
+                return 1;
+            }
+            std::vector<std::string> args(argv + 2, argv + argc);
+            if (command == "fetch" && args.size() <= 1) {
+                MiniGit::fetch(args.empty() ? MiniGit::DEFAULT_REMOTE : args[0]);
+            } else if (command == "push" && args.size() <= 2) {
+                MiniGit::push(args.empty() ? MiniGit::DEFAULT_REMOTE : args[0], args.size() == 2 ? args[1] : "");
+            } else if (command == "remote" && args.empty()) {
+                MiniGit::listRemotes();
+            } else if (command == "remote" && args.size() == 3 && args[0] == "add") {
+                MiniGit::addRemote(args[1], args[2]);
+            } else {
+                std::cerr << "Usage: minigit fetch [<remote>] | push [<remote> [<branch>]] | remote [add <name> <url>]"
+                          << std::endl;
+                return 1;
+            }
+        }
+        else if (command == "upload-pack" || command == "receive-pack") {
+            if (argc != 3) {
+                std::cerr << "Usage: minigit " << command << " <directory>" << std::endl;
+                return 1;
+            }
+            if (command == "upload-pack") {
+                MiniGit::uploadPack(argv[2]);
+            } else {
+                MiniGit::receivePack(argv[2]);
+            }
+        }
+        else if (command == "gc" || command == "repack") {
+            if (!MiniGit::repoExists()) {
+                std::cerr << "Fatal: Not a MiniGit repository." << std::endl;
+                return 1;
+            }
+            MiniGit::gc();
+        }
         else {
             std::cerr << "Unknown command: " << command << std::endl;
             printUsage();
@@ -99,3 +410,62 @@ int main(int argc, char* argv[]) {
 
     return 0;
 }
+
+// Runs one command of a batch ("minigit" and the request's arguments)
+int runBatchCommand(const std::vector<std::string>& args) {
+    // Those that need stdin and stdout, or leave the batch's repository
+    if (args[0] == "--batch" || args[0] == "serve" || args[0] == "clone" || args[0] == "upload-pack" ||
+        args[0] == "receive-pack") {
+        std::cerr << "Fatal: " << args[0] << " cannot run inside a batch" << std::endl;
+        return 1;
+    }
+    std::vector<std::string> words{"minigit"};
+    words.insert(words.end(), args.begin(), args.end());
+    std::vector<char*> argv;
+    for (std::string& word : words) {
+        argv.push_back(&word[0]);
+    }
+    argv.push_back(nullptr);
+    return runCommand(static_cast<int>(words.size()), argv.data());
+}
+
+// Entry point of the program
+int main(int argc, char* argv[]) {
+    // "--trace" or "--trace=<file>" before the command
+    MiniGit::Trace::startFromEnvironment();
+    if (argc >= 2 && std::string(argv[1]).compare(0, 7, "--trace") == 0 &&
+        (argv[1][7] == '\0' || argv[1][7] == '=')) {
+        MiniGit::Trace::start(argv[1][7] == '=' ? argv[1] + 8 : "summary");
+        argv[1] = argv[0];
+        ++argv;
+        --argc;
+    }
+
+    std::string command = argc >= 2 ? argv[1] : "";
+    try {
+        if (command == "--batch" && argc == 2) {
+            std::ios::sync_with_stdio(false); // requests and answers are buffered
+            int status = MiniGit::runBatch(std::cin, std::cout, runBatchCommand);
+            MiniGit::Trace::finish();
+            return status;
+        }
+        if (command == "serve") {
+            if (argc != 3) {
+                std::cerr << "Usage: minigit serve <socket>" << std::endl;
+                return 1;
+            }
+            MiniGit::serveBatches(argv[2], runBatchCommand);
+            return 0;
+        }
+
+        int status = runCommand(argc, argv);
+        // Objects nothing refers to yet (batch durability) still get published
+        MiniGit::flushObjects();
+        MiniGit::Trace::finish();
+        return status;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        MiniGit::Trace::finish();
+        return 1;
+    }
+}
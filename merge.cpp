@@ -0,0 +1,202 @@
+/**
+ * merge.cpp
+ * * Three-way tree merge with parallel line merges.
+ */
+
+#include "merge.h"
+#include "concurrency.h"
+#include "diff.h"
+#include "file_map.h"
+#include "minigit.h"
+#include "object_store.h"
+#include "tree.h"
+#include <algorithm>
+
+namespace MiniGit {
+
+    namespace {
+
+        // A file changed on both sides, merged line by line later
+        struct LineMerge {
+            std::string path;
+            ObjectId base; // empty if both sides added the file
+            ObjectId ours;
+            ObjectId theirs;
+        };
+
+        std::vector<TreeEntry> sortedEntries(const ObjectId& hash) {
+            std::vector<TreeEntry> entries;
+            if (!hash.empty()) {
+                entries = readTree(hash);
+            }
+            std::sort(entries.begin(), entries.end(), [](const TreeEntry& a, const TreeEntry& b) {
+                return a.name != b.name ? a.name < b.name : a.isTree < b.isTree;
+            });
+            return entries;
+        }
+
+        class TreeMerger {
+        public:
+            std::vector<LineMerge> lineMerges;
+            std::vector<std::string> keptChanges;
+
+            /**
+             * @brief Merges one directory level and stores the result.
+             * @return The merged tree, or an empty id if nothing is left.
+             */
+            ObjectId merge(const ObjectId& base, const ObjectId& ours, const ObjectId& theirs,
+                           const std::string& prefix) {
+                // DSA: identical hashes mean identical subtrees, so the
+                // side that changed wins without a single read
+                if (ours == theirs || base == theirs) {
+                    return ours;
+                }
+                if (base == ours) {
+                    return theirs;
+                }
+
+                std::vector<TreeEntry> before = sortedEntries(base);
+                std::vector<TreeEntry> mine = sortedEntries(ours);
+                std::vector<TreeEntry> other = sortedEntries(theirs);
+                auto precedes = [](const TreeEntry& a, const TreeEntry& b) {
+                    return a.name != b.name ? a.name < b.name : a.isTree < b.isTree;
+                };
+
+                // DSA: MERGE of three sorted lists, keyed by (name, kind)
+                std::vector<TreeEntry> merged;
+                std::vector<bool> oursHasIt; // per merged entry, for name clashes below
+                std::size_t i = 0, j = 0, k = 0;
+                while (i < before.size() || j < mine.size() || k < other.size()) {
+                    const TreeEntry* key = nullptr;
+                    for (const TreeEntry* head : {i < before.size() ? &before[i] : nullptr,
+                                                  j < mine.size() ? &mine[j] : nullptr,
+                                                  k < other.size() ? &other[k] : nullptr}) {
+                        if (head != nullptr && (key == nullptr || precedes(*head, *key))) {
+                            key = head;
+                        }
+                    }
+                    TreeEntry current{key->name, key->isTree, ObjectId()};
+                    auto take = [&](std::vector<TreeEntry>& list, std::size_t& position) {
+                        if (position < list.size() && !precedes(current, list[position]) &&
+                            !precedes(list[position], current)) {
+                            return list[position++].hash;
+                        }
+                        return ObjectId();
+                    };
+                    ObjectId baseHash = take(before, i);
+                    ObjectId ourHash = take(mine, j);
+                    ObjectId theirHash = take(other, k);
+                    std::string path = prefix + current.name;
+
+                    if (ourHash == theirHash || baseHash == theirHash) {
+                        current.hash = ourHash;
+                    } else if (baseHash == ourHash) {
+                        current.hash = theirHash;
+                    } else if (!ourHash.empty() && !theirHash.empty()) {
+                        if (current.isTree) {
+                            current.hash = merge(baseHash, ourHash, theirHash, path + "/");
+                        } else {
+                            current.hash = ourHash; // replaced once the line merge is done
+                            lineMerges.push_back(LineMerge{path, baseHash, ourHash, theirHash});
+                        }
+                    } else {
+                        // Deleted on one side, changed on the other: keep the change
+                        current.hash = ourHash.empty() ? theirHash : ourHash;
+                        keptChanges.push_back(current.isTree ? path + "/" : path);
+                    }
+                    if (!current.hash.empty()) {
+                        oursHasIt.push_back(!ourHash.empty());
+                        merged.push_back(std::move(current));
+                    }
+                }
+
+                // A file on one side where the other has a directory of the
+                // same name cannot both be checked out: ours stays
+                for (std::size_t e = 0; e + 1 < merged.size();) {
+                    if (merged[e].name != merged[e + 1].name) {
+                        ++e;
+                        continue;
+                    }
+                    keptChanges.push_back(prefix + merged[e].name);
+                    std::size_t drop = oursHasIt[e] ? e + 1 : e;
+                    merged.erase(merged.begin() + drop);
+                    oursHasIt.erase(oursHasIt.begin() + drop);
+                }
+
+                if (merged.empty()) {
+                    return ObjectId(); // the directory is gone
+                }
+                return writeTreeObject(merged);
+            }
+        };
+
+    } // namespace
+
+    MergeResult mergeTrees(const ObjectId& baseTree, const ObjectId& oursTree, const ObjectId& theirsTree,
+                           const std::string& oursLabel, const std::string& theirsLabel, unsigned jobs) {
+        // 1. Merge the trees; files changed on both sides are set aside
+        MergeResult result;
+        TreeMerger merger;
+        result.tree = merger.merge(baseTree, oursTree, theirsTree, "");
+        if (result.tree.empty()) {
+            result.tree = writeTreeObject({});
+        }
+        result.keptChanges = std::move(merger.keptChanges);
+        std::sort(result.keptChanges.begin(), result.keptChanges.end());
+
+        // 2. DSA: THREAD POOL. Each line merge reads its three versions,
+        // merges them and stores the result on its own
+        struct Outcome {
+            bool clean = false;
+            ObjectId blob;
+            std::string marked;
+        };
+        std::vector<Outcome> outcomes(merger.lineMerges.size());
+        if (!merger.lineMerges.empty()) {
+            ThreadPool workers(std::min<unsigned>(ThreadPool::resolveThreadCount(jobs),
+                                                  static_cast<unsigned>(merger.lineMerges.size())));
+            for (std::size_t m = 0; m < merger.lineMerges.size(); ++m) {
+                workers.submit([&, m] {
+                    const LineMerge& job = merger.lineMerges[m];
+                    std::string base, ours, theirs, merged;
+                    if (!job.base.empty()) {
+                        readObjectInto(job.base, base);
+                    }
+                    readObjectInto(job.ours, ours);
+                    readObjectInto(job.theirs, theirs);
+                    Outcome& outcome = outcomes[m];
+                    outcome.clean = mergeText(merged, base, ours, theirs, oursLabel, theirsLabel);
+                    if (outcome.clean) {
+                        outcome.blob = hashString(merged);
+                        writeObject(outcome.blob, ObjectType::Blob, merged);
+                    } else {
+                        outcome.marked = std::move(merged); // empty for binary files
+                    }
+                });
+            }
+            workers.wait();
+        }
+
+        // 3. Put the merged files into the tree (only the trees on their
+        // paths are rewritten)
+        FileMap mergedFiles;
+        for (std::size_t m = 0; m < outcomes.size(); ++m) {
+            const std::string& path = merger.lineMerges[m].path;
+            if (outcomes[m].clean) {
+                mergedFiles.add(path, outcomes[m].blob);
+            } else {
+                result.conflicts.push_back(path);
+                if (!outcomes[m].marked.empty()) {
+                    result.markedFiles.emplace_back(path, std::move(outcomes[m].marked));
+                }
+            }
+        }
+        if (!mergedFiles.empty()) {
+            mergedFiles.normalize();
+            result.tree = updateTree(result.tree, mergedFiles);
+        }
+        std::sort(result.conflicts.begin(), result.conflicts.end());
+        return result;
+    }
+
+} // namespace MiniGit
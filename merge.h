@@ -0,0 +1,47 @@
+/**
+ * merge.h
+ * * Three-way tree merge, the core of 'minigit merge'.
+ *
+ * The trees of the merge base, our commit and their commit are walked
+ * together. A subtree (or file) with the same hash on two sides needs no
+ * work: whichever side changed it wins, without reading it. Only files
+ * changed on both sides are loaded, and their line merges (diff3, see
+ * diff.h) run on a pool of worker threads.
+ */
+
+#ifndef MINIGIT_MERGE_H
+#define MINIGIT_MERGE_H
+
+#include "object_id.h"
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace MiniGit {
+
+    /**
+     * @brief The outcome of a tree merge.
+     */
+    struct MergeResult {
+        ObjectId tree; // the merged root tree; conflicted files hold our version
+        std::vector<std::string> conflicts; // changed on both sides, lines overlap: resolve by hand (sorted)
+        std::vector<std::pair<std::string, std::string>> markedFiles; // path -> text with conflict markers
+        std::vector<std::string> keptChanges; // deleted (or replaced by a directory) on one side,
+                                              // changed on the other: the change was kept (sorted)
+    };
+
+    /**
+     * @brief Merges the changes from 'baseTree' to 'theirsTree' into 'oursTree'.
+     * Files changed on one side take that side; files changed on both are
+     * merged line by line; overlapping changed lines are conflicts. A
+     * file deleted on one side and changed on the other keeps the change,
+     * and is reported for review.
+     * @param oursLabel, theirsLabel Names for the conflict markers.
+     * @param jobs Number of threads for the line merges (0 = one per CPU core).
+     */
+    MergeResult mergeTrees(const ObjectId& baseTree, const ObjectId& oursTree, const ObjectId& theirsTree,
+                           const std::string& oursLabel, const std::string& theirsLabel, unsigned jobs = 0);
+
+} // namespace MiniGit
+
+#endif // MINIGIT_MERGE_H
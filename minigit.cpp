@@ -5,11 +5,38 @@
  */
 
 #include "minigit.h"
+#include "commit_graph.h"
+#include "concurrency.h"
+#include "delta.h"
+#include "diff.h"
+#include "fsmonitor.h"
+#include "index.h"
+#include "merge.h"
+#include "object_cache.h"
+#include "object_store.h"
+#include "pack.h"
+#include "platform.h"
+#include "prefetch.h"
+#include "refs.h"
+#include "remote.h"
+#include "trace.h"
+#include "tree.h"
+#include "worktree.h"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <optional>
 #include <iostream>
+#include <iterator>
 #include <fstream>
 #include <sstream>
-#include <functional> // For std::hash
+#include <string_view>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
 #include <stdexcept> // For std::runtime_error
+#include <mutex>
+#include <thread>
 
 // --- ADD THIS LINE ---
 // This line tells the compiler that "fs" is an alias for "std::filesystem"
@@ -18,129 +45,536 @@ namespace fs = std::filesystem;
 
 namespace MiniGit {
 
+    namespace {
+        // A merge that stopped on conflicts (.minigit/MERGE_HEAD), as
+        // "key: value" lines like a commit object:
+        //   merge: <their commit>
+        //   tree: <merged tree, conflicted files at our version>
+        //   conflict: <path>   (one per conflict)
+        void writeMergeState(const MergeState& state) {
+            std::string content = "merge: " + state.theirs.toHex() + "\ntree: " + state.tree.toHex() + "\n";
+            for (const std::string& path : state.conflicts) {
+                content += "conflict: " + path + "\n";
+            }
+            writeFileAtomic(rootPath(MERGE_FILE), content);
+        }
+
+        // How many commits 'log' keeps requested ahead of the one it prints
+        const std::size_t LOG_READ_AHEAD = 64;
+
+        // A path given on the command line as the index stores it: relative
+        // to the root, generic and normalized ("./a.txt", "d//b.txt" and
+        // "<root>/a.txt" are all "a.txt", the root itself is "."). False
+        // for a path outside the working tree.
+        bool workTreePath(const std::string& given, std::string& out) {
+            fs::path path = fs::path(given).lexically_normal();
+            if (path.is_absolute()) {
+                path = path.lexically_relative(fs::absolute(rootPath(".")).lexically_normal());
+            }
+            out = path.generic_string();
+            while (out.size() > 1 && out.back() == '/') {
+                out.pop_back();
+            }
+            bool outside = out.empty() || path.is_absolute() || out == ".." || out.compare(0, 3, "../") == 0;
+            return !outside;
+        }
+
+        // Whether the filesystem monitor reported 'path' as touched: the
+        // path itself, or a directory above it (moved or removed)
+        bool isTouched(const std::vector<std::string>& touched, std::string_view path) {
+            if (std::binary_search(touched.begin(), touched.end(), path)) {
+                return true;
+            }
+            for (std::size_t slash = path.find('/'); slash != std::string_view::npos; slash = path.find('/', slash + 1)) {
+                if (std::binary_search(touched.begin(), touched.end(), path.substr(0, slash))) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Whether 'changed' is 'path' or lies below it ("" matches all)
+        bool pathMatches(const std::string& changed, const std::string& path) {
+            return changed.compare(0, path.size(), path) == 0 &&
+                   (path.empty() || changed.size() == path.size() || changed[path.size()] == '/');
+        }
+
+        bool matchesAny(const std::string& changed, const std::vector<std::string>& paths) {
+            return paths.empty() || std::any_of(paths.begin(), paths.end(), [&](const std::string& path) {
+                       return pathMatches(changed, path);
+                   });
+        }
+
+        // The diff between two commits: the trees are compared first and
+        // only the changed blobs are read. With 'paths', only the files
+        // at or below them.
+        void appendCommitDiff(std::string& out, const ObjectId& from, const ObjectId& to,
+                              const std::vector<std::string>& paths = {}) {
+            std::string oldText;
+            std::string newText;
+            for (const TreeChange& change : diffCommits(from, to)) {
+                if (!matchesAny(change.path, paths)) {
+                    continue;
+                }
+                oldText.clear();
+                newText.clear();
+                if (!change.oldHash.empty()) {
+                    readObjectInto(change.oldHash, oldText);
+                }
+                if (!change.newHash.empty()) {
+                    readObjectInto(change.newHash, newText);
+                }
+                appendFileDiff(out, change.path, oldText, !change.oldHash.empty(), newText, !change.newHash.empty());
+            }
+        }
+
+        // Whether a commit changed any of the paths, compared with its first
+        // parent: only the trees along each path are read, on both sides
+        bool commitTouches(const CommitInfo& commit, const ObjectId& hash, const std::vector<std::string>& paths) {
+            ObjectId parentTree = getCommitTree(commit.parent);
+            if (commit.tree.empty() || (parentTree.empty() && !commit.parent.empty())) {
+                // A commit that predates trees: compare the file lists
+                for (const TreeChange& change : diffCommits(commit.parent, hash)) {
+                    if (matchesAny(change.path, paths)) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+            for (const std::string& path : paths) {
+                ObjectId file, directory, parentFile, parentDirectory;
+                lookupTreePath(commit.tree, path, file, directory);
+                lookupTreePath(parentTree, path, parentFile, parentDirectory);
+                if (file != parentFile || directory != parentDirectory) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void printWorkingTreeUpdate(const WorkingTreeUpdate& update) {
+            std::string out;
+            for (const std::string& path : update.deleted) {
+                out += "Deleted " + path + "\n";
+            }
+            for (const std::string& path : update.restored) {
+                out += "Restored " + path + "\n";
+            }
+            std::cout << out;
+        }
+    }
+
+    bool readMergeState(MergeState& state) {
+        if (!fs::exists(rootPath(MERGE_FILE))) {
+            return false;
+        }
+        std::istringstream in(readFileContent(rootPath(MERGE_FILE)));
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.rfind("merge: ", 0) == 0) {
+                state.theirs = ObjectId::fromHex(line.substr(7));
+            } else if (line.rfind("tree: ", 0) == 0) {
+                state.tree = ObjectId::fromHex(line.substr(6));
+            } else if (line.rfind("conflict: ", 0) == 0) {
+                state.conflicts.push_back(line.substr(10));
+            }
+        }
+        if (state.theirs.empty() || state.tree.empty()) {
+            throw std::runtime_error("Corrupt merge state in " + MERGE_FILE.string());
+        }
+        return true;
+    }
+
     // --- Core Commands Implementation ---
 
     void init() {
-        if (repoExists()) {
+        if (!initRepository()) {
             std::cout << "MiniGit repository already initialized in " << GIT_DIR << std::endl;
             return;
         }
+        std::cout << "Initialized empty MiniGit repository in " << fs::absolute(rootPath(GIT_DIR)) << std::endl;
+    }
+
+    bool initRepository() {
+        if (repoExists()) {
+            return false;
+        }
         
         // Create the main .minigit directory
-        fs::create_directory(GIT_DIR);
+        fs::create_directory(rootPath(GIT_DIR));
         // Create the 'objects' directory for content-addressed storage
-        fs::create_directory(OBJECTS_DIR);
+        fs::create_directory(rootPath(OBJECTS_DIR));
+
+        // Record the repository format and hash engine
+        upgradeRepoFormat();
         
-        // Create HEAD file, initially empty (no commits)
-        setHEAD(""); 
+        // HEAD starts on the default branch, which has no commit yet
+        setSymbolicHEAD(BRANCH_PREFIX + DEFAULT_BRANCH);
         // Create index file, initially empty (nothing staged)
         setStagingArea({}); 
-        
-        std::cout << "Initialized empty MiniGit repository in " << fs::absolute(GIT_DIR) << std::endl;
+        return true;
     }
 
-    void add(const std::vector<std::string>& filenames) {
-        // Load the current staging area
-        std::map<std::string, std::string> stagedFiles = getStagingArea();
-        
-        for (const auto& filename : filenames) {
-            fs::path filepath = filename;
-            
-            if (!fs::exists(filepath)) {
-                std::cerr << "File not found: " << filename << ". Skipping." << std::endl;
+    void add(const std::vector<std::string>& paths, unsigned jobs) {
+        AddReport report = stageFiles(paths, jobs);
+        if (report.staged.empty() && report.skipped.empty()) {
+            std::cout << "Nothing to add." << std::endl;
+            return;
+        }
+        for (const std::string& message : report.skipped) {
+            std::cerr << message << std::endl;
+        }
+        std::string out;
+        for (const std::string& path : report.staged) {
+            out += "Staged " + path + "\n";
+        }
+        std::cout << out << std::flush;
+    }
+
+    AddReport stageFiles(const std::vector<std::string>& paths, unsigned jobs) {
+        MINIGIT_TRACE_SCOPE("add");
+        upgradeRepoFormat();
+        AddReport report;
+
+        // 0. A directory stands for the new and modified files below it
+        // ("add ." stages the whole working tree). The working tree check
+        // skips unchanged files via the stat cache and the filesystem
+        // monitor, so only those are read again below.
+        std::vector<std::string> filenames;
+        std::optional<WorkingTreeStatus> tree;
+        bool expanded = false;
+        for (const auto& given : paths) {
+            std::string path;
+            if (!workTreePath(given, path)) {
+                report.skipped.push_back("Outside the working tree: " + given + ". Skipping.");
                 continue;
             }
-            if (fs::is_directory(filepath)) {
-                std::cerr << "Cannot add directories: " << filename << ". Skipping." << std::endl;
+            std::error_code error;
+            if (!fs::is_directory(rootPath(path), error)) {
+                filenames.push_back(path);
                 continue;
             }
+            if (!tree) {
+                tree = checkWorkingTree(jobs, true);
+            }
+            expanded = true;
+            std::string prefix = path == "." ? std::string() : path + "/";
+            for (const auto* list : {&tree->modified, &tree->untracked}) {
+                for (const auto& file : *list) {
+                    if (file.compare(0, prefix.size(), prefix) == 0) {
+                        filenames.push_back(file);
+                    }
+                }
+            }
+        }
+        if (expanded) {
+            std::sort(filenames.begin(), filenames.end());
+            filenames.erase(std::unique(filenames.begin(), filenames.end()), filenames.end());
+            if (filenames.empty()) {
+                return report; // nothing to add
+            }
+        }
 
-            // 1. Read file content
-            std::string content = readFileContent(filepath);
-            
-            // 2. DSA: HASHING
-            // Hash the content to get a unique ID
-            std::string hash = hashString(content);
-            
-            // 3. Store the content in the 'objects' directory
-            // This is our "blob" object.
-            fs::path objectPath = OBJECTS_DIR / hash;
-            if (!fs::exists(objectPath)) {
-                writeFileContent(objectPath, content);
+        // The work is split into a three stage pipeline so the disk and the
+        // CPU are busy at the same time:
+        //   reader (1 thread) -> hashers (N threads) -> object writer (1 thread)
+        // The queues between the stages are bounded, so at most a few file
+        // contents are held in memory no matter how many files are added.
+        unsigned hashThreads = ThreadPool::resolveThreadCount(jobs);
+
+        struct StagedBlob {
+            std::size_t slot = 0; // position of the file in 'filenames'
+            std::string content;
+            ObjectId hash;
+            bool streamed = false; // a big file: hashed and stored in one pass, never held in memory
+        };
+        struct FileResult {
+            ObjectId hash;
+            std::string error;
+            FileStat stat;
+        };
+        std::vector<FileResult> results(filenames.size());
+
+        // The index doubles as a stat cache: a file whose size, timestamps
+        // and inode match its entry is unchanged and is not read again.
+        IndexView index;
+        index.load(rootPath(INDEX_FILE));
+
+        BoundedQueue<StagedBlob> readQueue(hashThreads * 2);
+        BoundedQueue<StagedBlob> writeQueue(hashThreads * 2);
+
+        const uint64_t streamThreshold = bigFileThreshold();
+
+        // 1. Read stage: read the files in order
+        std::thread reader([&] {
+            MINIGIT_TRACE_SCOPE("add: read files");
+            for (std::size_t i = 0; i < filenames.size(); ++i) {
+                fs::path filepath = rootPath(filenames[i]);
+
+                if (!statFile(filepath, results[i].stat)) {
+                    results[i].error = "File not found: " + filenames[i] + ". Skipping.";
+                    continue;
+                }
+                // No throwing overloads on this thread: an escaping
+                // exception would terminate the process
+                std::error_code error;
+                bool isDirectory = fs::is_directory(filepath, error);
+                if (error) {
+                    results[i].error = "Cannot read " + filenames[i] + ": " + error.message() + ". Skipping.";
+                    continue;
+                }
+                if (isDirectory) {
+                    results[i].error = "Cannot add directories: " + filenames[i] + ". Skipping.";
+                    continue;
+                }
+
+                std::size_t position;
+                if (index.find(filenames[i], position) && index.statMatches(position, results[i].stat)) {
+                    results[i].hash = index.hash(position); // unchanged since it was hashed
+                    continue;
+                }
+
+                try {
+                    StagedBlob blob;
+                    blob.slot = i;
+                    if (results[i].stat.size >= streamThreshold) {
+                        blob.streamed = true; // left for a hasher to stream
+                    } else {
+                        blob.content = readFileContent(filepath);
+                    }
+                    readQueue.push(std::move(blob));
+                } catch (const std::exception& e) {
+                    results[i].error = e.what();
+                }
+            }
+            readQueue.close();
+        });
+
+        // 3. Write stage: store each new blob in the 'objects' directory
+        std::thread writer([&] {
+            MINIGIT_TRACE_SCOPE("add: write objects");
+            std::unordered_set<ObjectId> written; // blobs shared by several files are written once
+            StagedBlob blob;
+            while (writeQueue.pop(blob)) {
+                try {
+                    if (written.insert(blob.hash).second && !blob.streamed) {
+                        writeObject(blob.hash, ObjectType::Blob, blob.content);
+                    }
+                    results[blob.slot].hash = blob.hash;
+                } catch (const std::exception& e) {
+                    results[blob.slot].error = e.what();
+                }
+            }
+        });
+
+        // 2. DSA: HASHING
+        // Hash stage: the thread pool hashes contents as soon as they are read
+        std::exception_ptr hashError;
+        {
+            ThreadPool hashers(hashThreads);
+            for (unsigned t = 0; t < hashers.size(); ++t) {
+                hashers.submit([&] {
+                    StagedBlob blob;
+                    while (readQueue.pop(blob)) {
+                        if (blob.streamed) {
+                            try {
+                                blob.hash = writeBlobFromFile(rootPath(filenames[blob.slot]));
+                            } catch (const std::exception& e) {
+                                results[blob.slot].error = e.what();
+                                continue;
+                            }
+                        } else {
+                            blob.hash = hashString(blob.content);
+                        }
+                        writeQueue.push(std::move(blob));
+                    }
+                });
+            }
+            try {
+                hashers.wait();
+            } catch (...) {
+                hashError = std::current_exception();
+                readQueue.close(); // unblock the reader
             }
-            
-            // 4. DSA: HASH MAP (std::map)
-            // Add or update the file in our staging area (map)
-            stagedFiles[filename] = hash;
-            
-            std::cout << "Staged " << filename << std::endl;
         }
-        
-        // Save the updated staging area back to the index file
-        setStagingArea(stagedFiles);
+        writeQueue.close();
+
+        reader.join();
+        writer.join();
+        if (hashError) {
+            std::rethrow_exception(hashError);
+        }
+
+        // 4. Report the results in the order the files were given, so the
+        // report does not depend on which thread finished first.
+        std::vector<IndexRecord> added;
+        for (std::size_t i = 0; i < filenames.size(); ++i) {
+            if (!results[i].error.empty()) {
+                report.skipped.push_back(std::move(results[i].error));
+                continue;
+            }
+            IndexRecord record;
+            record.path = filenames[i];
+            record.hash = results[i].hash;
+            record.stat = results[i].stat;
+            record.flags = INDEX_STAGED;
+            added.push_back(record);
+            report.staged.push_back(filenames[i]);
+        }
+
+        // Sort the new entries by path; if a path was given twice the last
+        // one wins, just like assigning into a map.
+        std::stable_sort(added.begin(), added.end(), [](const IndexRecord& a, const IndexRecord& b) {
+            return a.path < b.path;
+        });
+        std::vector<IndexRecord> newEntries;
+        for (std::size_t i = 0; i < added.size(); ++i) {
+            if (i + 1 < added.size() && added[i + 1].path == added[i].path) {
+                continue;
+            }
+            newEntries.push_back(added[i]);
+        }
+
+        // 5. DSA: MERGE of two sorted lists
+        // Merge the new entries into the (sorted, memory-mapped) index
+        // and save it back to the index file (once)
+        std::vector<IndexRecord> merged;
+        merged.reserve(index.size() + newEntries.size());
+        std::size_t i = 0;
+        std::size_t j = 0;
+        while (i < index.size() || j < newEntries.size()) {
+            if (j == newEntries.size() || (i < index.size() && index.path(i) < newEntries[j].path)) {
+                merged.push_back(index.record(i));
+                ++i;
+            } else {
+                if (i < index.size() && index.path(i) == newEntries[j].path) {
+                    ++i; // replaced by the newly staged version
+                }
+                merged.push_back(newEntries[j]);
+                ++j;
+            }
+        }
+        std::string indexContent = encodeIndex(merged, index.fsmonitorToken());
+        index.close();
+        writeIndexContent(rootPath(INDEX_FILE), std::move(indexContent));
+        return report;
     }
 
-    void commit(const std::string& message) {
-        // 1. Load the staging area
-        std::map<std::string, std::string> stagedFiles = getStagingArea();
-        
-        if (stagedFiles.empty()) {
+    void commit(const std::string& message, bool all) {
+        // "commit -a": stage every modified tracked file first
+        if (all) {
+            upgradeRepoFormat();
+            WorkingTreeStatus tree = checkWorkingTree(0, false);
+            if (!tree.modified.empty()) {
+                add(tree.modified);
+            }
+        }
+        ObjectId commitHash = createCommit(message);
+        if (commitHash.empty()) {
             std::cout << "Nothing to commit, working tree clean." << std::endl;
             return;
         }
+        std::cout << "Committed [" << commitHash.toHex() << "] " << message << std::endl;
+    }
+
+    ObjectId createCommit(const std::string& message) {
+        MINIGIT_TRACE_SCOPE("commit");
+        upgradeRepoFormat();
+
+        // 1. Load the staging area: the index entries flagged as staged
+        // (the others are just the stat cache of unchanged files)
+        FileMap stagedFiles = getStagingArea();
+
+        // A merge that stopped on conflicts is concluded by this commit,
+        // once every conflicted file has been staged
+        MergeState mergeState;
+        bool merging = readMergeState(mergeState);
+        if (merging) {
+            std::vector<std::string> unresolved;
+            for (const std::string& path : mergeState.conflicts) {
+                ObjectId staged;
+                if (!stagedFiles.find(path, staged)) {
+                    unresolved.push_back(path);
+                }
+            }
+            if (!unresolved.empty()) {
+                std::string list;
+                for (const std::string& path : unresolved) {
+                    list += "\n        " + path;
+                }
+                throw Error(ErrorCode::Conflict, "Fatal: Resolve the conflicts and 'add' these files first:" + list);
+            }
+        }
+
+        if (stagedFiles.empty() && !merging) {
+            return ObjectId(); // nothing to commit, working tree clean
+        }
 
         // 2. Get the current HEAD (parent commit)
         // This is the "pointer" for our linked list
-        std::string parentCommit = getHEAD();
+        ObjectId parentCommit = getHEAD();
 
-        // 3. DSA: HASH MAP (std::map)
-        // Create the new commit's file map (tree).
-        // Start by inheriting all files from the parent commit.
-        std::map<std::string, std::string> commitFiles;
-        if (!parentCommit.empty()) {
-            commitFiles = getCommitFiles(parentCommit);
+        // 3. DSA: TREE (path copying)
+        // Start from the parent's root tree and rewrite only the trees on
+        // the paths of the staged files. Unchanged subtrees are never read,
+        // so the cost follows the staged set, not the whole repository.
+        ObjectId treeHash;
+        ObjectId parentTree = merging ? mergeState.tree : getCommitTree(parentCommit);
+        if (!parentTree.empty() || parentCommit.empty()) {
+            treeHash = updateTree(parentTree, stagedFiles);
+        } else {
+            // 4. The parent predates trees: build the full tree once from
+            // its inline file list (later commits take the fast path)
+            FileMap commitFiles = getCommitFiles(parentCommit);
+            for (const FileMap::Entry& file : stagedFiles) {
+                commitFiles.add(file.path, file.hash); // replaces the parent's version
+            }
+            commitFiles.normalize();
+            treeHash = writeTree(commitFiles);
         }
 
-        // 4. Update the map with the newly staged files
-        for (const auto& pair : stagedFiles) {
-            commitFiles[pair.first] = pair.second;
-        }
-        
         // 5. Build the "commit object" content
         std::stringstream commitContent;
         
         // DSA: LINKED LIST
         // Add a pointer to the parent commit
-        commitContent << "parent: " << parentCommit << "\n";
-        commitContent << "message: " << message << "\n";
-        
-        // Add all the tracked files (our "tree")
-        for (const auto& pair : commitFiles) {
-            commitContent << "file: " << pair.first << " " << pair.second << "\n";
+        commitContent << "parent: " << parentCommit.toHex() << "\n";
+        if (merging) {
+            commitContent << "merge: " << mergeState.theirs.toHex() << "\n";
         }
+        commitContent << "tree: " << treeHash.toHex() << "\n";
+        commitContent << "date: " << std::chrono::duration_cast<std::chrono::seconds>(
+                                        std::chrono::system_clock::now().time_since_epoch()).count() << "\n";
+        commitContent << "message: " << message << "\n";
         
         // 6. DSA: HASHING
         // Hash the commit object itself to get its unique ID
         std::string commitString = commitContent.str();
-        std::string commitHash = hashString(commitString);
+        ObjectId commitHash = hashString(commitString);
         
         // 7. Save the commit object
-        writeFileContent(OBJECTS_DIR / commitHash, commitString);
+        writeObject(commitHash, ObjectType::Commit, commitString);
         
         // 8. DSA: LINKED LIST
         // Update HEAD to point to this new commit.
-        // We are inserting at the head of the list.
-        setHEAD(commitHash);
+        // We are inserting at the head of the list, which only works if
+        // nobody else did meanwhile: the branch must still be at the parent
+        // (otherwise this fails, and the staged files stay staged).
+        setHEAD(commitHash, &parentCommit);
+        if (merging) {
+            fs::remove(rootPath(MERGE_FILE));
+        }
         
-        // 9. Clear the staging area
+        // 9. Clear the staging area (the files stay in the index, unstaged,
+        // as the stat cache for the next 'add' or 'status')
         setStagingArea({});
-        
-        std::cout << "Committed [" << commitHash << "] " << message << std::endl;
+        return commitHash;
     }
 
-    void log() {
+    void log(bool patch, const std::vector<std::string>& pathArgs) {
+        MINIGIT_TRACE_SCOPE("log");
         // 1. Get the current HEAD (start of the linked list)
-        std::string currentCommitHash = getHEAD();
+        ObjectId currentCommitHash = getHEAD();
         
         if (currentCommitHash.empty()) {
             std::cout << "No commits yet." << std::endl;
@@ -148,196 +582,1365 @@ namespace MiniGit {
         }
         
         // 2. DSA: LINKED LIST TRAVERSAL
-        // Loop as long as we have a valid commit hash
-        while (!currentCommitHash.empty()) {
-            fs::path commitPath = OBJECTS_DIR / currentCommitHash;
-            if (!fs::exists(commitPath)) {
-                std::cerr << "Fatal: Missing commit object " << currentCommitHash << std::endl;
+        // The walker follows the commit-graph where it covers the history;
+        // the message itself still comes from the commit object, which the
+        // object cache keeps parsed for the rest of this process. As the
+        // graph names the commits ahead before their objects are read, a
+        // window of them is read (and, with -p, diffed) in the background
+        // while the ones before are printed.
+        //
+        // With paths, the commits the graph's changed-path filters rule
+        // out are skipped right here, unread; the others are checked
+        // against their trees in the background.
+        std::vector<std::string> paths;
+        for (const std::string& arg : pathArgs) {
+            std::string path = fs::path(arg).lexically_normal().generic_string();
+            while (!path.empty() && path.back() == '/') {
+                path.pop_back();
+            }
+            if (path.empty() || path == ".") {
+                paths.clear(); // the whole tree
                 break;
             }
-            
-            std::string commitContent = readFileContent(commitPath);
-            std::stringstream ss(commitContent);
-            std::string line;
-            
-            std::string parentHash = "";
-            std::string message = "";
-            
-            // Read the commit object line by line
-            while (std::getline(ss, line)) {
-                if (line.rfind("parent: ", 0) == 0) {
-                    parentHash = line.substr(8);
-                } else if (line.rfind("message: ", 0) == 0) {
-                    message = line.substr(9);
+            paths.push_back(path);
+        }
+        std::vector<ChangedPathKey> keys;
+        for (const std::string& path : paths) {
+            keys.push_back(changedPathKey(path));
+        }
+
+        struct Entry {
+            ObjectId hash;
+            std::shared_ptr<const CommitInfo> commit;
+            bool shown = true;
+            std::string patch;
+        };
+        Prefetcher<Entry> entries([patch, &paths](const ObjectId& hash) {
+            Entry entry{hash, getCommit(hash), true, std::string()};
+            if (!paths.empty() && !commitTouches(*entry.commit, hash, paths)) {
+                entry.shown = false;
+            } else if (patch && entry.commit->secondParent.empty()) {
+                appendCommitDiff(entry.patch, entry.commit->parent, hash, paths);
+            }
+            return entry;
+        });
+        CommitWalker walker(currentCommitHash);
+        bool walking = true;
+        while (true) {
+            Entry entry;
+            try {
+                while (walking && entries.pending() < LOG_READ_AHEAD) {
+                    walking = walker.next(currentCommitHash);
+                    if (!walking) {
+                        break;
+                    }
+                    uint32_t position = walker.graphPosition();
+                    if (!keys.empty() && position != CommitGraph::NO_PARENT &&
+                        std::none_of(keys.begin(), keys.end(), [&](const ChangedPathKey& key) {
+                            return walker.graph()->mayHaveChanged(position, key);
+                        })) {
+                        continue; // certainly did not change any of the paths
+                    }
+                    entries.request(currentCommitHash);
+                }
+                if (entries.pending() == 0) {
+                    break;
                 }
+                entry = entries.next();
+            } catch (const std::runtime_error& e) {
+                std::cerr << "Fatal: " << e.what() << std::endl;
+                break;
+            }
+            if (!entry.shown) {
+                continue;
             }
             
-            // Print commit info
-            std::cout << "commit " << currentCommitHash << "\n";
-            std::cout << "    " << message << "\n" << std::endl;
-            
-            // 3. Move to the next node in the list
-            currentCommitHash = parentHash;
+            // 3. Print commit info
+            std::cout << "commit " << entry.hash.toHex() << "\n";
+            std::cout << "    " << entry.commit->message << "\n" << std::endl;
+            if (!entry.patch.empty()) {
+                std::cout << entry.patch << std::endl;
+            }
+        }
+    }
+
+    void diff(const std::vector<std::string>& commits) {
+        std::string out;
+        std::string oldText; // reused: every blob is inflated into the same buffers
+
+        if (commits.size() == 2) {
+            // 1. DSA: TREE DIFF by sorted merge; subtrees with equal hashes
+            // are skipped unread, so only the changed blobs are loaded
+            appendCommitDiff(out, resolveObjectName(commits[0]), resolveObjectName(commits[1]));
+            std::cout << out << std::flush;
+            return;
+        }
+
+        // 2. No commits: the working tree against the index. Only the
+        // files the working tree check reports as changed are looked at;
+        // they are memory-mapped rather than read.
+        WorkingTreeStatus tree = checkWorkingTree(0, false);
+        std::vector<std::string> paths;
+        std::merge(tree.modified.begin(), tree.modified.end(), tree.deleted.begin(), tree.deleted.end(),
+                   std::back_inserter(paths));
+        if (paths.empty()) {
+            return;
+        }
+        IndexView index;
+        index.load(rootPath(INDEX_FILE));
+        FileMap headFiles = getCommitFiles(getHEAD()); // for files the index does not know
+        for (const std::string& path : paths) {
+            ObjectId expected;
+            std::size_t position;
+            if (index.find(path, position)) {
+                expected = index.hash(position);
+            } else if (!headFiles.find(path, expected)) {
+                continue;
+            }
+            oldText.clear();
+            readObjectInto(expected, oldText);
+            MappedFile file;
+            bool exists = file.open(rootPath(path));
+            std::string_view current = exists ? std::string_view(reinterpret_cast<const char*>(file.data()), file.size())
+                                              : std::string_view();
+            appendFileDiff(out, path, oldText, true, current, exists);
+            std::cout << out;
+            out.clear();
+        }
+        std::cout << std::flush;
+    }
+
+    void revList(const std::string& start, bool countOnly) {
+        ObjectId startHash = start.empty() ? getHEAD() : resolveObjectName(start);
+
+        // Buffered: with a commit-graph this loop never touches the disk
+        std::string out;
+        std::size_t count = 0;
+        CommitWalker walker(startHash);
+        ObjectId hash;
+        char hex[2 * ObjectId::MAX_BYTES];
+        while (walker.next(hash)) {
+            ++count;
+            if (!countOnly) {
+                hash.writeHex(hex);
+                out.append(hex, hash.hexLength);
+                out += '\n';
+            }
+        }
+        if (countOnly) {
+            out = std::to_string(count) + "\n";
+        }
+        std::cout << out << std::flush;
+    }
+
+
+    void status(unsigned jobs) {
+        WorkingTreeStatus tree = checkWorkingTree(jobs, true);
+
+        // Print the report (buffered, flushed once)
+        std::ostringstream out;
+        MergeState mergeState;
+        if (readMergeState(mergeState)) {
+            out << "Merging " << mergeState.theirs.toHex() << " (commit to conclude the merge)\n";
+            std::vector<std::string> unresolved;
+            for (const std::string& path : mergeState.conflicts) {
+                if (!std::binary_search(tree.staged.begin(), tree.staged.end(), path)) {
+                    unresolved.push_back(path);
+                }
+            }
+            if (!unresolved.empty()) {
+                out << "Unmerged paths (fix them, then 'add'):\n";
+                for (const auto& path : unresolved) {
+                    out << "        conflict: " << path << "\n";
+                }
+            }
+            out << "\n";
+        }
+        if (!tree.staged.empty()) {
+            out << "Changes to be committed:\n";
+            for (const auto& path : tree.staged) {
+                out << "        staged:   " << path << "\n";
+            }
+            out << "\n";
+        }
+        if (!tree.modified.empty() || !tree.deleted.empty()) {
+            out << "Changes not staged for commit:\n";
+            for (const auto& path : tree.modified) {
+                out << "        modified: " << path << "\n";
+            }
+            for (const auto& path : tree.deleted) {
+                out << "        deleted:  " << path << "\n";
+            }
+            out << "\n";
+        }
+        if (!tree.untracked.empty()) {
+            out << "Untracked files:\n";
+            for (const auto& path : tree.untracked) {
+                out << "        " << path << "\n";
+            }
+            out << "\n";
         }
+        if (tree.staged.empty() && tree.modified.empty() && tree.deleted.empty()) {
+            out << (tree.untracked.empty() ? "Nothing to commit, working tree clean.\n"
+                                           : "Nothing added to commit, but untracked files are present.\n");
+        }
+        std::cout << out.str() << std::flush;
     }
 
 
     // --- Helper Functions Implementation ---
 
+    WorkingTreeStatus checkWorkingTree(unsigned jobs, bool findUntracked) {
+        MINIGIT_TRACE_SCOPE("checkWorkingTree");
+        IndexView index;
+        index.load(rootPath(INDEX_FILE));
+        WorkingTreeStatus result;
+
+        // 1. Staged files: everything flagged in the index
+        for (std::size_t i = 0; i < index.size(); ++i) {
+            if (index.isStaged(i)) {
+                result.staged.emplace_back(index.path(i));
+            }
+        }
+
+        // 2. Ask the filesystem monitor (if one runs) what was touched since
+        // the index was written. This comes before any check, so a change
+        // made while the checks run is reported next time.
+        FsmonitorToken oldToken = index.fsmonitorToken();
+        FsmonitorToken newToken;
+        std::vector<std::string> touched;
+        bool everything = true;
+        bool monitored = queryFsmonitor(oldToken, newToken, touched, everything);
+        bool trustMonitor = monitored && !everything;
+
+        // 3. Tracked files: the index entries plus the files of HEAD that
+        // the index does not know yet (e.g. committed by an older MiniGit).
+        // Both lists are sorted, so one merge pass visits each path once.
+        FileMap headFiles = getCommitFiles(getHEAD());
+        struct TrackedFile {
+            IndexRecord record;
+            bool cached = false;    // 'record' came from the index (stat data is valid)
+            std::size_t position = 0;
+            enum Outcome { Unchanged, Refreshed, Modified, Deleted } outcome = Unchanged;
+        };
+        std::vector<TrackedFile> tracked;
+        tracked.reserve(index.size() + headFiles.size());
+
+        std::size_t i = 0;
+        auto head = headFiles.begin();
+        while (i < index.size() || head != headFiles.end()) {
+            TrackedFile file;
+            if (head == headFiles.end() || (i < index.size() && index.path(i) <= head->path)) {
+                if (head != headFiles.end() && index.path(i) == head->path) {
+                    ++head;
+                }
+                file.record = index.record(i);
+                file.cached = true;
+                file.position = i++;
+            } else {
+                file.record.path = head->path;
+                file.record.hash = head->hash;
+                ++head;
+            }
+            tracked.push_back(file);
+        }
+
+        // 4. Check the tracked files against the working tree, and walk it
+        // for untracked ones. Both run on all cores. A file the monitor
+        // vouches for is not even stat'ed; one whose stat data matches the
+        // index is not read.
+        std::vector<std::string> worktreeFiles;
+        if (findUntracked) {
+            worktreeFiles = scanWorkingTree(IgnoreRules::load(rootPath(IGNORE_FILE)), jobs);
+        }
+        {
+            ThreadPool checkers(jobs);
+            const std::size_t batch = 256; // files per job, so small trees need few jobs
+            for (std::size_t first = 0; first < tracked.size(); first += batch) {
+                checkers.submit([&, first] {
+                    std::size_t last = std::min(first + batch, tracked.size());
+                    for (std::size_t k = first; k < last; ++k) {
+                        TrackedFile& file = tracked[k];
+                        if (trustMonitor && file.cached && (file.record.flags & INDEX_FSMONITOR_VALID) &&
+                            !isTouched(touched, file.record.path)) {
+                            continue; // unchanged when last checked, untouched since
+                        }
+                        FileStat current;
+                        if (!statFile(rootPath(std::string(file.record.path)), current)) {
+                            file.outcome = TrackedFile::Deleted;
+                        } else if (file.cached && index.statMatches(file.position, current)) {
+                            // Unchanged: the stat cache says so, no need to read it
+                        } else if (fileHasId(rootPath(std::string(file.record.path)), file.record.hash)) {
+                            // Same content, but the cached stat data was stale,
+                            // racy or missing. Remember the fresh stat data so
+                            // the next run is cheap; a racy entry keeps its
+                            // stat data, and the rewrite alone makes it clean
+                            // (the new index is newer than the file).
+                            file.record.stat = current;
+                            file.outcome = TrackedFile::Refreshed;
+                        } else {
+                            file.outcome = TrackedFile::Modified;
+                        }
+                    }
+                });
+            }
+            checkers.wait();
+        }
+
+        // 5. Sort the outcomes into the report, and flag what the monitor
+        // may vouch for next time
+        std::vector<IndexRecord> refreshed;
+        refreshed.reserve(tracked.size());
+        bool indexChanged = monitored ? newToken != oldToken && (everything || !touched.empty()) : oldToken.valid();
+        for (auto& file : tracked) {
+            if (file.outcome == TrackedFile::Modified) {
+                result.modified.emplace_back(file.record.path);
+            } else if (file.outcome == TrackedFile::Deleted) {
+                result.deleted.emplace_back(file.record.path);
+            }
+            uint8_t flags = file.record.flags & static_cast<uint8_t>(~INDEX_FSMONITOR_VALID);
+            if (monitored && (file.outcome == TrackedFile::Unchanged || file.outcome == TrackedFile::Refreshed)) {
+                flags |= INDEX_FSMONITOR_VALID;
+            }
+            // A HEAD file new to the index caches its stat data from now on
+            indexChanged = indexChanged || !file.cached || file.outcome == TrackedFile::Refreshed ||
+                           flags != file.record.flags;
+            file.record.flags = flags;
+            refreshed.push_back(file.record);
+        }
+
+        // 6. Untracked: in the working tree but not tracked (both lists are
+        // sorted, so again one merge pass)
+        auto trackedIt = tracked.begin();
+        for (auto& path : worktreeFiles) {
+            while (trackedIt != tracked.end() && trackedIt->record.path < path) {
+                ++trackedIt;
+            }
+            if (trackedIt == tracked.end() || trackedIt->record.path != path) {
+                result.untracked.push_back(std::move(path));
+            }
+        }
+
+        // 7. Save the refreshed stat data and flags, so unchanged files that
+        // had to be hashed (or stat'ed) this time are skipped next time
+        if (indexChanged) {
+            std::string content = encodeIndex(refreshed, monitored ? newToken : FsmonitorToken());
+            index.close();
+            writeIndexContent(rootPath(INDEX_FILE), std::move(content));
+        }
+        return result;
+    }
+
+    namespace {
+        fs::path repositoryRoot; // "" for the working directory
+    }
+
+    void setRepositoryRoot(const fs::path& root) {
+        repositoryRoot = root;
+    }
+
+    fs::path rootPath(const fs::path& relative) {
+        return repositoryRoot.empty() ? relative : repositoryRoot / relative;
+    }
+
     bool repoExists() {
-        return fs::exists(GIT_DIR) && fs::is_directory(GIT_DIR);
+        std::error_code error;
+        return fs::is_directory(rootPath(GIT_DIR), error);
     }
 
     std::string readFileContent(const fs::path& filename) {
-        std::ifstream file(filename);
+        std::ifstream file(filename, std::ios::binary | std::ios::ate);
         if (!file.is_open()) {
             throw std::runtime_error("Could not open file: " + filename.string());
         }
-        std::stringstream buffer;
-        buffer << file.rdbuf();
-        return buffer.str();
+        // Size the string once and read straight into it (no stringstream
+        // copy). Large blobs do not come through here: see writeBlobFromFile.
+        std::streamoff size = file.tellg();
+        std::string content;
+        if (size > 0) {
+            content.resize(static_cast<std::size_t>(size));
+            file.seekg(0);
+            file.read(&content[0], size);
+            content.resize(static_cast<std::size_t>(file.gcount()));
+        }
+        MINIGIT_TRACE_COUNT(BytesRead, content.size());
+        return content;
     }
 
     void writeFileContent(const fs::path& filepath, const std::string& content) {
-        std::ofstream file(filepath);
+        std::ofstream file(filepath, std::ios::binary);
         if (!file.is_open()) {
             throw std::runtime_error("Could not write to file: " + filepath.string());
         }
         file << content;
+        MINIGIT_TRACE_COUNT(BytesWritten, content.size());
     }
 
-    std::string hashString(const std::string& content) {
-        // Use std::hash to generate a hash value (a number)
-        std::hash<std::string> hasher;
-        size_t hashVal = hasher(content);
-        
-        // Convert the number to a hexadecimal string
-        std::stringstream ss;
-        ss << std::hex << hashVal;
-        return ss.str();
+    namespace {
+        // How long writeFileAtomic waits for another command's lock
+        const unsigned FILE_LOCK_TIMEOUT_MS = 5000;
+
+        // Locks are held for milliseconds: one this old was left behind
+        // by a command that crashed
+        const auto STALE_LOCK_AGE = std::chrono::minutes(10);
+
+        bool isStaleLock(const fs::path& lockPath) {
+            std::error_code ec;
+            fs::file_time_type modified = fs::last_write_time(lockPath, ec);
+            return !ec && fs::file_time_type::clock::now() - modified > STALE_LOCK_AGE;
+        }
+    }
+
+    LockFile::LockFile(const fs::path& target) : target_(target), lockPath_(target) {
+        lockPath_ += ".lock";
     }
 
-    std::map<std::string, std::string> getStagingArea() {
-        // DSA: The index file *is* our staging area.
-        // We parse it into a std::map (Hash Map) for easy manipulation.
-        std::map<std::string, std::string> stagedFiles;
-        if (!fs::exists(INDEX_FILE)) {
+    LockFile::~LockFile() {
+        if (held_) {
+            std::error_code ec;
+            fs::remove(lockPath_, ec); // never committed: release it
+        }
+    }
+
+    bool LockFile::tryLock() {
+        held_ = file_.create(lockPath_, false);
+        return held_;
+    }
+
+    void LockFile::lock(unsigned timeoutMs) {
+        // Back off exponentially: a lock is normally held for milliseconds
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+        std::chrono::milliseconds pause(1);
+        bool checkedStale = false;
+        while (!tryLock()) {
+            if (!checkedStale) {
+                checkedStale = true;
+                if (isStaleLock(lockPath_)) {
+                    std::error_code ec;
+                    fs::remove(lockPath_, ec);
+                    continue;
+                }
+            }
+            if (std::chrono::steady_clock::now() >= deadline) {
+                throw Error(ErrorCode::Locked, "Unable to lock " + lockPath_.string() +
+                                         ": another command is running (if none is, remove the file)");
+            }
+            std::this_thread::sleep_for(pause);
+            pause = std::min(pause * 2, std::chrono::milliseconds(50));
+        }
+    }
+
+    void LockFile::commit(const std::string& content) {
+        DurabilityMode mode = durabilityMode();
+
+        // 1. Write the new version next to the file
+        file_.write(content.data(), content.size());
+        file_.commit(mode == DurabilityMode::Object);
+
+        // 2. Batch mode: one filesystem flush covers the pending objects
+        // and this file (flushObjects does it if it has any work)
+        bool flushed = flushObjects();
+        if (mode == DurabilityMode::Batch && !flushed) {
+            syncFilesystem(lockPath_.parent_path());
+        }
+
+        // 3. Swap it in (which also releases the lock), and make the new
+        // name durable
+        fs::rename(lockPath_, target_);
+        held_ = false;
+        if (mode != DurabilityMode::None) {
+            syncDirectory(target_.parent_path());
+        }
+    }
+
+    void writeFileAtomic(const fs::path& filepath, const std::string& content) {
+        LockFile lock(filepath);
+        lock.lock(FILE_LOCK_TIMEOUT_MS);
+        lock.commit(content);
+    }
+
+    ObjectId hashString(const std::string& content) {
+        MINIGIT_TRACE_SCOPE("hashString");
+        MINIGIT_TRACE_COUNT(BytesHashed, content.size());
+        // Run the content through the repository's hash engine and
+        // use the digest as the object id
+        std::unique_ptr<Hasher> hasher = makeObjectHasher();
+        hasher->update(content);
+        return hasher->finalizeId();
+    }
+
+    std::unique_ptr<Hasher> makeObjectHasher() {
+        return makeHasher(getRepoHashAlgorithm());
+    }
+
+    bool fileHasId(const fs::path& file, const ObjectId& id) {
+        std::unique_ptr<Hasher> hasher = makeObjectHasher();
+        if (hasher->digestSize() * 2 != id.hexLength) {
+            return contentHasId(readFileContent(file), id); // legacy ids are never large files
+        }
+        std::ifstream in(file, std::ios::binary);
+        if (!in.is_open()) {
+            return false;
+        }
+        std::vector<char> buffer(1024 * 1024);
+        while (in) {
+            in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            hasher->update(reinterpret_cast<const unsigned char*>(buffer.data()), static_cast<std::size_t>(in.gcount()));
+            MINIGIT_TRACE_COUNT(BytesHashed, in.gcount());
+        }
+        return hasher->finalizeId() == id;
+    }
+
+    bool contentHasId(const std::string& content, const ObjectId& id) {
+        std::unique_ptr<Hasher> hasher = makeObjectHasher();
+        if (hasher->digestSize() * 2 != id.hexLength) {
+            // A legacy std::hash id. std::hash differs between standard
+            // libraries, so compare against the stored object instead.
+            return objectExists(id) && readObject(id) == content;
+        }
+        MINIGIT_TRACE_COUNT(BytesHashed, content.size());
+        hasher->update(content);
+        return hasher->finalizeId() == id;
+    }
+
+    // The config is read once per process and then cached, because the
+    // hashing threads of 'add' ask for the algorithm on every object.
+    namespace {
+        std::mutex configMutex;
+        bool configLoaded = false;
+        std::map<std::string, std::string> cachedConfig;
+
+        std::map<std::string, std::string> loadConfig() {
+            std::map<std::string, std::string> config;
+            if (!fs::exists(rootPath(CONFIG_FILE))) {
+                return config;
+            }
+            std::stringstream ss(readFileContent(rootPath(CONFIG_FILE)));
+            std::string line;
+            while (std::getline(ss, line)) {
+                std::size_t eq = line.find('=');
+                if (line.empty() || line[0] == '#' || eq == std::string::npos) {
+                    continue;
+                }
+                auto trim = [](std::string text) {
+                    std::size_t begin = text.find_first_not_of(" \t\r");
+                    std::size_t end = text.find_last_not_of(" \t\r");
+                    return begin == std::string::npos ? std::string() : text.substr(begin, end - begin + 1);
+                };
+                config[trim(line.substr(0, eq))] = trim(line.substr(eq + 1));
+            }
+            return config;
+        }
+    }
+
+    std::map<std::string, std::string> readConfig() {
+        std::lock_guard<std::mutex> lock(configMutex);
+        if (!configLoaded) {
+            cachedConfig = loadConfig();
+            configLoaded = true;
+        }
+        return cachedConfig;
+    }
+
+    void reloadConfig() {
+        std::lock_guard<std::mutex> lock(configMutex);
+        cachedConfig.clear();
+        configLoaded = false;
+    }
+
+    namespace {
+        // Stat data of the files behind the caches, as of the last refresh
+        struct CacheStamps {
+            FileStat config;
+            FileStat refs;
+            FileStat graph;
+            FileStat packs; // the pack directory: adding or removing a pack changes it
+            FileStat shallow;
+        };
+        std::mutex stampsMutex;
+        CacheStamps stamps;
+        fs::path stampedRoot;
+
+        FileStat stampOf(const fs::path& path) {
+            FileStat stat; // all zero when missing
+            statFile(path, stat);
+            return stat;
+        }
+    }
+
+    void refreshCaches() {
+        std::lock_guard<std::mutex> lock(stampsMutex);
+        std::error_code error;
+        fs::path root = fs::absolute(rootPath("."), error);
+        CacheStamps current{stampOf(rootPath(CONFIG_FILE)), stampOf(rootPath(PACKED_REFS_FILE)),
+                            stampOf(rootPath(COMMIT_GRAPH_FILE)), stampOf(rootPath(PACK_DIR)),
+                            stampOf(rootPath(SHALLOW_FILE))};
+        bool switched = root != stampedRoot;
+        if (switched || current.config != stamps.config) {
+            reloadConfig();
+        }
+        if (switched || current.refs != stamps.refs) {
+            reloadRefs();
+        }
+        if (switched || current.graph != stamps.graph) {
+            reloadCommitGraph();
+        }
+        if (switched || current.packs != stamps.packs) {
+            reloadPacks();
+        }
+        if (switched || current.shallow != stamps.shallow) {
+            reloadShallow();
+        }
+        if (switched || current.config != stamps.config || current.shallow != stamps.shallow) {
+            // Another repository's objects, a budget from another config,
+            // or commits parsed with parents that are cut off now (or the
+            // reverse)
+            reloadObjectCache();
+        }
+        stamps = current;
+        stampedRoot = root;
+    }
+
+    void writeConfig(const std::map<std::string, std::string>& config) {
+        std::stringstream content;
+        for (const auto& pair : config) {
+            content << pair.first << " = " << pair.second << "\n";
+        }
+        writeFileAtomic(rootPath(CONFIG_FILE), content.str());
+
+        std::lock_guard<std::mutex> lock(configMutex);
+        cachedConfig = config;
+        configLoaded = true;
+    }
+
+    int getRepoFormatVersion() {
+        std::map<std::string, std::string> config = readConfig();
+        auto it = config.find("repositoryformatversion");
+        return it == config.end() ? 0 : std::stoi(it->second);
+    }
+
+    std::size_t upgradeRepoFormat() {
+        int version = getRepoFormatVersion();
+        if (version > REPO_FORMAT_VERSION) {
+            throw std::runtime_error("Repository format version " + std::to_string(version) +
+                                     " is newer than this MiniGit supports");
+        }
+        if (version == REPO_FORMAT_VERSION) {
+            return 0;
+        }
+        // Move loose objects into the sharded layout before the version
+        // says so; readers still find objects left in the old place
+        std::size_t moved = 0;
+        if (version < 3) {
+            moved = shardLooseObjects();
+        }
+
+        // HEAD held the commit id itself; it becomes the default branch
+        if (version < 5 && fs::exists(rootPath(HEAD_FILE)) && symbolicHEAD().empty()) {
+            ObjectId head = getHEAD();
+            if (!head.empty()) {
+                updateRef(BRANCH_PREFIX + DEFAULT_BRANCH, head);
+            }
+            setSymbolicHEAD(BRANCH_PREFIX + DEFAULT_BRANCH);
+        }
+
+        std::map<std::string, std::string> config = readConfig();
+        config["repositoryformatversion"] = std::to_string(REPO_FORMAT_VERSION);
+        config["hash"] = hashAlgorithmName(HashAlgorithm::Blake3);
+        writeConfig(config);
+        return moved;
+    }
+
+    HashAlgorithm getRepoHashAlgorithm() {
+        std::map<std::string, std::string> config = readConfig();
+        auto it = config.find("hash");
+        return it == config.end() ? HashAlgorithm::Blake3 : parseHashAlgorithm(it->second);
+    }
+
+    ObjectId resolveObjectName(const std::string& name) {
+        // 1. Symbolic names: HEAD and branches (a branch wins over a hash
+        // prefix that happens to spell the same)
+        if (name == "HEAD") {
+            ObjectId head = getHEAD();
+            if (head.empty()) {
+                throw Error(ErrorCode::NotFound, "Fatal: HEAD has no commit yet");
+            }
+            return head;
+        }
+        std::string refName;
+        ObjectId refId;
+        if (findBranch(name, refName, refId)) {
+            return refId;
+        }
+        // Remote-tracking branches ("origin/main") and other full ref names
+        if (readRef(REMOTE_PREFIX + name, refId) || (name.compare(0, 5, "refs/") == 0 && readRef(name, refId))) {
+            return refId;
+        }
+
+        // 2. The command line is where ids arrive as (possibly abbreviated) hex
+        if (name.empty() || !ObjectId::isHex(name)) {
+            throw Error(ErrorCode::NotFound, "Fatal: Not a valid object name: " + name);
+        }
+        ObjectId id = ObjectId::fromHex(name);
+        if (objectExists(id)) {
+            return id;
+        }
+        if (name.size() < 4) {
+            throw Error(ErrorCode::NotFound, "Fatal: Not a valid object name: " + name);
+        }
+
+        // Abbreviated hash: look for exactly one object starting with it,
+        // loose or packed
+        ObjectId match;
+        char hex[2 * ObjectId::MAX_BYTES];
+        auto consider = [&](const ObjectId& candidate) {
+            if (candidate.hexLength < name.size() || candidate == match) {
+                return;
+            }
+            candidate.writeHex(hex);
+            if (name.compare(0, name.size(), hex, name.size()) == 0) {
+                if (!match.empty()) {
+                    throw std::runtime_error("Fatal: Ambiguous object name: " + name);
+                }
+                match = candidate;
+            }
+        };
+        for (const ObjectId& candidate : listLooseObjects()) {
+            consider(candidate);
+        }
+        for (const ObjectId& candidate : listPackedObjects()) {
+            consider(candidate);
+        }
+        if (match.empty()) {
+            throw Error(ErrorCode::NotFound, "Fatal: Not a valid object name: " + name);
+        }
+        return match;
+    }
+
+    void gc() {
+        MINIGIT_TRACE_SCOPE("gc");
+        upgradeRepoFormat();
+
+        // 1. Everything we have: loose object files and the existing packs.
+        // Big blobs stay loose, so they are never loaded into memory whole.
+        std::vector<ObjectId> looseObjects;
+        const uint64_t streamThreshold = bigFileThreshold();
+        for (const ObjectId& hash : listLooseObjects()) {
+            uint64_t size;
+            if (looseObjectSize(hash, size) && size < streamThreshold) {
+                looseObjects.push_back(hash);
+            }
+        }
+        std::vector<fs::path> oldPacks = listPackFiles();
+        std::set<ObjectId> allObjects(looseObjects.begin(), looseObjects.end());
+        for (const ObjectId& hash : listPackedObjects()) {
+            allObjects.insert(hash);
+        }
+        if (allObjects.empty()) {
+            std::cout << "Nothing to pack." << std::endl;
+            return;
+        }
+
+        // 2. Pick delta bases. The versions of one path across history are
+        // usually near-identical, so walk the history newest first and let
+        // each older version be a delta against the next newer one. The
+        // newest version stays whole, which keeps 'checkout HEAD' cheap.
+        // DSA: HASH MAP of object -> base, forming chains (a forest)
+        std::unordered_map<ObjectId, ObjectId> deltaBase;
+        // Every branch is walked, each until it joins history already seen.
+        // Only the files that differ from the commit walked before are
+        // visited (the others already hold the same blob), so the cost
+        // follows the changes rather than history x files.
+        std::unordered_set<ObjectId> walked;
+        for (const ObjectId& tip : listRefTips()) {
+            std::unordered_map<std::string, ObjectId> newestVersion; // path -> blob seen last
+            CommitWalker walker(tip);
+            ObjectId commitHash;
+            ObjectId previous; // empty: the first commit is diffed against nothing
+            while (walker.next(commitHash) && walked.insert(commitHash).second) {
+                for (const TreeChange& change : diffCommits(previous, commitHash)) {
+                    if (change.newHash.empty()) {
+                        continue; // not in this commit: the newer version stays the base
+                    }
+                    ObjectId& newer = newestVersion[change.path];
+                    if (!newer.empty() && newer != change.newHash && deltaBase.count(change.newHash) == 0 &&
+                        allObjects.count(newer) != 0) {
+                        deltaBase[change.newHash] = newer;
+                    }
+                    newer = change.newHash;
+                }
+                previous = commitHash;
+            }
+        }
+
+        // 3. Write the pack, every base before the objects built on it.
+        // Deltas are only kept when they are much smaller than the object,
+        // and chains are capped so a read never replays too many deltas.
+        const int MAX_DELTA_DEPTH = 10;
+        PackWriter writer(rootPath(PACK_DIR));
+        std::unordered_map<ObjectId, int> depth;
+        std::unordered_set<ObjectId> inProgress; // guards against cycles in deltaBase
+        std::size_t deltaCount = 0;
+
+        // DSA: DEPTH-FIRST SEARCH along the delta chain
+        std::function<void(const ObjectId&)> pack = [&](const ObjectId& hash) {
+            if (writer.contains(hash) || !inProgress.insert(hash).second) {
+                return;
+            }
+            // Chunked blobs are packed as their manifest and chunks
+            std::string content;
+            ObjectType type = readStoredObject(hash, content);
+
+            auto base = deltaBase.find(hash);
+            if (base != deltaBase.end()) {
+                pack(base->second); // no-op if already written (or a cycle)
+                std::string delta, baseContent;
+                if (writer.contains(base->second) && depth[base->second] < MAX_DELTA_DEPTH &&
+                    readStoredObject(base->second, baseContent) == type &&
+                    computeDelta(baseContent, content, delta, content.size() / 2)) {
+                    writer.addDelta(hash, type, content.size(), base->second, delta);
+                    depth[hash] = depth[base->second] + 1;
+                    ++deltaCount;
+                    return;
+                }
+            }
+            writer.addWhole(hash, type, content);
+            depth[hash] = 0;
+        };
+        for (const ObjectId& hash : allObjects) {
+            pack(hash);
+        }
+        fs::path newPack = writer.finish();
+        try {
+            verifyPack(newPack); // before the packs it replaces go
+        } catch (const std::runtime_error&) {
+            fs::path newIdx = newPack;
+            std::error_code ec;
+            fs::remove(newIdx.replace_extension(".idx"), ec);
+            fs::remove(newPack, ec);
+            throw;
+        }
+
+        // 4. The new pack holds everything: drop what it replaces
+        reloadPacks();
+        for (const fs::path& oldPack : oldPacks) {
+            if (oldPack != newPack) {
+                fs::path oldIdx = oldPack;
+                fs::remove(oldIdx.replace_extension(".idx")); // unpublish first
+                fs::remove(oldPack);
+            }
+        }
+        reloadPacks();
+        for (const ObjectId& hash : looseObjects) {
+            removeLooseObject(hash);
+        }
+
+        std::cout << "Packed " << writer.size() << " objects (" << deltaCount << " as deltas) into "
+                  << newPack.filename().string() << std::endl;
+
+        // 5. Index the history for fast walks (log, rev-list, ancestry checks)
+        commitGraphWrite();
+    }
+
+    void commitGraphWrite() {
+        upgradeRepoFormat();
+        std::size_t commitCount = writeCommitGraph();
+        std::cout << "Wrote commit-graph with " << commitCount << " commit(s)" << std::endl;
+    }
+
+    FileMap getStagingArea() {
+        MINIGIT_TRACE_SCOPE("getStagingArea");
+        // DSA: The index file holds our staging area (the entries flagged
+        // as staged) next to the stat cache of all tracked files.
+        // It is stored sorted, so the FileMap is filled in order (no
+        // sorting) for callers that want to manipulate it. The commands
+        // themselves work on the memory-mapped IndexView directly.
+        FileMap stagedFiles;
+        IndexView index;
+        if (!index.load(rootPath(INDEX_FILE))) {
             return stagedFiles;
         }
-        
-        std::ifstream file(INDEX_FILE);
-        std::string line;
-        while (std::getline(file, line)) {
-            std::stringstream ss(line);
-            std::string filename, hash;
-            if (ss >> filename >> hash) {
-                stagedFiles[filename] = hash;
+        for (std::size_t i = 0; i < index.size(); ++i) {
+            if (index.isStaged(i)) {
+                stagedFiles.add(index.path(i), index.hash(i));
             }
         }
         return stagedFiles;
     }
 
-    void setStagingArea(const std::map<std::string, std::string>& stagedFiles) {
-        // Write the std::map (Hash Map) back to the index file.
-        std::ofstream file(INDEX_FILE);
-        for (const auto& pair : stagedFiles) {
-            file << pair.first << " " << pair.second << "\n";
+    void setStagingArea(const FileMap& stagedFiles) {
+        MINIGIT_TRACE_SCOPE("setStagingArea");
+        // Write the FileMap back to the index file as the new set of
+        // staged files. Other tracked files stay in the index (as
+        // unstaged entries) so their stat data is not lost.
+        // The FileMap is already sorted by path, as the index format requires.
+        IndexView index;
+        index.load(rootPath(INDEX_FILE));
+
+        std::vector<IndexRecord> records;
+        records.reserve(index.size() + stagedFiles.size());
+        std::size_t i = 0;
+        auto it = stagedFiles.begin();
+        while (i < index.size() || it != stagedFiles.end()) {
+            if (it == stagedFiles.end() || (i < index.size() && index.path(i) < it->path)) {
+                IndexRecord record = index.record(i);
+                record.flags &= static_cast<uint8_t>(~INDEX_STAGED);
+                records.push_back(record);
+                ++i;
+                continue;
+            }
+
+            IndexRecord record;
+            record.path = it->path;
+            record.hash = it->hash;
+            if (i < index.size() && index.path(i) == it->path) {
+                if (index.hash(i) == record.hash) {
+                    record.stat = index.stat(i); // same content, the cached stat still applies
+                }
+                ++i;
+            }
+            record.flags = INDEX_STAGED;
+            records.push_back(record);
+            ++it;
         }
+
+        std::string content = encodeIndex(records, index.fsmonitorToken());
+        index.close();
+        writeIndexContent(rootPath(INDEX_FILE), std::move(content));
     }
 
-    std::string getHEAD() {
-        if (!fs::exists(HEAD_FILE)) {
-            return "";
-        }
-        return readFileContent(HEAD_FILE);
+    ObjectId getCommitParent(const ObjectId& commitHash) {
+        return commitHash.empty() ? ObjectId() : getCommit(commitHash)->parent;
     }
 
-    void setHEAD(const std::string& commitHash) {
-        writeFileContent(HEAD_FILE, commitHash);
+    ObjectId getCommitTree(const ObjectId& commitHash) {
+        return commitHash.empty() ? ObjectId() : getCommit(commitHash)->tree;
     }
 
-    std::map<std::string, std::string> getCommitFiles(const std::string& commitHash) {
-        // This function parses a commit object and reconstructs its file map
-        std::map<std::string, std::string> files;
+    FileMap getCommitFiles(const ObjectId& commitHash) {
+        MINIGIT_TRACE_SCOPE("getCommitFiles");
+        // This function reconstructs a commit's file map from its
+        // (cached) parsed form
+        FileMap files;
         if (commitHash.empty()) {
             return files;
         }
         
-        fs::path commitPath = OBJECTS_DIR / commitHash;
-        if (!fs::exists(commitPath)) {
-            throw std::runtime_error("Cannot find commit object: " + commitHash);
+        // Commits point at a root tree; older ones list every file inline
+        std::shared_ptr<const CommitInfo> commit = getCommit(commitHash);
+        for (const auto& file : commit->inlineFiles) {
+            files.add(file.first, file.second);
         }
-        
-        std::stringstream ss(readFileContent(commitPath));
-        std::string line;
-        
-        while (std::getline(ss, line)) {
-            if (line.rfind("file: ", 0) == 0) {
-                std::stringstream line_ss(line.substr(6));
-                std::string filename, hash;
-                if (line_ss >> filename >> hash) {
-                    files[filename] = hash;
-                }
-            }
+        if (!commit->tree.empty()) {
+            flattenTree(commit->tree, "", files);
         }
+        files.normalize(); // tree order is not path order ("a.txt" < "a/b")
         return files;
     }
 
     // --- CHECKOUT FUNCTION ---
-    void checkout(const std::string& commitHash) {
+    void checkout(const std::string& commitName, unsigned jobs) {
+        CheckoutReport report = checkoutCommit(commitName, jobs);
+        if (report.discardedStaged != 0) {
+            std::cout << "Warning: Discarding " << report.discardedStaged << " staged change(s)." << std::endl;
+        }
+        printWorkingTreeUpdate(report.files);
+        if (report.abandonedMerge) {
+            std::cout << "Abandoned the merge in progress." << std::endl;
+        }
+        if (!report.branch.empty()) {
+            std::cout << "\nSwitched to branch '" << report.branch.substr(BRANCH_PREFIX.size()) << "'" << std::endl;
+        } else {
+            std::cout << "\nHEAD is now at " << report.commit.toHex() << std::endl;
+        }
+    }
+
+    CheckoutReport checkoutCommit(const std::string& commitName, unsigned jobs) {
+        MINIGIT_TRACE_SCOPE("checkout");
+        upgradeRepoFormat();
+        CheckoutReport report;
+
         // 0. Check if the target commit object actually exists
-        fs::path commitPath = OBJECTS_DIR / commitHash;
-        if (commitHash.empty() || !fs::exists(commitPath)) {
-            throw std::runtime_error("Fatal: Not a valid commit hash: " + commitHash);
+        // (a branch switches to it; abbreviated hashes are expanded first)
+        if (!findBranch(commitName, report.branch, report.commit)) {
+            report.branch.clear();
+            report.commit = resolveObjectName(commitName);
+        }
+
+        // 1. Count the staged changes (which will be lost)
+        {
+            IndexView index;
+            index.load(rootPath(INDEX_FILE));
+            for (std::size_t i = 0; i < index.size(); ++i) {
+                report.discardedStaged += index.isStaged(i) ? 1 : 0;
+            }
+        }
+
+        // 2. What differs between HEAD and the target. Identical subtrees
+        // are skipped, so this follows the size of the difference. The
+        // target's trees are all needed (its file list is flattened from
+        // them), so they are read ahead in parallel first.
+        prefetchTrees(getCommitTree(report.commit));
+        std::vector<TreeChange> changes = diffCommits(getHEAD(), report.commit);
+        report.files = updateWorkingTree(changes, getCommitFiles(report.commit), jobs);
+
+        // 3. A merge in progress is abandoned
+        if (fs::exists(rootPath(MERGE_FILE))) {
+            fs::remove(rootPath(MERGE_FILE));
+            report.abandonedMerge = true;
+        }
+
+        // 4. Update HEAD: onto the branch, or detached at the commit
+        if (!report.branch.empty()) {
+            setSymbolicHEAD(report.branch);
+        } else {
+            detachHEAD(report.commit);
+        }
+        return report;
+    }
+
+    // --- MERGE FUNCTION ---
+    bool merge(const std::string& name, unsigned jobs) {
+        MergeReport report = mergeBranch(name, jobs);
+        if (report.kind == MergeReport::Kind::UpToDate) {
+            std::cout << "Already up to date." << std::endl;
+            return true;
+        }
+        printWorkingTreeUpdate(report.files);
+        if (report.kind == MergeReport::Kind::FastForward) {
+            std::cout << "\nFast-forward to " << report.commit.toHex() << std::endl;
+            return true;
+        }
+        if (report.kind == MergeReport::Kind::Merged) {
+            std::cout << "\nMerged " << name << " [" << report.commit.toHex() << "]" << std::endl;
+            return true;
+        }
+        std::ostringstream out;
+        for (const std::string& path : report.conflicts) {
+            out << "CONFLICT: Merge conflict in " << path << "\n";
+        }
+        for (const std::string& path : report.keptChanges) {
+            out << "Kept " << path << " (deleted on one side, changed on the other)\n";
+        }
+        out << (report.conflicts.empty()
+                    ? "Review the merged files, then 'commit' to record the merge.\n"
+                    : "Automatic merge failed: fix the conflicts, 'add' the files and 'commit' the result.\n");
+        std::cout << "\n" << out.str() << std::flush;
+        return report.conflicts.empty();
+    }
+
+    MergeReport mergeBranch(const std::string& name, unsigned jobs) {
+        MINIGIT_TRACE_SCOPE("merge");
+        upgradeRepoFormat();
+        if (fs::exists(rootPath(MERGE_FILE))) {
+            throw Error(ErrorCode::Conflict, "Fatal: A merge is in progress: resolve it and commit (or check "
+                                             "out a branch to abandon it)");
         }
+        MergeReport report;
 
-        // 1. Warn user if they have staged changes (which will be lost)
-        std::map<std::string, std::string> stagedFiles = getStagingArea();
-        if (!stagedFiles.empty()) {
-            std::cout << "Warning: Discarding " << stagedFiles.size() << " staged change(s)." << std::endl;
+        // 0. The two sides
+        ObjectId ours = getHEAD();
+        ObjectId theirs = resolveObjectName(name);
+
+        // 1. The merge rewrites the working tree, so it must not hold
+        // anything that is not committed
+        WorkingTreeStatus tree = checkWorkingTree(jobs, false);
+        if (!tree.staged.empty() || !tree.modified.empty() || !tree.deleted.empty()) {
+            throw Error(ErrorCode::Conflict, "Fatal: Commit your changes before merging (see 'minigit status')");
+        }
+
+        // 2. The merge base decides what each side changed
+        ObjectId base = mergeBase(ours, theirs);
+        if (!ours.empty() && base == theirs) {
+            report.kind = MergeReport::Kind::UpToDate;
+            return report;
+        }
+        if (base == ours) {
+            // Nothing to merge on our side: move forward
+            report.files = updateWorkingTree(diffCommits(ours, theirs), getCommitFiles(theirs), jobs);
+            setHEAD(theirs, &ours);
+            report.kind = MergeReport::Kind::FastForward;
+            report.commit = theirs;
+            return report;
+        }
+        if (base.empty()) {
+            throw std::runtime_error("Fatal: " + name + " shares no history with HEAD");
+        }
+
+        // 3. DSA: THREE-WAY MERGE of the trees (commits from before trees
+        // get one built from their file list)
+        auto treeOf = [](const ObjectId& commitHash) {
+            ObjectId treeHash = getCommitTree(commitHash);
+            return treeHash.empty() ? writeTree(getCommitFiles(commitHash)) : treeHash;
+        };
+        ObjectId ourTree = treeOf(ours);
+        MergeResult result = mergeTrees(treeOf(base), ourTree, treeOf(theirs), "HEAD", name, jobs);
+
+        // 4. Bring the working tree to the merged tree
+        std::vector<TreeChange> changes;
+        diffTrees(ourTree, result.tree, "", changes);
+        FileMap mergedFiles;
+        flattenTree(result.tree, "", mergedFiles);
+        mergedFiles.normalize();
+        report.files = updateWorkingTree(changes, mergedFiles, jobs);
+
+        // 5. Nothing to look at: record the merge commit
+        if (result.conflicts.empty() && result.keptChanges.empty()) {
+            std::stringstream commitContent;
+            commitContent << "parent: " << ours.toHex() << "\n";
+            commitContent << "merge: " << theirs.toHex() << "\n";
+            commitContent << "tree: " << result.tree.toHex() << "\n";
+            commitContent << "date: " << std::chrono::duration_cast<std::chrono::seconds>(
+                                             std::chrono::system_clock::now().time_since_epoch()).count() << "\n";
+            commitContent << "message: Merge " << name << "\n";
+            std::string commitString = commitContent.str();
+            ObjectId commitHash = hashString(commitString);
+            writeObject(commitHash, ObjectType::Commit, commitString);
+            setHEAD(commitHash, &ours);
+            report.kind = MergeReport::Kind::Merged;
+            report.commit = commitHash;
+            return report;
         }
 
-        // 2. Get the file maps (trees) for both commits
-        std::map<std::string, std::string> targetFiles = getCommitFiles(commitHash);
-        std::map<std::string, std::string> headFiles = getCommitFiles(getHEAD());
+        // 6. Stop for the user: conflicted files get their markers, and the
+        // merge is remembered for the commit that concludes it
+        for (const auto& marked : result.markedFiles) {
+            writeFileContent(rootPath(marked.first), marked.second);
+        }
+        writeMergeState(MergeState{theirs, result.tree, result.conflicts});
+        report.kind = MergeReport::Kind::Stopped;
+        report.conflicts = std::move(result.conflicts);
+        report.keptChanges = std::move(result.keptChanges);
+        return report;
+    }
+
+    void printMergeBase(const std::string& first, const std::string& second) {
+        ObjectId base = mergeBase(resolveObjectName(first), resolveObjectName(second));
+        if (base.empty()) {
+            throw std::runtime_error("Fatal: " + first + " and " + second + " share no history");
+        }
+        std::cout << base.toHex() << std::endl;
+    }
 
-        // 3. Delete files that are in HEAD but not in the target commit
-        for (const auto& pair : headFiles) {
-            const std::string& filename = pair.first;
-            if (targetFiles.find(filename) == targetFiles.end()) {
-                // Not in the target, so delete it
-                if (fs::exists(filename)) {
-                    fs::remove(filename);
-                    std::cout << "Deleted " << filename << std::endl;
+    // --- BRANCH FUNCTIONS ---
+    void listBranches() {
+        std::string current = symbolicHEAD();
+        std::ostringstream out;
+        for (const auto& ref : listRefs()) {
+            if (ref.first.compare(0, BRANCH_PREFIX.size(), BRANCH_PREFIX) != 0) {
+                continue;
+            }
+            out << (ref.first == current ? "* " : "  ") << ref.first.substr(BRANCH_PREFIX.size()) << "\n";
+        }
+        if (current.empty()) {
+            out << "* (HEAD detached at " << getHEAD().toHex() << ")\n";
+        }
+        std::cout << out.str() << std::flush;
+    }
+
+    void createBranch(const std::string& name, const std::string& start) {
+        upgradeRepoFormat();
+        ObjectId commitHash = resolveObjectName(start.empty() ? "HEAD" : start);
+        createBranchAt(name, commitHash);
+        std::cout << "Created branch '" << name << "' at " << commitHash.toHex() << std::endl;
+    }
+
+    void createBranchAt(const std::string& name, const ObjectId& commitHash) {
+        upgradeRepoFormat();
+        ObjectId none; // the branch must not exist yet
+        try {
+            updateRef(BRANCH_PREFIX + name, commitHash, &none);
+        } catch (const std::runtime_error&) {
+            ObjectId existing;
+            if (readRef(BRANCH_PREFIX + name, existing)) {
+                throw Error(ErrorCode::Conflict, "Fatal: A branch named '" + name + "' already exists");
+            }
+            throw;
+        }
+    }
+
+    void deleteBranch(const std::string& name) {
+        ObjectId commitHash = removeBranch(name);
+        std::cout << "Deleted branch '" << name << "' (was " << commitHash.toHex() << ")" << std::endl;
+    }
+
+    ObjectId removeBranch(const std::string& name) {
+        upgradeRepoFormat();
+        std::string refName;
+        ObjectId commitHash;
+        if (!findBranch(name, refName, commitHash)) {
+            throw Error(ErrorCode::NotFound, "Fatal: Branch '" + name + "' not found");
+        }
+        if (refName == symbolicHEAD()) {
+            throw Error(ErrorCode::Conflict, "Fatal: Cannot delete the current branch '" + name + "'");
+        }
+        updateRef(refName, ObjectId(), &commitHash);
+        return commitHash;
+    }
+
+    WorkingTreeUpdate updateWorkingTree(const std::vector<TreeChange>& changes, const FileMap& targetFiles,
+                                        unsigned jobs) {
+        MINIGIT_TRACE_SCOPE("updateWorkingTree");
+        WorkingTreeUpdate update;
+
+        // 1. Delete the files that are gone in the target, and collect
+        // the ones whose content must be written
+        struct WriteJob {
+            std::string path;
+            ObjectId hash;
+            std::size_t record; // position in 'records'
+        };
+        std::vector<WriteJob> writes;
+        std::set<std::string, std::less<>> changed;
+        std::set<std::string> parents; // of the deleted files
+        for (const TreeChange& change : changes) {
+            changed.insert(change.path);
+            if (change.newHash.empty() && fs::exists(rootPath(change.path))) {
+                fs::remove(rootPath(change.path));
+                update.deleted.push_back(change.path);
+                for (std::size_t slash = change.path.rfind('/'); slash != std::string::npos && slash != 0;
+                     slash = change.path.rfind('/', slash - 1)) {
+                    parents.insert(change.path.substr(0, slash));
                 }
             }
         }
 
-        // 4. Create/overwrite all files from the target commit
-        for (const auto& pair : targetFiles) {
-            const std::string& filename = pair.first;
-            const std::string& contentHash = pair.second;
-            
-            fs::path targetPath = filename;
+        // The directories the deletions emptied go too, deepest first, so
+        // a file can take the place of a directory ("d/x" becoming "d")
+        for (auto it = parents.rbegin(); it != parents.rend(); ++it) {
+            std::error_code error;
+            fs::remove(rootPath(*it), error); // fails, harmlessly, while anything is left in it
+        }
 
-            // Important: Ensure the directory exists before writing!
-            if (targetPath.has_parent_path()) {
-                fs::create_directories(targetPath.parent_path());
+        // 2. Files that are the same on both sides are only rewritten if
+        // the working copy no longer holds them. The index entries of
+        // those keep their stat data and flags as they are; a file the
+        // filesystem monitor vouches for is not even stat'ed, and the stat
+        // cache answers for the other clean ones without reading them.
+        IndexView index;
+        index.load(rootPath(INDEX_FILE));
+        FsmonitorToken monitorToken;
+        std::vector<std::string> touched;
+        bool everything = true;
+        bool monitored = queryFsmonitor(index.fsmonitorToken(), monitorToken, touched, everything);
+        bool trustMonitor = monitored && !everything;
+        std::vector<IndexRecord> records;
+        records.reserve(targetFiles.size());
+        for (const FileMap::Entry& file : targetFiles) {
+            IndexRecord record;
+            record.path = file.path; // points into targetFiles, which outlives 'records'
+            record.hash = file.hash;
+            bool mustWrite = changed.count(file.path) != 0;
+            if (!mustWrite) {
+                std::size_t position;
+                bool known = index.find(file.path, position) && !index.isStaged(position) &&
+                             index.hash(position) == record.hash;
+                uint8_t flags = known ? index.flags(position) : 0;
+                if (trustMonitor && (flags & INDEX_FSMONITOR_VALID) && !isTouched(touched, file.path)) {
+                    record.stat = index.stat(position); // unchanged, as the monitor saw it
+                    record.flags = flags;
+                    records.push_back(record);
+                    continue;
+                }
+                fs::path path = rootPath(std::string(file.path));
+                bool present = statFile(path, record.stat);
+                bool clean = present && known && index.statMatches(position, record.stat);
+                mustWrite = !clean && (!present || !fs::is_regular_file(path) ||
+                                       !fileHasId(path, file.hash));
+                if (clean) {
+                    record.flags = flags & static_cast<uint8_t>(~INDEX_FSMONITOR_VALID);
+                    if (monitored) {
+                        record.flags |= INDEX_FSMONITOR_VALID; // just checked
+                    }
+                }
             }
+            if (mustWrite) {
+                writes.push_back(WriteJob{std::string(file.path), file.hash, records.size()});
+            }
+            records.push_back(record);
+        }
+        index.close();
+
+        // A partial clone gets the blobs about to be written in one
+        // request, rather than one per file from the worker threads
+        std::vector<ObjectId> blobs;
+        blobs.reserve(writes.size());
+        for (const WriteJob& job : writes) {
+            blobs.push_back(job.hash);
+        }
+        fetchMissingObjects(blobs);
 
-            // Read the blob content from objects
-            std::string content = readFileContent(OBJECTS_DIR / contentHash);
+        // 3. Create every directory the writes need up front, each once,
+        // instead of one create_directories call per file
+        std::set<fs::path> directories;
+        for (const WriteJob& job : writes) {
+            fs::path parent = fs::path(job.path).parent_path();
+            if (!parent.empty()) {
+                directories.insert(parent);
+            }
+        }
+        for (const fs::path& directory : directories) {
+            fs::create_directories(rootPath(directory));
+        }
 
-            // Write the content to the working directory
-            writeFileContent(targetPath, content);
-            std::cout << "Restored " << filename << std::endl;
+        // 4. DSA: THREAD POOL. Reading (and inflating) blobs and writing
+        // files are independent per file, so spread them over the workers.
+        // Each job only touches its own record.
+        {
+            ThreadPool workers(std::min<unsigned>(ThreadPool::resolveThreadCount(jobs),
+                                                  static_cast<unsigned>(std::max<std::size_t>(writes.size(), 1))));
+            for (const WriteJob& job : writes) {
+                workers.submit([&job, &records] {
+                    fs::path path = rootPath(job.path);
+                    readObjectToFile(job.hash, path); // streamed for big blobs
+                    statFile(path, records[job.record].stat);
+                });
+            }
+            workers.wait();
+        }
+        for (WriteJob& job : writes) {
+            update.restored.push_back(std::move(job.path));
         }
 
-        // 5. Clear the staging area and update HEAD to point to the new commit
-        setStagingArea({});
-        setHEAD(commitHash);
+        // 5. The index becomes the target: nothing staged, and fresh stat
+        // data for the files written so later 'add' and 'status' calls know
+        // they are unchanged without reading them. The monitor's token is
+        // kept, so the entries it vouches for stay vouched for.
+        writeIndexContent(rootPath(INDEX_FILE), encodeIndex(records, monitored ? monitorToken : FsmonitorToken()));
+        return update;
+    }
+
+    std::vector<TreeChange> diffCommits(const ObjectId& fromCommit, const ObjectId& toCommit) {
+        MINIGIT_TRACE_SCOPE("diffCommits");
+        std::vector<TreeChange> changes;
+        ObjectId fromTree = getCommitTree(fromCommit);
+        ObjectId toTree = getCommitTree(toCommit);
+        if ((!fromTree.empty() || fromCommit.empty()) && (!toTree.empty() || toCommit.empty())) {
+            diffTrees(fromTree, toTree, "", changes);
+            return changes;
+        }
 
-        std::cout << "\nHEAD is now at " << commitHash << std::endl;
+        // A commit that predates trees: compare the flat file lists
+        FileMap before = getCommitFiles(fromCommit);
+        FileMap after = getCommitFiles(toCommit);
+        auto it = before.begin();
+        auto jt = after.begin();
+        while (it != before.end() || jt != after.end()) {
+            if (jt == after.end() || (it != before.end() && it->path < jt->path)) {
+                changes.push_back(TreeChange{std::string(it->path), it->hash, ObjectId()});
+                ++it;
+            } else if (it == before.end() || jt->path < it->path) {
+                changes.push_back(TreeChange{std::string(jt->path), ObjectId(), jt->hash});
+                ++jt;
+            } else {
+                if (it->hash != jt->hash) {
+                    changes.push_back(TreeChange{std::string(it->path), it->hash, jt->hash});
+                }
+                ++it;
+                ++jt;
+            }
+        }
+        return changes;
     }
 
 } // namespace MiniGit
@@ -14,6 +14,11 @@
 #include <set>
 #include <map>
 #include <filesystem> // C++17 standard library for file system operations
+#include <stdexcept>
+#include "hash.h"
+#include "object_id.h"
+#include "platform.h"
+#include "tree.h"
 
 // Define our file paths as constants
 namespace MiniGit {
@@ -21,8 +26,66 @@ namespace MiniGit {
     // Use .minigit to avoid conflicts with a real .git folder
     const std::filesystem::path GIT_DIR = ".minigit";
     const std::filesystem::path OBJECTS_DIR = GIT_DIR / "objects";
+    const std::filesystem::path PACK_DIR = OBJECTS_DIR / "pack"; // Packfiles made by 'gc'
     const std::filesystem::path HEAD_FILE = GIT_DIR / "HEAD";
     const std::filesystem::path INDEX_FILE = GIT_DIR / "index"; // Our staging area
+    const std::filesystem::path CONFIG_FILE = GIT_DIR / "config"; // Repo format marker
+    const std::filesystem::path COMMIT_GRAPH_FILE = GIT_DIR / "commit-graph"; // History table made by 'gc'
+    const std::filesystem::path MERGE_FILE = GIT_DIR / "MERGE_HEAD"; // A merge waiting for its conflicts to be resolved
+    const std::filesystem::path SHALLOW_FILE = GIT_DIR / "shallow"; // Commits a shallow clone has without their parents
+
+    /**
+     * @brief Sets the root of the working tree that the paths above, and
+     * the working tree paths the commands take, are relative to. The
+     * default "" is the working directory; a Repository call sets its own
+     * root for its duration instead of changing the working directory of
+     * the whole process. Must not change while a command runs.
+     */
+    void setRepositoryRoot(const std::filesystem::path& root);
+
+    /**
+     * @brief A path relative to the working tree root (a tracked file, or
+     * one of the repository files above) as a path to open.
+     */
+    std::filesystem::path rootPath(const std::filesystem::path& relative);
+
+    // Version of the on-disk repository format written by this build.
+    // Version 0 is a repository without a config file: objects named by
+    // std::hash. Version 1 names new objects with the configured hash
+    // engine; version 0 objects stay readable under their old names.
+    // Version 2 stores objects compressed, with a type/size header.
+    // Version 3 shards loose objects into objects/xx/ subdirectories.
+    // Version 4 stores a commit's files as tree objects, not "file:" lines.
+    // Version 5 keeps branches in packed-refs; HEAD names the current one.
+    const int REPO_FORMAT_VERSION = 5;
+
+    /**
+     * @brief What kind of failure an Error reports, for callers that
+     * react to failures (the Repository API) rather than print them.
+     */
+    enum class ErrorCode {
+        Failed,         // anything else: I/O errors, corrupt files, bad arguments
+        NotARepository, // no .minigit directory
+        NotFound,       // no such object, commit or branch
+        Locked,         // another command holds the lock
+        RefMoved,       // a ref changed between reading and updating it
+        Conflict,       // the repository's state blocks the command (a dirty tree, a merge in progress)
+    };
+
+    /**
+     * @brief An error with a code. Failures without one are plain
+     * std::runtime_error, which this derives from, so 'catch' sites for
+     * either keep working.
+     */
+    class Error : public std::runtime_error {
+    public:
+        Error(ErrorCode code, const std::string& message) : std::runtime_error(message), code_(code) {}
+
+        ErrorCode code() const { return code_; }
+
+    private:
+        ErrorCode code_;
+    };
 
     // --- Core Commands ---
 
@@ -32,33 +95,143 @@ namespace MiniGit {
      */
     void init();
 
+    /**
+     * @brief Creates the repository without printing (what init() does).
+     * @return false if there already is one.
+     */
+    bool initRepository();
+
     /**
      * @brief Adds one or more files to the staging area (index).
      * This reads the file content, hashes it, saves it as a "blob"
      * object, and adds the file's name to the index.
-     * @param filenames A vector of filepaths to add.
+     * Files are read, hashed and written by a pipeline: one reader
+     * thread, a pool of hashing threads and one object writer.
+     * A directory adds every new or modified file below it ("add .").
+     * @param paths The files (or directories) to add.
+     * @param jobs Number of hashing threads (0 = one per CPU core).
      */
-    void add(const std::vector<std::string>& filenames);
+    void add(const std::vector<std::string>& paths, unsigned jobs = 0);
+
+    /**
+     * @brief The outcome of staging files.
+     */
+    struct AddReport {
+        std::vector<std::string> staged;  // in the order given (directories expanded)
+        std::vector<std::string> skipped; // one message per file that could not be staged
+    };
+
+    /**
+     * @brief Stages files without printing (what add() does).
+     * @param paths Files or directories, relative to the root or absolute;
+     * they are stored normalized, and those outside the working tree are
+     * skipped.
+     */
+    AddReport stageFiles(const std::vector<std::string>& paths, unsigned jobs = 0);
 
     /**
      * @brief Creates a new commit from the staged files.
      * This creates a "commit" object that points to the previous
      * commit (its parent) and a "tree" (snapshot) of the staged files.
      * @param message The commit message.
+     * @param all Stage every modified tracked file first ("commit -a").
      */
-    void commit(const std::string& message);
+    void commit(const std::string& message, bool all = false);
+
+    /**
+     * @brief Commits the staged files without printing (what commit()
+     * does, without "-a").
+     * @return The new commit, or an empty id if nothing was staged.
+     */
+    ObjectId createCommit(const std::string& message);
 
     /**
      * @brief Displays the commit history, starting from HEAD.
-     * This traverses the "commit" linked list.
+     * This traverses the "commit" linked list through first parents only
+     * (as 'git log --first-parent' does): the commits a merge brought in
+     * through its second parent are not shown.
+     * @param patch Also show each commit's changes as a diff against its
+     * parent ("log -p"; merge commits show none, having two).
+     * @param paths If not empty, only the commits that changed one of these
+     * files or directories (compared with their first parent), and with
+     * -p only their diffs. The commit-graph's changed-path filters rule
+     * most other commits out without reading their trees.
+     */
+    void log(bool patch = false, const std::vector<std::string>& paths = {});
+
+    /**
+     * @brief Shows staged files, tracked files changed in the working tree,
+     * and untracked files (those not matched by .minigitignore).
+     * Files whose stat data matches the index are not read; files that had
+     * to be hashed get their stat data refreshed in the index.
+     * @param jobs Number of threads for the checks and the working tree
+     * walk (0 = one per CPU core).
      */
-    void log();
+    void status(unsigned jobs = 0);
 
 
     // --- Helper Functions ---
 
     /**
-     * @brief Checks if a .minigit repository exists in the current directory.
+     * @brief What differs between the index and the working tree.
+     */
+    struct WorkingTreeStatus {
+        std::vector<std::string> staged;
+        std::vector<std::string> modified;  // tracked, content differs
+        std::vector<std::string> deleted;   // tracked, file is gone
+        std::vector<std::string> untracked; // not tracked, not ignored
+    };
+
+    /**
+     * @brief Compares the tracked files (index and HEAD) with the working
+     * tree. Files the filesystem monitor reports untouched since they
+     * were last found unchanged are not stat'ed; files whose stat data
+     * matches the index are not read. Refreshed stat data is saved.
+     * @param jobs Number of threads (0 = one per CPU core).
+     * @param findUntracked Also walk the working tree for untracked files.
+     * @return Sorted path lists.
+     */
+    WorkingTreeStatus checkWorkingTree(unsigned jobs, bool findUntracked);
+
+    /**
+     * @brief A merge that stopped on conflicts (.minigit/MERGE_HEAD).
+     */
+    struct MergeState {
+        ObjectId theirs;
+        ObjectId tree; // the merged tree, conflicted files at our version
+        std::vector<std::string> conflicts;
+    };
+
+    /**
+     * @brief Reads the merge in progress.
+     * @return false if there is none.
+     */
+    bool readMergeState(MergeState& state);
+
+    /**
+     * @brief The files updateWorkingTree() changed.
+     */
+    struct WorkingTreeUpdate {
+        std::vector<std::string> deleted;
+        std::vector<std::string> restored;
+    };
+
+    /**
+     * @brief Makes the working tree and the index match a target file
+     * list. Only changed files (and files missing from the working tree)
+     * are written, in parallel, and directories emptied by the deletions
+     * are removed. The index is rewritten with nothing staged: fresh stat
+     * data for the files written, the other entries kept as they were.
+     * @param changes What differs between the current files and the target.
+     * @param targetFiles The target's files (normalized).
+     * @param jobs Number of worker threads (0 = one per CPU core).
+     * @return The files deleted and written.
+     */
+    WorkingTreeUpdate updateWorkingTree(const std::vector<TreeChange>& changes, const FileMap& targetFiles,
+                                        unsigned jobs);
+
+    /**
+     * @brief Checks if a .minigit repository exists in the root (see rootPath).
      * @return true if it exists, false otherwise.
      */
     bool repoExists();
@@ -78,55 +251,332 @@ namespace MiniGit {
     void writeFileContent(const std::filesystem::path& filepath, const std::string& content);
 
     /**
-     * @brief Hashes a string content using std::hash.
+     * @brief Replaces a repository file (HEAD, the index, ...) atomically:
+     * the content goes to "<file>.lock" and is renamed over the file, so
+     * a crash leaves either the old or the new version, never a torn one.
+     * Pending objects are flushed first, so the new file never refers to
+     * objects that could be lost. Flushing follows durabilityMode().
+     * Waits for another command's lock on the file (see LockFile::lock).
+     * @param filepath The file to replace.
+     * @param content The new content.
+     */
+    void writeFileAtomic(const std::filesystem::path& filepath, const std::string& content);
+
+    /**
+     * @brief Exclusive ownership of "<file>.lock", the way to replace a
+     * file that several commands may update at once (read the current
+     * version only after locking, then commit the new one).
+     * The lock is released by commit() or, without one, on destruction.
+     */
+    class LockFile {
+    public:
+        explicit LockFile(const std::filesystem::path& target);
+        ~LockFile();
+
+        LockFile(const LockFile&) = delete;
+        LockFile& operator=(const LockFile&) = delete;
+
+        /**
+         * @brief Takes the lock if nobody holds it.
+         */
+        bool tryLock();
+
+        /**
+         * @brief Waits up to 'timeoutMs' for the lock. A lock file not
+         * touched for ten minutes is taken to be left by a command that
+         * crashed, and removed.
+         * @throws Error (Locked) if it stays taken.
+         */
+        void lock(unsigned timeoutMs);
+
+        /**
+         * @brief Replaces the file with 'content' (durably, as
+         * writeFileAtomic does) and releases the lock.
+         */
+        void commit(const std::string& content);
+
+    private:
+        std::filesystem::path target_;
+        std::filesystem::path lockPath_;
+        NewFile file_;
+        bool held_ = false;
+    };
+
+    /**
+     * @brief Hashes a string content using the repository's hash engine
+     * (BLAKE3 unless the config says otherwise).
      * This is our content-addressing mechanism.
      * @param content The string content to hash.
-     * @return A string representation of the hash.
+     * @return The object id.
+     */
+    ObjectId hashString(const std::string& content);
+
+    /**
+     * @brief Creates a streaming hasher for the repository's hash engine.
+     * Feeding it the same bytes as hashString gives the same id.
+     */
+    std::unique_ptr<Hasher> makeObjectHasher();
+
+    /**
+     * @brief Checks whether a file's content is what the given object id
+     * names, hashing it a buffer at a time.
      */
-    std::string hashString(const std::string& content);
+    bool fileHasId(const std::filesystem::path& file, const ObjectId& id);
+
+    /**
+     * @brief Checks whether content is what the given object id names.
+     * Ids from a legacy (std::hash) repository cannot be recomputed
+     * reliably, so those are compared against the stored object.
+     * @param content The content to check.
+     * @param id The expected object id.
+     */
+    bool contentHasId(const std::string& content, const ObjectId& id);
+
+    /**
+     * @brief Reads the repository config (.minigit/config) as key = value pairs.
+     * @return The settings, or an empty map when there is no config file.
+     */
+    std::map<std::string, std::string> readConfig();
+
+    /**
+     * @brief Forgets the cached config, so the next readConfig() reads
+     * the file again (after another process changed it).
+     */
+    void reloadConfig();
+
+    /**
+     * @brief Drops the caches another process (or another repository)
+     * made stale: the config, the packed refs, the commit-graph, the
+     * packs, the shallow list and the parsed objects. One stat per cached
+     * file; whatever is unchanged stays loaded. Called before each
+     * Repository call and each batch request.
+     */
+    void refreshCaches();
+
+    /**
+     * @brief Writes the repository config (.minigit/config).
+     * @param config The settings to store.
+     */
+    void writeConfig(const std::map<std::string, std::string>& config);
+
+    /**
+     * @brief The format version recorded in the config (0 if there is none).
+     */
+    int getRepoFormatVersion();
+
+    /**
+     * @brief Stamps a legacy repository with the current format marker.
+     * Existing objects are left untouched; new objects use the new engine.
+     * Prints nothing (the command line reports the count).
+     * @return The number of loose objects moved into the sharded layout.
+     */
+    std::size_t upgradeRepoFormat();
+
+    /**
+     * @brief The hash engine configured for new objects.
+     */
+    HashAlgorithm getRepoHashAlgorithm();
+
+    /**
+     * @brief Expands an object name: HEAD, a branch, or a (possibly
+     * abbreviated) hash.
+     * @param name "HEAD", a branch name, a remote-tracking branch
+     * ("origin/main"), a full ref name, a full hash or a
+     * unique prefix of at least 4 characters.
+     * @return The full object id.
+     * @throws std::runtime_error if no object (or more than one) matches.
+     */
+    ObjectId resolveObjectName(const std::string& name);
 
     /**
      * @brief Reads the staging area (index file).
-     * DATA STRUCTURE: Uses std::map as a hash map (filename -> content hash)
-     * @return A map of staged files (filename: hash).
+     * DATA STRUCTURE: a flat FileMap sorted by path (filename -> content hash)
+     * @return The staged files.
      */
-    std::map<std::string, std::string> getStagingArea();
+    FileMap getStagingArea();
 
     /**
      * @brief Writes to the staging area (index file).
-     * DATA STRUCTURE: Uses std::map as a hash map (filename -> content hash)
-     * @param stagedFiles The map of staged files to save.
+     * DATA STRUCTURE: a flat FileMap sorted by path (filename -> content hash)
+     * @param stagedFiles The (normalized) staged files to save.
      */
-    void setStagingArea(const std::map<std::string, std::string>& stagedFiles);
+    void setStagingArea(const FileMap& stagedFiles);
 
     /**
-     * @brief Gets the hash of the current commit (from HEAD file).
-     * @return The commit hash, or an empty string if no commits yet.
+     * @brief Gets the hash of the current commit (HEAD, through the
+     * current branch unless detached).
+     * @return The commit id, or an empty id if no commits yet.
      */
-    std::string getHEAD();
+    ObjectId getHEAD();
 
     /**
-     * @brief Sets the HEAD to point to a new commit hash.
+     * @brief Moves HEAD (the current branch, or HEAD itself when
+     * detached) to a new commit, atomically.
      * @param commitHash The hash of the new commit.
+     * @param expectedOld If given, the commit HEAD must still be at (an
+     * empty id: no commit yet).
+     * @throws std::runtime_error if HEAD moved meanwhile.
      */
-    void setHEAD(const std::string& commitHash);
+    void setHEAD(const ObjectId& commitHash, const ObjectId* expectedOld = nullptr);
 
     /**
      * @brief Reads a commit object and returns its parent's hash.
      * @param commitHash The hash of the commit to read.
      * @return The hash of the parent commit.
      */
-    std::string getCommitParent(const std::string& commitHash);
+    ObjectId getCommitParent(const ObjectId& commitHash);
+
+    /**
+     * @brief Reads a commit object and returns the hash of its root tree.
+     * @param commitHash The hash of the commit to read (empty for none).
+     * @return The tree hash, or an empty id for no commit or a commit that
+     * lists its files inline (made before trees existed).
+     */
+    ObjectId getCommitTree(const ObjectId& commitHash);
 
     /**
      * @brief Reads a commit object and returns its file map (tree).
-     * DATA STRUCTURE: Uses std::map as a hash map (filename -> content hash)
+     * DATA STRUCTURE: a flat FileMap sorted by path (filename -> content hash)
      * @param commitHash The hash of the commit to read.
-     * @return A map of files (filename: hash) in that commit.
+     * @return The files in that commit.
+     */
+    FileMap getCommitFiles(const ObjectId& commitHash);
+
+    /**
+     * @brief Packs all objects into one packfile ('gc' / 'repack').
+     * Versions of the same file across history are delta-compressed
+     * against each other; the loose objects and old packs are removed.
+     */
+    void gc();
+
+    /**
+     * @brief Prints the hashes of a commit and its ancestors, newest first.
+     * Uses the commit-graph, so no commit objects are read for history
+     * that 'gc' has already indexed.
+     * @param start The commit to start from ("" for HEAD).
+     * @param countOnly Print only the number of commits.
+     */
+    void revList(const std::string& start, bool countOnly);
+
+    /**
+     * @brief Prints a unified diff between two commits, or with no
+     * commits, between the index and the working tree.
+     * @param commits Two commit names, or none.
+     */
+    void diff(const std::vector<std::string>& commits);
+
+    /**
+     * @brief Rebuilds .minigit/commit-graph from the history of HEAD and
+     * every branch ('commit-graph write'; 'gc' does this too).
+     */
+    void commitGraphWrite();
+
+    /**
+     * @brief Lists the files that differ between two commits.
+     * Commits with trees are compared tree by tree, skipping shared
+     * subtrees; older commits are compared file by file.
+     * @param fromCommit The older side (empty for no commit).
+     * @param toCommit The newer side (empty for no commit).
+     */
+    std::vector<TreeChange> diffCommits(const ObjectId& fromCommit, const ObjectId& toCommit);
+
+    /**
+     * @brief Restores the working directory to the state of a commit.
+     * Only files that differ are written; blobs are read and written by
+     * a pool of worker threads.
+     * A branch name switches HEAD to that branch; any other commit name
+     * detaches HEAD at the commit.
+     * @param commitName A branch, or a commit hash (or a unique prefix of it).
+     * @param jobs Number of worker threads (0 = one per CPU core).
+     */
+    void checkout(const std::string& commitName, unsigned jobs = 0);
+
+    /**
+     * @brief The outcome of a checkout.
+     */
+    struct CheckoutReport {
+        ObjectId commit;
+        std::string branch; // the full ref name, or "" if HEAD was detached
+        std::size_t discardedStaged = 0;
+        bool abandonedMerge = false;
+        WorkingTreeUpdate files;
+    };
+
+    /**
+     * @brief Checks out without printing (what checkout() does).
+     */
+    CheckoutReport checkoutCommit(const std::string& commitName, unsigned jobs = 0);
+
+    /**
+     * @brief Merges a branch (or commit) into the current one.
+     * If the current commit is an ancestor of it, HEAD just moves forward.
+     * Otherwise the changes since the merge base are merged and, without
+     * conflicts, recorded in a merge commit. With conflicts, the merged
+     * files (conflicted ones with markers) are left in the working tree
+     * and the merge is concluded by 'add' and 'commit'.
+     * @param name The branch or commit to merge.
+     * @param jobs Number of threads for line merges and file writes.
+     * @return false if the merge stopped on conflicts.
+     */
+    bool merge(const std::string& name, unsigned jobs = 0);
+
+    /**
+     * @brief The outcome of a merge.
+     */
+    struct MergeReport {
+        enum class Kind {
+            UpToDate,    // nothing to merge
+            FastForward, // HEAD moved forward to their commit
+            Merged,      // a merge commit was recorded
+            Stopped,     // conflicts (or kept changes) wait for the user
+        };
+        Kind kind = Kind::UpToDate;
+        ObjectId commit; // the new HEAD (FastForward, Merged)
+        std::vector<std::string> conflicts;   // files with conflict markers (Stopped)
+        std::vector<std::string> keptChanges; // deleted on one side, changed on the other (Stopped)
+        WorkingTreeUpdate files;
+    };
+
+    /**
+     * @brief Merges without printing (what merge() does).
+     */
+    MergeReport mergeBranch(const std::string& name, unsigned jobs = 0);
+
+    /**
+     * @brief Prints the best common ancestor of two commits ('merge-base').
+     * @throws std::runtime_error if they share no history.
+     */
+    void printMergeBase(const std::string& first, const std::string& second);
+
+    /**
+     * @brief Lists the branches, marking the current one with '*'.
+     */
+    void listBranches();
+
+    /**
+     * @brief Creates a branch.
+     * @param name The branch name ("topic" for refs/heads/topic).
+     * @param start The commit it points to ("" for HEAD).
+     * @throws std::runtime_error if the branch already exists.
      */
-    std::map<std::string, std::string> getCommitFiles(const std::string& commitHash);
+    void createBranch(const std::string& name, const std::string& start);
 
-    void checkout(const std::string& commitHash);
+    /**
+     * @brief Creates a branch at a commit, without printing.
+     * @throws Error (Conflict) if the branch already exists.
+     */
+    void createBranchAt(const std::string& name, const ObjectId& commitHash);
+
+    /**
+     * @brief Deletes a branch (never the current one).
+     */
+    void deleteBranch(const std::string& name);
+
+    /**
+     * @brief Deletes a branch without printing (what deleteBranch() does).
+     * @return The commit it pointed to.
+     */
+    ObjectId removeBranch(const std::string& name);
 
 } // namespace MiniGit
 
@@ -0,0 +1,221 @@
+/**
+ * object_cache.cpp
+ * * The LRU object cache and the cached commit/tree readers.
+ */
+
+#include "object_cache.h"
+#include "minigit.h"
+#include "object_store.h"
+#include "remote.h"
+#include "trace.h"
+#include <cstdlib>
+#include <map>
+#include <stdexcept>
+#include <utility>
+
+namespace MiniGit {
+
+    namespace {
+        const std::size_t DEFAULT_BUDGET_MIB = 64;
+
+        // Rough heap footprint, so the budget tracks real memory use
+        std::size_t costOf(const ObjectId& hash, const CommitInfo& commit) {
+            std::size_t cost = sizeof(CommitInfo) + sizeof(hash) + commit.message.size();
+            for (const auto& file : commit.inlineFiles) {
+                cost += sizeof(file) + file.first.size();
+            }
+            return cost;
+        }
+
+        std::size_t costOf(const ObjectId& hash, const TreeEntries& tree) {
+            std::size_t cost = sizeof(TreeEntries) + sizeof(hash);
+            for (const auto& entry : tree) {
+                cost += sizeof(TreeEntry) + entry.name.size();
+            }
+            return cost;
+        }
+
+        bool startsWith(std::string_view text, std::string_view prefix) {
+            return text.compare(0, prefix.size(), prefix) == 0;
+        }
+    }
+
+    CommitInfo parseCommit(std::string_view content) {
+        CommitInfo commit;
+        while (!content.empty()) {
+            std::size_t end = content.find('\n');
+            std::string_view line = content.substr(0, end);
+            content.remove_prefix(end == std::string_view::npos ? content.size() : end + 1);
+
+            if (startsWith(line, "parent: ")) {
+                commit.parent = ObjectId::fromHex(line.substr(8));
+            } else if (startsWith(line, "merge: ")) {
+                commit.secondParent = ObjectId::fromHex(line.substr(7));
+            } else if (startsWith(line, "tree: ")) {
+                commit.tree = ObjectId::fromHex(line.substr(6));
+            } else if (startsWith(line, "date: ")) {
+                commit.timestamp = std::strtoull(std::string(line.substr(6)).c_str(), nullptr, 10);
+            } else if (startsWith(line, "message: ")) {
+                commit.message = std::string(line.substr(9));
+            } else if (startsWith(line, "file: ")) {
+                // "file: <filename> <hash>" (the hash never contains spaces)
+                std::string_view entry = line.substr(6);
+                std::size_t space = entry.rfind(' ');
+                if (space != std::string_view::npos && space > 0) {
+                    commit.inlineFiles.emplace_back(std::string(entry.substr(0, space)),
+                                                    ObjectId::fromHex(entry.substr(space + 1)));
+                }
+            }
+        }
+        return commit;
+    }
+
+    // --- ObjectCache ---
+
+    ObjectCache::ObjectCache(std::size_t budgetBytes) : budget_(budgetBytes) {}
+
+    ObjectCache::Slot* ObjectCache::touch(const ObjectId& hash) {
+        auto it = slots_.find(hash);
+        if (it == slots_.end()) {
+            return nullptr;
+        }
+        recency_.splice(recency_.begin(), recency_, it->second.position);
+        return &it->second;
+    }
+
+    void ObjectCache::insert(const ObjectId& hash, Slot slot) {
+        if (slot.cost > budget_) {
+            return; // would evict everything else and still not fit
+        }
+        auto existing = slots_.find(hash);
+        if (existing != slots_.end()) {
+            used_ -= existing->second.cost;
+            recency_.erase(existing->second.position);
+            slots_.erase(existing);
+        }
+
+        // Evict from the cold end until the new object fits
+        evict(slot.cost);
+
+        recency_.push_front(hash);
+        slot.position = recency_.begin();
+        used_ += slot.cost;
+        slots_.emplace(hash, std::move(slot));
+    }
+
+    std::shared_ptr<const CommitInfo> ObjectCache::findCommit(const ObjectId& hash) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Slot* slot = touch(hash);
+        return slot != nullptr ? slot->commit : nullptr;
+    }
+
+    std::shared_ptr<const TreeEntries> ObjectCache::findTree(const ObjectId& hash) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Slot* slot = touch(hash);
+        return slot != nullptr ? slot->tree : nullptr;
+    }
+
+    void ObjectCache::put(const ObjectId& hash, std::shared_ptr<const CommitInfo> commit) {
+        Slot slot;
+        slot.cost = costOf(hash, *commit);
+        slot.commit = std::move(commit);
+        std::lock_guard<std::mutex> lock(mutex_);
+        insert(hash, std::move(slot));
+    }
+
+    void ObjectCache::put(const ObjectId& hash, std::shared_ptr<const TreeEntries> tree) {
+        Slot slot;
+        slot.cost = costOf(hash, *tree);
+        slot.tree = std::move(tree);
+        std::lock_guard<std::mutex> lock(mutex_);
+        insert(hash, std::move(slot));
+    }
+
+    void ObjectCache::clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        slots_.clear();
+        recency_.clear();
+        used_ = 0;
+    }
+
+    std::size_t ObjectCache::bytesUsed() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return used_;
+    }
+
+    std::size_t ObjectCache::budgetBytes() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return budget_;
+    }
+
+    void ObjectCache::setBudget(std::size_t budgetBytes) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        budget_ = budgetBytes;
+        evict(0);
+    }
+
+    void ObjectCache::evict(std::size_t room) {
+        while (used_ + room > budget_ && !recency_.empty()) {
+            auto victim = slots_.find(recency_.back());
+            used_ -= victim->second.cost;
+            slots_.erase(victim);
+            recency_.pop_back();
+        }
+    }
+
+    // --- Cached readers ---
+
+    namespace {
+        std::size_t configuredBudget() {
+            std::map<std::string, std::string> config = readConfig();
+            auto it = config.find("objectcache");
+            std::size_t mib = it == config.end() ? DEFAULT_BUDGET_MIB : std::stoul(it->second);
+            return mib * 1024 * 1024;
+        }
+    }
+
+    ObjectCache& objectCache() {
+        static ObjectCache cache(configuredBudget());
+        return cache;
+    }
+
+    void reloadObjectCache() {
+        ObjectCache& cache = objectCache();
+        cache.clear();
+        cache.setBudget(configuredBudget());
+    }
+
+    std::shared_ptr<const CommitInfo> getCommit(const ObjectId& hash) {
+        std::shared_ptr<const CommitInfo> commit = objectCache().findCommit(hash);
+        if (commit) {
+            MINIGIT_TRACE_COUNT(CacheHits, 1);
+            return commit;
+        }
+        MINIGIT_TRACE_COUNT(CacheMisses, 1);
+        if (!objectExists(hash)) {
+            throw std::runtime_error("Cannot find commit object: " + hash.toHex());
+        }
+        CommitInfo parsed = parseCommit(readObject(hash));
+        // Where a shallow clone's history was cut, the parents are not here
+        if (isShallowCommit(hash)) {
+            parsed.parent = ObjectId();
+            parsed.secondParent = ObjectId();
+        }
+        commit = std::make_shared<const CommitInfo>(std::move(parsed));
+        objectCache().put(hash, commit);
+        return commit;
+    }
+
+    std::shared_ptr<const TreeEntries> getTree(const ObjectId& hash) {
+        std::shared_ptr<const TreeEntries> tree = objectCache().findTree(hash);
+        if (tree) {
+            MINIGIT_TRACE_COUNT(CacheHits, 1);
+            return tree;
+        }
+        MINIGIT_TRACE_COUNT(CacheMisses, 1);
+        tree = std::make_shared<const TreeEntries>(parseTree(readObject(hash)));
+        objectCache().put(hash, tree);
+        return tree;
+    }
+
+} // namespace MiniGit
@@ -0,0 +1,119 @@
+/**
+ * object_cache.h
+ * * An in-process cache of parsed commits and trees.
+ *
+ * History walks (log, checkout, gc, ...) read the same commits and trees
+ * over and over. Parsed objects are kept here, keyed by hash, so a repeat
+ * visit in the same process costs a hash-map lookup instead of a file
+ * read, an inflate and a parse. The cache is bounded by a memory budget
+ * (config key "objectcache", in MiB; 0 disables it) and evicts the least
+ * recently used objects first. Objects are immutable, so no entry ever
+ * goes stale.
+ */
+
+#ifndef MINIGIT_OBJECT_CACHE_H
+#define MINIGIT_OBJECT_CACHE_H
+
+#include "tree.h"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace MiniGit {
+
+    /**
+     * @brief A parsed commit object.
+     */
+    struct CommitInfo {
+        ObjectId parent;       // empty for the first commit
+        ObjectId secondParent; // the branch a merge commit merged in, else empty
+        ObjectId tree;   // empty for commits that list their files inline
+        std::string message;
+        uint64_t timestamp = 0; // seconds since the epoch, 0 if not recorded
+        std::vector<std::pair<std::string, ObjectId>> inlineFiles; // "file:" lines (path, blob)
+    };
+
+    using TreeEntries = std::vector<TreeEntry>;
+
+    /**
+     * @brief Parses the text of a commit object.
+     */
+    CommitInfo parseCommit(std::string_view content);
+
+    /**
+     * @brief A thread-safe LRU cache of parsed objects with a byte budget.
+     */
+    class ObjectCache {
+    public:
+        explicit ObjectCache(std::size_t budgetBytes);
+
+        std::shared_ptr<const CommitInfo> findCommit(const ObjectId& hash);
+        std::shared_ptr<const TreeEntries> findTree(const ObjectId& hash);
+        void put(const ObjectId& hash, std::shared_ptr<const CommitInfo> commit);
+        void put(const ObjectId& hash, std::shared_ptr<const TreeEntries> tree);
+
+        void clear();
+        std::size_t bytesUsed() const;
+        std::size_t budgetBytes() const;
+
+        /**
+         * @brief Changes the budget, evicting the least recently used
+         * objects until they fit.
+         */
+        void setBudget(std::size_t budgetBytes);
+
+    private:
+        struct Slot {
+            std::shared_ptr<const CommitInfo> commit;
+            std::shared_ptr<const TreeEntries> tree;
+            std::size_t cost = 0;
+            std::list<ObjectId>::iterator position; // in recency_
+        };
+
+        Slot* touch(const ObjectId& hash);
+        void insert(const ObjectId& hash, Slot slot);
+        void evict(std::size_t room); // until 'room' more bytes fit
+
+        // DSA: HASH MAP + DOUBLY LINKED LIST (the classic LRU cache).
+        // The list holds hashes from most to least recently used; each map
+        // slot knows its list node, so a hit moves it to the front in O(1).
+        mutable std::mutex mutex_;
+        std::size_t budget_;
+        std::size_t used_ = 0;
+        std::list<ObjectId> recency_;
+        std::unordered_map<ObjectId, Slot> slots_;
+    };
+
+    /**
+     * @brief The process-wide cache, sized from the repository config.
+     */
+    ObjectCache& objectCache();
+
+    /**
+     * @brief Empties the process-wide cache and sizes it from the config
+     * again (for another repository, or after the config changed).
+     */
+    void reloadObjectCache();
+
+    /**
+     * @brief Reads and parses a commit, through the cache.
+     * @throws std::runtime_error if the commit does not exist.
+     */
+    std::shared_ptr<const CommitInfo> getCommit(const ObjectId& hash);
+
+    /**
+     * @brief Reads and parses a tree, through the cache.
+     * @throws std::runtime_error if the tree does not exist.
+     */
+    std::shared_ptr<const TreeEntries> getTree(const ObjectId& hash);
+
+} // namespace MiniGit
+
+#endif // MINIGIT_OBJECT_CACHE_H
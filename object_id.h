@@ -0,0 +1,133 @@
+/**
+ * object_id.h
+ * * ObjectId: the fixed-width, binary form of an object id.
+ *
+ * Ids are 32 bytes plus the number of hex digits they stand for, so they
+ * can be copied, compared and hashed without touching the heap. Hex is
+ * only produced at the edges: object file names, the text formats of
+ * commits and trees, and what the command line prints or parses.
+ */
+
+#ifndef MINIGIT_OBJECT_ID_H
+#define MINIGIT_OBJECT_ID_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace MiniGit {
+
+    /**
+     * @brief A hex object id packed into 32 bytes plus its hex length.
+     * The length lets ids of any size round-trip exactly: 64 hex digits
+     * for BLAKE3, and up to 16 (sometimes odd) for legacy std::hash ids.
+     * A default-constructed id is empty ("no object", e.g. no parent).
+     */
+    struct ObjectId {
+        static const std::size_t MAX_BYTES = 32;
+
+        unsigned char bytes[MAX_BYTES] = {};
+        uint8_t hexLength = 0;
+
+        /**
+         * @brief Parses lowercase hex ("" gives the empty id).
+         * @throws std::runtime_error for non-hex digits or overlong ids.
+         */
+        static constexpr ObjectId fromHex(std::string_view hex) {
+            if (hex.size() > 2 * MAX_BYTES) {
+                throw std::runtime_error("Object id too long: " + std::string(hex));
+            }
+            ObjectId id;
+            id.hexLength = static_cast<uint8_t>(hex.size());
+            // An odd number of digits is read as if it had a leading zero
+            std::size_t nibble = hex.size() % 2;
+            for (char c : hex) {
+                int value = hexValue(c);
+                if (value < 0) {
+                    throw std::runtime_error("Invalid object id: " + std::string(hex));
+                }
+                id.bytes[nibble / 2] |= static_cast<unsigned char>(nibble % 2 == 0 ? value << 4 : value);
+                ++nibble;
+            }
+            return id;
+        }
+
+        /**
+         * @brief Whether 'hex' is a well-formed id (what fromHex accepts).
+         */
+        static constexpr bool isHex(std::string_view hex) {
+            if (hex.size() > 2 * MAX_BYTES) {
+                return false;
+            }
+            for (char c : hex) {
+                if (hexValue(c) < 0) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /**
+         * @brief Writes the hexLength hex digits to 'out' (not terminated).
+         */
+        constexpr void writeHex(char* out) const {
+            const char digits[] = "0123456789abcdef";
+            std::size_t nibble = hexLength % 2; // skip the padding digit
+            for (std::size_t i = 0; i < hexLength; ++i, ++nibble) {
+                unsigned char byte = bytes[nibble / 2];
+                out[i] = digits[nibble % 2 == 0 ? byte >> 4 : byte & 0x0f];
+            }
+        }
+
+        std::string toHex() const {
+            std::string hex(hexLength, '0');
+            writeHex(&hex[0]);
+            return hex;
+        }
+
+        constexpr bool empty() const { return hexLength == 0; }
+
+        constexpr int compare(const ObjectId& other) const {
+            for (std::size_t i = 0; i < MAX_BYTES; ++i) {
+                if (bytes[i] != other.bytes[i]) {
+                    return bytes[i] < other.bytes[i] ? -1 : 1;
+                }
+            }
+            return static_cast<int>(hexLength) - static_cast<int>(other.hexLength);
+        }
+
+        constexpr bool operator==(const ObjectId& other) const { return compare(other) == 0; }
+        constexpr bool operator!=(const ObjectId& other) const { return compare(other) != 0; }
+        constexpr bool operator<(const ObjectId& other) const { return compare(other) < 0; }
+
+    private:
+        static constexpr int hexValue(char c) {
+            if (c >= '0' && c <= '9') {
+                return c - '0';
+            }
+            if (c >= 'a' && c <= 'f') {
+                return c - 'a' + 10;
+            }
+            return -1;
+        }
+    };
+
+} // namespace MiniGit
+
+namespace std {
+    template <>
+    struct hash<MiniGit::ObjectId> {
+        std::size_t operator()(const MiniGit::ObjectId& id) const noexcept {
+            // The bytes are already a hash: their leading bytes are well mixed
+            std::size_t value;
+            std::memcpy(&value, id.bytes, sizeof(value));
+            return value ^ id.hexLength;
+        }
+    };
+}
+
+#endif // MINIGIT_OBJECT_ID_H
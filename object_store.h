@@ -0,0 +1,163 @@
+/**
+ * object_store.h
+ * * Reading and writing objects in .minigit/objects.
+ *
+ * Loose objects live in .minigit/objects/<first 2 hex>/<rest of the id>.
+ *
+ * Loose object layout:
+ *   header   "MGOB", u8 type, u8 codec, u16 reserved, u64 uncompressed size
+ *   payload  the content, deflate-compressed (codec 1) or stored (codec 0)
+ *
+ * An object's id is always the hash of its uncompressed content, so
+ * compression does not change any ids. Objects written before this
+ * format (raw content, no header) are still read as-is.
+ *
+ * Durability (config key "fsync"):
+ *   none    objects are created in place; nothing is flushed
+ *   batch   (default) objects are written to objects/tmp unflushed and
+ *           published by flushObjects(): one filesystem flush for all
+ *           of them, the renames, and one more flush for the names
+ *   object  every object is flushed and renamed into place on its own
+ * Platforms without a whole-filesystem flush treat batch as object.
+ */
+
+#ifndef MINIGIT_OBJECT_STORE_H
+#define MINIGIT_OBJECT_STORE_H
+
+#include "object_id.h"
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace MiniGit {
+
+    enum class ObjectType : uint8_t {
+        Unknown = 0, // a legacy object without a header
+        Blob = 1,
+        Commit = 2,
+        Tree = 3,
+        ChunkedBlob = 4, // a blob stored as a manifest of chunks (see chunker.h)
+        Chunk = 5        // one piece of a chunked blob
+    };
+
+    /**
+     * @brief The path of a loose object file, in its fan-out subdirectory.
+     */
+    std::filesystem::path objectPath(const ObjectId& hash);
+
+    /**
+     * @brief Checks whether an object is stored (packed or loose).
+     */
+    bool objectExists(const ObjectId& hash);
+
+    /**
+     * @brief The ids of all loose objects.
+     */
+    std::vector<ObjectId> listLooseObjects();
+
+    /**
+     * @brief Deletes a loose object file (and its subdirectory once empty).
+     */
+    void removeLooseObject(const ObjectId& hash);
+
+    /**
+     * @brief Moves objects from the old flat layout into fan-out
+     * subdirectories. Safe to run again after an interruption.
+     * @return The number of objects moved.
+     */
+    std::size_t shardLooseObjects();
+
+    enum class DurabilityMode {
+        None,
+        Batch,
+        Object
+    };
+
+    /**
+     * @brief The configured durability mode (see above).
+     * @throws std::runtime_error for an unknown "fsync" value.
+     */
+    DurabilityMode durabilityMode();
+
+    /**
+     * @brief Makes the objects written so far (batch mode) durable and
+     * moves them to their final names. Called before anything that
+     * refers to them (HEAD, the index, ...) is replaced.
+     * @return true if there were objects to publish; the filesystem has
+     * then been flushed.
+     */
+    bool flushObjects();
+
+    /**
+     * @brief Compresses and stores an object, unless it is already stored.
+     * @param hash The object id (hash of 'content').
+     * @param type What kind of object this is.
+     * @param content The uncompressed object content.
+     */
+    void writeObject(const ObjectId& hash, ObjectType type, const std::string& content);
+
+    /**
+     * @brief Reads an object exactly as stored: a chunked blob comes back
+     * as its manifest, with type ChunkedBlob.
+     */
+    ObjectType readStoredObject(const ObjectId& hash, std::string& out);
+
+    /**
+     * @brief Reads an object into a caller-supplied buffer.
+     * Chunked blobs are reassembled and reported as ObjectType::Blob.
+     * Packs are searched first, then the loose object file, which is
+     * memory-mapped and inflated straight into 'out' (sized once from the
+     * header; its previous capacity is reused).
+     * @param hash The object id.
+     * @param out Receives the uncompressed content.
+     * @return The object's type.
+     * @throws std::runtime_error if the object is missing or corrupt.
+     */
+    ObjectType readObjectInto(const ObjectId& hash, std::string& out);
+
+    /**
+     * @brief Blobs at least this large are streamed through fixed-size
+     * buffers instead of being held in memory (config key
+     * "bigfilethreshold", in MiB; default 32). 'gc' leaves them loose.
+     */
+    uint64_t bigFileThreshold();
+
+    /**
+     * @brief Whether big blobs are split into content-defined chunks
+     * (config key "chunking" = true).
+     */
+    bool chunkingEnabled();
+
+    /**
+     * @brief Hashes, compresses and stores a file as a blob, a fixed-size
+     * buffer at a time, so memory use does not depend on the file size.
+     * The object is written to a temporary file and renamed into place,
+     * or, with chunking enabled, stored as chunks plus a manifest.
+     * @return The blob's id.
+     */
+    ObjectId writeBlobFromFile(const std::filesystem::path& file);
+
+    /**
+     * @brief Writes an object's content to a file. Loose objects are
+     * decompressed a buffer at a time; chunked blobs a chunk at a time.
+     */
+    void readObjectToFile(const ObjectId& hash, const std::filesystem::path& destination);
+
+    /**
+     * @brief Reads only the header of a loose object.
+     * @param size Receives the uncompressed size.
+     * @return false if there is no loose object with this id.
+     */
+    bool looseObjectSize(const ObjectId& hash, uint64_t& size);
+
+    /**
+     * @brief Reads an object and returns its uncompressed content.
+     * @param hash The object id.
+     * @param type If not null, receives the object's type.
+     */
+    std::string readObject(const ObjectId& hash, ObjectType* type = nullptr);
+
+} // namespace MiniGit
+
+#endif // MINIGIT_OBJECT_STORE_H
@@ -0,0 +1,442 @@
+/**
+ * pack.cpp
+ * * Writing and reading packfiles.
+ */
+
+#include "pack.h"
+#include "compression.h"
+#include "delta.h"
+#include "minigit.h"
+#include "platform.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+namespace MiniGit {
+
+    namespace {
+        const char PACK_MAGIC[4] = {'M', 'G', 'P', 'K'};
+        const char IDX_MAGIC[4] = {'M', 'G', 'P', 'I'};
+        const uint32_t PACK_VERSION = 1;
+        const std::size_t PACK_HEADER_SIZE = 16;
+        const std::size_t ENTRY_HEADER_SIZE = 40;
+        const std::size_t IDX_HEADER_SIZE = 16;
+        const std::size_t FANOUT_SIZE = 256 * 4;
+        const std::size_t IDX_ENTRY_SIZE = 48;
+        const std::size_t CHECKSUM_SIZE = 32;
+
+        const uint8_t KIND_WHOLE = 0;
+        const uint8_t KIND_DELTA = 1;
+        const uint8_t CODEC_STORED = 0;
+        const uint8_t CODEC_DEFLATE = 1;
+
+        // Protects against corrupt packs whose deltas go in circles
+        const int MAX_CHAIN = 100;
+
+        /**
+         * A mapped .pack/.idx pair.
+         */
+        class Pack {
+        public:
+            explicit Pack(const fs::path& packPath) : packPath_(packPath) {
+                fs::path idxPath = packPath;
+                idxPath.replace_extension(".idx");
+                if (!pack_.open(packPath) || !idx_.open(idxPath)) {
+                    throw std::runtime_error("Incomplete pack: " + packPath.string());
+                }
+                validate(idxPath);
+            }
+
+            const fs::path& path() const { return packPath_; }
+            std::size_t count() const { return count_; }
+
+            ObjectId hashAt(std::size_t i) const {
+                const unsigned char* e = idxEntries_ + i * IDX_ENTRY_SIZE;
+                return getObjectId(e, e[32]);
+            }
+
+            // DSA: BINARY SEARCH, narrowed first by the fanout table
+            bool find(const ObjectId& hash, uint64_t& offset) const {
+                std::size_t low = hash.bytes[0] == 0 ? 0 : getU32(fanout_ + 4 * (hash.bytes[0] - 1));
+                std::size_t high = getU32(fanout_ + 4 * hash.bytes[0]);
+                while (low < high) {
+                    std::size_t mid = low + (high - low) / 2;
+                    int c = hashAt(mid).compare(hash);
+                    if (c == 0) {
+                        offset = getU64(idxEntries_ + mid * IDX_ENTRY_SIZE + 40);
+                        return true;
+                    }
+                    if (c < 0) {
+                        low = mid + 1;
+                    } else {
+                        high = mid;
+                    }
+                }
+                return false;
+            }
+
+            ObjectType read(uint64_t offset, std::string& out, int depth = 0) const {
+                if (depth > MAX_CHAIN) {
+                    throw corrupt("delta chain too long");
+                }
+                if (offset < PACK_HEADER_SIZE || offset + ENTRY_HEADER_SIZE > pack_.size() - CHECKSUM_SIZE) {
+                    throw corrupt("bad offset");
+                }
+                const unsigned char* e = pack_.data() + offset;
+                ObjectType type = static_cast<ObjectType>(e[0]);
+                uint8_t codec = e[1];
+                uint8_t kind = e[2];
+                uint64_t objectSize = getU64(e + 8);
+                uint64_t payloadSize = getU64(e + 16);
+                uint64_t baseOffset = getU64(e + 24);
+                uint64_t rawSize = getU64(e + 32);
+                const unsigned char* payload = e + ENTRY_HEADER_SIZE;
+                if (payloadSize > pack_.size() - CHECKSUM_SIZE - offset - ENTRY_HEADER_SIZE) {
+                    throw corrupt("entry past end");
+                }
+
+                // The payload is the object itself, or the delta for a delta entry
+                // (its size is checked against the payload before it is
+                // allocated)
+                if (codec == CODEC_STORED ? payloadSize != rawSize
+                                          : rawSize > maxInflatedSize(static_cast<std::size_t>(payloadSize))) {
+                    throw corrupt(codec == CODEC_STORED ? "bad stored entry" : "bad compressed entry");
+                }
+                std::string delta;
+                std::string& raw = kind == KIND_DELTA ? delta : out;
+                raw.resize(static_cast<std::size_t>(rawSize));
+                if (codec == CODEC_STORED) {
+                    if (rawSize != 0) {
+                        std::memcpy(&raw[0], payload, static_cast<std::size_t>(rawSize));
+                    }
+                } else if (!inflateExact(payload, static_cast<std::size_t>(payloadSize), &raw[0], raw.size())) {
+                    throw corrupt("bad compressed entry");
+                }
+
+                if (kind == KIND_DELTA) {
+                    if (baseOffset >= offset) {
+                        throw corrupt("delta base is not earlier in the pack");
+                    }
+                    std::string base;
+                    read(baseOffset, base, depth + 1);
+                    out = applyDelta(base, delta);
+                } else if (kind != KIND_WHOLE) {
+                    throw corrupt("unknown entry kind");
+                }
+                if (out.size() != objectSize) {
+                    throw corrupt("object size mismatch");
+                }
+                return type;
+            }
+
+            // Reads the whole pack: only done where a pack enters the
+            // repository, not on every open
+            void verifyChecksum() const {
+                unsigned char checksum[CHECKSUM_SIZE];
+                Blake3Hasher hasher;
+                hasher.update(pack_.data(), pack_.size() - CHECKSUM_SIZE);
+                hasher.finalize(checksum);
+                const unsigned char* trailer = pack_.data() + pack_.size() - CHECKSUM_SIZE;
+                if (std::memcmp(checksum, trailer, CHECKSUM_SIZE) != 0 ||
+                    packPath_.stem().string() != "pack-" + toHex(trailer, CHECKSUM_SIZE)) {
+                    throw corrupt("checksum mismatch");
+                }
+            }
+
+        private:
+            std::runtime_error corrupt(const std::string& why) const {
+                return std::runtime_error("Corrupt pack " + packPath_.string() + ": " + why);
+            }
+
+            void validate(const fs::path& idxPath) {
+                if (pack_.size() < PACK_HEADER_SIZE + CHECKSUM_SIZE ||
+                    std::memcmp(pack_.data(), PACK_MAGIC, sizeof(PACK_MAGIC)) != 0 ||
+                    getU32(pack_.data() + 4) != PACK_VERSION) {
+                    throw corrupt("bad header");
+                }
+                const unsigned char* idx = idx_.data();
+                if (idx_.size() < IDX_HEADER_SIZE + FANOUT_SIZE + CHECKSUM_SIZE ||
+                    std::memcmp(idx, IDX_MAGIC, sizeof(IDX_MAGIC)) != 0 || getU32(idx + 4) != PACK_VERSION) {
+                    throw std::runtime_error("Corrupt pack index " + idxPath.string());
+                }
+                count_ = getU32(idx + 8);
+                if (IDX_HEADER_SIZE + FANOUT_SIZE + count_ * IDX_ENTRY_SIZE + CHECKSUM_SIZE != idx_.size() ||
+                    count_ != getU32(pack_.data() + 8)) {
+                    throw std::runtime_error("Corrupt pack index " + idxPath.string());
+                }
+
+                unsigned char checksum[CHECKSUM_SIZE];
+                Blake3Hasher hasher;
+                hasher.update(idx, idx_.size() - CHECKSUM_SIZE);
+                hasher.finalize(checksum);
+                if (std::memcmp(checksum, idx + idx_.size() - CHECKSUM_SIZE, CHECKSUM_SIZE) != 0) {
+                    throw std::runtime_error("Corrupt pack index " + idxPath.string());
+                }
+
+                // The fanout must climb to the object count, or find()
+                // would search outside the entries
+                fanout_ = idx + IDX_HEADER_SIZE;
+                uint32_t previous = 0;
+                for (std::size_t i = 0; i < 256; ++i) {
+                    uint32_t bucket = getU32(fanout_ + 4 * i);
+                    if (bucket < previous || bucket > count_) {
+                        throw std::runtime_error("Corrupt pack index " + idxPath.string());
+                    }
+                    previous = bucket;
+                }
+                if (previous != count_) {
+                    throw std::runtime_error("Corrupt pack index " + idxPath.string());
+                }
+                idxEntries_ = fanout_ + FANOUT_SIZE;
+            }
+
+            fs::path packPath_;
+            MappedFile pack_;
+            MappedFile idx_;
+            const unsigned char* fanout_ = nullptr;
+            const unsigned char* idxEntries_ = nullptr;
+            std::size_t count_ = 0;
+        };
+
+        // All packs of the repository, mapped on first use
+        std::mutex packsMutex;
+        bool packsLoaded = false;
+        std::vector<std::shared_ptr<Pack>> loadedPacks;
+
+        std::vector<std::shared_ptr<Pack>> packs() {
+            std::lock_guard<std::mutex> lock(packsMutex);
+            if (!packsLoaded) {
+                loadedPacks.clear();
+                std::error_code ec;
+                if (fs::is_directory(rootPath(PACK_DIR), ec)) {
+                    // A pack is only complete once its .idx exists
+                    std::vector<fs::path> paths;
+                    for (const auto& entry : fs::directory_iterator(rootPath(PACK_DIR))) {
+                        if (entry.path().extension() == ".idx") {
+                            fs::path packPath = entry.path();
+                            paths.push_back(packPath.replace_extension(".pack"));
+                        }
+                    }
+                    std::sort(paths.begin(), paths.end());
+                    for (const auto& path : paths) {
+                        loadedPacks.push_back(std::make_shared<Pack>(path));
+                    }
+                }
+                packsLoaded = true;
+            }
+            return loadedPacks;
+        }
+
+    }
+
+    // --- PackWriter ---
+
+    PackWriter::PackWriter(const fs::path& directory)
+        : directory_(directory), checksum_(new Blake3Hasher()) {
+        // A name of our own, taken exclusively: two commands packing at
+        // once never write into the same file
+        static std::atomic<unsigned> counter{0};
+        std::string prefix = "tmp-pack-" + std::to_string(processId()) + "-";
+        NewFile reserved;
+        do {
+            tempPath_ = directory_ / (prefix + std::to_string(counter++));
+        } while (!reserved.create(tempPath_, false));
+        reserved.commit();
+        out_.open(tempPath_, std::ios::binary | std::ios::trunc);
+        if (!out_.is_open()) {
+            std::error_code ec;
+            fs::remove(tempPath_, ec);
+            throw std::runtime_error("Could not write to file: " + tempPath_.string());
+        }
+        std::string header(PACK_MAGIC, sizeof(PACK_MAGIC));
+        putU32(header, PACK_VERSION);
+        putU32(header, 0); // object count, patched in finish()
+        putU32(header, 0);
+        out_.write(header.data(), static_cast<std::streamsize>(header.size()));
+        offset_ = header.size();
+    }
+
+    PackWriter::~PackWriter() {
+        if (!finished_) {
+            out_.close();
+            std::error_code ec;
+            fs::remove(tempPath_, ec);
+        }
+    }
+
+    void PackWriter::write(const std::string& bytes) {
+        out_.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        if (!out_) {
+            throw std::runtime_error("Could not write to file: " + tempPath_.string());
+        }
+        offset_ += bytes.size();
+    }
+
+    void PackWriter::writeEntry(const ObjectId& hash, ObjectType type, uint8_t kind, std::size_t objectSize,
+                                uint64_t baseOffset, const std::string& payload, std::size_t rawSize, uint8_t codec) {
+        uint64_t entryOffset = offset_;
+        std::string header;
+        putU8(header, static_cast<uint8_t>(type));
+        putU8(header, codec);
+        putU8(header, kind);
+        putU8(header, 0);
+        putU32(header, 0);
+        putU64(header, objectSize);
+        putU64(header, payload.size());
+        putU64(header, baseOffset);
+        putU64(header, rawSize);
+        write(header);
+        write(payload);
+
+        entries_.push_back({hash, entryOffset});
+        offsets_[hash] = entryOffset;
+    }
+
+    void PackWriter::addWhole(const ObjectId& hash, ObjectType type, const std::string& content) {
+        std::string payload;
+        deflateAppend(content.data(), content.size(), compressionLevel(), payload);
+        uint8_t codec = CODEC_DEFLATE;
+        if (payload.size() >= content.size()) {
+            payload = content;
+            codec = CODEC_STORED;
+        }
+        writeEntry(hash, type, KIND_WHOLE, content.size(), 0, payload, content.size(), codec);
+    }
+
+    void PackWriter::addDelta(const ObjectId& hash, ObjectType type, std::size_t objectSize,
+                              const ObjectId& baseHash, const std::string& delta) {
+        auto base = offsets_.find(baseHash);
+        if (base == offsets_.end()) {
+            throw std::runtime_error("Delta base not in pack: " + baseHash.toHex());
+        }
+        std::string payload;
+        deflateAppend(delta.data(), delta.size(), compressionLevel(), payload);
+        uint8_t codec = CODEC_DEFLATE;
+        if (payload.size() >= delta.size()) {
+            payload = delta;
+            codec = CODEC_STORED;
+        }
+        writeEntry(hash, type, KIND_DELTA, objectSize, base->second, payload, delta.size(), codec);
+    }
+
+    fs::path PackWriter::finish() {
+        // 1. Patch the object count into the header, then checksum the
+        // whole file (re-read, since the header changed after streaming)
+        out_.seekp(8);
+        std::string count;
+        putU32(count, static_cast<uint32_t>(entries_.size()));
+        out_.write(count.data(), static_cast<std::streamsize>(count.size()));
+        out_.close();
+
+        unsigned char checksum[CHECKSUM_SIZE];
+        {
+            MappedFile written;
+            written.open(tempPath_);
+            checksum_->update(written.data(), written.size());
+            checksum_->finalize(checksum);
+        }
+        {
+            std::ofstream tail(tempPath_, std::ios::binary | std::ios::app);
+            tail.write(reinterpret_cast<const char*>(checksum), CHECKSUM_SIZE);
+            if (!tail) {
+                throw std::runtime_error("Could not write to file: " + tempPath_.string());
+            }
+        }
+
+        // 2. Build the index: entries sorted by hash plus the fanout table
+        std::sort(entries_.begin(), entries_.end(), [](const Entry& a, const Entry& b) {
+            return a.hash < b.hash;
+        });
+        std::string idx(IDX_MAGIC, sizeof(IDX_MAGIC));
+        putU32(idx, PACK_VERSION);
+        putU32(idx, static_cast<uint32_t>(entries_.size()));
+        putU32(idx, 0);
+        std::size_t position = 0;
+        for (int byte = 0; byte < 256; ++byte) {
+            while (position < entries_.size() && entries_[position].hash.bytes[0] <= byte) {
+                ++position;
+            }
+            putU32(idx, static_cast<uint32_t>(position));
+        }
+        for (const auto& entry : entries_) {
+            putObjectId(idx, entry.hash);
+            putU8(idx, entry.hash.hexLength);
+            idx.append(7, '\0');
+            putU64(idx, entry.offset);
+        }
+        unsigned char idxChecksum[CHECKSUM_SIZE];
+        Blake3Hasher idxHasher;
+        idxHasher.update(idx);
+        idxHasher.finalize(idxChecksum);
+        idx.append(reinterpret_cast<const char*>(idxChecksum), CHECKSUM_SIZE);
+
+        // 3. Name the pack after its checksum. The .idx is written last:
+        // a pack only becomes visible once its index exists. (In batch
+        // mode the flush before the .idx is renamed covers the pack too.)
+        std::string name = "pack-" + toHex(checksum, CHECKSUM_SIZE);
+        fs::path packPath = directory_ / (name + ".pack");
+        if (durabilityMode() == DurabilityMode::Object) {
+            syncFile(tempPath_);
+        }
+        fs::rename(tempPath_, packPath);
+        writeFileAtomic(directory_ / (name + ".idx"), idx);
+        finished_ = true;
+        return packPath;
+    }
+
+    // --- Reading ---
+
+    bool readPackedObject(const ObjectId& hash, std::string& out, ObjectType& type) {
+        for (const auto& pack : packs()) {
+            uint64_t offset;
+            if (pack->find(hash, offset)) {
+                type = pack->read(offset, out);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool packedObjectExists(const ObjectId& hash) {
+        for (const auto& pack : packs()) {
+            uint64_t offset;
+            if (pack->find(hash, offset)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<ObjectId> listPackedObjects() {
+        std::vector<ObjectId> hashes;
+        for (const auto& pack : packs()) {
+            for (std::size_t i = 0; i < pack->count(); ++i) {
+                hashes.push_back(pack->hashAt(i));
+            }
+        }
+        return hashes;
+    }
+
+    std::vector<fs::path> listPackFiles() {
+        std::vector<fs::path> paths;
+        for (const auto& pack : packs()) {
+            paths.push_back(pack->path());
+        }
+        return paths;
+    }
+
+    void verifyPack(const fs::path& packPath) {
+        Pack(packPath).verifyChecksum();
+    }
+
+    void reloadPacks() {
+        std::lock_guard<std::mutex> lock(packsMutex);
+        loadedPacks.clear();
+        packsLoaded = false;
+    }
+
+} // namespace MiniGit
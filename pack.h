@@ -0,0 +1,135 @@
+/**
+ * pack.h
+ * * Packfiles: many objects stored in one file, with an index for lookup.
+ *
+ * .minigit/objects/pack/pack-<checksum>.pack
+ *   header   "MGPK", u32 version, u32 object count, u32 reserved
+ *   entries  u8 type, u8 codec, u8 kind (0 whole, 1 delta), u8 reserved,
+ *            u32 reserved, u64 object size, u64 payload size,
+ *            u64 base offset (delta only), u64 delta size (delta only),
+ *            then the payload (deflated content or deflated delta)
+ *   checksum BLAKE3 of everything above (checked when a pack is written
+ *            or received, see verifyPack)
+ *
+ * .minigit/objects/pack/pack-<checksum>.idx
+ *   header   "MGPI", u32 version, u32 object count, u32 reserved
+ *   fanout   256 x u32: number of objects whose first hash byte is <= i
+ *   entries  sorted by hash: 32-byte hash, u8 hex length, 7 reserved,
+ *            u64 offset of the entry in the pack
+ *   checksum BLAKE3 of everything above
+ *
+ * A delta entry's base always comes earlier in the same pack.
+ */
+
+#ifndef MINIGIT_PACK_H
+#define MINIGIT_PACK_H
+
+#include "binary_format.h"
+#include "hash.h"
+#include "object_store.h"
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace MiniGit {
+
+    /**
+     * @brief Streams objects into a new packfile and writes its index.
+     * Objects must be added in dependency order: a delta's base first.
+     */
+    class PackWriter {
+    public:
+        explicit PackWriter(const std::filesystem::path& directory);
+        ~PackWriter();
+
+        PackWriter(const PackWriter&) = delete;
+        PackWriter& operator=(const PackWriter&) = delete;
+
+        void addWhole(const ObjectId& hash, ObjectType type, const std::string& content);
+
+        /**
+         * @brief Adds an object stored as a delta against an earlier object.
+         * @param hash The object id.
+         * @param type The object type.
+         * @param objectSize Size of the reconstructed object.
+         * @param baseHash Id of the base object (already added).
+         * @param delta The delta from computeDelta.
+         */
+        void addDelta(const ObjectId& hash, ObjectType type, std::size_t objectSize,
+                      const ObjectId& baseHash, const std::string& delta);
+
+        bool contains(const ObjectId& hash) const { return offsets_.count(hash) != 0; }
+        std::size_t size() const { return entries_.size(); }
+
+        /**
+         * @brief Completes the pack and its index.
+         * @return The path of the new .pack file.
+         */
+        std::filesystem::path finish();
+
+    private:
+        void writeEntry(const ObjectId& hash, ObjectType type, uint8_t kind, std::size_t objectSize,
+                        uint64_t baseOffset, const std::string& payload, std::size_t rawSize, uint8_t codec);
+        void write(const std::string& bytes);
+
+        struct Entry {
+            ObjectId hash;
+            uint64_t offset;
+        };
+
+        std::filesystem::path directory_;
+        std::filesystem::path tempPath_;
+        std::ofstream out_;
+        std::unique_ptr<Hasher> checksum_;
+        uint64_t offset_ = 0;
+        std::vector<Entry> entries_;
+        std::unordered_map<ObjectId, uint64_t> offsets_;
+        bool finished_ = false;
+    };
+
+    /**
+     * @brief Looks an object up in the packs and reads it.
+     * @param hash The object id.
+     * @param out Receives the uncompressed content.
+     * @param type Receives the object type.
+     * @return false if no pack contains the object.
+     */
+    bool readPackedObject(const ObjectId& hash, std::string& out, ObjectType& type);
+
+    /**
+     * @brief Checks whether any pack contains the object.
+     */
+    bool packedObjectExists(const ObjectId& hash);
+
+    /**
+     * @brief The ids of all packed objects.
+     */
+    std::vector<ObjectId> listPackedObjects();
+
+    /**
+     * @brief The .pack files currently in use.
+     */
+    std::vector<std::filesystem::path> listPackFiles();
+
+    /**
+     * @brief Checks a pack against its trailer checksum and its name.
+     * Reads the whole pack, so it is done where a pack enters the
+     * repository (gc, fetch) rather than each time one is opened, which
+     * only checks the headers and the index.
+     * @throws std::runtime_error if the pack is damaged.
+     */
+    void verifyPack(const std::filesystem::path& packPath);
+
+    /**
+     * @brief Drops the cached pack mappings so the next lookup rescans
+     * the pack directory (after a repack).
+     */
+    void reloadPacks();
+
+} // namespace MiniGit
+
+#endif // MINIGIT_PACK_H
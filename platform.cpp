@@ -0,0 +1,384 @@
+/**
+ * platform.cpp
+ * * POSIX and Windows implementations of the platform wrappers.
+ */
+
+#include "platform.h"
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace MiniGit {
+
+    // --- statFile ---
+
+#ifdef _WIN32
+    bool statFile(const fs::path& path, FileStat& out) {
+        std::error_code ec;
+        fs::file_status status = fs::status(path, ec);
+        if (ec || !fs::exists(status)) {
+            return false;
+        }
+        out = FileStat();
+        auto mtime = fs::last_write_time(path, ec).time_since_epoch();
+        out.mtimeNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(mtime).count());
+        out.size = fs::is_regular_file(status) ? static_cast<uint64_t>(fs::file_size(path, ec)) : 0;
+        out.mode = static_cast<uint32_t>(status.permissions()) | (fs::is_directory(status) ? 0x4000u : 0x8000u);
+        return true;
+    }
+#else
+    bool statFile(const fs::path& path, FileStat& out) {
+        struct stat st;
+        if (::lstat(path.c_str(), &st) != 0) {
+            return false;
+        }
+        out = FileStat();
+#if defined(__APPLE__)
+        out.mtimeNs = static_cast<uint64_t>(st.st_mtimespec.tv_sec) * 1000000000ull + st.st_mtimespec.tv_nsec;
+        out.ctimeNs = static_cast<uint64_t>(st.st_ctimespec.tv_sec) * 1000000000ull + st.st_ctimespec.tv_nsec;
+#else
+        out.mtimeNs = static_cast<uint64_t>(st.st_mtim.tv_sec) * 1000000000ull + st.st_mtim.tv_nsec;
+        out.ctimeNs = static_cast<uint64_t>(st.st_ctim.tv_sec) * 1000000000ull + st.st_ctim.tv_nsec;
+#endif
+        out.size = static_cast<uint64_t>(st.st_size);
+        out.inode = static_cast<uint64_t>(st.st_ino);
+        out.mode = static_cast<uint32_t>(st.st_mode);
+        return true;
+    }
+#endif
+
+    // --- MappedFile ---
+
+    MappedFile::~MappedFile() {
+        close();
+    }
+
+    MappedFile::MappedFile(MappedFile&& other) noexcept {
+        *this = std::move(other);
+    }
+
+    MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            close();
+            std::swap(data_, other.data_);
+            std::swap(size_, other.size_);
+            std::swap(open_, other.open_);
+#ifdef _WIN32
+            std::swap(mappingHandle_, other.mappingHandle_);
+#endif
+        }
+        return *this;
+    }
+
+#ifdef _WIN32
+    bool MappedFile::open(const fs::path& path) {
+        close();
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                  nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            DWORD error = GetLastError();
+            if (error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND) {
+                return false;
+            }
+            throw std::runtime_error("Could not open file: " + path.string());
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize)) {
+            CloseHandle(file);
+            throw std::runtime_error("Could not stat file: " + path.string());
+        }
+        size_ = static_cast<std::size_t>(fileSize.QuadPart);
+        open_ = true;
+        if (size_ == 0) {
+            CloseHandle(file); // an empty file cannot be mapped, but is valid
+            return true;
+        }
+
+        HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (mapping == nullptr) {
+            open_ = false;
+            throw std::runtime_error("Could not map file: " + path.string());
+        }
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (view == nullptr) {
+            CloseHandle(mapping);
+            open_ = false;
+            throw std::runtime_error("Could not map file: " + path.string());
+        }
+        mappingHandle_ = mapping;
+        data_ = static_cast<const unsigned char*>(view);
+        return true;
+    }
+
+    void MappedFile::close() {
+        if (data_ != nullptr) {
+            UnmapViewOfFile(data_);
+        }
+        if (mappingHandle_ != nullptr) {
+            CloseHandle(mappingHandle_);
+        }
+        data_ = nullptr;
+        mappingHandle_ = nullptr;
+        size_ = 0;
+        open_ = false;
+    }
+#else
+    bool MappedFile::open(const fs::path& path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            if (errno == ENOENT) {
+                return false;
+            }
+            throw std::runtime_error("Could not open file: " + path.string());
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Could not stat file: " + path.string());
+        }
+        size_ = static_cast<std::size_t>(st.st_size);
+        open_ = true;
+        if (size_ == 0) {
+            ::close(fd); // an empty file cannot be mapped, but is valid
+            return true;
+        }
+
+        void* view = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // the mapping keeps its own reference to the file
+        if (view == MAP_FAILED) {
+            open_ = false;
+            size_ = 0;
+            throw std::runtime_error("Could not map file: " + path.string());
+        }
+        data_ = static_cast<const unsigned char*>(view);
+        return true;
+    }
+
+    void MappedFile::close() {
+        if (data_ != nullptr) {
+            ::munmap(const_cast<unsigned char*>(data_), size_);
+        }
+        data_ = nullptr;
+        size_ = 0;
+        open_ = false;
+    }
+#endif
+
+    // --- Flushing ---
+
+#ifdef _WIN32
+    void syncFile(const fs::path& path) {
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        MINIGIT_TRACE_COUNT(Fsyncs, 1);
+        bool flushed = file != INVALID_HANDLE_VALUE && FlushFileBuffers(file);
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+        if (!flushed) {
+            throw std::runtime_error("Could not flush file: " + path.string());
+        }
+    }
+
+    void syncDirectory(const fs::path&) {}
+
+    bool syncFilesystem(const fs::path&) {
+        return false;
+    }
+#else
+    namespace {
+        void syncPath(const fs::path& path, int flags) {
+            int fd = ::open(path.c_str(), flags);
+            if (fd < 0) {
+                throw std::runtime_error("Could not open for flushing: " + path.string());
+            }
+            MINIGIT_TRACE_COUNT(Fsyncs, 1);
+            int result;
+            do {
+                result = ::fsync(fd);
+            } while (result != 0 && errno == EINTR);
+            ::close(fd);
+            if (result != 0) {
+                throw std::runtime_error("Could not flush: " + path.string());
+            }
+        }
+    }
+
+    void syncFile(const fs::path& path) {
+        syncPath(path, O_RDONLY);
+    }
+
+    void syncDirectory(const fs::path& path) {
+        syncPath(path.empty() ? fs::path(".") : path, O_RDONLY | O_DIRECTORY);
+    }
+
+    bool syncFilesystem(const fs::path& path) {
+#if defined(__linux__)
+        int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY);
+        if (fd < 0) {
+            throw std::runtime_error("Could not open for flushing: " + path.string());
+        }
+        MINIGIT_TRACE_COUNT(Fsyncs, 1);
+        int result = ::syncfs(fd);
+        ::close(fd);
+        if (result != 0) {
+            throw std::runtime_error("Could not flush the filesystem of " + path.string());
+        }
+#else
+        (void)path;
+        MINIGIT_TRACE_COUNT(Fsyncs, 1);
+        ::sync();
+#endif
+        return true;
+    }
+#endif
+
+    // --- processId ---
+
+    unsigned long processId() {
+#ifdef _WIN32
+        return static_cast<unsigned long>(GetCurrentProcessId());
+#else
+        return static_cast<unsigned long>(getpid());
+#endif
+    }
+
+    // --- NewFile ---
+
+#ifdef _WIN32
+    bool NewFile::create(const fs::path& path, bool /* readOnly */) {
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            HANDLE file = CreateFileW(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_NEW,
+                                      FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file != INVALID_HANDLE_VALUE) {
+                handle_ = file;
+                path_ = path;
+                return true;
+            }
+            DWORD error = GetLastError();
+            if (error == ERROR_FILE_EXISTS || error == ERROR_ALREADY_EXISTS) {
+                return false;
+            }
+            if (error != ERROR_PATH_NOT_FOUND || attempt != 0) {
+                break;
+            }
+            fs::create_directories(path.parent_path());
+        }
+        throw std::runtime_error("Could not write to file: " + path.string());
+    }
+
+    void NewFile::write(const void* data, std::size_t size) {
+        const char* bytes = static_cast<const char*>(data);
+        while (size > 0) {
+            DWORD chunk = static_cast<DWORD>(std::min<std::size_t>(size, 1u << 30));
+            DWORD written = 0;
+            if (!WriteFile(handle_, bytes, chunk, &written, nullptr)) {
+                throw std::runtime_error("Could not write to file: " + path_.string());
+            }
+            bytes += written;
+            size -= written;
+        }
+    }
+
+    void NewFile::commit(bool sync) {
+        if (handle_ != nullptr) {
+            HANDLE file = handle_;
+            handle_ = nullptr;
+            if (sync) {
+                MINIGIT_TRACE_COUNT(Fsyncs, 1);
+            }
+            bool flushed = !sync || FlushFileBuffers(file);
+            if (!CloseHandle(file) || !flushed) {
+                fs::remove(path_);
+                throw std::runtime_error("Could not write to file: " + path_.string());
+            }
+        }
+    }
+
+    NewFile::~NewFile() {
+        if (handle_ != nullptr) {
+            CloseHandle(handle_);
+            std::error_code ec;
+            fs::remove(path_, ec);
+        }
+    }
+#else
+    bool NewFile::create(const fs::path& path, bool readOnly) {
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, readOnly ? 0444 : 0666);
+            if (fd >= 0) {
+                fd_ = fd;
+                path_ = path;
+                return true;
+            }
+            if (errno == EEXIST) {
+                return false;
+            }
+            if (errno != ENOENT || attempt != 0) {
+                break;
+            }
+            fs::create_directories(path.parent_path());
+        }
+        throw std::runtime_error("Could not write to file: " + path.string());
+    }
+
+    void NewFile::write(const void* data, std::size_t size) {
+        const char* bytes = static_cast<const char*>(data);
+        while (size > 0) {
+            ssize_t written = ::write(fd_, bytes, size);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error("Could not write to file: " + path_.string());
+            }
+            bytes += written;
+            size -= static_cast<std::size_t>(written);
+        }
+    }
+
+    void NewFile::commit(bool sync) {
+        if (fd_ >= 0) {
+            int fd = fd_;
+            fd_ = -1;
+            if (sync) {
+                MINIGIT_TRACE_COUNT(Fsyncs, 1);
+            }
+            bool flushed = !sync || ::fsync(fd) == 0;
+            if (::close(fd) != 0 || !flushed) {
+                ::unlink(path_.c_str());
+                throw std::runtime_error("Could not write to file: " + path_.string());
+            }
+        }
+    }
+
+    NewFile::~NewFile() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+            ::unlink(path_.c_str()); // never leave a half-written file behind
+        }
+    }
+#endif
+
+} // namespace MiniGit
@@ -0,0 +1,144 @@
+/**
+ * platform.h
+ * * Thin wrappers over the operating system features the standard
+ * library does not cover (memory-mapped files, ...).
+ * POSIX and Windows implementations live in platform.cpp.
+ */
+
+#ifndef MINIGIT_PLATFORM_H
+#define MINIGIT_PLATFORM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+namespace MiniGit {
+
+    /**
+     * @brief The file metadata MiniGit uses to tell whether a file changed.
+     * Fields the platform cannot provide are left as 0.
+     */
+    struct FileStat {
+        uint64_t mtimeNs = 0; // last modification, nanoseconds (filesystem clock)
+        uint64_t ctimeNs = 0; // last status change (POSIX only)
+        uint64_t size = 0;
+        uint64_t inode = 0;   // POSIX only
+        uint32_t mode = 0;
+
+        bool operator==(const FileStat& other) const {
+            return mtimeNs == other.mtimeNs && ctimeNs == other.ctimeNs && size == other.size &&
+                   inode == other.inode && mode == other.mode;
+        }
+        bool operator!=(const FileStat& other) const { return !(*this == other); }
+    };
+
+    /**
+     * @brief Reads the metadata of a file (without following it into a directory).
+     * @return false if the file does not exist.
+     */
+    bool statFile(const std::filesystem::path& path, FileStat& out);
+
+    /**
+     * @brief A read-only memory mapping of a whole file.
+     * The mapping is released when the object is destroyed.
+     */
+    class MappedFile {
+    public:
+        MappedFile() = default;
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile& operator=(MappedFile&& other) noexcept;
+
+        /**
+         * @brief Maps the file at 'path'.
+         * @return false if the file does not exist.
+         * @throws std::runtime_error if the file exists but cannot be mapped.
+         */
+        bool open(const std::filesystem::path& path);
+
+        void close();
+
+        const unsigned char* data() const { return data_; }
+        std::size_t size() const { return size_; }
+        bool isOpen() const { return open_; }
+
+    private:
+        const unsigned char* data_ = nullptr;
+        std::size_t size_ = 0;
+        bool open_ = false;
+#ifdef _WIN32
+        void* mappingHandle_ = nullptr;
+#endif
+    };
+
+    /**
+     * @brief Flushes a file's data to stable storage (fsync).
+     * @throws std::runtime_error if the file cannot be flushed.
+     */
+    void syncFile(const std::filesystem::path& path);
+
+    /**
+     * @brief Flushes a directory, making the names created, renamed or
+     * removed in it durable. A no-op on Windows, where there is no
+     * directory handle to flush.
+     */
+    void syncDirectory(const std::filesystem::path& path);
+
+    /**
+     * @brief Flushes every pending write on the filesystem holding
+     * 'path' in one call (syncfs on Linux, sync on other POSIX systems).
+     * @return false if the platform has no such call (Windows).
+     */
+    bool syncFilesystem(const std::filesystem::path& path);
+
+    /**
+     * @brief The id of this process, for file names no other process
+     * picks at the same time.
+     */
+    unsigned long processId();
+
+    /**
+     * @brief A file that is created exclusively: creating it fails, rather
+     * than truncating, if the file already exists. This lets the caller
+     * test for existence and create in one system call.
+     * A file that is not closed with commit() is removed again.
+     */
+    class NewFile {
+    public:
+        NewFile() = default;
+        ~NewFile();
+
+        NewFile(const NewFile&) = delete;
+        NewFile& operator=(const NewFile&) = delete;
+
+        /**
+         * @brief Creates the file, and its parent directory if that is missing.
+         * @param readOnly Create it without write permission (objects).
+         * @return false if the file already exists.
+         * @throws std::runtime_error if the file cannot be created.
+         */
+        bool create(const std::filesystem::path& path, bool readOnly = true);
+
+        void write(const void* data, std::size_t size);
+
+        /**
+         * @brief Closes the file, keeping it.
+         * @param sync Flush the data to stable storage first (fsync).
+         */
+        void commit(bool sync = false);
+
+    private:
+        std::filesystem::path path_;
+#ifdef _WIN32
+        void* handle_ = nullptr;
+#else
+        int fd_ = -1;
+#endif
+    };
+
+} // namespace MiniGit
+
+#endif // MINIGIT_PLATFORM_H
@@ -0,0 +1,39 @@
+/**
+ * prefetch.cpp
+ * * Prefetching a commit's trees into the object cache.
+ */
+
+#include "prefetch.h"
+#include "object_cache.h"
+#include <memory>
+#include <unordered_set>
+
+namespace MiniGit {
+
+    void prefetchTrees(const ObjectId& root) {
+        ObjectCache& cache = objectCache();
+        if (root.empty() || cache.budgetBytes() == 0) {
+            return;
+        }
+
+        // DSA: BREADTH-FIRST SEARCH over the trees, a window of them
+        // loading at once. Trees shared by several directories are read
+        // once. The walk stops when the trees fill half the cache, so it
+        // never evicts the ones it has just read.
+        Prefetcher<std::shared_ptr<const TreeEntries>> trees(getTree);
+        std::unordered_set<ObjectId> seen{root};
+        trees.request(root);
+        while (trees.pending() != 0) {
+            std::shared_ptr<const TreeEntries> tree = trees.next();
+            if (cache.bytesUsed() > cache.budgetBytes() / 2) {
+                break;
+            }
+            for (const TreeEntry& entry : *tree) {
+                if (entry.isTree && seen.insert(entry.hash).second) {
+                    trees.request(entry.hash);
+                }
+            }
+        }
+    }
+
+} // namespace MiniGit
@@ -0,0 +1,165 @@
+/**
+ * prefetch.h
+ * * Reading objects ahead of the code that consumes them.
+ *
+ * A history walk or a checkout reads one object, works on it, then reads
+ * the next: on a cold cache or network storage every read is a full round
+ * trip, and those add up. Once the walk knows which objects come next
+ * (the commit-graph gives the commits ahead, a tree its subtrees), a
+ * Prefetcher loads them on background threads, a bounded window ahead,
+ * and hands them back in the order they were requested. Several reads
+ * are in flight at once, so the walk waits for the slowest of them
+ * rather than for their sum.
+ */
+
+#ifndef MINIGIT_PREFETCH_H
+#define MINIGIT_PREFETCH_H
+
+#include "object_id.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace MiniGit {
+
+    /**
+     * @brief Loads objects on background threads, ahead of the consumer.
+     * request() queues an object; next() returns the next one queued, in
+     * request order, waiting for it if it is not loaded yet. At most
+     * 'window' objects are loaded and not yet taken, which bounds the
+     * memory held. A load that throws rethrows from next().
+     *
+     * Reads wait on the disk (or the network) more than they compute, so
+     * the default is more threads than cores.
+     */
+    template <typename T>
+    class Prefetcher {
+    public:
+        using Loader = std::function<T(const ObjectId& id)>;
+
+        explicit Prefetcher(Loader load, std::size_t window = 0, unsigned threads = 0)
+            : load_(std::move(load)), threads_(threads != 0 ? threads : defaultThreads()),
+              window_(window != 0 ? window : threads_ * 4) {}
+
+        ~Prefetcher() {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping_ = true;
+            }
+            work_.notify_all();
+            for (std::thread& worker : workers_) {
+                worker.join();
+            }
+        }
+        Prefetcher(const Prefetcher&) = delete;
+        Prefetcher& operator=(const Prefetcher&) = delete;
+
+        void request(const ObjectId& id) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                slots_.emplace_back(id);
+                // Threads are started as the work calls for them: a short
+                // walk does not pay for a full set
+                if (workers_.size() < threads_ && workers_.size() < slots_.size() - started_) {
+                    workers_.emplace_back([this] { workerLoop(); });
+                }
+            }
+            work_.notify_one();
+        }
+
+        /**
+         * @brief Requests still to be taken by next().
+         */
+        std::size_t pending() const {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return slots_.size();
+        }
+
+        /**
+         * @brief The next requested object (there must be one pending).
+         */
+        T next() {
+            std::unique_lock<std::mutex> lock(mutex_);
+            done_.wait(lock, [this] { return slots_.front().done; });
+            Slot slot = std::move(slots_.front());
+            slots_.pop_front();
+            --started_;
+            lock.unlock();
+            work_.notify_one(); // a place in the window is free
+            if (slot.error) {
+                std::rethrow_exception(slot.error);
+            }
+            return std::move(*slot.value);
+        }
+
+        static unsigned defaultThreads() {
+            return std::max(8u, std::thread::hardware_concurrency());
+        }
+
+    private:
+        struct Slot {
+            explicit Slot(const ObjectId& requested) : id(requested) {}
+
+            ObjectId id;
+            std::optional<T> value;
+            std::exception_ptr error;
+            bool done = false;
+        };
+
+        void workerLoop() {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (true) {
+                work_.wait(lock, [this] { return stopping_ || (started_ < slots_.size() && started_ < window_); });
+                if (stopping_) {
+                    return;
+                }
+                // The deque keeps references to its elements valid while
+                // others are added at the back; this one stays until taken
+                Slot& slot = slots_[started_++];
+                lock.unlock();
+                std::optional<T> value;
+                std::exception_ptr error;
+                try {
+                    value.emplace(load_(slot.id));
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                lock.lock();
+                slot.value = std::move(value);
+                slot.error = error;
+                slot.done = true;
+                done_.notify_all();
+            }
+        }
+
+        Loader load_;
+        unsigned threads_;
+        std::size_t window_;
+        mutable std::mutex mutex_;
+        std::condition_variable work_;
+        std::condition_variable done_;
+        std::deque<Slot> slots_; // requested and not yet taken, in request order
+        std::size_t started_ = 0; // slots_[0, started_) are loading or loaded
+        bool stopping_ = false;
+        std::vector<std::thread> workers_;
+    };
+
+    /**
+     * @brief Reads every tree below 'root' into the object cache, level by
+     * level with a Prefetcher, so a walk over it that follows (a flatten
+     * or a diff) finds them all parsed instead of reading them one by one.
+     * Does nothing if the object cache is off.
+     */
+    void prefetchTrees(const ObjectId& root);
+
+} // namespace MiniGit
+
+#endif // MINIGIT_PREFETCH_H
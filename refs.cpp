@@ -0,0 +1,348 @@
+/**
+ * refs.cpp
+ * * The packed refs table, compare-and-swap ref updates, and HEAD.
+ */
+
+#include "refs.h"
+#include "binary_format.h"
+#include "hash.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+namespace MiniGit {
+
+    namespace {
+        const char REFS_MAGIC[4] = {'M', 'G', 'R', 'F'};
+        const uint32_t REFS_VERSION = 1;
+        const std::size_t HEADER_SIZE = 16;
+        const std::size_t ENTRY_SIZE = 48;
+        const std::size_t CHECKSUM_SIZE = 32;
+        const std::string SYMBOLIC_PREFIX = "ref: ";
+
+        // Refs are held for milliseconds; waiting this long means a
+        // command is stuck (or died holding the lock)
+        const unsigned REFS_LOCK_TIMEOUT_MS = 5000;
+
+        void refsChecksum(const unsigned char* data, std::size_t size, unsigned char out[CHECKSUM_SIZE]) {
+            Blake3Hasher hasher;
+            hasher.update(data, size);
+            hasher.finalize(out);
+        }
+
+        // The mapped table is shared with its readers: one that dropped
+        // it (after an update, or a reload) only lets go of its own
+        // reference, so the mapping lives until the last reader is done
+        std::mutex refsMutex;
+        std::shared_ptr<const RefTable> loadedRefs;
+
+        std::shared_ptr<const RefTable> refTable() {
+            std::lock_guard<std::mutex> lock(refsMutex);
+            if (!loadedRefs) {
+                auto table = std::make_shared<RefTable>();
+                table->load(rootPath(PACKED_REFS_FILE)); // no file: an empty table
+                loadedRefs = std::move(table);
+            }
+            return loadedRefs;
+        }
+
+        void dropRefTable() {
+            std::lock_guard<std::mutex> lock(refsMutex);
+            loadedRefs.reset();
+        }
+
+        using RefList = std::vector<std::pair<std::string, ObjectId>>;
+
+        RefList readRefList(const RefTable& table) {
+            RefList refs;
+            refs.reserve(table.size());
+            for (std::size_t i = 0; i < table.size(); ++i) {
+                refs.emplace_back(std::string(table.name(i)), table.id(i));
+            }
+            return refs;
+        }
+
+        std::string encodeRefs(const RefList& refs) {
+            std::string out;
+            out.append(REFS_MAGIC, sizeof(REFS_MAGIC));
+            putU32(out, REFS_VERSION);
+            putU32(out, static_cast<uint32_t>(refs.size()));
+            putU32(out, 0); // reserved
+
+            uint32_t nameOffset = 0;
+            for (const auto& ref : refs) {
+                putU32(out, nameOffset);
+                putU32(out, static_cast<uint32_t>(ref.first.size()));
+                putU8(out, ref.second.hexLength);
+                out.append(7, '\0'); // reserved
+                putObjectId(out, ref.second);
+                nameOffset += static_cast<uint32_t>(ref.first.size());
+            }
+            for (const auto& ref : refs) {
+                out += ref.first;
+            }
+
+            unsigned char checksum[CHECKSUM_SIZE];
+            refsChecksum(reinterpret_cast<const unsigned char*>(out.data()), out.size(), checksum);
+            out.append(reinterpret_cast<const char*>(checksum), CHECKSUM_SIZE);
+            return out;
+        }
+
+        std::string describe(const ObjectId& id) {
+            return id.empty() ? "nothing" : id.toHex();
+        }
+
+        // HEAD as stored: a ref name, or an id when detached
+        void readHEADFile(std::string& refName, ObjectId& id) {
+            refName.clear();
+            id = ObjectId();
+            if (!fs::exists(rootPath(HEAD_FILE))) {
+                return;
+            }
+            std::string content = readFileContent(rootPath(HEAD_FILE));
+            while (!content.empty() && (content.back() == '\n' || content.back() == '\r')) {
+                content.pop_back();
+            }
+            if (content.compare(0, SYMBOLIC_PREFIX.size(), SYMBOLIC_PREFIX) == 0) {
+                refName = content.substr(SYMBOLIC_PREFIX.size());
+            } else {
+                id = ObjectId::fromHex(content);
+            }
+        }
+
+        /**
+         * @brief The compare-and-swap itself; the caller holds the refs lock,
+         * which commit() releases.
+         */
+        void updateRefLocked(LockFile& lock, const std::string& name, const ObjectId& newId,
+                             const ObjectId* expectedOld) {
+            // 1. Re-read the table now that nobody else can change it
+            RefTable table;
+            table.load(rootPath(PACKED_REFS_FILE));
+            RefList refs = readRefList(table);
+            table.close();
+
+            // 2. Check the ref still has the value the caller started from
+            auto it = std::lower_bound(refs.begin(), refs.end(), name,
+                                       [](const RefList::value_type& ref, const std::string& n) { return ref.first < n; });
+            bool exists = it != refs.end() && it->first == name;
+            ObjectId current = exists ? it->second : ObjectId();
+            if (expectedOld != nullptr && *expectedOld != current) {
+                throw Error(ErrorCode::RefMoved, "Fatal: " + name + " is at " + describe(current) + " but expected " +
+                                         describe(*expectedOld) + " (another command updated it meanwhile)");
+            }
+
+            // 3. Apply the change and swap the new table in
+            if (newId.empty()) {
+                if (!exists) {
+                    return; // nothing to delete; the lock is released unchanged
+                }
+                refs.erase(it);
+            } else if (exists) {
+                it->second = newId;
+            } else {
+                refs.emplace(it, name, newId);
+            }
+            lock.commit(encodeRefs(refs));
+            dropRefTable();
+        }
+    }
+
+    // --- RefTable ---
+
+    bool RefTable::load(const fs::path& file) {
+        close();
+        if (!map_.open(file)) {
+            return false;
+        }
+        auto corrupt = [&]() { return std::runtime_error("Corrupt refs file " + file.string()); };
+
+        const unsigned char* data = map_.data();
+        std::size_t size = map_.size();
+        if (size < HEADER_SIZE + CHECKSUM_SIZE || std::memcmp(data, REFS_MAGIC, sizeof(REFS_MAGIC)) != 0) {
+            throw corrupt();
+        }
+        if (getU32(data + 4) != REFS_VERSION) {
+            throw std::runtime_error("Unsupported refs version in " + file.string());
+        }
+        uint64_t count = getU32(data + 8);
+        if (HEADER_SIZE + count * ENTRY_SIZE + CHECKSUM_SIZE > size) {
+            throw corrupt();
+        }
+        unsigned char checksum[CHECKSUM_SIZE];
+        refsChecksum(data, size - CHECKSUM_SIZE, checksum);
+        if (std::memcmp(checksum, data + size - CHECKSUM_SIZE, CHECKSUM_SIZE) != 0) {
+            throw corrupt();
+        }
+
+        entries_ = data + HEADER_SIZE;
+        count_ = static_cast<std::size_t>(count);
+        names_ = entries_ + count_ * ENTRY_SIZE;
+        namesSize_ = size - CHECKSUM_SIZE - (names_ - data);
+        for (std::size_t i = 0; i < count_; ++i) {
+            const unsigned char* e = entry(i);
+            if (static_cast<uint64_t>(getU32(e)) + getU32(e + 4) > namesSize_) {
+                throw corrupt();
+            }
+        }
+        return true;
+    }
+
+    void RefTable::close() {
+        map_.close();
+        entries_ = nullptr;
+        names_ = nullptr;
+        namesSize_ = 0;
+        count_ = 0;
+    }
+
+    const unsigned char* RefTable::entry(std::size_t position) const {
+        return entries_ + position * ENTRY_SIZE;
+    }
+
+    std::string_view RefTable::name(std::size_t position) const {
+        const unsigned char* e = entry(position);
+        return std::string_view(reinterpret_cast<const char*>(names_) + getU32(e), getU32(e + 4));
+    }
+
+    ObjectId RefTable::id(std::size_t position) const {
+        const unsigned char* e = entry(position);
+        return getObjectId(e + 16, e[8]);
+    }
+
+    bool RefTable::find(std::string_view target, ObjectId& id) const {
+        // DSA: BINARY SEARCH over the sorted entries
+        std::size_t low = 0, high = count_;
+        while (low < high) {
+            std::size_t mid = low + (high - low) / 2;
+            int c = name(mid).compare(target);
+            if (c == 0) {
+                id = this->id(mid);
+                return true;
+            }
+            if (c < 0) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        return false;
+    }
+
+    // --- Refs ---
+
+    void checkRefName(const std::string& name) {
+        auto invalid = [&]() { return std::runtime_error("Fatal: '" + name + "' is not a valid ref name"); };
+        if (name.compare(0, 5, "refs/") != 0 || name.back() == '/' || name.back() == '.' ||
+            name.find("..") != std::string::npos || name.find("//") != std::string::npos ||
+            name.find("/.") != std::string::npos || name.find("@{") != std::string::npos) {
+            throw invalid();
+        }
+        for (unsigned char c : name) {
+            if (c <= ' ' || c == 0x7f || std::strchr("~^:?*[\\", c) != nullptr) {
+                throw invalid();
+            }
+        }
+    }
+
+    bool readRef(const std::string& name, ObjectId& id) {
+        return refTable()->find(name, id);
+    }
+
+    bool findBranch(const std::string& name, std::string& refName, ObjectId& id) {
+        refName = name.compare(0, BRANCH_PREFIX.size(), BRANCH_PREFIX) == 0 ? name : BRANCH_PREFIX + name;
+        return readRef(refName, id);
+    }
+
+    std::vector<std::pair<std::string, ObjectId>> listRefs() {
+        return readRefList(*refTable());
+    }
+
+    void updateRef(const std::string& name, const ObjectId& newId, const ObjectId* expectedOld) {
+        checkRefName(name);
+        LockFile lock(rootPath(PACKED_REFS_FILE));
+        lock.lock(REFS_LOCK_TIMEOUT_MS);
+        updateRefLocked(lock, name, newId, expectedOld);
+    }
+
+    // --- HEAD ---
+
+    ObjectId getHEAD() {
+        std::string refName;
+        ObjectId id;
+        readHEADFile(refName, id);
+        if (!refName.empty()) {
+            readRef(refName, id); // an unborn branch: no commit yet
+        }
+        return id;
+    }
+
+    void setHEAD(const ObjectId& commitHash, const ObjectId* expectedOld) {
+        MINIGIT_TRACE_SCOPE("setHEAD");
+        // The refs lock covers HEAD too, so what HEAD points to cannot
+        // change between reading it and updating through it
+        LockFile lock(rootPath(PACKED_REFS_FILE));
+        lock.lock(REFS_LOCK_TIMEOUT_MS);
+        std::string refName;
+        ObjectId current;
+        readHEADFile(refName, current);
+        if (!refName.empty()) {
+            updateRefLocked(lock, refName, commitHash, expectedOld);
+            return;
+        }
+        if (expectedOld != nullptr && *expectedOld != current) {
+            throw Error(ErrorCode::RefMoved, "Fatal: HEAD is at " + describe(current) + " but expected " +
+                                     describe(*expectedOld) + " (another command updated it meanwhile)");
+        }
+        writeFileAtomic(rootPath(HEAD_FILE), commitHash.toHex());
+    }
+
+    std::string symbolicHEAD() {
+        std::string refName;
+        ObjectId id;
+        readHEADFile(refName, id);
+        return refName;
+    }
+
+    void setSymbolicHEAD(const std::string& refName) {
+        checkRefName(refName);
+        LockFile lock(rootPath(PACKED_REFS_FILE));
+        lock.lock(REFS_LOCK_TIMEOUT_MS);
+        writeFileAtomic(rootPath(HEAD_FILE), SYMBOLIC_PREFIX + refName + "\n");
+    }
+
+    void detachHEAD(const ObjectId& commitHash) {
+        LockFile lock(rootPath(PACKED_REFS_FILE));
+        lock.lock(REFS_LOCK_TIMEOUT_MS);
+        writeFileAtomic(rootPath(HEAD_FILE), commitHash.toHex());
+    }
+
+    void reloadRefs() {
+        dropRefTable();
+    }
+
+    std::vector<ObjectId> listRefTips() {
+        std::vector<ObjectId> tips;
+        std::unordered_set<ObjectId> seen;
+        ObjectId head = getHEAD();
+        if (!head.empty()) {
+            tips.push_back(head);
+            seen.insert(head);
+        }
+        std::shared_ptr<const RefTable> table = refTable();
+        for (std::size_t i = 0; i < table->size(); ++i) {
+            ObjectId id = table->id(i);
+            if (seen.insert(id).second) {
+                tips.push_back(id);
+            }
+        }
+        return tips;
+    }
+
+} // namespace MiniGit
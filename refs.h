@@ -0,0 +1,144 @@
+/**
+ * refs.h
+ * * Branches: named refs kept in one packed, sorted table.
+ *
+ * .minigit/packed-refs
+ *   header   "MGRF", u32 version, u32 ref count, u32 reserved
+ *   entries  sorted by name, 48 bytes each:
+ *              u32 name offset, u32 name length (in the name block),
+ *              u8 id hex length, 7 reserved bytes, 32-byte id
+ *   names    the full ref names ("refs/heads/main"), back to back
+ *   checksum BLAKE3 of everything above
+ *
+ * Looking a ref up is one binary search in the mapped file, however many
+ * branches there are. Every update goes through .minigit/packed-refs.lock:
+ * the writer takes the lock, re-reads the table, checks the ref still has
+ * the value the caller based its work on (compare-and-swap) and renames
+ * the new table into place. Two commands updating refs at once are
+ * serialized, and one that raced with another fails instead of silently
+ * overwriting its result.
+ *
+ * HEAD is either "ref: refs/heads/<name>" (on a branch) or a commit id
+ * (detached). Its updates take the same lock.
+ */
+
+#ifndef MINIGIT_REFS_H
+#define MINIGIT_REFS_H
+
+#include "minigit.h"
+#include "platform.h"
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace MiniGit {
+
+    const std::filesystem::path PACKED_REFS_FILE = GIT_DIR / "packed-refs";
+    const std::string BRANCH_PREFIX = "refs/heads/";
+    const std::string DEFAULT_BRANCH = "main";
+
+    /**
+     * @brief A memory-mapped, read-only view of the packed-refs file.
+     */
+    class RefTable {
+    public:
+        RefTable() = default;
+        RefTable(const RefTable&) = delete;
+        RefTable& operator=(const RefTable&) = delete;
+
+        /**
+         * @brief Maps the table file.
+         * @return false if there is no table (no refs yet).
+         * @throws std::runtime_error if the file is corrupt.
+         */
+        bool load(const std::filesystem::path& file);
+        void close();
+
+        std::size_t size() const { return count_; }
+
+        /**
+         * @brief Looks a ref up by its full name (binary search).
+         */
+        bool find(std::string_view name, ObjectId& id) const;
+
+        std::string_view name(std::size_t position) const;
+        ObjectId id(std::size_t position) const;
+
+    private:
+        const unsigned char* entry(std::size_t position) const;
+
+        MappedFile map_;
+        const unsigned char* entries_ = nullptr;
+        const unsigned char* names_ = nullptr;
+        std::size_t namesSize_ = 0;
+        std::size_t count_ = 0;
+    };
+
+    /**
+     * @brief Checks that a full ref name ("refs/heads/topic") is usable.
+     * @throws std::runtime_error if it is not.
+     */
+    void checkRefName(const std::string& name);
+
+    /**
+     * @brief Reads a ref from the (cached) table.
+     * @return false if the ref does not exist.
+     */
+    bool readRef(const std::string& name, ObjectId& id);
+
+    /**
+     * @brief Looks up a branch by its short ("topic") or full
+     * ("refs/heads/topic") name.
+     * @param refName Receives the full ref name.
+     * @return false if there is no such branch.
+     */
+    bool findBranch(const std::string& name, std::string& refName, ObjectId& id);
+
+    /**
+     * @brief Every ref, sorted by name.
+     */
+    std::vector<std::pair<std::string, ObjectId>> listRefs();
+
+    /**
+     * @brief Sets, creates or deletes a ref, atomically.
+     * @param newId The new value; an empty id deletes the ref.
+     * @param expectedOld If given, the value the ref must still have (an
+     * empty id: the ref must not exist yet).
+     * @throws std::runtime_error if the ref moved meanwhile, or the lock
+     * could not be taken.
+     */
+    void updateRef(const std::string& name, const ObjectId& newId, const ObjectId* expectedOld = nullptr);
+
+    /**
+     * @brief The ref HEAD points to ("refs/heads/main"), or "" when detached.
+     */
+    std::string symbolicHEAD();
+
+    /**
+     * @brief Puts HEAD on a branch (which may not exist yet).
+     */
+    void setSymbolicHEAD(const std::string& refName);
+
+    /**
+     * @brief Detaches HEAD at a commit.
+     */
+    void detachHEAD(const ObjectId& commitHash);
+
+    /**
+     * @brief Forgets the cached table, so the next lookup maps the file
+     * again (after another process changed it).
+     */
+    void reloadRefs();
+
+    /**
+     * @brief The commits history starts from: HEAD and every ref,
+     * without duplicates.
+     */
+    std::vector<ObjectId> listRefTips();
+
+} // namespace MiniGit
+
+#endif // MINIGIT_REFS_H
@@ -0,0 +1,1341 @@
+/**
+ * remote.cpp
+ * * The transport to other repositories, both ends of it, and the shallow
+ * and promisor bookkeeping of clones that are not complete.
+ */
+
+#include "remote.h"
+#include "binary_format.h"
+#include "chunker.h"
+#include "commit_graph.h"
+#include "compression.h"
+#include "delta.h"
+#include "hash.h"
+#include "minigit.h"
+#include "object_cache.h"
+#include "object_store.h"
+#include "pack.h"
+#include "refs.h"
+#include "trace.h"
+#include <algorithm>
+#include <cctype>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char** environ;
+#endif
+
+namespace fs = std::filesystem;
+
+namespace MiniGit {
+
+    namespace {
+        const char* const PROTOCOL_LINE = "minigit-protocol 1";
+        const std::size_t RECORD_HEADER_SIZE = 4 + 3 * 8 + 2 * ObjectId::MAX_BYTES;
+        const std::size_t TRAILER_SIZE = 32;
+        const uint8_t RECORD_END = 0;
+        const uint8_t RECORD_WHOLE = 1;
+        const uint8_t RECORD_DELTA = 2;
+        const int MAX_DELTA_DEPTH = 10; // as 'gc' packs them
+
+        // --- The connection ---
+
+#ifndef _WIN32
+        // Two file descriptors (a child's pipes, or our own stdin and
+        // stdout) as one stream, buffered both ways
+        class FdBuffer : public std::streambuf {
+        public:
+            FdBuffer(int in, int out) : in_(in), out_(out) {
+                setg(input_, input_, input_);
+                setp(output_, output_ + sizeof(output_));
+            }
+            ~FdBuffer() override { sync(); }
+
+        protected:
+            int_type underflow() override {
+                ssize_t n;
+                do {
+                    n = ::read(in_, input_, sizeof(input_));
+                } while (n < 0 && errno == EINTR);
+                if (n <= 0) {
+                    return traits_type::eof();
+                }
+                setg(input_, input_, input_ + n);
+                return traits_type::to_int_type(input_[0]);
+            }
+
+            int_type overflow(int_type c) override {
+                if (sync() != 0) {
+                    return traits_type::eof();
+                }
+                if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                    *pptr() = traits_type::to_char_type(c);
+                    pbump(1);
+                }
+                return traits_type::not_eof(c);
+            }
+
+            int sync() override {
+                const char* data = pbase();
+                std::size_t size = static_cast<std::size_t>(pptr() - pbase());
+                while (size != 0) {
+                    ssize_t n = ::write(out_, data, size);
+                    if (n < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (n <= 0) {
+                        return -1; // the other end went away
+                    }
+                    data += n;
+                    size -= static_cast<std::size_t>(n);
+                }
+                setp(output_, output_ + sizeof(output_));
+                return 0;
+            }
+
+        private:
+            int in_;
+            int out_;
+            char input_[64 * 1024];
+            char output_[64 * 1024];
+        };
+#endif
+
+        bool startsWith(const std::string& text, const char* prefix) {
+            return text.compare(0, std::strlen(prefix), prefix) == 0;
+        }
+
+        // A host, port or path that ssh or the remote minigit could take for
+        // an option ("-oProxyCommand=...") is refused, never passed on
+        void checkSshUrl(const std::string& url, const std::string& host, const std::string& port,
+                         const std::string& path) {
+            bool digits = port.find_first_not_of("0123456789") == std::string::npos;
+            if (host.empty() || host[0] == '-' || path[0] == '-' || !digits) {
+                throw Error(ErrorCode::Failed, "Fatal: Invalid ssh url: " + url);
+            }
+        }
+
+        // "ssh://[user@]host[:port]/path" or "[user@]host:path"
+        bool parseSshUrl(const std::string& url, std::string& host, std::string& port, std::string& path) {
+            if (startsWith(url, "ssh://")) {
+                std::string rest = url.substr(6);
+                std::size_t slash = rest.find('/');
+                if (slash == std::string::npos || slash == 0) {
+                    throw Error(ErrorCode::Failed, "Fatal: Invalid ssh url: " + url);
+                }
+                host = rest.substr(0, slash);
+                path = rest.substr(slash);
+                if (startsWith(path, "/~")) {
+                    path.erase(0, 1); // ssh://host/~/repo is relative to the home directory
+                }
+                std::size_t colon = host.find(':', host.find('@') == std::string::npos ? 0 : host.find('@'));
+                if (colon != std::string::npos) {
+                    port = host.substr(colon + 1);
+                    host.erase(colon);
+                }
+                checkSshUrl(url, host, port, path);
+                return true;
+            }
+            // A colon before any slash (and not a drive letter) is scp-style
+            std::size_t colon = url.find(':');
+            if (colon == std::string::npos || colon < 2 || url.find('/') < colon) {
+                return false;
+            }
+            host = url.substr(0, colon);
+            path = url.substr(colon + 1);
+            if (path.empty()) {
+                throw Error(ErrorCode::Failed, "Fatal: Invalid ssh url: " + url);
+            }
+            checkSshUrl(url, host, port, path);
+            return true;
+        }
+
+        // Checks a url can be used, and makes a local path absolute (the
+        // commands change directory)
+        std::string resolveRemoteUrl(const std::string& url) {
+            if (startsWith(url, "http://") || startsWith(url, "https://")) {
+                throw Error(ErrorCode::Failed, "Fatal: HTTP remotes are not supported; use ssh://host/path, "
+                                               "host:path or a local path: " + url);
+            }
+            std::string host, port, path;
+            if (parseSshUrl(url, host, port, path)) {
+                return url;
+            }
+            fs::path local = startsWith(url, "file://") ? fs::path(url.substr(7)) : fs::path(url);
+            if (!fs::is_directory(local / GIT_DIR)) {
+                throw Error(ErrorCode::NotARepository, "Fatal: '" + url + "' is not a MiniGit repository");
+            }
+            return fs::absolute(local).lexically_normal().string();
+        }
+
+        std::string shellQuote(const std::string& word) {
+            std::string quoted = "'";
+            for (char c : word) {
+                quoted += c == '\'' ? std::string("'\\''") : std::string(1, c);
+            }
+            return quoted + "'";
+        }
+
+        // The command that serves 'service' for the remote at 'url'
+        std::vector<std::string> remoteCommand(const std::string& url, const std::string& service) {
+            std::string host, port, path;
+            if (!parseSshUrl(url, host, port, path)) {
+                std::string local = resolveRemoteUrl(url);
+                std::error_code ec;
+                fs::path self = fs::read_symlink("/proc/self/exe", ec); // this very binary, on Linux
+                return {ec ? std::string("minigit") : self.string(), service, local};
+            }
+            const char* ssh = std::getenv("MINIGIT_SSH");
+            std::vector<std::string> command{ssh != nullptr && *ssh != '\0' ? ssh : "ssh"};
+            if (!port.empty()) {
+                command.push_back("-p");
+                command.push_back(port);
+            }
+            command.push_back("--"); // whatever follows is the host, not an option
+            command.push_back(host);
+            command.push_back("minigit " + service + " " + shellQuote(path));
+            return command;
+        }
+
+        // The client end: the remote's service as a child process, its
+        // stdin and stdout our stream
+        class RemoteProcess {
+        public:
+            RemoteProcess(const std::string& url, const std::string& service) : stream_(nullptr), service_(service) {
+                std::vector<std::string> command = remoteCommand(url, service);
+#ifdef _WIN32
+                throw Error(ErrorCode::Failed, "Fatal: Remotes are only supported on POSIX systems");
+#else
+                std::signal(SIGPIPE, SIG_IGN); // a remote that dies is an error, not the end of us
+                int toChild[2];
+                int fromChild[2];
+                if (pipe(toChild) != 0) {
+                    throw std::runtime_error(std::string("pipe failed: ") + std::strerror(errno));
+                }
+                if (pipe(fromChild) != 0) {
+                    std::string reason = std::strerror(errno);
+                    close(toChild[0]);
+                    close(toChild[1]);
+                    throw std::runtime_error("pipe failed: " + reason);
+                }
+                // The child keeps only its ends, as its stdin and stdout
+                for (int fd : {toChild[0], toChild[1], fromChild[0], fromChild[1]}) {
+                    fcntl(fd, F_SETFD, FD_CLOEXEC);
+                }
+                posix_spawn_file_actions_t actions;
+                posix_spawn_file_actions_init(&actions);
+                posix_spawn_file_actions_adddup2(&actions, toChild[0], STDIN_FILENO);
+                posix_spawn_file_actions_adddup2(&actions, fromChild[1], STDOUT_FILENO);
+                std::vector<char*> argv;
+                for (std::string& word : command) {
+                    argv.push_back(&word[0]);
+                }
+                argv.push_back(nullptr);
+                int result = posix_spawnp(&pid_, argv[0], &actions, nullptr, argv.data(), environ);
+                posix_spawn_file_actions_destroy(&actions);
+                close(toChild[0]);
+                close(fromChild[1]);
+                if (result != 0) {
+                    close(toChild[1]);
+                    close(fromChild[0]);
+                    throw std::runtime_error("Fatal: Cannot run " + command[0] + ": " + std::strerror(result));
+                }
+                in_ = fromChild[0];
+                out_ = toChild[1];
+                buffer_ = std::make_unique<FdBuffer>(in_, out_);
+                stream_.rdbuf(buffer_.get());
+#endif
+            }
+
+            ~RemoteProcess() {
+                try {
+                    finish();
+                } catch (const std::exception&) {
+                    // already failing: the child's stderr says why
+                }
+            }
+
+            RemoteProcess(const RemoteProcess&) = delete;
+            RemoteProcess& operator=(const RemoteProcess&) = delete;
+
+            std::iostream& stream() { return stream_; }
+
+            /**
+             * @brief Closes our ends, so the child sees the end of its
+             * input, and waits for it to exit.
+             * @throws std::runtime_error if it did not exit with status 0.
+             */
+            void finish() {
+#ifndef _WIN32
+                if (pid_ <= 0) {
+                    return;
+                }
+                stream_.flush();
+                stream_.rdbuf(nullptr);
+                buffer_.reset();
+                close(out_);
+                close(in_);
+                int status = 0;
+                pid_t waited;
+                while ((waited = waitpid(pid_, &status, 0)) < 0 && errno == EINTR) {
+                }
+                pid_ = 0;
+                if (waited < 0) {
+                    throw std::runtime_error(std::string("waitpid failed: ") + std::strerror(errno));
+                }
+                if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                    throw Error(ErrorCode::Failed, "Fatal: The remote " + service_ + " failed " +
+                                (WIFEXITED(status) ? "with exit status " + std::to_string(WEXITSTATUS(status))
+                                                   : std::string("on a signal")));
+                }
+#endif
+            }
+
+        private:
+            std::iostream stream_;
+            std::unique_ptr<std::streambuf> buffer_;
+            std::string service_;
+#ifndef _WIN32
+            pid_t pid_ = 0;
+            int in_ = -1;
+            int out_ = -1;
+#endif
+        };
+
+        // The server end: our stdin and stdout, in the repository being
+        // served. What the commands print goes to stderr instead, where it
+        // cannot corrupt the protocol.
+        class ServiceConnection {
+        public:
+            explicit ServiceConnection(const fs::path& directory) : stream_(nullptr) {
+#ifdef _WIN32
+                (void)directory;
+                throw Error(ErrorCode::Failed, "Fatal: Remotes are only supported on POSIX systems");
+#else
+                std::error_code ec;
+                fs::current_path(directory, ec);
+                if (ec || !repoExists()) {
+                    throw Error(ErrorCode::NotARepository, "Fatal: '" + directory.string() + "' is not a MiniGit repository");
+                }
+                std::signal(SIGPIPE, SIG_IGN);
+                buffer_ = std::make_unique<FdBuffer>(STDIN_FILENO, STDOUT_FILENO);
+                stream_.rdbuf(buffer_.get());
+                stdout_ = std::cout.rdbuf(std::cerr.rdbuf());
+#endif
+            }
+
+            ~ServiceConnection() {
+                stream_.flush();
+                if (stdout_ != nullptr) {
+                    std::cout.rdbuf(stdout_);
+                }
+            }
+
+            ServiceConnection(const ServiceConnection&) = delete;
+            ServiceConnection& operator=(const ServiceConnection&) = delete;
+
+            std::iostream& stream() { return stream_; }
+
+        private:
+            std::iostream stream_;
+            std::unique_ptr<std::streambuf> buffer_;
+            std::streambuf* stdout_ = nullptr;
+        };
+
+        std::string readLine(std::istream& in) {
+            std::string line;
+            if (!std::getline(in, line)) {
+                throw Error(ErrorCode::Failed, "Fatal: The remote end hung up unexpectedly");
+            }
+            return line;
+        }
+
+        void readExact(std::istream& in, char* out, std::size_t size) {
+            if (!in.read(out, static_cast<std::streamsize>(size))) {
+                throw Error(ErrorCode::Failed, "Fatal: The remote end hung up unexpectedly");
+            }
+        }
+
+        ObjectId parseId(const std::string& hex) {
+            if (hex.empty() || !ObjectId::isHex(hex)) {
+                throw Error(ErrorCode::Failed, "Fatal: Invalid object id from the remote: " + hex);
+            }
+            return ObjectId::fromHex(hex);
+        }
+
+        // "<word> <rest>" -> word, rest
+        std::string splitWord(const std::string& line, std::string& rest) {
+            std::size_t space = line.find(' ');
+            rest = space == std::string::npos ? std::string() : line.substr(space + 1);
+            return line.substr(0, space);
+        }
+
+        // --- Refs on the wire ---
+
+        struct Advertisement {
+            std::vector<std::pair<std::string, ObjectId>> branches;
+            std::string head;
+        };
+
+        void writeAdvertisement(std::ostream& out) {
+            out << PROTOCOL_LINE << "\n";
+            for (const auto& ref : listRefs()) {
+                if (ref.first.compare(0, BRANCH_PREFIX.size(), BRANCH_PREFIX) == 0) {
+                    out << "ref " << ref.second.toHex() << " " << ref.first << "\n";
+                }
+            }
+            std::string head = symbolicHEAD();
+            if (!head.empty()) {
+                out << "head " << head << "\n";
+            }
+            out << "end\n" << std::flush;
+        }
+
+        Advertisement readAdvertisement(std::istream& in) {
+            std::string line = readLine(in);
+            if (line != PROTOCOL_LINE) {
+                throw Error(ErrorCode::Failed, "Fatal: The remote does not speak the MiniGit protocol: " + line);
+            }
+            Advertisement advertised;
+            while ((line = readLine(in)) != "end") {
+                std::string rest;
+                std::string word = splitWord(line, rest);
+                if (word == "ref") {
+                    std::string name;
+                    std::string hex = splitWord(rest, name);
+                    advertised.branches.emplace_back(name, parseId(hex));
+                } else if (word == "head") {
+                    advertised.head = rest;
+                } else if (word == "error") {
+                    throw Error(ErrorCode::Failed, "Fatal: The remote failed: " + rest);
+                } // anything else is from a newer server: ignored
+            }
+            return advertised;
+        }
+
+        // Reads the lines before the object stream
+        std::vector<ObjectId> readUntilPack(std::istream& in) {
+            std::vector<ObjectId> shallow;
+            std::string line;
+            while ((line = readLine(in)) != "pack") {
+                std::string rest;
+                std::string word = splitWord(line, rest);
+                if (word == "shallow") {
+                    shallow.push_back(parseId(rest));
+                } else if (word == "error") {
+                    throw Error(ErrorCode::Failed, "Fatal: The remote failed: " + rest);
+                }
+            }
+            return shallow;
+        }
+
+        // --- The object stream ---
+
+        class ObjectStreamWriter {
+        public:
+            explicit ObjectStreamWriter(std::ostream& out) : out_(out), level_(compressionLevel()) {}
+
+            bool sent(const ObjectId& hash) const { return depth_.count(hash) != 0; }
+            std::size_t count() const { return depth_.size(); }
+
+            /**
+             * @brief Sends an object (a chunked blob with its chunks), as a
+             * delta against 'base' if that was sent before and the delta
+             * is much smaller than the object.
+             */
+            void add(const ObjectId& hash, const ObjectId& base = ObjectId()) {
+                if (sent(hash)) {
+                    return;
+                }
+                std::string content;
+                ObjectType type = readStoredObject(hash, content);
+                auto baseDepth = base.empty() ? depth_.end() : depth_.find(base);
+                int depth = 0;
+                if (baseDepth != depth_.end() && baseDepth->second < MAX_DELTA_DEPTH &&
+                    readStoredObject(base, baseContent_) == type &&
+                    computeDelta(baseContent_, content, delta_, content.size() / 2)) {
+                    depth = baseDepth->second + 1;
+                    writeRecord(hash, type, RECORD_DELTA, base, content.size(), delta_);
+                } else {
+                    writeRecord(hash, type, RECORD_WHOLE, ObjectId(), content.size(), content);
+                }
+                depth_[hash] = depth;
+                if (type == ObjectType::ChunkedBlob) {
+                    for (const auto& chunk : parseManifest(content)) {
+                        add(chunk.first);
+                    }
+                }
+            }
+
+            void finish() {
+                const char end = static_cast<char>(RECORD_END);
+                hasher_.update(&end, 1);
+                out_.put(end);
+                unsigned char trailer[TRAILER_SIZE];
+                hasher_.finalize(trailer);
+                out_.write(reinterpret_cast<const char*>(trailer), TRAILER_SIZE);
+                out_.flush();
+            }
+
+        private:
+            void writeRecord(const ObjectId& hash, ObjectType type, uint8_t kind, const ObjectId& base,
+                             std::size_t objectSize, const std::string& raw) {
+                payload_.clear();
+                deflateAppend(raw.data(), raw.size(), level_, payload_);
+                header_.clear();
+                putU8(header_, kind);
+                putU8(header_, static_cast<uint8_t>(type));
+                putU8(header_, hash.hexLength);
+                putU8(header_, base.hexLength);
+                putU64(header_, objectSize);
+                putU64(header_, raw.size());
+                putU64(header_, payload_.size());
+                putObjectId(header_, hash);
+                putObjectId(header_, base);
+                hasher_.update(header_);
+                hasher_.update(payload_);
+                out_.write(header_.data(), static_cast<std::streamsize>(header_.size()));
+                out_.write(payload_.data(), static_cast<std::streamsize>(payload_.size()));
+            }
+
+            std::ostream& out_;
+            int level_;
+            Blake3Hasher hasher_;
+            std::unordered_map<ObjectId, int> depth_; // every object sent, by its delta chain length
+            std::string header_;
+            std::string payload_;
+            std::string baseContent_;
+            std::string delta_;
+        };
+
+        // Whether received content is what its id names. Legacy (std::hash)
+        // ids cannot be recomputed, and a chunked blob is named by its
+        // whole content: its chunks are checked one by one instead.
+        bool receivedIntact(const ObjectId& hash, ObjectType type, const std::string& content,
+                            std::size_t idHexLength) {
+            if (type == ObjectType::ChunkedBlob || hash.hexLength != idHexLength) {
+                return true;
+            }
+            return contentHasId(content, hash);
+        }
+
+        /**
+         * @brief Reads an object stream into one new pack (or, with
+         * 'loose', into loose objects, for the few a partial clone
+         * fetches on demand) and checks every object against its id.
+         * @return The number of objects received.
+         */
+        std::size_t receiveObjects(std::istream& in, bool loose) {
+            MINIGIT_TRACE_SCOPE("receive objects");
+            const std::size_t idHexLength = 2 * makeObjectHasher()->digestSize();
+            Blake3Hasher hasher;
+            std::optional<PackWriter> writer; // opened for the first object
+            std::vector<ObjectId> deltas;     // checked once the pack can be read
+            std::size_t count = 0;
+            std::string header(RECORD_HEADER_SIZE, '\0');
+            std::string payload;
+            std::string raw;
+
+            // 1. The records, until the end marker
+            while (true) {
+                readExact(in, &header[0], 1);
+                hasher.update(header.data(), 1);
+                if (static_cast<uint8_t>(header[0]) == RECORD_END) {
+                    break;
+                }
+                readExact(in, &header[1], RECORD_HEADER_SIZE - 1);
+                hasher.update(header.data() + 1, RECORD_HEADER_SIZE - 1);
+                const unsigned char* p = reinterpret_cast<const unsigned char*>(header.data());
+                uint8_t kind = p[0];
+                ObjectType type = static_cast<ObjectType>(p[1]);
+                uint64_t objectSize = getU64(p + 4);
+                uint64_t rawSize = getU64(p + 12);
+                uint64_t payloadSize = getU64(p + 20);
+                if (kind > RECORD_DELTA || type > ObjectType::Chunk || p[2] == 0 || p[2] > 2 * ObjectId::MAX_BYTES ||
+                    p[3] > 2 * ObjectId::MAX_BYTES || payloadSize > (uint64_t(1) << 40) ||
+                    rawSize > maxInflatedSize(static_cast<std::size_t>(payloadSize))) {
+                    throw Error(ErrorCode::Failed, "Fatal: Corrupt object stream from the remote");
+                }
+                ObjectId hash = getObjectId(p + 28, p[2]);
+                ObjectId base = getObjectId(p + 28 + ObjectId::MAX_BYTES, p[3]);
+                payload.resize(static_cast<std::size_t>(payloadSize));
+                readExact(in, &payload[0], payload.size());
+                hasher.update(payload);
+                raw.resize(static_cast<std::size_t>(rawSize));
+                if (!inflateExact(reinterpret_cast<const unsigned char*>(payload.data()), payload.size(), &raw[0],
+                                  raw.size())) {
+                    throw Error(ErrorCode::Failed, "Fatal: Corrupt object " + hash.toHex() + " from the remote");
+                }
+
+                if (kind == RECORD_WHOLE && !receivedIntact(hash, type, raw, idHexLength)) {
+                    throw Error(ErrorCode::Failed, "Fatal: Object " + hash.toHex() + " from the remote does not match its id");
+                }
+                if (loose) {
+                    if (kind != RECORD_WHOLE) {
+                        throw Error(ErrorCode::Failed, "Fatal: Unexpected delta from the remote");
+                    }
+                    writeObject(hash, type, raw);
+                } else {
+                    if (!writer) {
+                        writer.emplace(rootPath(PACK_DIR));
+                    }
+                    if (kind == RECORD_WHOLE) {
+                        writer->addWhole(hash, type, raw);
+                    } else {
+                        if (!writer->contains(base)) {
+                            throw Error(ErrorCode::Failed, "Fatal: Object " + hash.toHex() +
+                                                               " from the remote is a delta against one it did not send");
+                        }
+                        writer->addDelta(hash, type, static_cast<std::size_t>(objectSize), base, raw);
+                        deltas.push_back(hash);
+                    }
+                }
+                ++count;
+            }
+            unsigned char expected[TRAILER_SIZE];
+            unsigned char actual[TRAILER_SIZE];
+            readExact(in, reinterpret_cast<char*>(expected), TRAILER_SIZE);
+            hasher.finalize(actual);
+            if (std::memcmp(expected, actual, TRAILER_SIZE) != 0) {
+                throw Error(ErrorCode::Failed, "Fatal: The object stream from the remote is corrupt (checksum mismatch)");
+            }
+            if (!writer) {
+                return count;
+            }
+
+            // 2. Publish the pack, then check what the deltas rebuild to;
+            // a bad pack is removed before any ref can point into it
+            fs::path pack = writer->finish();
+            auto discard = [&pack]() {
+                fs::path index = pack;
+                std::error_code ec;
+                fs::remove(index.replace_extension(".idx"), ec);
+                fs::remove(pack, ec);
+                reloadPacks();
+            };
+            try {
+                verifyPack(pack);
+            } catch (const std::runtime_error& e) {
+                discard();
+                throw Error(ErrorCode::Failed, std::string("Fatal: ") + e.what());
+            }
+            reloadPacks();
+            std::string content;
+            for (const ObjectId& hash : deltas) {
+                ObjectType type;
+                if (!readPackedObject(hash, content, type) || !receivedIntact(hash, type, content, idHexLength)) {
+                    discard();
+                    throw Error(ErrorCode::Failed, "Fatal: Object " + hash.toHex() + " from the remote does not match its id");
+                }
+            }
+            return count;
+        }
+
+        // --- Choosing what to send ---
+
+        struct PackRequest {
+            std::vector<ObjectId> wants;   // commits the receiver wants
+            std::vector<ObjectId> haves;   // commits it has (with their history)
+            std::vector<ObjectId> shallow; // its shallow commits: it has them, not their parents
+            unsigned depth = 0;            // 0: the whole history
+            bool blobs = true;             // false: "filter blob:none"
+        };
+
+        void parentsOf(const ObjectId& hash, std::vector<ObjectId>& parents) {
+            parents.clear();
+            const CommitGraph* graph = commitGraph();
+            uint32_t position;
+            if (graph != nullptr && graph->find(hash, position)) {
+                for (uint32_t parent : {graph->parent(position), graph->secondParent(position)}) {
+                    if (parent != CommitGraph::NO_PARENT) {
+                        parents.push_back(graph->hash(parent));
+                    }
+                }
+                return;
+            }
+            std::shared_ptr<const CommitInfo> commit = getCommit(hash);
+            for (const ObjectId& parent : {commit->parent, commit->secondParent}) {
+                if (!parent.empty()) {
+                    parents.push_back(parent);
+                }
+            }
+        }
+
+        // Every tree and blob below a tree (the receiver has them all)
+        void markTree(const ObjectId& tree, std::unordered_set<ObjectId>& marked) {
+            if (tree.empty() || !marked.insert(tree).second) {
+                return;
+            }
+            for (const TreeEntry& entry : *getTree(tree)) {
+                if (entry.isTree) {
+                    markTree(entry.hash, marked);
+                } else {
+                    marked.insert(entry.hash);
+                }
+            }
+        }
+
+        /**
+         * @brief Answers a request: "shallow" lines for the commits the
+         * depth cut at, "pack", and the objects the receiver lacks.
+         * @return The number of objects sent.
+         */
+        std::size_t sendHistory(std::ostream& out, const PackRequest& request) {
+            MINIGIT_TRACE_SCOPE("send objects");
+            std::vector<ObjectId> parents;
+
+            // 1. What the receiver has: its haves and their history, down
+            // to its shallow commits
+            std::unordered_set<ObjectId> theirShallow(request.shallow.begin(), request.shallow.end());
+            std::unordered_set<ObjectId> common;
+            std::vector<ObjectId> stack;
+            for (const ObjectId& have : request.haves) {
+                if (objectExists(have)) {
+                    stack.push_back(have);
+                }
+            }
+            while (!stack.empty()) {
+                ObjectId hash = stack.back();
+                stack.pop_back();
+                if (!common.insert(hash).second || theirShallow.count(hash) != 0) {
+                    continue;
+                }
+                parentsOf(hash, parents);
+                stack.insert(stack.end(), parents.begin(), parents.end());
+            }
+
+            // 2. The commits it lacks, newest first, cut at the depth.
+            // DSA: BREADTH-FIRST SEARCH, so a commit is reached first on its
+            // shortest path from a want and the depth counts that path.
+            std::vector<ObjectId> commits;
+            std::vector<ObjectId> cut;      // sent without their parents
+            std::vector<ObjectId> boundary; // common parents of sent commits
+            std::unordered_set<ObjectId> seen;
+            std::deque<std::pair<ObjectId, unsigned>> queue;
+            for (const ObjectId& want : request.wants) {
+                queue.emplace_back(want, 1);
+            }
+            while (!queue.empty()) {
+                std::pair<ObjectId, unsigned> next = queue.front();
+                queue.pop_front();
+                if (common.count(next.first) != 0 || !seen.insert(next.first).second) {
+                    continue;
+                }
+                commits.push_back(next.first);
+                parentsOf(next.first, parents);
+                if (request.depth != 0 && next.second >= request.depth) {
+                    if (!parents.empty()) {
+                        cut.push_back(next.first);
+                    }
+                    continue;
+                }
+                for (const ObjectId& parent : parents) {
+                    if (common.count(parent) != 0) {
+                        boundary.push_back(parent);
+                    } else {
+                        queue.emplace_back(parent, next.second + 1);
+                    }
+                }
+            }
+
+            // 3. Where the histories meet, the receiver has every tree and
+            // blob of the commit: none of those is sent
+            std::unordered_set<ObjectId> excluded;
+            for (const ObjectId& hash : boundary) {
+                std::shared_ptr<const CommitInfo> commit = getCommit(hash);
+                markTree(commit->tree, excluded);
+                for (const auto& file : commit->inlineFiles) {
+                    excluded.insert(file.second);
+                }
+            }
+
+            // 4. Send, each commit followed by its new trees and blobs; an
+            // older version of a file goes as a delta against the newer one
+            for (const ObjectId& hash : cut) {
+                out << "shallow " << hash.toHex() << "\n";
+            }
+            out << "pack\n";
+            ObjectStreamWriter writer(out);
+            std::unordered_map<std::string, ObjectId> newestVersion; // path -> blob sent last
+            auto sendBlob = [&](const std::string& path, const ObjectId& blob) {
+                if (request.blobs && excluded.count(blob) == 0) {
+                    ObjectId& newer = newestVersion[path];
+                    writer.add(blob, newer);
+                    newer = blob;
+                }
+            };
+            std::function<void(const ObjectId&, const std::string&)> sendTree = [&](const ObjectId& tree,
+                                                                                    const std::string& prefix) {
+                if (tree.empty() || excluded.count(tree) != 0 || writer.sent(tree)) {
+                    return;
+                }
+                writer.add(tree);
+                for (const TreeEntry& entry : *getTree(tree)) {
+                    if (entry.isTree) {
+                        sendTree(entry.hash, prefix + entry.name + "/");
+                    } else {
+                        sendBlob(prefix + entry.name, entry.hash);
+                    }
+                }
+            };
+            for (const ObjectId& hash : commits) {
+                writer.add(hash);
+                std::shared_ptr<const CommitInfo> commit = getCommit(hash);
+                sendTree(commit->tree, "");
+                for (const auto& file : commit->inlineFiles) {
+                    sendBlob(file.first, file.second);
+                }
+            }
+            writer.finish();
+            return writer.count();
+        }
+
+        // --- Shallow and promisor state ---
+
+        std::mutex shallowMutex;
+        bool shallowLoaded = false;
+        std::unordered_set<ObjectId> shallowSet;
+
+        void loadShallowLocked() {
+            if (shallowLoaded) {
+                return;
+            }
+            shallowSet.clear();
+            if (fs::exists(rootPath(SHALLOW_FILE))) {
+                std::istringstream lines(readFileContent(rootPath(SHALLOW_FILE)));
+                std::string line;
+                while (std::getline(lines, line)) {
+                    if (!line.empty()) {
+                        shallowSet.insert(ObjectId::fromHex(line));
+                    }
+                }
+            }
+            shallowLoaded = true;
+        }
+
+        void writeShallowCommits(std::vector<ObjectId> commits) {
+            std::sort(commits.begin(), commits.end());
+            commits.erase(std::unique(commits.begin(), commits.end()), commits.end());
+            std::string content;
+            for (const ObjectId& hash : commits) {
+                content += hash.toHex() + "\n";
+            }
+            writeFileAtomic(rootPath(SHALLOW_FILE), content);
+            reloadShallow();
+            objectCache().clear(); // parsed commits may list parents that are now cut off
+        }
+
+        std::mutex promisorMutex;
+
+        // The remote a partial clone fetches missing objects from ("" for none)
+        std::string promisorRemote() {
+            const std::string prefix = "remote.";
+            const std::string suffix = ".promisor";
+            for (const auto& setting : readConfig()) {
+                const std::string& key = setting.first;
+                if (setting.second == "true" && key.size() > prefix.size() + suffix.size() &&
+                    key.compare(0, prefix.size(), prefix) == 0 &&
+                    key.compare(key.size() - suffix.size(), suffix.size(), suffix) == 0) {
+                    return key.substr(prefix.size(), key.size() - prefix.size() - suffix.size());
+                }
+            }
+            return "";
+        }
+
+        // A configured remote's url, or (for push) a url given directly
+        std::string remoteUrl(const std::string& remote, bool allowUrl) {
+            std::map<std::string, std::string> config = readConfig();
+            auto url = config.find("remote." + remote + ".url");
+            if (url != config.end()) {
+                return url->second;
+            }
+            if (allowUrl && remote.find_first_of("/:") != std::string::npos) {
+                return resolveRemoteUrl(remote);
+            }
+            throw Error(ErrorCode::NotFound, "Fatal: No such remote: " + remote);
+        }
+
+        // Caches of the repository clone() leaves or enters
+        void dropRepositoryCaches() {
+            reloadConfig();
+            reloadRefs();
+            reloadCommitGraph();
+            reloadPacks();
+            reloadShallow();
+            objectCache().clear();
+        }
+    }
+
+    // --- Fetch and clone ---
+
+    FetchReport fetchRemote(const std::string& remote, const FetchOptions& options) {
+        MINIGIT_TRACE_SCOPE("fetch");
+        upgradeRepoFormat();
+        std::string url = remoteUrl(remote, false);
+        std::map<std::string, std::string> config = readConfig();
+        auto filter = config.find("remote." + remote + ".filter");
+        bool blobless = options.blobless || (filter != config.end() && filter->second == "blob:none");
+
+        FetchReport report;
+        RemoteProcess connection(url, "upload-pack");
+        std::iostream& io = connection.stream();
+        Advertisement advertised = readAdvertisement(io);
+        report.remoteBranches = advertised.branches;
+        report.remoteHead = advertised.head;
+
+        // 1. Ask for the branch tips we lack, listing every tip we have
+        std::set<ObjectId> wants;
+        for (const auto& branch : advertised.branches) {
+            if (!objectExists(branch.second)) {
+                wants.insert(branch.second);
+            }
+        }
+        for (const ObjectId& want : wants) {
+            io << "want " << want.toHex() << "\n";
+        }
+        if (!wants.empty()) {
+            for (const ObjectId& have : listRefTips()) {
+                io << "have " << have.toHex() << "\n";
+            }
+            for (const ObjectId& hash : shallowCommits()) {
+                io << "shallow " << hash.toHex() << "\n";
+            }
+            if (options.depth != 0) {
+                io << "depth " << options.depth << "\n";
+            }
+            if (blobless) {
+                io << "filter blob:none\n";
+            }
+        }
+        io << "done\n" << std::flush;
+
+        // 2. The objects, into one pack. A commit we already had is never
+        // cut off, whatever the remote's depth count says.
+        std::vector<ObjectId> cut;
+        for (const ObjectId& hash : readUntilPack(io)) {
+            if (!objectExists(hash)) {
+                cut.push_back(hash);
+            }
+        }
+        report.objects = receiveObjects(io, false);
+        connection.finish();
+
+        // 3. The new cut, then the refs, which now lead to complete history
+        if (!cut.empty()) {
+            std::vector<ObjectId> shallow = shallowCommits();
+            shallow.insert(shallow.end(), cut.begin(), cut.end());
+            writeShallowCommits(shallow);
+        }
+        for (const auto& branch : advertised.branches) {
+            if (branch.first.compare(0, BRANCH_PREFIX.size(), BRANCH_PREFIX) != 0) {
+                continue;
+            }
+            std::string tracking = REMOTE_PREFIX + remote + "/" + branch.first.substr(BRANCH_PREFIX.size());
+            ObjectId old;
+            readRef(tracking, old);
+            if (old != branch.second) {
+                updateRef(tracking, branch.second);
+                report.updated.push_back(FetchReport::Update{tracking, old, branch.second});
+            }
+        }
+        return report;
+    }
+
+    void fetch(const std::string& remote) {
+        FetchReport report = fetchRemote(remote);
+        if (report.updated.empty()) {
+            std::cout << "Already up to date." << std::endl;
+            return;
+        }
+        std::ostringstream out;
+        out << "Received " << report.objects << " object(s)\n";
+        for (const FetchReport::Update& update : report.updated) {
+            std::string name = update.ref.substr(REMOTE_PREFIX.size());
+            if (update.oldId.empty()) {
+                out << "  * [new branch] " << name << " " << update.newId.toHex() << "\n";
+            } else {
+                out << "  " << name << " " << update.oldId.toHex() << ".." << update.newId.toHex() << "\n";
+            }
+        }
+        std::cout << out.str() << std::flush;
+    }
+
+    void clone(const std::string& url, const std::string& directory, const FetchOptions& options) {
+        // 1. The new directory: empty, or not there yet
+        std::string location = resolveRemoteUrl(url);
+        fs::path target = directory;
+        if (target.empty()) {
+            std::string name = location;
+            while (!name.empty() && (name.back() == '/' || name.back() == '\\')) {
+                name.pop_back();
+            }
+            target = name.substr(name.find_last_of("/\\:") + 1);
+            if (target.empty()) {
+                throw Error(ErrorCode::Failed, "Fatal: Cannot tell a directory name from " + url + "; name one");
+            }
+        }
+        std::error_code ec;
+        bool created = !fs::exists(target);
+        if (!created && (!fs::is_directory(target) || !fs::is_empty(target, ec))) {
+            throw Error(ErrorCode::Conflict,
+                        "Fatal: Destination path '" + target.string() + "' already exists and is not an empty directory");
+        }
+        std::cout << "Cloning into '" << target.string() << "'..." << std::endl;
+        fs::create_directories(target);
+
+        // 2. A repository there, with the remote as origin, fetched and
+        // checked out. A clone that fails leaves nothing behind.
+        fs::path previous = fs::current_path();
+        try {
+            fs::current_path(target);
+            dropRepositoryCaches();
+            initRepository();
+            std::map<std::string, std::string> config = readConfig();
+            config["remote." + DEFAULT_REMOTE + ".url"] = location;
+            if (options.blobless) {
+                config["remote." + DEFAULT_REMOTE + ".promisor"] = "true";
+                config["remote." + DEFAULT_REMOTE + ".filter"] = "blob:none";
+            }
+            writeConfig(config);
+            FetchReport report = fetchRemote(DEFAULT_REMOTE, options);
+
+            // The branch the remote's HEAD is on, else the default one, else any
+            std::string branch;
+            ObjectId tip;
+            for (const std::string& candidate : {report.remoteHead, BRANCH_PREFIX + DEFAULT_BRANCH}) {
+                for (const auto& advertised : report.remoteBranches) {
+                    if (branch.empty() && advertised.first == candidate) {
+                        branch = advertised.first;
+                        tip = advertised.second;
+                    }
+                }
+            }
+            if (branch.empty() && !report.remoteBranches.empty()) {
+                branch = report.remoteBranches.front().first;
+                tip = report.remoteBranches.front().second;
+            }
+            std::ostringstream out;
+            out << "Received " << report.objects << " object(s)";
+            if (options.depth != 0) {
+                out << " (history cut at depth " << options.depth << ")";
+            }
+            out << "\n";
+            if (branch.empty()) {
+                out << "Warning: You appear to have cloned an empty repository.\n";
+            } else {
+                updateRef(branch, tip);
+                CheckoutReport checkout = checkoutCommit(branch.substr(BRANCH_PREFIX.size()));
+                out << "Checked out " << checkout.files.restored.size() << " file(s) on branch '"
+                    << branch.substr(BRANCH_PREFIX.size()) << "'\n";
+            }
+            flushObjects();
+            fs::current_path(previous);
+            dropRepositoryCaches();
+            std::cout << out.str() << std::flush;
+        } catch (...) {
+            fs::current_path(previous, ec);
+            dropRepositoryCaches();
+            if (created) {
+                fs::remove_all(target, ec);
+            } else {
+                for (const auto& entry : fs::directory_iterator(target, ec)) {
+                    fs::remove_all(entry.path(), ec);
+                }
+            }
+            throw;
+        }
+    }
+
+    // --- Push ---
+
+    void push(const std::string& remote, const std::string& branch) {
+        MINIGIT_TRACE_SCOPE("push");
+        upgradeRepoFormat();
+
+        // 1. The branch to push
+        std::string refName;
+        ObjectId localId;
+        if (branch.empty()) {
+            refName = symbolicHEAD();
+            if (refName.empty()) {
+                throw Error(ErrorCode::Conflict, "Fatal: HEAD is detached; name the branch to push");
+            }
+            if (!readRef(refName, localId)) {
+                throw Error(ErrorCode::NotFound, "Fatal: " + refName.substr(BRANCH_PREFIX.size()) + " has no commits yet");
+            }
+        } else if (!findBranch(branch, refName, localId)) {
+            throw Error(ErrorCode::NotFound, "Fatal: No such branch: " + branch);
+        }
+        std::string name = refName.substr(BRANCH_PREFIX.size());
+        std::string url = remoteUrl(remote, true);
+
+        // 2. Where the remote has it: only a fast-forward is sent
+        RemoteProcess connection(url, "receive-pack");
+        std::iostream& io = connection.stream();
+        Advertisement advertised = readAdvertisement(io);
+        ObjectId remoteId;
+        PackRequest request;
+        for (const auto& ref : advertised.branches) {
+            if (ref.first == refName) {
+                remoteId = ref.second;
+            }
+            if (objectExists(ref.second)) {
+                request.haves.push_back(ref.second);
+            }
+        }
+        if (remoteId != localId) {
+            if (!remoteId.empty() && (!objectExists(remoteId) || !isAncestor(remoteId, localId))) {
+                throw Error(ErrorCode::Conflict, "Fatal: The remote's " + name +
+                                                     " has commits this branch does not (fetch and merge them first)");
+            }
+            request.wants.push_back(localId);
+            io << "update " << (remoteId.empty() ? std::string("-") : remoteId.toHex()) << " " << localId.toHex()
+               << " " << refName << "\n";
+        }
+        io << "done\n";
+        std::size_t sent = sendHistory(io, request);
+
+        // 3. The remote's verdict
+        std::string refused;
+        bool accepted = false;
+        std::string line;
+        while ((line = readLine(io)) != "end") {
+            std::string rest;
+            std::string word = splitWord(line, rest);
+            if (word == "ok") {
+                accepted = true;
+            } else if (word == "ng") {
+                std::string reason;
+                splitWord(rest, reason);
+                refused = reason;
+            } else if (word == "error") {
+                refused = rest;
+            }
+        }
+        connection.finish();
+        if (!refused.empty()) {
+            throw Error(ErrorCode::Conflict, "Fatal: The remote refused " + name + ": " + refused);
+        }
+        if (!accepted) {
+            std::cout << "Everything up to date." << std::endl;
+            return;
+        }
+        if (readConfig().count("remote." + remote + ".url") != 0) {
+            updateRef(REMOTE_PREFIX + remote + "/" + name, localId);
+        }
+        std::cout << "To " << url << "\n  " << name << " "
+                  << (remoteId.empty() ? std::string("[new branch] ") : remoteId.toHex() + "..") << localId.toHex()
+                  << " (" << sent << " object(s) sent)" << std::endl;
+    }
+
+    // --- Remotes in the config ---
+
+    void listRemotes() {
+        const std::string prefix = "remote.";
+        const std::string suffix = ".url";
+        std::ostringstream out;
+        for (const auto& setting : readConfig()) {
+            const std::string& key = setting.first;
+            if (key.size() > prefix.size() + suffix.size() && key.compare(0, prefix.size(), prefix) == 0 &&
+                key.compare(key.size() - suffix.size(), suffix.size(), suffix) == 0) {
+                out << key.substr(prefix.size(), key.size() - prefix.size() - suffix.size()) << "\t" << setting.second
+                    << "\n";
+            }
+        }
+        std::cout << out.str() << std::flush;
+    }
+
+    void addRemote(const std::string& name, const std::string& url) {
+        upgradeRepoFormat();
+        bool valid = !name.empty() && std::all_of(name.begin(), name.end(), [](char c) {
+            return std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_' || c == '.';
+        });
+        if (!valid || name[0] == '.') {
+            throw Error(ErrorCode::Failed, "Fatal: Invalid remote name: " + name);
+        }
+        std::map<std::string, std::string> config = readConfig();
+        if (config.count("remote." + name + ".url") != 0) {
+            throw Error(ErrorCode::Conflict, "Fatal: Remote " + name + " already exists");
+        }
+        config["remote." + name + ".url"] = resolveRemoteUrl(url);
+        writeConfig(config);
+    }
+
+    // --- The serving ends ---
+
+    void uploadPack(const fs::path& directory) {
+        ServiceConnection connection(directory);
+        std::iostream& io = connection.stream();
+        writeAdvertisement(io);
+
+        // 1. The request
+        PackRequest request;
+        std::vector<ObjectId> objects;
+        std::string problem;
+        std::string line;
+        while ((line = readLine(io)) != "done") {
+            std::string rest;
+            std::string word = splitWord(line, rest);
+            if (word == "want" || word == "object") {
+                ObjectId hash = parseId(rest);
+                if (!objectExists(hash)) {
+                    problem = "not our object: " + rest;
+                }
+                (word == "want" ? request.wants : objects).push_back(hash);
+            } else if (word == "have") {
+                request.haves.push_back(parseId(rest));
+            } else if (word == "shallow") {
+                request.shallow.push_back(parseId(rest));
+            } else if (word == "depth") {
+                request.depth = static_cast<unsigned>(std::stoul(rest));
+            } else if (word == "filter") {
+                if (rest != "blob:none") {
+                    problem = "unsupported filter: " + rest;
+                }
+                request.blobs = false;
+            } else {
+                problem = "unknown request: " + line;
+            }
+        }
+        if (!problem.empty()) {
+            io << "error " << problem << "\n" << std::flush;
+            return;
+        }
+
+        // 2. The objects: just those asked for (a partial clone filling
+        // in), or the history the wants lead to
+        if (!objects.empty()) {
+            io << "pack\n";
+            ObjectStreamWriter writer(io);
+            for (const ObjectId& hash : objects) {
+                writer.add(hash);
+            }
+            writer.finish();
+            return;
+        }
+        sendHistory(io, request);
+    }
+
+    void receivePack(const fs::path& directory) {
+        ServiceConnection connection(directory);
+        std::iostream& io = connection.stream();
+        upgradeRepoFormat();
+        writeAdvertisement(io);
+
+        // 1. The updates asked for, then the objects they need
+        struct Update {
+            ObjectId oldId;
+            ObjectId newId;
+            std::string ref;
+        };
+        std::vector<Update> updates;
+        std::string line;
+        while ((line = readLine(io)) != "done") {
+            std::string rest;
+            if (splitWord(line, rest) != "update") {
+                io << "error unknown request: " << line << "\n" << std::flush;
+                return;
+            }
+            std::string ids;
+            std::string ref;
+            std::string oldHex = splitWord(rest, ids);
+            std::string newHex = splitWord(ids, ref);
+            updates.push_back(Update{oldHex == "-" ? ObjectId() : parseId(oldHex), parseId(newHex), ref});
+        }
+        readUntilPack(io);
+        receiveObjects(io, false);
+
+        // 2. Each ref moves only forward, and only if nobody moved it
+        // meanwhile; the branch checked out here is left alone, since
+        // its working tree would no longer match
+        std::string checkedOut = symbolicHEAD();
+        for (const Update& update : updates) {
+            std::string reason;
+            try {
+                checkRefName(update.ref);
+                if (update.ref == checkedOut) {
+                    reason = "the branch is checked out in the remote's working tree";
+                } else if (!objectExists(update.newId)) {
+                    reason = "missing objects";
+                } else if (!update.oldId.empty() && !isAncestor(update.oldId, update.newId)) {
+                    reason = "not a fast-forward";
+                } else {
+                    updateRef(update.ref, update.newId, &update.oldId);
+                }
+            } catch (const std::exception& e) {
+                reason = e.what();
+            }
+            io << (reason.empty() ? "ok " + update.ref : "ng " + update.ref + " " + reason) << "\n";
+        }
+        io << "end\n" << std::flush;
+    }
+
+    // --- Shallow commits, missing objects ---
+
+    bool isShallowCommit(const ObjectId& hash) {
+        std::lock_guard<std::mutex> lock(shallowMutex);
+        loadShallowLocked();
+        return shallowSet.count(hash) != 0;
+    }
+
+    std::vector<ObjectId> shallowCommits() {
+        std::lock_guard<std::mutex> lock(shallowMutex);
+        loadShallowLocked();
+        return std::vector<ObjectId>(shallowSet.begin(), shallowSet.end());
+    }
+
+    void reloadShallow() {
+        std::lock_guard<std::mutex> lock(shallowMutex);
+        shallowSet.clear();
+        shallowLoaded = false;
+    }
+
+    bool fetchMissingObjects(const std::vector<ObjectId>& ids) {
+        std::string remote = promisorRemote();
+        if (remote.empty()) {
+            return false;
+        }
+        // One fetch at a time: when a checkout's threads miss together,
+        // the later ones find their objects stored by the first
+        std::lock_guard<std::mutex> lock(promisorMutex);
+        std::set<ObjectId> missing;
+        for (const ObjectId& hash : ids) {
+            if (!hash.empty() && !objectExists(hash)) {
+                missing.insert(hash);
+            }
+        }
+        if (missing.empty()) {
+            return true;
+        }
+        MINIGIT_TRACE_SCOPE("fetch missing objects");
+        RemoteProcess connection(remoteUrl(remote, false), "upload-pack");
+        std::iostream& io = connection.stream();
+        readAdvertisement(io);
+        for (const ObjectId& hash : missing) {
+            io << "object " << hash.toHex() << "\n";
+        }
+        io << "done\n" << std::flush;
+        readUntilPack(io);
+        receiveObjects(io, true);
+        connection.finish();
+        return true;
+    }
+
+} // namespace MiniGit
@@ -0,0 +1,164 @@
+/**
+ * remote.h
+ * * Remotes: clone, fetch and push, and the lazily fetched objects of
+ * partial clones.
+ *
+ * A remote is another repository, reached through a child process that
+ * runs 'minigit upload-pack <dir>' (for clone and fetch) or
+ * 'minigit receive-pack <dir>' (for push) and talks over its stdin and
+ * stdout:
+ *   /path/to/repo, file:///path   this binary, run locally
+ *   ssh://[user@]host[:port]/path  ssh host minigit <service> '<path>'
+ *   [user@]host:path               (MINIGIT_SSH names another ssh program)
+ * Remotes are kept in the config as "remote.<name>.url".
+ *
+ * Protocol (text lines, then one binary object stream):
+ *   server   "minigit-protocol 1", "ref <id> <name>" per branch,
+ *            "head <name>" if HEAD is on a branch, "end"
+ *   fetch    "want <id>" (commits), "have <id>" (tips the client has),
+ *            "shallow <id>" (its shallow commits), "depth <n>",
+ *            "filter blob:none", "object <id>" (just these objects), "done"
+ *            answered by "shallow <id>" (new shallow commits), "pack" and
+ *            the stream, or by "error <message>"
+ *   push     "update <old id or -> <new id> <ref>", "done", "pack", the
+ *            stream; answered by "ok <ref>" or "ng <ref> <reason>" per
+ *            update, and "end"
+ * Negotiation is one round: the receiver lists all its ref tips, and the
+ * sender skips every commit reachable from those it has, and every tree
+ * and blob of the commits where the two histories meet.
+ *
+ * Object stream (the objects in one pass, each delta after its base):
+ *   record   u8 kind (1 whole, 2 delta; 0 ends the stream), u8 type,
+ *            u8 id hex length, u8 base hex length, u64 object size,
+ *            u64 size of the content or delta, u64 payload size,
+ *            id (32 bytes), base id (32 bytes, zero for whole objects),
+ *            payload (the content or the delta, deflated)
+ *   trailer  BLAKE3 of all the records (32 bytes)
+ * Older versions of a file are sent as deltas against newer ones sent
+ * before them, as 'gc' packs them. Received objects go into one new
+ * packfile, and are checked against their ids before the refs move.
+ *
+ * Shallow clones (--depth n) get the newest n commits of each branch; the
+ * commits at the cut are listed in .minigit/shallow and read as having
+ * no parents. Partial clones (--filter=blob:none) get no blobs at all;
+ * the remote is recorded as their promisor ("remote.<name>.promisor"),
+ * and a blob that is read but not stored is fetched from it then.
+ * checkout fetches every blob it is about to write in one request.
+ */
+
+#ifndef MINIGIT_REMOTE_H
+#define MINIGIT_REMOTE_H
+
+#include "object_id.h"
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace MiniGit {
+
+    const std::string REMOTE_PREFIX = "refs/remotes/"; // remote-tracking branches: refs/remotes/<remote>/<branch>
+    const std::string DEFAULT_REMOTE = "origin";
+
+    /**
+     * @brief What a fetch asks for beyond the missing commits.
+     */
+    struct FetchOptions {
+        unsigned depth = 0;    // only this many commits of each branch (0: the whole history)
+        bool blobless = false; // no blobs ("--filter=blob:none"; remembered for later fetches)
+    };
+
+    /**
+     * @brief The outcome of a fetch.
+     */
+    struct FetchReport {
+        struct Update {
+            std::string ref; // refs/remotes/<remote>/<branch>
+            ObjectId oldId;  // empty for a new branch
+            ObjectId newId;
+        };
+        std::vector<Update> updated;
+        std::vector<std::pair<std::string, ObjectId>> remoteBranches; // as advertised: refs/heads/...
+        std::string remoteHead; // the branch the remote's HEAD is on, "" if detached
+        std::size_t objects = 0;
+    };
+
+    /**
+     * @brief Copies a repository into a new directory and checks out the
+     * branch its HEAD is on.
+     * @param url The remote (see above); a local path is stored absolute.
+     * @param directory Where to ("" for the last component of the url).
+     * @throws Error (Conflict) if the directory exists and is not empty.
+     */
+    void clone(const std::string& url, const std::string& directory, const FetchOptions& options);
+
+    /**
+     * @brief Fetches a remote's branches into refs/remotes/<remote>/.
+     */
+    void fetch(const std::string& remote);
+
+    /**
+     * @brief Fetches without printing (what fetch() does).
+     */
+    FetchReport fetchRemote(const std::string& remote, const FetchOptions& options = {});
+
+    /**
+     * @brief Sends a branch and the objects it needs to a remote, and
+     * moves the remote's branch if that is a fast-forward. The branch
+     * checked out in the remote's working tree is refused.
+     * @param remote A configured remote, or a url.
+     * @param branch The branch ("" for the current one).
+     */
+    void push(const std::string& remote, const std::string& branch);
+
+    /**
+     * @brief Lists the configured remotes and their urls ('remote').
+     */
+    void listRemotes();
+
+    /**
+     * @brief Records a remote ('remote add <name> <url>').
+     */
+    void addRemote(const std::string& name, const std::string& url);
+
+    /**
+     * @brief Serves a fetch of the repository in 'directory' on stdin and
+     * stdout ('upload-pack', the command a client runs over ssh).
+     */
+    void uploadPack(const std::filesystem::path& directory);
+
+    /**
+     * @brief Serves a push into the repository in 'directory' on stdin
+     * and stdout ('receive-pack').
+     */
+    void receivePack(const std::filesystem::path& directory);
+
+    /**
+     * @brief Checks whether a commit is one of the cut-off ends of a
+     * shallow clone (.minigit/shallow): its parents are not stored, and
+     * getCommit() reports it without them.
+     */
+    bool isShallowCommit(const ObjectId& hash);
+
+    /**
+     * @brief The commits listed in .minigit/shallow.
+     */
+    std::vector<ObjectId> shallowCommits();
+
+    /**
+     * @brief Forgets the cached shallow list, so the next lookup reads
+     * the file again (after another process changed it).
+     */
+    void reloadShallow();
+
+    /**
+     * @brief Fetches the objects a partial clone left out from its
+     * promisor remote (stored loose). Safe to call from any thread.
+     * @param ids Objects to get; those already stored are skipped.
+     * @return false if the repository has no promisor remote.
+     */
+    bool fetchMissingObjects(const std::vector<ObjectId>& ids);
+
+} // namespace MiniGit
+
+#endif // MINIGIT_REMOTE_H
@@ -0,0 +1,233 @@
+/**
+ * repository.cpp
+ * * The library API: calls on a Repository handle.
+ */
+
+#include "repository.h"
+#include "commit_graph.h"
+#include "diff.h"
+#include "pack.h"
+#include "platform.h"
+#include "refs.h"
+#include <algorithm>
+#include <mutex>
+#include <string_view>
+
+namespace fs = std::filesystem;
+
+namespace MiniGit {
+
+    namespace {
+        // The repository code keeps per-process caches and resolves its
+        // paths against one root (rootPath), so one call runs at a time,
+        // with the root of the repository it was made on
+        std::mutex sessionMutex;
+
+        class Session {
+        public:
+            explicit Session(const fs::path& root) : lock_(sessionMutex) {
+                setRepositoryRoot(root); // the process' working directory is left alone
+
+                // Drop what another process (or another repository) made
+                // stale; everything else stays loaded from the last call
+                refreshCaches();
+            }
+
+            ~Session() {
+                // Objects written by a call that failed half-way are
+                // published here, while their paths still resolve
+                try {
+                    flushObjects();
+                } catch (const std::exception&) {
+                    // nothing refers to them yet: losing them is harmless
+                }
+                setRepositoryRoot(fs::path());
+            }
+
+            Session(const Session&) = delete;
+            Session& operator=(const Session&) = delete;
+
+        private:
+            std::lock_guard<std::mutex> lock_;
+        };
+
+        /**
+         * @brief Runs one call in the repository, turning failures without
+         * an ErrorCode into Error (Failed).
+         */
+        template <typename Operation>
+        auto inRepository(const fs::path& root, Operation&& operation) -> decltype(operation()) {
+            try {
+                Session session(root);
+                return operation();
+            } catch (const Error&) {
+                throw;
+            } catch (const std::exception& e) {
+                throw Error(ErrorCode::Failed, e.what());
+            }
+        }
+
+        void assignPaths(PathList& out, const std::vector<std::string>& paths) {
+            out.clear();
+            for (const std::string& path : paths) {
+                out.emplace_back(std::string_view(path));
+            }
+        }
+    }
+
+    Repository Repository::open(const fs::path& root) {
+        fs::path absolute = fs::weakly_canonical(fs::absolute(root));
+        std::error_code error;
+        if (!fs::is_directory(absolute / GIT_DIR, error)) {
+            throw Error(ErrorCode::NotARepository, "Fatal: Not a MiniGit repository: " + absolute.string());
+        }
+        return Repository(absolute);
+    }
+
+    Repository Repository::init(const fs::path& root) {
+        fs::path absolute = fs::weakly_canonical(fs::absolute(root));
+        try {
+            fs::create_directories(absolute);
+        } catch (const std::exception& e) {
+            throw Error(ErrorCode::Failed, e.what());
+        }
+        inRepository(absolute, [] { return initRepository(); });
+        return Repository(absolute);
+    }
+
+    // --- Reading ---
+
+    ObjectId Repository::head() {
+        return inRepository(root_, [] { return getHEAD(); });
+    }
+
+    ObjectId Repository::resolve(const std::string& name) {
+        return inRepository(root_, [&] { return resolveObjectName(name); });
+    }
+
+    ObjectType Repository::readObject(const ObjectId& id, std::string& buffer) {
+        return inRepository(root_, [&] { return readObjectInto(id, buffer); });
+    }
+
+    void Repository::history(const ObjectId& start, std::pmr::vector<ObjectId>& out, std::size_t limit) {
+        inRepository(root_, [&] {
+            out.clear();
+            CommitWalker walker(start);
+            ObjectId hash;
+            while ((limit == 0 || out.size() < limit) && walker.next(hash)) {
+                out.push_back(hash);
+            }
+        });
+    }
+
+    void Repository::diff(const ObjectId& from, const ObjectId& to, std::string& out) {
+        inRepository(root_, [&] {
+            std::string oldText; // reused for every file
+            std::string newText;
+            for (const TreeChange& change : diffCommits(from, to)) {
+                oldText.clear();
+                newText.clear();
+                if (!change.oldHash.empty()) {
+                    readObjectInto(change.oldHash, oldText);
+                }
+                if (!change.newHash.empty()) {
+                    readObjectInto(change.newHash, newText);
+                }
+                appendFileDiff(out, change.path, oldText, !change.oldHash.empty(), newText, !change.newHash.empty());
+            }
+        });
+    }
+
+    void Repository::status(StatusResult& out, unsigned jobs) {
+        inRepository(root_, [&] {
+            WorkingTreeStatus tree = checkWorkingTree(jobs, true);
+            assignPaths(out.staged, tree.staged);
+            assignPaths(out.modified, tree.modified);
+            assignPaths(out.deleted, tree.deleted);
+            assignPaths(out.untracked, tree.untracked);
+            out.merging = ObjectId();
+            out.unmerged.clear();
+            MergeState mergeState;
+            if (readMergeState(mergeState)) {
+                out.merging = mergeState.theirs;
+                std::sort(mergeState.conflicts.begin(), mergeState.conflicts.end());
+                for (const std::string& path : mergeState.conflicts) {
+                    if (!std::binary_search(tree.staged.begin(), tree.staged.end(), path)) {
+                        out.unmerged.emplace_back(std::string_view(path));
+                    }
+                }
+            }
+        });
+    }
+
+    void Repository::branches(BranchList& out) {
+        inRepository(root_, [&] {
+            out.clear();
+            std::string current = symbolicHEAD();
+            for (const auto& ref : listRefs()) {
+                if (ref.first.compare(0, BRANCH_PREFIX.size(), BRANCH_PREFIX) != 0) {
+                    continue;
+                }
+                std::string_view name = std::string_view(ref.first).substr(BRANCH_PREFIX.size());
+                out.push_back(Branch{std::pmr::string(name, out.get_allocator().resource()), ref.second,
+                                     ref.first == current});
+            }
+        });
+    }
+
+    // --- Changing ---
+
+    void Repository::add(const std::vector<std::string>& paths, AddResult& out, unsigned jobs) {
+        inRepository(root_, [&] {
+            AddReport report = stageFiles(paths, jobs);
+            assignPaths(out.staged, report.staged);
+            assignPaths(out.skipped, report.skipped);
+        });
+    }
+
+    ObjectId Repository::commit(const std::string& message, bool all) {
+        return inRepository(root_, [&] {
+            if (all) {
+                upgradeRepoFormat();
+                WorkingTreeStatus tree = checkWorkingTree(0, false);
+                if (!tree.modified.empty()) {
+                    stageFiles(tree.modified);
+                }
+            }
+            return createCommit(message);
+        });
+    }
+
+    void Repository::checkout(const std::string& name, CheckoutResult& out, unsigned jobs) {
+        inRepository(root_, [&] {
+            CheckoutReport report = checkoutCommit(name, jobs);
+            out.commit = report.commit;
+            out.branch.assign(report.branch.begin(), report.branch.end());
+            out.discardedStaged = report.discardedStaged;
+            out.abandonedMerge = report.abandonedMerge;
+            assignPaths(out.deleted, report.files.deleted);
+            assignPaths(out.restored, report.files.restored);
+        });
+    }
+
+    void Repository::merge(const std::string& name, MergeResult& out, unsigned jobs) {
+        inRepository(root_, [&] {
+            MergeReport report = mergeBranch(name, jobs);
+            out.kind = report.kind;
+            out.commit = report.commit;
+            assignPaths(out.conflicts, report.conflicts);
+            assignPaths(out.keptChanges, report.keptChanges);
+            assignPaths(out.deleted, report.files.deleted);
+            assignPaths(out.restored, report.files.restored);
+        });
+    }
+
+    void Repository::createBranch(const std::string& name, const ObjectId& commit) {
+        inRepository(root_, [&] { createBranchAt(name, commit); });
+    }
+
+    void Repository::deleteBranch(const std::string& name) {
+        inRepository(root_, [&] { removeBranch(name); });
+    }
+
+} // namespace MiniGit
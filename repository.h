@@ -0,0 +1,185 @@
+/**
+ * repository.h
+ * * The library API: a handle for driving a repository from another
+ * program, without starting a 'minigit' process per operation.
+ *
+ * Operations return their results instead of printing them. Results go
+ * into objects the caller owns and passes back in, so one set of result
+ * objects (and their capacity) is reused across calls; their containers
+ * allocate from the std::pmr::memory_resource they were built with.
+ * Failures are thrown as MiniGit::Error, with an ErrorCode.
+ *
+ * What the first calls load stays loaded for the next ones: the config,
+ * the refs table, the commit-graph and the packs stay mapped, parsed
+ * objects stay in the object cache, and an index whose checksum was
+ * verified is not verified again. Each call checks (one stat per file)
+ * whether another process changed any of them, and reloads only those.
+ *
+ * Paths are resolved against the repository root (the working directory
+ * of the program is never changed), and the caches are process-wide, so
+ * calls are serialized by a process-wide lock.
+ */
+
+#ifndef MINIGIT_REPOSITORY_H
+#define MINIGIT_REPOSITORY_H
+
+#include "minigit.h"
+#include "object_id.h"
+#include "object_store.h"
+#include <cstddef>
+#include <filesystem>
+#include <memory_resource>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace MiniGit {
+
+    using PathList = std::pmr::vector<std::pmr::string>;
+
+    /**
+     * @brief A repository opened for repeated use in this process.
+     */
+    class Repository {
+    public:
+        /**
+         * @brief What 'add' staged.
+         */
+        struct AddResult {
+            explicit AddResult(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+                : staged(resource), skipped(resource) {}
+
+            PathList staged;  // in the order given (directories expanded)
+            PathList skipped; // one message per file that could not be staged
+        };
+
+        /**
+         * @brief What 'status' shows. All lists are sorted.
+         */
+        struct StatusResult {
+            explicit StatusResult(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+                : staged(resource), modified(resource), deleted(resource), untracked(resource),
+                  unmerged(resource) {}
+
+            PathList staged;
+            PathList modified;
+            PathList deleted;
+            PathList untracked;
+            ObjectId merging; // their commit while a merge waits for its conflicts, else empty
+            PathList unmerged; // conflicted files not staged yet
+        };
+
+        /**
+         * @brief What 'checkout' did.
+         */
+        struct CheckoutResult {
+            explicit CheckoutResult(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+                : branch(resource), deleted(resource), restored(resource) {}
+
+            ObjectId commit;
+            std::pmr::string branch; // the full ref name, or "" if HEAD was detached
+            std::size_t discardedStaged = 0;
+            bool abandonedMerge = false;
+            PathList deleted;
+            PathList restored;
+        };
+
+        /**
+         * @brief What 'merge' did.
+         */
+        struct MergeResult {
+            explicit MergeResult(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+                : conflicts(resource), keptChanges(resource), deleted(resource), restored(resource) {}
+
+            MergeReport::Kind kind = MergeReport::Kind::UpToDate;
+            ObjectId commit; // the new HEAD (FastForward, Merged)
+            PathList conflicts;
+            PathList keptChanges;
+            PathList deleted;
+            PathList restored;
+        };
+
+        struct Branch {
+            std::pmr::string name; // short name ("topic")
+            ObjectId commit;
+            bool current = false;
+        };
+        using BranchList = std::pmr::vector<Branch>;
+
+        /**
+         * @brief Opens the repository whose .minigit directory is in 'root'.
+         * @throws Error (NotARepository) if there is none.
+         */
+        static Repository open(const std::filesystem::path& root);
+
+        /**
+         * @brief Creates a repository in 'root' (made if missing), or opens
+         * the one already there.
+         */
+        static Repository init(const std::filesystem::path& root);
+
+        const std::filesystem::path& root() const { return root_; }
+
+        // --- Reading ---
+
+        /**
+         * @brief The current commit (an empty id before the first commit).
+         */
+        ObjectId head();
+
+        /**
+         * @brief Expands an object name, as the command line does.
+         * @throws Error (NotFound) if nothing matches.
+         */
+        ObjectId resolve(const std::string& name);
+
+        /**
+         * @brief Reads an object's content into 'buffer', reusing its
+         * capacity.
+         */
+        ObjectType readObject(const ObjectId& id, std::string& buffer);
+
+        /**
+         * @brief Collects the ids of a commit and its first-parent
+         * ancestors, newest first (the caller's vector is cleared first).
+         * @param limit Stop after this many (0 = all).
+         */
+        void history(const ObjectId& start, std::pmr::vector<ObjectId>& out, std::size_t limit = 0);
+
+        /**
+         * @brief Appends the unified diff between two commits to 'out'.
+         */
+        void diff(const ObjectId& from, const ObjectId& to, std::string& out);
+
+        void status(StatusResult& out, unsigned jobs = 0);
+
+        void branches(BranchList& out);
+
+        // --- Changing ---
+
+        void add(const std::vector<std::string>& paths, AddResult& out, unsigned jobs = 0);
+
+        /**
+         * @brief Commits the staged files.
+         * @param all Stage every modified tracked file first ("commit -a").
+         * @return The new commit, or an empty id if there was nothing to commit.
+         */
+        ObjectId commit(const std::string& message, bool all = false);
+
+        void checkout(const std::string& name, CheckoutResult& out, unsigned jobs = 0);
+
+        void merge(const std::string& name, MergeResult& out, unsigned jobs = 0);
+
+        void createBranch(const std::string& name, const ObjectId& commit);
+
+        void deleteBranch(const std::string& name);
+
+    private:
+        explicit Repository(std::filesystem::path root) : root_(std::move(root)) {}
+
+        std::filesystem::path root_; // absolute
+    };
+
+} // namespace MiniGit
+
+#endif // MINIGIT_REPOSITORY_H
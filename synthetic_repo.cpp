@@ -0,0 +1,134 @@
+/**
+ * synthetic_repo.cpp
+ * * Generating repositories for the benchmarks.
+ */
+
+#include "synthetic_repo.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+namespace MiniGit {
+
+    namespace {
+        const std::size_t LINE_SIZE = 64; // 63 characters and a newline
+        const std::size_t FILES_PER_DIRECTORY = 8;
+
+        void randomLine(std::string& out, std::size_t position, std::mt19937_64& random) {
+            static const char letters[] = "abcdefghijklmnopqrstuvwxyz      ";
+            for (std::size_t i = 0; i + 1 < LINE_SIZE; ++i) {
+                out[position + i] = letters[random() % (sizeof(letters) - 1)];
+            }
+            out[position + LINE_SIZE - 1] = '\n';
+        }
+
+        void writeFile(const fs::path& path, const std::string& content) {
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            file.write(content.data(), static_cast<std::streamsize>(content.size()));
+            if (!file) {
+                throw std::runtime_error("Could not write to file: " + path.string());
+            }
+        }
+    }
+
+    std::vector<std::string> syntheticPaths(const SyntheticRepoSpec& spec) {
+        // Enough directories per level for about FILES_PER_DIRECTORY files
+        // in each leaf directory
+        std::size_t leaves = std::max<std::size_t>(1, spec.files / FILES_PER_DIRECTORY);
+        std::size_t fanout = 1;
+        if (spec.depth != 0) {
+            fanout = std::max<std::size_t>(
+                2, static_cast<std::size_t>(std::ceil(std::pow(static_cast<double>(leaves), 1.0 / spec.depth))));
+        }
+        std::size_t leafCount = 1;
+        for (unsigned level = 0; level < spec.depth; ++level) {
+            leafCount *= fanout;
+        }
+
+        std::vector<std::string> paths;
+        paths.reserve(spec.files);
+        for (std::size_t i = 0; i < spec.files; ++i) {
+            std::string path;
+            std::size_t directory = i % leafCount;
+            for (unsigned level = 0; level < spec.depth; ++level) {
+                path += "d" + std::to_string(directory % fanout) + "/";
+                directory /= fanout;
+            }
+            paths.push_back(path + "file" + std::to_string(i) + ".txt");
+        }
+        std::sort(paths.begin(), paths.end());
+        return paths;
+    }
+
+    std::vector<std::string> churnFiles(const fs::path& root, const std::vector<std::string>& paths, double churn,
+                                        std::mt19937_64& random) {
+        std::size_t count = std::max<std::size_t>(1, static_cast<std::size_t>(churn * paths.size()));
+        count = std::min(count, paths.size());
+
+        // DSA: PARTIAL FISHER-YATES SHUFFLE picks 'count' distinct files
+        std::vector<std::size_t> order(paths.size());
+        for (std::size_t i = 0; i < order.size(); ++i) {
+            order[i] = i;
+        }
+        std::vector<std::string> changed;
+        changed.reserve(count);
+        std::string content;
+        for (std::size_t i = 0; i < count; ++i) {
+            std::size_t pick = i + random() % (order.size() - i);
+            std::swap(order[i], order[pick]);
+            const std::string& path = paths[order[i]];
+
+            std::ifstream in(root / path, std::ios::binary);
+            content.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            in.close();
+            std::size_t lines = content.size() / LINE_SIZE;
+            if (lines == 0) {
+                content.resize(LINE_SIZE);
+                lines = 1;
+            }
+            randomLine(content, (random() % lines) * LINE_SIZE, random);
+            writeFile(root / path, content);
+            changed.push_back(path);
+        }
+        std::sort(changed.begin(), changed.end());
+        return changed;
+    }
+
+    Repository generateSyntheticRepo(const fs::path& root, const SyntheticRepoSpec& spec,
+                                     std::vector<ObjectId>& commits) {
+        if (fs::exists(root)) {
+            throw std::runtime_error("Fatal: " + root.string() + " already exists");
+        }
+        Repository repo = Repository::init(root);
+        std::mt19937_64 random(spec.seed);
+
+        // 1. The files, each a few lines of random text
+        std::vector<std::string> paths = syntheticPaths(spec);
+        std::size_t lines = std::max<std::size_t>(1, spec.fileSize / LINE_SIZE);
+        std::string content(lines * LINE_SIZE, ' ');
+        for (const std::string& path : paths) {
+            fs::create_directories((repo.root() / path).parent_path());
+            for (std::size_t line = 0; line < lines; ++line) {
+                randomLine(content, line * LINE_SIZE, random);
+            }
+            writeFile(repo.root() / path, content);
+        }
+
+        // 2. The history: everything, then 'churn' of the files per commit
+        commits.clear();
+        Repository::AddResult added;
+        repo.add({"."}, added);
+        commits.push_back(repo.commit("Add " + std::to_string(paths.size()) + " files"));
+        for (std::size_t revision = 1; revision < spec.history; ++revision) {
+            std::vector<std::string> changed = churnFiles(repo.root(), paths, spec.churn, random);
+            repo.add(changed, added);
+            commits.push_back(repo.commit("Revision " + std::to_string(revision)));
+        }
+        return repo;
+    }
+
+} // namespace MiniGit
@@ -0,0 +1,58 @@
+/**
+ * synthetic_repo.h
+ * * Generated repositories for the benchmarks (minigit_bench).
+ *
+ * A synthetic repository has N text files spread over a directory tree D
+ * levels deep (about eight files per leaf directory) and a history of H
+ * commits: the first adds every file, and each later one changes a random
+ * 'churn' fraction of them, one line per file. The same spec and seed
+ * always give the same files and the same history.
+ */
+
+#ifndef MINIGIT_SYNTHETIC_REPO_H
+#define MINIGIT_SYNTHETIC_REPO_H
+
+#include "repository.h"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace MiniGit {
+
+    struct SyntheticRepoSpec {
+        std::size_t files = 1000;
+        unsigned depth = 3;          // directory levels above the files
+        std::size_t history = 50;    // commits
+        double churn = 0.05;         // fraction of the files each later commit changes
+        std::size_t fileSize = 4096; // bytes per file (rounded to whole lines)
+        uint64_t seed = 1;
+    };
+
+    /**
+     * @brief The relative paths of the spec's files, sorted.
+     */
+    std::vector<std::string> syntheticPaths(const SyntheticRepoSpec& spec);
+
+    /**
+     * @brief Rewrites one random line in a random 'churn' fraction of the
+     * files (at least one).
+     * @param root The working tree the paths are relative to.
+     * @return The changed paths, sorted.
+     */
+    std::vector<std::string> churnFiles(const std::filesystem::path& root, const std::vector<std::string>& paths,
+                                        double churn, std::mt19937_64& random);
+
+    /**
+     * @brief Creates the repository in 'root' (which must not exist yet)
+     * and commits its whole history on the default branch.
+     * @param commits Receives the commit ids, oldest first.
+     */
+    Repository generateSyntheticRepo(const std::filesystem::path& root, const SyntheticRepoSpec& spec,
+                                     std::vector<ObjectId>& commits);
+
+} // namespace MiniGit
+
+#endif // MINIGIT_SYNTHETIC_REPO_H
@@ -0,0 +1,343 @@
+/**
+ * tests.cpp
+ * * minigit_tests: regression tests, run by ctest.
+ *
+ * Usage: minigit_tests <minigit executable> [test name...]
+ *
+ * Each test builds a repository of its own in a temporary directory and
+ * drives it through the library, in this process; the minigit executable
+ * plays another process changing the repository behind its back. With
+ * names given, only those tests run.
+ */
+
+#include "batch.h"
+#include "delta.h"
+#include "minigit.h"
+#include "platform.h"
+#include "repository.h"
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Ends the running test with a message naming the failed condition
+#define CHECK(condition)                                                                                     \
+    do {                                                                                                     \
+        if (!(condition)) {                                                                                  \
+            throw std::runtime_error(std::string(__FILE__) + ":" + std::to_string(__LINE__) + ": CHECK(" \
+                                     #condition ") failed");                                                 \
+        }                                                                                                    \
+    } while (0)
+
+namespace fs = std::filesystem;
+using namespace MiniGit;
+
+namespace {
+    fs::path minigitExecutable;
+
+    /**
+     * @brief A new empty directory, made the working directory for the
+     * test's lifetime (the commands run on the working directory), and
+     * removed afterwards.
+     */
+    class TestDirectory {
+    public:
+        TestDirectory() : previous_(fs::current_path()) {
+            static std::atomic<unsigned> counter{0};
+            path_ = fs::temp_directory_path() /
+                    ("minigit-test-" + std::to_string(processId()) + "-" + std::to_string(counter++));
+            fs::remove_all(path_);
+            fs::create_directories(path_);
+            fs::current_path(path_);
+            refreshCaches(); // nothing loaded for the last test's repository is used
+        }
+        ~TestDirectory() {
+            std::error_code ec;
+            fs::current_path(previous_, ec);
+            fs::remove_all(path_, ec);
+        }
+        TestDirectory(const TestDirectory&) = delete;
+        TestDirectory& operator=(const TestDirectory&) = delete;
+
+        const fs::path& path() const { return path_; }
+
+    private:
+        fs::path previous_;
+        fs::path path_;
+    };
+
+    // Sends what a command prints to std::cout elsewhere, for its lifetime
+    class QuietOutput {
+    public:
+        explicit QuietOutput(std::streambuf* target) : previous_(std::cout.rdbuf(target)) {}
+        ~QuietOutput() { std::cout.rdbuf(previous_); }
+        QuietOutput(const QuietOutput&) = delete;
+        QuietOutput& operator=(const QuietOutput&) = delete;
+
+    private:
+        std::streambuf* previous_;
+    };
+
+    std::string quoted(const std::string& word) {
+        std::string out = "'";
+        for (char c : word) {
+            out += c == '\'' ? std::string("'\\''") : std::string(1, c);
+        }
+        return out + "'";
+    }
+
+    /**
+     * @brief Runs the minigit executable in the working directory, as
+     * another process would.
+     */
+    void runOutside(const std::vector<std::string>& args) {
+        std::string command = quoted(minigitExecutable.string());
+        for (const std::string& arg : args) {
+            command += " " + quoted(arg);
+        }
+        command += " >/dev/null 2>&1";
+        if (std::system(command.c_str()) != 0) {
+            throw std::runtime_error("Failed: " + command);
+        }
+    }
+
+    /**
+     * @brief Runs a batch command in this process, for runBatch. Only what
+     * the tests need: add, commit -m, log, status; "outside <args>" runs
+     * the minigit executable instead, between two requests.
+     */
+    int runTestCommand(const std::vector<std::string>& args) {
+        const std::string& command = args[0];
+        if (command == "outside") {
+            runOutside(std::vector<std::string>(args.begin() + 1, args.end()));
+        } else if (command == "add") {
+            add(std::vector<std::string>(args.begin() + 1, args.end()));
+        } else if (command == "commit" && args.size() == 3 && args[1] == "-m") {
+            commit(args[2]);
+        } else if (command == "log") {
+            log();
+        } else if (command == "status") {
+            status();
+        } else {
+            std::cerr << "Unknown test command: " << command << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    /**
+     * @brief Splits a batch's output into its answers ("ok" or "error"
+     * and the bytes printed).
+     */
+    std::vector<std::pair<std::string, std::string>> parseAnswers(const std::string& output) {
+        std::vector<std::pair<std::string, std::string>> answers;
+        std::istringstream in(output);
+        std::string status;
+        std::size_t size;
+        while (in >> status >> size) {
+            in.get(); // the newline
+            std::string body(size, '\0');
+            in.read(&body[0], static_cast<std::streamsize>(size));
+            answers.emplace_back(status, body);
+        }
+        return answers;
+    }
+
+    // --- Tests ---
+
+    // A batch (and so 'serve') reloads what another process changed
+    // between two of its requests: new commits, and a gc that moved the
+    // loose objects into a pack
+    void testBatchSeesOutsideChanges() {
+        TestDirectory directory;
+        runOutside({"init"});
+        writeFileContent("a.txt", "a\n");
+        runOutside({"add", "a.txt"});
+        runOutside({"commit", "-m", "first"});
+        writeFileContent("c.txt", "c\n");
+
+        std::istringstream requests("log\n"
+                                    "outside add b.txt\n"
+                                    "outside commit -m second\n"
+                                    "outside gc\n"
+                                    "log\n"
+                                    "status\n"
+                                    "add c.txt\n"
+                                    "commit -m third\n"
+                                    "log\n");
+        writeFileContent("b.txt", "b\n");
+        std::ostringstream output;
+        CHECK(runBatch(requests, output, runTestCommand) == 0);
+
+        auto answers = parseAnswers(output.str());
+        CHECK(answers.size() == 9);
+        for (const auto& answer : answers) {
+            CHECK(answer.first == "ok");
+        }
+        CHECK(answers[0].second.find("second") == std::string::npos);
+        CHECK(answers[4].second.find("second") != std::string::npos);
+        CHECK(answers[5].second.find("c.txt") != std::string::npos);
+        CHECK(answers[8].second.find("third") != std::string::npos);
+        CHECK(answers[8].second.find("second") != std::string::npos);
+    }
+
+    // A length-delimited request the batch cannot hold is answered with
+    // an error, and ends the batch instead of the process
+    void testBatchRefusesHugeRequests() {
+        TestDirectory directory;
+        runOutside({"init"});
+        std::istringstream requests("status\n"
+                                    "999999999999999999\n"
+                                    "status\n");
+        std::ostringstream output;
+        CHECK(runBatch(requests, output, runTestCommand) == 0);
+
+        auto answers = parseAnswers(output.str());
+        CHECK(answers.size() == 2);
+        CHECK(answers[0].first == "ok");
+        CHECK(answers[1].first == "error");
+        CHECK(answers[1].second.find("Request too large") != std::string::npos);
+    }
+
+    // A delta claiming a result far larger than its instructions can make
+    // is refused as corrupt before anything is allocated
+    void testDeltaRefusesImpossibleSizes() {
+        std::string delta;
+        delta += '\x03'; // base size 3
+        delta += std::string(8, '\xff') + '\x0f'; // result size about 2^60
+        delta += std::string("\x01\x00\x03", 3); // copy the whole base
+        bool refused = false;
+        try {
+            applyDelta("abc", delta);
+        } catch (const std::runtime_error& e) {
+            refused = std::string(e.what()).find("Corrupt delta") == 0;
+        }
+        CHECK(refused);
+
+        std::string base;
+        for (int i = 0; i < 100; ++i) {
+            base += "line " + std::to_string(i) + "\n";
+        }
+        std::string good;
+        CHECK(computeDelta(base, base + "one more\n", good, base.size()));
+        CHECK(applyDelta(base, good) == base + "one more\n");
+    }
+
+    // An entry whose file is no older than the index ("racy clean") is
+    // hashed to be sure; once it verifies, the index is rewritten, which
+    // makes it clean, so the next status reads nothing
+    void testStatusSettlesRacyEntries() {
+        TestDirectory directory;
+        runOutside({"init"});
+        auto past = fs::file_time_type::clock::now() - std::chrono::seconds(10);
+        for (const char* name : {"a.txt", "b.txt"}) {
+            writeFileContent(name, std::string(4096, name[0]));
+            fs::last_write_time(name, past);
+        }
+        runOutside({"add", "a.txt", "b.txt"});
+        runOutside({"commit", "-m", "first"});
+        // The stat data in the index matches the files, but the index
+        // looks as old as they are (as right after a checkout)
+        fs::last_write_time(INDEX_FILE, fs::last_write_time("a.txt"));
+
+        auto hashedByStatus = [] {
+            std::stringbuf printed;
+            QuietOutput quiet(&printed);
+            uint64_t before = Trace::counters[static_cast<int>(Trace::Counter::BytesHashed)].load();
+            status();
+            return Trace::counters[static_cast<int>(Trace::Counter::BytesHashed)].load() - before;
+        };
+        Trace::enabled = true;
+        uint64_t first = hashedByStatus();
+        uint64_t second = hashedByStatus();
+        Trace::enabled = false;
+        CHECK(first == 2 * 4096);
+        CHECK(second == 0);
+    }
+
+    // Upgrading a repository with the old flat object layout moves its
+    // objects through the library without printing anything (the command
+    // line reports it; repository.h calls return results, never print)
+    void testLibraryUpgradeIsSilent() {
+        TestDirectory directory;
+        runOutside({"init"});
+        writeFileContent("a.txt", "a\n");
+        runOutside({"add", "a.txt"});
+        runOutside({"commit", "-m", "first"});
+
+        // Back to format version 2: loose objects directly in objects/
+        std::size_t flattened = 0;
+        for (const auto& shard : fs::directory_iterator(OBJECTS_DIR)) {
+            std::string prefix = shard.path().filename().string();
+            if (!shard.is_directory() || prefix.size() != 2) {
+                continue;
+            }
+            for (const auto& object : fs::directory_iterator(shard.path())) {
+                fs::rename(object.path(), OBJECTS_DIR / (prefix + object.path().filename().string()));
+                ++flattened;
+            }
+            fs::remove(shard.path());
+        }
+        CHECK(flattened != 0);
+        writeFileContent(CONFIG_FILE, "hash = blake3\nrepositoryformatversion = 2\n");
+        writeFileContent("b.txt", "b\n");
+
+        std::stringbuf printed;
+        {
+            QuietOutput quiet(&printed);
+            Repository repository = Repository::open(directory.path());
+            Repository::AddResult added;
+            repository.add({"b.txt"}, added);
+            CHECK(added.staged.size() == 1);
+        }
+        CHECK(printed.str().empty());
+        for (const auto& entry : fs::directory_iterator(OBJECTS_DIR)) {
+            CHECK(!entry.is_regular_file());
+        }
+        CHECK(getRepoFormatVersion() == REPO_FORMAT_VERSION);
+    }
+
+    struct Test {
+        const char* name;
+        std::function<void()> run;
+    };
+
+    const std::vector<Test> tests = {
+        {"batch_sees_outside_changes", testBatchSeesOutsideChanges},
+        {"batch_refuses_huge_requests", testBatchRefusesHugeRequests},
+        {"status_settles_racy_entries", testStatusSettlesRacyEntries},
+        {"delta_refuses_impossible_sizes", testDeltaRefusesImpossibleSizes},
+        {"library_upgrade_is_silent", testLibraryUpgradeIsSilent},
+    };
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: minigit_tests <minigit executable> [test name...]" << std::endl;
+        return 1;
+    }
+    minigitExecutable = fs::absolute(argv[1]);
+    std::vector<std::string> selected(argv + 2, argv + argc);
+
+    int failed = 0;
+    for (const Test& test : tests) {
+        if (!selected.empty() && std::find(selected.begin(), selected.end(), test.name) == selected.end()) {
+            continue;
+        }
+        try {
+            test.run();
+            std::cout << "ok      " << test.name << std::endl;
+        } catch (const std::exception& e) {
+            std::cout << "FAILED  " << test.name << ": " << e.what() << std::endl;
+            ++failed;
+        }
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,204 @@
+/**
+ * trace.cpp
+ * * Collecting the timed phases and writing them out as a table or as
+ * Chrome trace events.
+ */
+
+#include "trace.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace MiniGit {
+
+    namespace Trace {
+
+        std::atomic<bool> enabled{false};
+        std::atomic<uint64_t> counters[static_cast<int>(Counter::Count)];
+
+        namespace {
+            const char* const COUNTER_NAMES[] = {"bytes_read",     "bytes_written", "bytes_hashed", "objects_read",
+                                                 "objects_written", "cache_hits",    "cache_misses", "fsyncs"};
+            static_assert(sizeof(COUNTER_NAMES) / sizeof(COUNTER_NAMES[0]) == static_cast<std::size_t>(Counter::Count),
+                          "one name per counter");
+
+            struct Event {
+                const char* name;
+                int64_t begin;    // ns since tracing started
+                int64_t duration; // ns
+            };
+
+            // Each thread appends to its own buffer, so recording a phase
+            // takes no lock; the buffers are only read by finish()
+            struct ThreadEvents {
+                unsigned id = 0;
+                unsigned generation = 0; // the start() this buffer belongs to
+                std::vector<Event> events;
+            };
+
+            std::mutex registryMutex;
+            std::vector<std::shared_ptr<ThreadEvents>> registry; // every thread's buffer, by id
+            std::atomic<unsigned> generation{0};
+            std::string destination; // "" for the summary table, else the JSON file
+            std::chrono::steady_clock::time_point origin;
+
+            // The lock is only taken by a thread's first phase of a run
+            ThreadEvents& threadEvents() {
+                thread_local std::shared_ptr<ThreadEvents> mine;
+                unsigned current = generation.load(std::memory_order_acquire);
+                if (!mine || mine->generation != current) {
+                    std::lock_guard<std::mutex> lock(registryMutex);
+                    mine = std::make_shared<ThreadEvents>();
+                    mine->id = static_cast<unsigned>(registry.size()) + 1;
+                    mine->generation = current;
+                    registry.push_back(mine);
+                }
+                return *mine;
+            }
+
+            void writeSummary(std::ostream& out, int64_t total) {
+                struct Phase {
+                    const char* name;
+                    uint64_t calls = 0;
+                    int64_t total = 0;
+                    int64_t longest = 0;
+                };
+                std::vector<Phase> phases;
+                std::unordered_map<std::string, std::size_t> slots;
+                for (const auto& thread : registry) {
+                    for (const Event& event : thread->events) {
+                        auto inserted = slots.emplace(event.name, phases.size());
+                        if (inserted.second) {
+                            phases.push_back(Phase{event.name});
+                        }
+                        Phase& phase = phases[inserted.first->second];
+                        ++phase.calls;
+                        phase.total += event.duration;
+                        phase.longest = std::max(phase.longest, event.duration);
+                    }
+                }
+                std::sort(phases.begin(), phases.end(),
+                          [](const Phase& a, const Phase& b) { return a.total > b.total; });
+
+                char line[128];
+                std::snprintf(line, sizeof(line), "%-28s %10s %12s %12s\n", "phase", "calls", "total ms", "max ms");
+                std::string text = line;
+                for (const Phase& phase : phases) {
+                    std::snprintf(line, sizeof(line), "%-28s %10llu %12.3f %12.3f\n", phase.name,
+                                  static_cast<unsigned long long>(phase.calls), phase.total / 1e6,
+                                  phase.longest / 1e6);
+                    text += line;
+                }
+                std::snprintf(line, sizeof(line), "%-28s %10s %12.3f\n", "(traced run)", "", total / 1e6);
+                text += line;
+                text += "\n";
+                for (int i = 0; i < static_cast<int>(Counter::Count); ++i) {
+                    std::snprintf(line, sizeof(line), "%-28s %10llu\n", COUNTER_NAMES[i],
+                                  static_cast<unsigned long long>(counters[i].load()));
+                    text += line;
+                }
+                out << text << std::flush;
+            }
+
+            // The JSON Object Format of the Trace Event Format: one complete
+            // ("X") event per phase and the counters as one "C" event
+            void writeTraceEvents(std::ostream& out, int64_t total) {
+                std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+                char event[256];
+                for (const auto& thread : registry) {
+                    std::snprintf(event, sizeof(event),
+                                  "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                                  "\"args\":{\"name\":\"thread %u\"}},\n",
+                                  thread->id, thread->id);
+                    json += event;
+                    for (const Event& e : thread->events) {
+                        std::snprintf(event, sizeof(event),
+                                      "{\"name\":\"%s\",\"cat\":\"minigit\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                                      "\"pid\":1,\"tid\":%u},\n",
+                                      e.name, e.begin / 1e3, e.duration / 1e3, thread->id);
+                        json += event;
+                    }
+                }
+                std::snprintf(event, sizeof(event), "{\"name\":\"counters\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"args\":{",
+                              total / 1e3);
+                json += event;
+                for (int i = 0; i < static_cast<int>(Counter::Count); ++i) {
+                    std::snprintf(event, sizeof(event), "%s\"%s\":%llu", i == 0 ? "" : ",", COUNTER_NAMES[i],
+                                  static_cast<unsigned long long>(counters[i].load()));
+                    json += event;
+                }
+                json += "}}\n]}\n";
+                out << json;
+            }
+        }
+
+        void start(const std::string& where) {
+            std::lock_guard<std::mutex> lock(registryMutex);
+#ifndef MINIGIT_TRACING
+            std::cerr << "Warning: This build has no tracing (configure with -DMINIGIT_TRACING=ON)" << std::endl;
+            (void)where;
+#else
+            registry.clear();
+            generation.fetch_add(1, std::memory_order_release);
+            // The commands may change directory (see repository.h): a
+            // relative file is taken from where tracing was switched on
+            destination = where == "1" || where == "summary" ? std::string() : fs::absolute(where).string();
+            for (auto& counter : counters) {
+                counter.store(0);
+            }
+            origin = std::chrono::steady_clock::now();
+            enabled.store(true);
+#endif
+        }
+
+        void startFromEnvironment() {
+            const char* value = std::getenv("MINIGIT_TRACE");
+            if (value != nullptr && *value != '\0' && std::string(value) != "0") {
+                start(value);
+            }
+        }
+
+        void record(const char* name, std::chrono::steady_clock::time_point begin,
+                    std::chrono::steady_clock::time_point end) {
+            if (!enabled.load(std::memory_order_relaxed)) {
+                return; // finished while this phase ran
+            }
+            threadEvents().events.push_back(
+                Event{name, std::chrono::duration_cast<std::chrono::nanoseconds>(begin - origin).count(),
+                      std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count()});
+        }
+
+        void finish() {
+            if (!enabled.exchange(false)) {
+                return;
+            }
+            // Called once the command's threads are done, so no buffer
+            // is still being appended to
+            std::lock_guard<std::mutex> lock(registryMutex);
+            int64_t total =
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+            if (destination.empty()) {
+                writeSummary(std::cerr, total);
+            } else {
+                std::ofstream file(destination, std::ios::binary | std::ios::trunc);
+                writeTraceEvents(file, total);
+                if (!file) {
+                    std::cerr << "Warning: Could not write the trace to " << destination << std::endl;
+                }
+            }
+            registry.clear();
+            generation.fetch_add(1, std::memory_order_release);
+        }
+
+    } // namespace Trace
+
+} // namespace MiniGit
@@ -0,0 +1,115 @@
+/**
+ * trace.h
+ * * Per-phase timers and counters, for finding where a slow command spends
+ * its time.
+ *
+ * MINIGIT_TRACE_SCOPE("phase") times the rest of the enclosing block, and
+ * MINIGIT_TRACE_COUNT(Counter, n) adds n to one of the counters below.
+ * Both cost one relaxed atomic load unless tracing was switched on for
+ * the run, either by the environment or by the command line:
+ *   MINIGIT_TRACE=1 (or summary)   a table of the phases and counters on
+ *   minigit --trace <command>      stderr when the command ends
+ *   MINIGIT_TRACE=<file>           Chrome trace-event JSON written to the
+ *   minigit --trace=<file> ...     file (chrome://tracing, Perfetto)
+ *
+ * Built with MINIGIT_TRACING off (cmake -DMINIGIT_TRACING=OFF), the macros
+ * expand to nothing and no timing code is compiled in at all.
+ */
+
+#ifndef MINIGIT_TRACE_H
+#define MINIGIT_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace MiniGit {
+
+    namespace Trace {
+
+        enum class Counter {
+            BytesRead,      // file contents and loose objects read from disk
+            BytesWritten,   // file contents and objects written to disk
+            BytesHashed,    // content run through the object hash
+            ObjectsRead,    // objects read from the loose store or a pack
+            ObjectsWritten, // new objects stored
+            CacheHits,      // parsed commits and trees found in the object cache
+            CacheMisses,    // ... and not found there
+            Fsyncs,         // fsync and syncfs calls
+            Count
+        };
+
+        extern std::atomic<bool> enabled;
+        extern std::atomic<uint64_t> counters[static_cast<int>(Counter::Count)];
+
+        /**
+         * @brief Switches tracing on for the rest of the process.
+         * @param destination "1" or "summary" for the table on stderr,
+         * anything else is the file the trace-event JSON goes to.
+         */
+        void start(const std::string& destination);
+
+        /**
+         * @brief Starts tracing if MINIGIT_TRACE is set (and not "0").
+         */
+        void startFromEnvironment();
+
+        /**
+         * @brief Writes the trace (once) and switches tracing off again.
+         */
+        void finish();
+
+        /**
+         * @brief Records one finished phase ('name' must outlive the
+         * process, as string literals do).
+         */
+        void record(const char* name, std::chrono::steady_clock::time_point begin,
+                    std::chrono::steady_clock::time_point end);
+
+        inline void count(Counter counter, uint64_t amount) {
+            if (enabled.load(std::memory_order_relaxed)) {
+                counters[static_cast<int>(counter)].fetch_add(amount, std::memory_order_relaxed);
+            }
+        }
+
+        // Times its own lifetime, if tracing was on when it began
+        class Scope {
+        public:
+            explicit Scope(const char* name) : name_(name) {
+                if (enabled.load(std::memory_order_relaxed)) {
+                    begin_ = std::chrono::steady_clock::now();
+                    active_ = true;
+                }
+            }
+            ~Scope() {
+                if (active_) {
+                    record(name_, begin_, std::chrono::steady_clock::now());
+                }
+            }
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+
+        private:
+            const char* name_;
+            std::chrono::steady_clock::time_point begin_;
+            bool active_ = false;
+        };
+
+    } // namespace Trace
+
+} // namespace MiniGit
+
+#define MINIGIT_TRACE_CONCAT_(a, b) a##b
+#define MINIGIT_TRACE_CONCAT(a, b) MINIGIT_TRACE_CONCAT_(a, b)
+
+#ifdef MINIGIT_TRACING
+#define MINIGIT_TRACE_SCOPE(name) ::MiniGit::Trace::Scope MINIGIT_TRACE_CONCAT(minigitTraceScope_, __LINE__)(name)
+#define MINIGIT_TRACE_COUNT(counter, amount) \
+    ::MiniGit::Trace::count(::MiniGit::Trace::Counter::counter, static_cast<uint64_t>(amount))
+#else
+#define MINIGIT_TRACE_SCOPE(name) ((void)0)
+#define MINIGIT_TRACE_COUNT(counter, amount) ((void)0)
+#endif
+
+#endif // MINIGIT_TRACE_H
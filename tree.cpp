@@ -0,0 +1,286 @@
+/**
+ * tree.cpp
+ * * Building, storing and walking tree objects.
+ */
+
+#include "tree.h"
+#include "minigit.h"
+#include "object_cache.h"
+#include "object_store.h"
+#include "trace.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace MiniGit {
+
+    namespace {
+        using FileIterator = FileMap::const_iterator;
+
+        // Builds the tree for the files in [begin, end), which all share
+        // their first 'offset' characters (the directory prefix).
+        // DSA: RECURSION over a sorted range. All paths below one directory
+        // are contiguous in the sorted map, so each level is one linear pass.
+        ObjectId buildTree(FileIterator begin, FileIterator end, std::size_t offset) {
+            std::vector<TreeEntry> entries;
+            FileIterator it = begin;
+            while (it != end) {
+                std::string_view rest = it->path.substr(offset);
+                std::size_t slash = rest.find('/');
+                if (slash == std::string_view::npos) {
+                    entries.push_back({std::string(rest), false, it->hash});
+                    ++it;
+                    continue;
+                }
+
+                // Everything under this subdirectory
+                std::string_view childPrefix = it->path.substr(0, offset + slash + 1);
+                FileIterator childEnd = it;
+                while (childEnd != end && childEnd->path.compare(0, childPrefix.size(), childPrefix) == 0) {
+                    ++childEnd;
+                }
+                entries.push_back({std::string(rest.substr(0, slash)), true,
+                                   buildTree(it, childEnd, childPrefix.size())});
+                it = childEnd;
+            }
+
+            // "a.txt" sorts before "a/..." in the file map, but the tree is
+            // ordered by the component name alone
+            std::stable_sort(entries.begin(), entries.end(),
+                             [](const TreeEntry& a, const TreeEntry& b) { return a.name < b.name; });
+            return writeTreeObject(entries);
+        }
+    }
+
+    namespace {
+        // Applies the changed files in [begin, end) (all below the directory
+        // at 'offset') to the tree 'treeHash' and stores the new tree.
+        // DSA: PATH COPYING. Only the directories on the path to a change
+        // are read and rewritten; every other subtree keeps its hash.
+        ObjectId patchTree(const ObjectId& treeHash, FileIterator begin, FileIterator end,
+                              std::size_t offset) {
+            std::vector<TreeEntry> entries;
+            if (!treeHash.empty()) {
+                entries = readTree(treeHash);
+            }
+
+            // Finds the entry 'name' of the given kind, or where it belongs
+            auto locate = [&](const std::string& name, bool isTree, bool& found) {
+                auto it = std::lower_bound(entries.begin(), entries.end(), name,
+                                           [](const TreeEntry& e, const std::string& n) { return e.name < n; });
+                while (it != entries.end() && it->name == name) {
+                    if (it->isTree == isTree) {
+                        found = true;
+                        return it;
+                    }
+                    ++it;
+                }
+                found = false;
+                return it;
+            };
+            auto put = [&](const std::string& name, bool isTree, const ObjectId& hash) {
+                bool found;
+                auto it = locate(name, isTree, found);
+                if (found) {
+                    it->hash = hash;
+                } else {
+                    entries.insert(it, TreeEntry{name, isTree, hash});
+                }
+            };
+
+            FileIterator it = begin;
+            while (it != end) {
+                std::string_view rest = it->path.substr(offset);
+                std::size_t slash = rest.find('/');
+                if (slash == std::string_view::npos) {
+                    put(std::string(rest), false, it->hash);
+                    ++it;
+                    continue;
+                }
+
+                std::string_view childPrefix = it->path.substr(0, offset + slash + 1);
+                FileIterator childEnd = it;
+                while (childEnd != end && childEnd->path.compare(0, childPrefix.size(), childPrefix) == 0) {
+                    ++childEnd;
+                }
+                std::string name(rest.substr(0, slash));
+                bool found;
+                auto child = locate(name, true, found);
+                ObjectId childHash = found ? child->hash : ObjectId();
+                put(name, true, patchTree(childHash, it, childEnd, childPrefix.size()));
+                it = childEnd;
+            }
+            return writeTreeObject(entries);
+        }
+    }
+
+    std::string encodeTree(const std::vector<TreeEntry>& entries) {
+        std::string content;
+        for (const auto& entry : entries) {
+            content += entry.isTree ? "tree " : "blob ";
+            content += entry.hash.toHex();
+            content += ' ';
+            content += entry.name;
+            content += '\n';
+        }
+        return content;
+    }
+
+    std::vector<TreeEntry> parseTree(std::string_view content) {
+        std::vector<TreeEntry> entries;
+        while (!content.empty()) {
+            std::size_t end = content.find('\n');
+            std::string_view line = content.substr(0, end);
+            content.remove_prefix(end == std::string_view::npos ? content.size() : end + 1);
+
+            // "<kind> <hash> <name>": the hash never contains spaces, the name may
+            std::size_t space = line.find(' ', 5);
+            if (line.size() < 6 || line[4] != ' ' || space == std::string_view::npos || space == 5 ||
+                (line.compare(0, 4, "blob") != 0 && line.compare(0, 4, "tree") != 0)) {
+                throw std::runtime_error("Corrupt tree entry: " + std::string(line));
+            }
+            TreeEntry entry;
+            entry.isTree = line[0] == 't';
+            entry.hash = ObjectId::fromHex(line.substr(5, space - 5));
+            entry.name = std::string(line.substr(space + 1));
+            entries.push_back(std::move(entry));
+        }
+        return entries;
+    }
+
+    std::vector<TreeEntry> readTree(const ObjectId& hash) {
+        return *getTree(hash);
+    }
+
+    ObjectId writeTreeObject(const std::vector<TreeEntry>& entries) {
+        std::string content = encodeTree(entries);
+        ObjectId hash = hashString(content);
+        writeObject(hash, ObjectType::Tree, content); // shared subtrees already exist
+        return hash;
+    }
+
+    ObjectId writeTree(const FileMap& files) {
+        MINIGIT_TRACE_SCOPE("writeTree");
+        return buildTree(files.begin(), files.end(), 0);
+    }
+
+    ObjectId updateTree(const ObjectId& treeHash, const FileMap& changes) {
+        MINIGIT_TRACE_SCOPE("updateTree");
+        return patchTree(treeHash, changes.begin(), changes.end(), 0);
+    }
+
+    void flattenTree(const ObjectId& treeHash, const std::string& prefix, FileMap& files) {
+        std::shared_ptr<const TreeEntries> tree = getTree(treeHash);
+        for (const auto& entry : *tree) {
+            std::string path = prefix + entry.name;
+            if (entry.isTree) {
+                flattenTree(entry.hash, path + "/", files);
+            } else {
+                files.add(path, entry.hash);
+            }
+        }
+    }
+
+    void lookupTreePath(const ObjectId& treeHash, std::string_view path, ObjectId& file, ObjectId& directory) {
+        file = ObjectId();
+        directory = ObjectId();
+        ObjectId current = treeHash;
+        while (!current.empty()) {
+            std::size_t slash = path.find('/');
+            std::string_view name = path.substr(0, slash);
+            std::shared_ptr<const TreeEntries> tree = getTree(current);
+
+            // DSA: BINARY SEARCH by name (a file and a directory of the
+            // same name sit next to each other)
+            auto it = std::lower_bound(tree->begin(), tree->end(), name,
+                                       [](const TreeEntry& e, std::string_view n) { return e.name < n; });
+            current = ObjectId();
+            for (; it != tree->end() && it->name == name; ++it) {
+                if (slash == std::string_view::npos) {
+                    (it->isTree ? directory : file) = it->hash;
+                } else if (it->isTree) {
+                    current = it->hash;
+                }
+            }
+            if (slash == std::string_view::npos) {
+                return;
+            }
+            path.remove_prefix(slash + 1);
+        }
+    }
+
+    void diffTrees(const ObjectId& oldTree, const ObjectId& newTree, const std::string& prefix,
+                   std::vector<TreeChange>& changes) {
+        if (oldTree == newTree) {
+            return; // DSA: identical hashes mean identical subtrees
+        }
+
+        // Order both sides by (name, kind) so they can be merged in one pass
+        auto load = [](const ObjectId& hash) {
+            std::vector<TreeEntry> entries;
+            if (!hash.empty()) {
+                entries = readTree(hash);
+            }
+            std::sort(entries.begin(), entries.end(), [](const TreeEntry& a, const TreeEntry& b) {
+                return a.name != b.name ? a.name < b.name : a.isTree < b.isTree;
+            });
+            return entries;
+        };
+        std::vector<TreeEntry> before = load(oldTree);
+        std::vector<TreeEntry> after = load(newTree);
+
+        // A whole subtree that exists on one side only
+        auto addAll = [&](const TreeEntry& entry, bool isOld) {
+            FileMap files;
+            flattenTree(entry.hash, prefix + entry.name + "/", files);
+            files.normalize();
+            for (const FileMap::Entry& file : files) {
+                std::string path(file.path);
+                changes.push_back(isOld ? TreeChange{path, file.hash, ObjectId()}
+                                        : TreeChange{path, ObjectId(), file.hash});
+            }
+        };
+        auto one = [&](const TreeEntry& entry, bool isOld) {
+            if (entry.isTree) {
+                addAll(entry, isOld);
+            } else {
+                std::string path = prefix + entry.name;
+                changes.push_back(isOld ? TreeChange{path, entry.hash, ObjectId()}
+                                        : TreeChange{path, ObjectId(), entry.hash});
+            }
+        };
+
+        // DSA: MERGE of two sorted lists
+        std::size_t i = 0;
+        std::size_t j = 0;
+        while (i < before.size() || j < after.size()) {
+            int c;
+            if (i == before.size()) {
+                c = 1;
+            } else if (j == after.size()) {
+                c = -1;
+            } else if (before[i].name != after[j].name) {
+                c = before[i].name < after[j].name ? -1 : 1;
+            } else {
+                c = static_cast<int>(before[i].isTree) - static_cast<int>(after[j].isTree);
+            }
+
+            if (c < 0) {
+                one(before[i++], true);
+            } else if (c > 0) {
+                one(after[j++], false);
+            } else {
+                const TreeEntry& a = before[i++];
+                const TreeEntry& b = after[j++];
+                if (a.hash == b.hash) {
+                    continue;
+                }
+                if (a.isTree) {
+                    diffTrees(a.hash, b.hash, prefix + a.name + "/", changes);
+                } else {
+                    changes.push_back(TreeChange{prefix + a.name, a.hash, b.hash});
+                }
+            }
+        }
+    }
+
+} // namespace MiniGit
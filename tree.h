@@ -0,0 +1,112 @@
+/**
+ * tree.h
+ * * Tree objects: one per directory, listing its files and subdirectories.
+ *
+ * Tree object layout (text, one line per entry, sorted by name):
+ *   blob <hash> <name>
+ *   tree <hash> <name>
+ *
+ * A commit points at the tree of the repository root. Because trees are
+ * content-addressed, a directory that did not change between commits has
+ * the same hash and is stored (and walked) only once.
+ */
+
+#ifndef MINIGIT_TREE_H
+#define MINIGIT_TREE_H
+
+#include "file_map.h"
+#include "object_id.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace MiniGit {
+
+    struct TreeEntry {
+        std::string name;    // a single path component
+        bool isTree = false; // a subdirectory rather than a file
+        ObjectId hash;
+    };
+
+    /**
+     * @brief One file that differs between two trees.
+     */
+    struct TreeChange {
+        std::string path;
+        ObjectId oldHash; // empty if the file was added
+        ObjectId newHash; // empty if the file was deleted
+    };
+
+    /**
+     * @brief Serializes tree entries (sorted by name) into a tree object.
+     */
+    std::string encodeTree(const std::vector<TreeEntry>& entries);
+
+    /**
+     * @brief Parses a tree object.
+     * @throws std::runtime_error if a line is malformed.
+     */
+    std::vector<TreeEntry> parseTree(std::string_view content);
+
+    /**
+     * @brief Reads and parses the tree object 'hash' (through the object cache).
+     */
+    std::vector<TreeEntry> readTree(const ObjectId& hash);
+
+    /**
+     * @brief Hashes and stores one tree object.
+     * @return The tree's hash.
+     */
+    ObjectId writeTreeObject(const std::vector<TreeEntry>& entries);
+
+    /**
+     * @brief Stores the trees for a flat, normalized file map.
+     * Paths are split into directories at '/'.
+     * @return The hash of the root tree.
+     */
+    ObjectId writeTree(const FileMap& files);
+
+    /**
+     * @brief Stores a new tree that is 'treeHash' with some files changed.
+     * Only the trees on the paths to the changed files are read and
+     * rewritten, so the cost follows the size of the change, not of the
+     * repository.
+     * @param treeHash The tree to start from (empty for an empty tree).
+     * @param changes Changed or added files (path -> blob hash).
+     * @return The hash of the new root tree.
+     */
+    ObjectId updateTree(const ObjectId& treeHash, const FileMap& changes);
+
+    /**
+     * @brief Expands a tree back into a flat file map.
+     * @param treeHash The tree to walk.
+     * @param prefix Prepended to every path ("" for the root).
+     * @param files Receives path -> blob hash, in tree order (call
+     * files.normalize() before looking paths up).
+     */
+    void flattenTree(const ObjectId& treeHash, const std::string& prefix, FileMap& files);
+
+    /**
+     * @brief Looks up what a tree holds at 'path': the blob of a file
+     * and the tree of a directory of that name (a tree can hold both, as
+     * "a" and "a/..."). Only the trees along the path are read.
+     * @param file Receives the blob, or an empty id if there is none.
+     * @param directory Receives the subtree, or an empty id if there is none.
+     */
+    void lookupTreePath(const ObjectId& treeHash, std::string_view path, ObjectId& file, ObjectId& directory);
+
+    /**
+     * @brief Lists the files that differ between two trees, in tree order.
+     * Subtrees with the same hash on both sides are skipped without being
+     * read, so the cost follows the size of the difference.
+     * @param oldTree The tree before (empty for an empty tree).
+     * @param newTree The tree after (empty for an empty tree).
+     * @param prefix Prepended to every path ("" for the root).
+     * @param changes Receives the differences.
+     */
+    void diffTrees(const ObjectId& oldTree, const ObjectId& newTree, const std::string& prefix,
+                   std::vector<TreeChange>& changes);
+
+} // namespace MiniGit
+
+#endif // MINIGIT_TREE_H
@@ -0,0 +1,225 @@
+/**
+ * worktree.cpp
+ * * Ignore rules and the parallel working tree walk.
+ */
+
+#include "worktree.h"
+#include "concurrency.h"
+#include "minigit.h"
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace MiniGit {
+
+    namespace {
+
+        /**
+         * @brief Glob match where '*' and '?' never match a '/'.
+         * DSA: GREEDY MATCHING WITH BACKTRACKING to the last '*' only,
+         * which is linear for patterns with a single star.
+         */
+        bool globMatch(std::string_view glob, std::string_view text) {
+            std::size_t g = 0, t = 0;
+            std::size_t starGlob = std::string_view::npos, starText = 0;
+            while (t < text.size()) {
+                if (g < glob.size() && glob[g] == '*') {
+                    starGlob = g++;
+                    starText = t;
+                } else if (g < glob.size() && text[t] != '/' && (glob[g] == '?' || glob[g] == text[t])) {
+                    ++g;
+                    ++t;
+                } else if (g < glob.size() && glob[g] == '/' && text[t] == '/') {
+                    ++g;
+                    ++t;
+                } else if (starGlob != std::string_view::npos && text[starText] != '/') {
+                    // Let the last '*' swallow one more character and retry
+                    g = starGlob + 1;
+                    t = ++starText;
+                } else {
+                    return false;
+                }
+            }
+            while (g < glob.size() && glob[g] == '*') {
+                ++g;
+            }
+            return g == glob.size();
+        }
+
+        // One thread's share of the walk
+        struct WalkQueue {
+            std::mutex mutex;
+            std::deque<std::string> directories;
+        };
+
+    } // namespace
+
+    IgnoreRules IgnoreRules::load(const fs::path& file) {
+        IgnoreRules rules;
+        std::ifstream in(file, std::ios::binary);
+        std::string line;
+        while (std::getline(in, line)) {
+            rules.addPattern(line);
+        }
+        return rules;
+    }
+
+    void IgnoreRules::addPattern(std::string_view line) {
+        // 1. Trim the line ending and trailing blanks; skip comments
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' ' || line.back() == '\t')) {
+            line.remove_suffix(1);
+        }
+        if (line.empty() || line.front() == '#') {
+            return;
+        }
+
+        // 2. Decode the markers
+        Pattern pattern;
+        if (line.front() == '!') {
+            pattern.negated = true;
+            line.remove_prefix(1);
+        }
+        if (!line.empty() && line.back() == '/') {
+            pattern.directoryOnly = true;
+            line.remove_suffix(1);
+        }
+        if (line.find('/') != std::string_view::npos) {
+            pattern.wholePath = true;
+            if (line.front() == '/') {
+                line.remove_prefix(1);
+            }
+        }
+        if (line.empty()) {
+            return;
+        }
+        pattern.glob = std::string(line);
+        patterns_.push_back(std::move(pattern));
+    }
+
+    bool IgnoreRules::ignored(std::string_view path, bool isDirectory) const {
+        std::size_t slash = path.rfind('/');
+        std::string_view name = slash == std::string_view::npos ? path : path.substr(slash + 1);
+
+        // The last matching pattern decides, so walk from the end
+        for (auto it = patterns_.rbegin(); it != patterns_.rend(); ++it) {
+            if (it->directoryOnly && !isDirectory) {
+                continue;
+            }
+            if (globMatch(it->glob, it->wholePath ? path : name)) {
+                return !it->negated;
+            }
+        }
+        return false;
+    }
+
+    std::vector<std::string> scanWorkingTree(const IgnoreRules& rules, unsigned jobs) {
+        unsigned threads = ThreadPool::resolveThreadCount(jobs);
+        std::vector<WalkQueue> queues(threads);
+        std::vector<std::vector<std::string>> found(threads); // per thread, merged at the end
+
+        // Directories queued or being read; the walk is over once it drops to 0.
+        // A directory's subdirectories are counted before it is, so it never
+        // drops to 0 early.
+        std::atomic<std::size_t> outstanding{1};
+        queues[0].directories.push_back(""); // the root
+
+        auto takeOwn = [&](unsigned self, std::string& directory) {
+            std::lock_guard<std::mutex> lock(queues[self].mutex);
+            if (queues[self].directories.empty()) {
+                return false;
+            }
+            directory = std::move(queues[self].directories.back());
+            queues[self].directories.pop_back();
+            return true;
+        };
+        auto steal = [&](unsigned self, std::string& directory) {
+            for (unsigned offset = 1; offset < threads; ++offset) {
+                WalkQueue& victim = queues[(self + offset) % threads];
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if (!victim.directories.empty()) {
+                    directory = std::move(victim.directories.front());
+                    victim.directories.pop_front();
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        auto readDirectory = [&](unsigned self, const std::string& directory) {
+            std::error_code error;
+            fs::directory_iterator it(directory.empty() ? rootPath(".") : rootPath(directory), error);
+            if (error) {
+                return; // unreadable (or removed meanwhile): nothing to report
+            }
+            std::vector<std::string> subdirectories;
+            for (; it != fs::directory_iterator(); it.increment(error)) {
+                if (error) {
+                    break;
+                }
+                std::string name = it->path().filename().string();
+                if (directory.empty() && name == GIT_DIR.string()) {
+                    continue;
+                }
+                std::string path = directory.empty() ? name : directory + "/" + name;
+                // The entry type comes from the directory listing itself;
+                // symbolic links are listed, never followed
+                bool isDirectory = !it->is_symlink(error) && it->is_directory(error);
+                if (rules.ignored(path, isDirectory)) {
+                    continue;
+                }
+                if (isDirectory) {
+                    subdirectories.push_back(std::move(path));
+                } else {
+                    found[self].push_back(std::move(path));
+                }
+            }
+            if (!subdirectories.empty()) {
+                outstanding += subdirectories.size();
+                std::lock_guard<std::mutex> lock(queues[self].mutex);
+                for (auto& subdirectory : subdirectories) {
+                    queues[self].directories.push_back(std::move(subdirectory));
+                }
+            }
+        };
+
+        {
+            ThreadPool walkers(threads);
+            for (unsigned t = 0; t < threads; ++t) {
+                walkers.submit([&, t] {
+                    std::string directory;
+                    while (true) {
+                        if (takeOwn(t, directory) || steal(t, directory)) {
+                            readDirectory(t, directory);
+                            --outstanding;
+                        } else if (outstanding.load() == 0) {
+                            return;
+                        } else {
+                            std::this_thread::yield(); // others are still reading
+                        }
+                    }
+                });
+            }
+            walkers.wait();
+        }
+
+        // Merge the per-thread lists into one sorted list
+        std::size_t total = 0;
+        for (const auto& list : found) {
+            total += list.size();
+        }
+        std::vector<std::string> files;
+        files.reserve(total);
+        for (auto& list : found) {
+            std::move(list.begin(), list.end(), std::back_inserter(files));
+        }
+        std::sort(files.begin(), files.end());
+        return files;
+    }
+
+} // namespace MiniGit
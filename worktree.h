@@ -0,0 +1,75 @@
+/**
+ * worktree.h
+ * * Walking the working tree: which files are there, minus the ignored ones.
+ *
+ * .minigitignore (at the repository root), one pattern per line:
+ *   # comment      blank lines and lines starting with '#' are skipped
+ *   build/         a trailing '/' matches directories only
+ *   *.o            no '/' inside: matched against the name, at any depth
+ *   /docs/out      a '/' inside (or leading): matched against the whole
+ *                  path from the root
+ *   !keep.o        a leading '!' re-includes what an earlier line ignored
+ * '*' matches any run of characters except '/', '?' any one of them.
+ * The last matching line wins. An ignored directory is never opened, so
+ * nothing below it costs a system call. .minigit itself is always skipped.
+ */
+
+#ifndef MINIGIT_WORKTREE_H
+#define MINIGIT_WORKTREE_H
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace MiniGit {
+
+    const std::filesystem::path IGNORE_FILE = ".minigitignore";
+
+    class IgnoreRules {
+    public:
+        /**
+         * @brief Reads the patterns of an ignore file (none if it is missing).
+         */
+        static IgnoreRules load(const std::filesystem::path& file);
+
+        /**
+         * @brief Adds one line in the ignore file syntax.
+         */
+        void addPattern(std::string_view line);
+
+        /**
+         * @brief Whether a path (relative to the root, '/'-separated) is ignored.
+         */
+        bool ignored(std::string_view path, bool isDirectory) const;
+
+        bool empty() const { return patterns_.empty(); }
+
+    private:
+        struct Pattern {
+            std::string glob;
+            bool negated = false;       // "!pattern"
+            bool directoryOnly = false; // "pattern/"
+            bool wholePath = false;     // contains a '/': matched from the root
+        };
+
+        std::vector<Pattern> patterns_;
+    };
+
+    /**
+     * @brief Lists the files of the working tree (below the root, see rootPath),
+     * skipping ignored files and directories.
+     * DSA: WORK STEALING. Every thread keeps its own deque of directories
+     * still to read: it takes the newest from its own end (depth first,
+     * cache friendly) and, when it runs dry, steals the oldest from
+     * another thread, which is the directory most likely to have a big
+     * subtree below it. Wide and deep trees both keep every thread busy.
+     * @param rules The ignore rules.
+     * @param jobs Number of threads (0 = one per CPU core).
+     * @return Paths relative to the root, '/'-separated, sorted.
+     */
+    std::vector<std::string> scanWorkingTree(const IgnoreRules& rules, unsigned jobs);
+
+} // namespace MiniGit
+
+#endif // MINIGIT_WORKTREE_H